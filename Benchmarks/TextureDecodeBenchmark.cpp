@@ -0,0 +1,178 @@
+// --------------------------------------------------------
+// Measures texture import throughput (read, decode and mip
+// generation) across different thread counts, using the same
+// TextureImporter the game loads its textures with.
+//
+// Builds and runs anywhere with a C++14 compiler, e.g. on Linux:
+//
+//   g++ -std=c++14 -O2 -I.. -pthread -o TextureDecodeBenchmark
+//       TextureDecodeBenchmark.cpp ../JobSystem.cpp ../PngDecoder.cpp ../TextureImporter.cpp
+//       ../MipGenerator.cpp ../TextureCooker.cpp
+//   ./TextureDecodeBenchmark ../Assets/PBR ../Assets/Skies/Planet
+//
+// Every .png in the given directories is imported once per run,
+// and the best of several runs is reported for each thread count.
+// Thread counts go up to the hardware thread count unless
+// --max-threads says otherwise.
+// --------------------------------------------------------
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "JobSystem.h"
+#include "TextureImporter.h"
+
+namespace
+{
+	bool EndsWith(const std::string& str, const std::string& suffix)
+	{
+		return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+
+	void FindPngs(const std::string& directory, std::vector<std::string>& out)
+	{
+		DIR* dir = opendir(directory.c_str());
+		if (!dir)
+		{
+			printf("Can't open %s\n", directory.c_str());
+			return;
+		}
+
+		while (dirent* entry = readdir(dir))
+		{
+			std::string name = entry->d_name;
+			if (EndsWith(name, ".png"))
+				out.push_back(directory + "/" + name);
+		}
+
+		closedir(dir);
+		std::sort(out.begin(), out.end());
+	}
+
+	struct RunResult
+	{
+		double seconds = 0;
+		size_t fileBytes = 0;
+		size_t pixels = 0;		// Top level only
+		unsigned int failures = 0;
+	};
+
+	RunResult Run(JobSystem& jobs, const std::vector<std::string>& files, bool generateMips)
+	{
+		std::vector<ImportedTexture> textures(files.size());
+		std::vector<ImportedTexture*> pointers;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			textures[i].path = files[i];
+			pointers.push_back(&textures[i]);
+		}
+
+		TextureImporter importer(jobs);
+
+		auto start = std::chrono::steady_clock::now();
+		importer.ReadFiles(pointers);
+
+		// Count file sizes before decoding releases the data
+		RunResult result;
+		for (ImportedTexture& texture : textures)
+			result.fileBytes += texture.fileData.size();
+
+		importer.Decode(pointers, generateMips);
+		auto end = std::chrono::steady_clock::now();
+
+		result.seconds = std::chrono::duration<double>(end - start).count();
+		for (ImportedTexture& texture : textures)
+		{
+			if (texture.decoded)
+				result.pixels += (size_t)texture.mips.levels[0].width * texture.mips.levels[0].height;
+			else
+			{
+				result.failures++;
+				printf("  %s: %s\n", texture.path.c_str(), texture.error.c_str());
+			}
+		}
+
+		return result;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> directories;
+	bool generateMips = true;
+	int runs = 3;
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--no-mips") generateMips = false;
+		else if (arg == "--runs" && i + 1 < argc) runs = std::max(1, atoi(argv[++i]));
+		else if (arg == "--max-threads" && i + 1 < argc) maxThreads = (unsigned int)std::max(1, atoi(argv[++i]));
+		else directories.push_back(arg);
+	}
+
+	if (directories.empty())
+	{
+		printf("Usage: %s [--no-mips] [--runs N] [--max-threads N] <directory>...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<std::string> files;
+	for (const std::string& directory : directories)
+		FindPngs(directory, files);
+
+	if (files.empty())
+	{
+		printf("No .png files found\n");
+		return 1;
+	}
+
+	// Powers of two up to the max, plus the max itself
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int count = 1; count < maxThreads; count *= 2)
+		threadCounts.push_back(count);
+	threadCounts.push_back(maxThreads);
+
+	printf("%zu files, %s mips, best of %d runs, %u hardware threads\n\n",
+		files.size(), generateMips ? "with" : "without", runs, std::thread::hardware_concurrency());
+	printf("%8s %10s %12s %12s %9s\n", "Threads", "Time (ms)", "File MB/s", "Mpixels/s", "Speedup");
+
+	double baseline = 0;
+	for (unsigned int threads : threadCounts)
+	{
+		// The calling thread helps out in ParallelFor, so it
+		// counts as one of the threads
+		JobSystem jobs((int)threads - 1);
+
+		RunResult best;
+		for (int run = 0; run < runs; run++)
+		{
+			RunResult result = Run(jobs, files, generateMips);
+			if (run == 0 || result.seconds < best.seconds)
+				best = result;
+		}
+
+		if (baseline == 0)
+			baseline = best.seconds;
+
+		printf("%8u %10.1f %12.1f %12.1f %8.2fx\n",
+			threads,
+			best.seconds * 1000.0,
+			best.fileBytes / best.seconds / (1024.0 * 1024.0),
+			best.pixels / best.seconds / 1000000.0,
+			baseline / best.seconds);
+
+		if (best.failures > 0)
+			return 1;
+	}
+
+	return 0;
+}
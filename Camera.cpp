@@ -33,10 +33,20 @@ float Camera::GetFOV()
 	return fov;
 }
 
+float Camera::GetNearClip()
+{
+	return nearClip;
+}
+
+float Camera::GetFarClip()
+{
+	return farClip;
+}
+
 
 void Camera::UpdateProjectionMatrix(float aspectRatio)
 {
-	XMMATRIX matrix = XMMatrixPerspectiveFovLH(fov, aspectRatio, 0.1f, 30);
+	XMMATRIX matrix = XMMatrixPerspectiveFovLH(fov, aspectRatio, nearClip, farClip);
 	XMStoreFloat4x4(&projMatrix, matrix);
 }
 
@@ -13,6 +13,8 @@ private:
 	bool isDirty = false;
 
 	float fov = 45.f;
+	float nearClip = 0.1f;
+	float farClip = 30.f;
 	float moveSpeed = 1.f;
 	float mouseSensitivity = 0.0050f;
 
@@ -24,6 +26,8 @@ public:
 	DirectX::XMFLOAT4X4 GetProjectionMatrix();
 	Transform GetTransform();
 	float GetFOV();
+	float GetNearClip();
+	float GetFarClip();
 
 	void UpdateProjectionMatrix(float aspectRatio);
 	void UpdateViewMatrix();
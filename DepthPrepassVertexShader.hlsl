@@ -0,0 +1,21 @@
+// Only the position stream is bound (see Mesh::DrawPositionsOnly)
+struct VertexShaderInput
+{
+    float3 localPosition : POSITION; // XYZ position
+};
+
+cbuffer ConstantBuffer : register(b0)
+{
+    matrix worldViewProjection;
+};
+
+// --------------------------------------------------------
+// Lays down depth ahead of the main pass, so the expensive
+// pixel shader only runs on the surfaces that end up visible.
+// The math must match VertexShader.hlsl exactly, or the main
+// pass's LESS_EQUAL test would reject its own surfaces.
+// --------------------------------------------------------
+float4 main(VertexShaderInput input) : SV_POSITION
+{
+    return mul(worldViewProjection, float4(input.localPosition, 1.0f));
+}
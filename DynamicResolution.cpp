@@ -0,0 +1,54 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::Update(float frameTime)
+{
+	if (frameTime <= 0)
+		return;
+
+	// Single frames are noisy, so the controller follows a
+	// running average instead
+	smoothedFrameTime = smoothedFrameTime > 0 ? smoothedFrameTime + (frameTime - smoothedFrameTime) * 0.1f : frameTime;
+
+	// Positive when there's time to spare, as a fraction of the
+	// budget, and limited so a single hitch can't swing it far
+	float error = (targetFrameTime - smoothedFrameTime) / targetFrameTime;
+	error = std::min(std::max(error, -1.0f), 1.0f);
+
+	float derivative = (error - previousError) / frameTime;
+	previousError = error;
+
+	// Only climb when there's room in the budget for a step up
+	// (frame cost grows with the square of the scale), or the
+	// scale would hop back and forth over the budget forever
+	float stepUp = (scale + hysteresis) / scale;
+	bool roomToClimb = error > stepUp * stepUp - 1;
+
+	// The integral only grows while the output isn't pinned at
+	// a limit, so it never winds up past what it can use
+	float newIntegral = error < 0 || roomToClimb ? integral + error * frameTime : integral;
+	float output = maxScale + proportionalGain * error + integralGain * newIntegral + derivativeGain * derivative;
+	if (output > minScale && output < maxScale)
+		integral = newIntegral;
+	else
+		integral = std::min(integral, 0.0f); // Never above the largest scale
+
+	desiredScale = std::min(std::max(output, minScale), maxScale);
+
+	// Only move once the controller has moved far enough, or to
+	// reach a limit
+	bool atLimit = desiredScale == minScale || desiredScale == maxScale;
+	if (fabsf(desiredScale - scale) > hysteresis || (atLimit && desiredScale != scale))
+		scale = desiredScale;
+}
+
+void DynamicResolution::Reset()
+{
+	scale = maxScale;
+	desiredScale = maxScale;
+	smoothedFrameTime = 0;
+	integral = 0;
+	previousError = 0;
+}
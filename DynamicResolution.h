@@ -0,0 +1,50 @@
+#pragma once
+
+// --------------------------------------------------------
+// Picks how much of the window's resolution to render the
+// scene at, from how long frames are taking against a budget.
+//
+// A PID controller turns the (smoothed) frame time's distance
+// from the budget into a scale: the proportional and derivative
+// terms react to the current frame, and the integral settles on
+// whatever scale the scene needs to keep to the budget.  The
+// scale actually used only follows the controller once they
+// differ by more than the hysteresis, so it isn't changed (and
+// the image doesn't shimmer) over every small fluctuation, and
+// it only climbs back up when the step would still fit the
+// budget, so it settles just under the budget instead of
+// cycling over and under it.
+//
+// Scales are per axis - 0.5 is a quarter of the pixels.
+// --------------------------------------------------------
+class DynamicResolution
+{
+public:
+	float targetFrameTime = 1.0f / 60.0f;	// Seconds
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	float hysteresis = 0.05f;
+
+	// Per fraction of the budget the frame is over or under by
+	float proportionalGain = 0.1f;
+	float integralGain = 0.5f;		// Per second
+	float derivativeGain = 0.01f;	// Seconds
+
+	// Feeds in the last frame's length (in seconds)
+	void Update(float frameTime);
+
+	// Starts over at the largest scale
+	void Reset();
+
+	float GetScale() { return scale; }
+	float GetDesiredScale() { return desiredScale; }
+	float GetSmoothedFrameTime() { return smoothedFrameTime; }
+
+private:
+	float scale = 1.0f;
+	float desiredScale = 1.0f;
+
+	float smoothedFrameTime = 0;
+	float integral = 0;
+	float previousError = 0;
+};
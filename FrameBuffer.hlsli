@@ -0,0 +1,18 @@
+#ifndef __FrameBuffer__ // Each .hlsli file needs a unique identifier!
+#define __FrameBuffer__
+
+#define MAX_SHADOW_CASCADES 4 // Must match ShadowMap::MaxCascades
+
+// Camera and shadow matrices, which are the same for every draw
+// in a frame.  Shared by every shader that includes this, so the
+// C++ side fills it once per frame (see SharedConstantBuffers.h).
+cbuffer FrameBuffer : register(b2) // b1 is the pixel shader's LightBuffer
+{
+    matrix view;
+    matrix projection;
+    matrix shadowViewProjections[MAX_SHADOW_CASCADES];
+    float4 shadowCascadeSplits; // View depth each cascade reaches to
+    int shadowCascadeCount;
+};
+
+#endif
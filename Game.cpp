@@ -3,6 +3,10 @@
 #include "Input.h"
 #include "PathHelpers.h"
 #include "Mesh.h"
+#include "StateCache.h"
+#include "SharedConstantBuffers.h"
+#include "TextureManager.h"
+#include "MatrixBatch.h"
 #include <string>
 #include "WICTextureLoader.h"
 
@@ -13,8 +17,13 @@
 // Needed for a helper function to load pre-compiled shader files
 #pragma comment(lib, "d3dcompiler.lib")
 #include <d3dcompiler.h>
+#include <DirectXCollision.h>
+#include <algorithm>
 
 #define PBR_Assets L"../../Assets/PBR/"
+#define SHADER_ARCHIVE_FILE L"Shaders.igme540shaders"
+#define TEXTURE_BUDGET_BYTES (256 * 1024 * 1024)
+#define TEXTURE_CACHE_DIRECTORY L"TextureCache/"
 
 // For the DirectX Math library
 using namespace DirectX;
@@ -61,6 +70,10 @@ Game::~Game()
 	ImGui_ImplDX11_Shutdown();
 	ImGui_ImplWin32_Shutdown();
 	ImGui::DestroyContext();
+
+	SharedConstantBuffers::GetInstance().Shutdown();
+	TextureManager::GetInstance().Shutdown();
+	StateCache::GetInstance().Shutdown();
 }
 
 // --------------------------------------------------------
@@ -72,8 +85,22 @@ void Game::Init()
 	// Helper methods for loading shaders, creating some basic
 	// geometry to draw and some simple camera matrices.
 	//  - You'll be expanding and/or replacing these later
+	// Shared constant buffers must exist before the shaders that use them
+	SharedConstantBuffers& sharedBuffers = SharedConstantBuffers::GetInstance();
+	sharedBuffers.Initialize(device, context);
+	sharedBuffers.Register("LightBuffer", sizeof(ShaderData::LightBuffer));
+	sharedBuffers.Register("FrameBuffer", sizeof(ShaderData::FrameBuffer));
+
 	LoadShaders();
 
+	// All state changes go through the cache, which filters redundant ones
+	StateCache::GetInstance().Initialize(context);
+
+	// Every material texture is loaded through the texture cache
+	TextureManager::GetInstance().Initialize(device, context, TEXTURE_BUDGET_BYTES, FixPath(TEXTURE_CACHE_DIRECTORY));
+
+	lightClusters.Initialize(device, context);
+
 	D3D11_SAMPLER_DESC samplerDesc = {};
 	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
 	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
@@ -92,29 +119,86 @@ void Game::Init()
 	ppSampDesc.MaxLOD = D3D11_FLOAT32_MAX;
 	device->CreateSamplerState(&ppSampDesc, ppSampler.GetAddressOf());
 
-	postProcess1 = PostProcess(device,windowWidth,windowHeight, ppSampler, ppPS1);
-	postProcess1.pixelShaderFloatData.insert({ "sharpenAmount", &sharpenAmount });
+	renderGraph.Initialize(device, context, windowWidth, windowHeight);
 
-	postProcess2 = PostProcess(device, windowWidth, windowHeight, ppSampler, ppPS2);
-	postProcess2.pixelShaderFloatData.insert({ "blurRadius", &blurAmount });
+	sharpenPostProcess = PostProcess(ppSampler, ppVS, ppPS1);
+	sharpenPostProcess.pixelShaderFloatData.insert({ "sharpenAmount", &sharpenAmount });
 
-	postProcess3 = PostProcess(device, windowWidth, windowHeight, ppSampler, ppPS3);
-	postProcess3.pixelShaderFloatData.insert({ "pixelLevel", &pixelIntensity });
+	blurPostProcess = GaussianBlurPostProcess(ppSampler, ppVS, ppPS2, ppCopyPS, &blurAmount, &blurHalfResolution);
 
-	postProcess4 = PostProcess(device, windowWidth, windowHeight, ppSampler, ppPS4);
-	postProcess4.pixelShaderFloatData.insert({ "mouseX", &mouseX });
-	postProcess4.pixelShaderFloatData.insert({ "mouseY", &mouseY });
+	pixelizePostProcess = PostProcess(ppSampler, ppVS, ppPS3);
+	pixelizePostProcess.pixelShaderFloatData.insert({ "pixelLevel", &pixelIntensity });
+
+	chromaticAberrationPostProcess = PostProcess(ppSampler, ppVS, ppPS4);
+	chromaticAberrationPostProcess.pixelShaderFloatData.insert({ "mouseX", &mouseX });
+	chromaticAberrationPostProcess.pixelShaderFloatData.insert({ "mouseY", &mouseY });
+
+	upscalePostProcess = PostProcess(ppSampler, ppVS, ppCopyPS);
+
+	fusedPostProcess = FusedPostProcess(ppSampler, ppVS, postProcessPermutations, &blurPostProcess, &sharpenAmount, &blurAmount, &pixelIntensity, &chromaticAberration);
+	fusedPostProcess.pixelShaderFloatData.insert({ "sharpenAmount", &sharpenAmount });
+	fusedPostProcess.pixelShaderFloatData.insert({ "pixelLevel", &pixelIntensity });
+	fusedPostProcess.pixelShaderFloatData.insert({ "mouseX", &mouseX });
+	fusedPostProcess.pixelShaderFloatData.insert({ "mouseY", &mouseY });
 
 	shadowMap = ShadowMap(device, shadowMapVertexShader, windowWidth, windowHeight);
+	shadowAtlas.Initialize(device, context, shadowMapVertexShader, ppVS);
+
+	D3D11_DEPTH_STENCIL_DESC prepassMatchDesc = {};
+	prepassMatchDesc.DepthEnable = true;
+	prepassMatchDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
+	prepassMatchDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
+	device->CreateDepthStencilState(&prepassMatchDesc, prepassMatchState.GetAddressOf());
+
+	D3D11_QUERY_DESC statsDesc = {};
+	statsDesc.Query = D3D11_QUERY_PIPELINE_STATISTICS;
+	for (int i = 0; i < SceneStatsLatency; i++)
+		device->CreateQuery(&statsDesc, sceneStatsQueries[i].GetAddressOf());
+
+	D3D11_QUERY_DESC disjointDesc = {};
+	disjointDesc.Query = D3D11_QUERY_TIMESTAMP_DISJOINT;
+	D3D11_QUERY_DESC timestampDesc = {};
+	timestampDesc.Query = D3D11_QUERY_TIMESTAMP;
+	for (int i = 0; i < FrameTimingLatency; i++)
+	{
+		device->CreateQuery(&disjointDesc, frameTimingQueries[i].disjoint.GetAddressOf());
+		device->CreateQuery(&timestampDesc, frameTimingQueries[i].start.GetAddressOf());
+		device->CreateQuery(&timestampDesc, frameTimingQueries[i].end.GetAddressOf());
+	}
 
-	CreateMaterial(PBR_Assets "floor_albedo.png", PBR_Assets "floor_normals.png", PBR_Assets "floor_roughness.png", PBR_Assets "floor_metal.png");
-	CreateMaterial(PBR_Assets "bronze_albedo.png", PBR_Assets "bronze_normals.png", PBR_Assets "bronze_roughness.png", PBR_Assets "bronze_metal.png");
-	CreateMaterial(PBR_Assets "cobblestone_albedo.png", PBR_Assets "cobblestone_normals.png", PBR_Assets "cobblestone_roughness.png", PBR_Assets "cobblestone_metalness.png");
-	CreateMaterial(PBR_Assets "scratched_albedo.png", PBR_Assets "scratched_normals.png", PBR_Assets "scratched_roughness.png", PBR_Assets "scratched_metal.png");
+	// Every material's textures in one batch, so they all decode in parallel
+	std::vector<std::wstring> materialTextures = {
+		PBR_Assets "floor_albedo.png", PBR_Assets "floor_normals.png",
+		PBR_Assets "bronze_albedo.png", PBR_Assets "bronze_normals.png",
+		PBR_Assets "cobblestone_albedo.png", PBR_Assets "cobblestone_normals.png",
+		PBR_Assets "scratched_albedo.png", PBR_Assets "scratched_normals.png",
+	};
+	for (std::wstring& file : materialTextures)
+		file = FixPath(file);
+
+	// Block compress each one to suit how the shader uses it
+	std::vector<TextureSemantic> semantics;
+	for (size_t i = 0; i < materialTextures.size(); i += 2)
+		semantics.insert(semantics.end(), { TextureSemantic::Albedo, TextureSemantic::NormalMap });
+
+	// Roughness and metalness are packed together (there are no
+	// occlusion maps yet), so materials sample one texture for both.
+	// The normal maps make rough spots rougher in the smaller mips.
+	std::vector<ORMSources> ormTextures = {
+		{ L"", FixPath(PBR_Assets "floor_roughness.png"), FixPath(PBR_Assets "floor_metal.png"), FixPath(PBR_Assets "floor_normals.png") },
+		{ L"", FixPath(PBR_Assets "bronze_roughness.png"), FixPath(PBR_Assets "bronze_metal.png"), FixPath(PBR_Assets "bronze_normals.png") },
+		{ L"", FixPath(PBR_Assets "cobblestone_roughness.png"), FixPath(PBR_Assets "cobblestone_metalness.png"), FixPath(PBR_Assets "cobblestone_normals.png") },
+		{ L"", FixPath(PBR_Assets "scratched_roughness.png"), FixPath(PBR_Assets "scratched_metal.png"), FixPath(PBR_Assets "scratched_normals.png") },
+	};
+
+	std::vector<std::shared_ptr<ManagedTexture>> loaded = TextureManager::GetInstance().LoadBatch(materialTextures, semantics);
+	std::vector<std::shared_ptr<ManagedTexture>> packed = TextureManager::GetInstance().LoadPackedORM(ormTextures);
+	for (size_t i = 0; i < packed.size() && i * 2 + 1 < loaded.size(); i++)
+		CreateMaterial(loaded[i * 2], loaded[i * 2 + 1], packed[i]);
 
 	CreateGeometry();
 
-	sky = std::make_shared<Sky>(cube, samplerState, device, context, FixPath(L"../../Assets/Skies/Planet/").c_str());
+	sky = std::make_shared<Sky>(cube, samplerState, device, context, FixPath(L"../../Assets/Skies/Planet/").c_str(), skyPixelShader, skyVertexShader);
 
 	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
@@ -172,9 +256,34 @@ void Game::Init()
 	light5.Color = XMFLOAT3(0, 1, 1);
 
 	lights.push_back(light5);
-#pragma endregion
 
-	shadowMap.MakeProjection(light3.Direction);
+	Light spotLight = Light();
+	spotLight.Type = LIGHT_TYPE_SPOT;
+	spotLight.Color = XMFLOAT3(1, 0.9f, 0.7f);
+	spotLight.Position = XMFLOAT3(0, 1, -3);
+	spotLight.Direction = XMFLOAT3(0, -1, 0.5f);
+	spotLight.Range = 12;
+	spotLight.Intensity = 3;
+	spotLight.SpotFalloff = 8;
+
+	lights.push_back(spotLight);
+
+	// A ring of small lights over the floor - far more than the
+	// LightBuffer could hold, but each pixel only shades a few
+	for (int i = 0; i < 32; i++)
+	{
+		float angle = XM_2PI * i / 32;
+
+		Light ringLight = Light();
+		ringLight.Type = LIGHT_TYPE_POINT;
+		ringLight.Color = XMFLOAT3(0.5f + 0.5f * cosf(angle), 0.5f + 0.5f * sinf(angle), 0.5f);
+		ringLight.Position = XMFLOAT3(8 * cosf(angle), -5.5f, 8 * sinf(angle));
+		ringLight.Range = 2.5f;
+		ringLight.Intensity = 1;
+
+		lights.push_back(ringLight);
+	}
+#pragma endregion
 }
 
 // --------------------------------------------------------
@@ -187,38 +296,200 @@ void Game::Init()
 // --------------------------------------------------------
 void Game::LoadShaders()
 {
-	pixelShader = std::make_shared<SimplePixelShader>(device, context, FixPath(L"PixelShader.cso").c_str());
-	vertexShader = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"VertexShader.cso").c_str());
+	// Every shader and its reflection data in a single read - see BuildShaderArchive()
+	shaderArchive.ReadFromFile(WideToNarrow(FixPath(SHADER_ARCHIVE_FILE)));
+
+	pixelShader = LoadShader<SimplePixelShader>(L"PixelShader");
+	vertexShader = LoadShader<SimpleVertexShader>(L"VertexShader", Mesh::GetInputSlots());
 	
-	shadowMapVertexShader = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"ShadowMapVertexShader.cso").c_str());
+	shadowMapVertexShader = LoadShader<SimpleVertexShader>(L"ShadowMapVertexShader", Mesh::GetInputSlots());
+	depthPrepassVertexShader = LoadShader<SimpleVertexShader>(L"DepthPrepassVertexShader", Mesh::GetInputSlots());
+
+	ppPS1 = LoadShader<SimplePixelShader>(L"PostProcessSharpenPS");
+	ppPS2 = LoadShader<SimplePixelShader>(L"PostProcessBlurPS");
+	ppPS3 = LoadShader<SimplePixelShader>(L"PostProcessPixelizePS");
+	ppPS4 = LoadShader<SimplePixelShader>(L"PostProcessChromaticAberrationPS");
+	ppCopyPS = LoadShader<SimplePixelShader>(L"PostProcessCopyPS");
+	ppUberPS = LoadShader<SimplePixelShader>(L"PostProcessUberPS");
 
-	ppPS1 = std::make_shared<SimplePixelShader>(device, context, FixPath(L"PostProcessSharpenPS.cso").c_str());
-	ppPS2 = std::make_shared<SimplePixelShader>(device, context, FixPath(L"PostProcessBlurPS.cso").c_str());
-	ppPS3 = std::make_shared<SimplePixelShader>(device, context, FixPath(L"PostProcessPixelizePS.cso").c_str());
-	ppPS4 = std::make_shared<SimplePixelShader>(device, context, FixPath(L"PostProcessChromaticAberrationPS.cso").c_str());
+	ppVS = LoadShader<SimpleVertexShader>(L"FullScreenTriangle");
 
-	ppVS = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"FullScreenTriangle.cso").c_str());
+	skyPixelShader = LoadShader<SimplePixelShader>(L"SkyPixelShader");
+	skyVertexShader = LoadShader<SimpleVertexShader>(L"SkyVertexShader", Mesh::GetInputSlots());
+
+	// Cheaper variants of the main pixel shader, chosen per material each frame
+	pixelShaderPermutations = std::make_shared<ShaderPermutationCache<ShaderPermutationKey>>(device, context, &shaderArchive, "PixelShader", pixelShader);
+
+	// The fused post-process pass, compiled for each combination of effects
+	postProcessPermutations = std::make_shared<ShaderPermutationCache<PostProcessPermutationKey>>(device, context, &shaderArchive, "PostProcessUberPS", ppUberPS);
+}
+
+// --------------------------------------------------------
+// Creates a shader from the shader archive if it's in there,
+// otherwise falls back to loading (and reflecting) the .cso
+//
+// name - The shader's file name, without the .cso extension
+// args - Anything else the shader's constructor takes (like a
+//        vertex shader's InputSlotMap)
+// --------------------------------------------------------
+template<typename T, typename... Args>
+std::shared_ptr<T> Game::LoadShader(const std::wstring& name, const Args&... args)
+{
+	const ShaderArchiveEntry* entry = shaderArchive.Find(WideToNarrow(name));
+	if (entry)
+		return std::make_shared<T>(device, context, *entry, args...);
+
+	return std::make_shared<T>(device, context, FixPath(name + L".cso").c_str(), args...);
 }
 
-void Game::CreateMaterial(std::wstring albedoFile, std::wstring normalFile, std::wstring roughnessFile, std::wstring metalnessFile)
+// --------------------------------------------------------
+// Compiles every distinct permutation of a pixel shader from
+// its source in the project directory into the archive
+//
+// Keeps going past a variant that fails, so every error is
+// printed (to stderr, for the build output) in one build.
+// Returns false if any variant failed.
+//
+// Key - ShaderPermutationKey or PostProcessPermutationKey
+// baseName - The shader's file name, without the .hlsl extension
+// --------------------------------------------------------
+template<typename Key>
+static bool AddPermutations(ShaderArchive& archive, const std::wstring& sourceDirectory, const std::string& baseName)
 {
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> albedoSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> normalsSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> roughnessSRV;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> metalnessSRV;
+	bool succeeded = true;
+
+	for (unsigned int i = 0; i < Key::Count; i++)
+	{
+		Key key = Key::FromIndex(i);
+		if (!key.IsDistinct())
+			continue;
+
+		std::vector<std::pair<std::string, std::string>> defines = key.GetDefines();
+		std::vector<D3D_SHADER_MACRO> macros;
+		for (auto& d : defines)
+			macros.push_back({ d.first.c_str(), d.second.c_str() });
+		macros.push_back({ 0, 0 }); // List must be null terminated
+
+		Microsoft::WRL::ComPtr<ID3DBlob> blob;
+		Microsoft::WRL::ComPtr<ID3DBlob> errors;
+		HRESULT hr = D3DCompileFromFile(
+			(sourceDirectory + NarrowToWide(baseName) + L".hlsl").c_str(),
+			macros.data(),
+			D3D_COMPILE_STANDARD_FILE_INCLUDE,
+			"main",
+			"ps_5_0",
+			D3DCOMPILE_OPTIMIZATION_LEVEL3,
+			0,
+			blob.GetAddressOf(),
+			errors.GetAddressOf());
+
+		ShaderArchiveEntry entry;
+		entry.Name = key.GetName(baseName);
+
+		if (hr != S_OK)
+		{
+			fprintf(stderr, "%s.hlsl: error: variant %s failed to compile\n", baseName.c_str(), entry.Name.c_str());
+			if (errors)
+				fprintf(stderr, "%s\n", (const char*)errors->GetBufferPointer());
+			succeeded = false;
+			continue;
+		}
+
+		if (!ISimpleShader::ReflectShader(blob, entry.Reflection))
+		{
+			fprintf(stderr, "%s.hlsl: error: variant %s couldn't be reflected\n", baseName.c_str(), entry.Name.c_str());
+			succeeded = false;
+			continue;
+		}
 
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(albedoFile).c_str(), nullptr, albedoSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(normalFile).c_str(), nullptr, normalsSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(roughnessFile).c_str(), nullptr, roughnessSRV.GetAddressOf());
-	CreateWICTextureFromFile(device.Get(), context.Get(), FixPath(metalnessFile).c_str(), nullptr, metalnessSRV.GetAddressOf());
+		const unsigned char* bytecode = (const unsigned char*)blob->GetBufferPointer();
+		entry.Bytecode.assign(bytecode, bytecode + blob->GetBufferSize());
 
+		archive.AddEntry(entry);
+	}
+
+	return succeeded;
+}
+
+// --------------------------------------------------------
+// Offline step, run by the post-build event as
+// "DX11Starter.exe --build-shader-archive <project dir>".
+// Reflects every compiled shader next to the executable and
+// bundles the bytecode and reflection data into one archive
+// file, so startup never has to call D3DReflect().  Also
+// compiles every permutation of the main pixel shader and the
+// fused post-process shader from their source in the project
+// directory.  (ShaderData.h is generated earlier in the build,
+// by ShaderDataTool, before any of the game is compiled.)
+//
+// Doesn't need a window or a Direct3D device.  Errors go to
+// stderr, and any shader that can't be compiled or reflected
+// fails the build (after the rest have been tried) rather than
+// leaving it out of the archive.
+// --------------------------------------------------------
+bool Game::BuildShaderArchive(const std::wstring& sourceDirectory)
+{
+	ShaderArchive archive;
+	bool shadersValid = true;
+
+	WIN32_FIND_DATAW findData = {};
+	HANDLE find = FindFirstFileW(FixPath(L"*.cso").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "error: no compiled shaders found next to the executable\n");
+		return false;
+	}
+
+	do
+	{
+		std::wstring fileName = findData.cFileName;
+
+		Microsoft::WRL::ComPtr<ID3DBlob> blob;
+		if (D3DReadFileToBlob(FixPath(fileName).c_str(), blob.GetAddressOf()) != S_OK)
+		{
+			fprintf(stderr, "%s: error: couldn't be read\n", WideToNarrow(fileName).c_str());
+			shadersValid = false;
+			continue;
+		}
+
+		ShaderArchiveEntry entry;
+		entry.Name = WideToNarrow(fileName.substr(0, fileName.size() - 4)); // Strip ".cso"
+		if (!ISimpleShader::ReflectShader(blob, entry.Reflection))
+		{
+			fprintf(stderr, "%s: error: couldn't be reflected\n", WideToNarrow(fileName).c_str());
+			shadersValid = false;
+			continue;
+		}
+
+		const unsigned char* bytecode = (const unsigned char*)blob->GetBufferPointer();
+		entry.Bytecode.assign(bytecode, bytecode + blob->GetBufferSize());
+
+		archive.AddEntry(entry);
+	} while (FindNextFileW(find, &findData));
+
+	FindClose(find);
+
+	// Compile each pixel shader permutation with its own defines
+	shadersValid &= AddPermutations<ShaderPermutationKey>(archive, sourceDirectory, "PixelShader");
+	shadersValid &= AddPermutations<PostProcessPermutationKey>(archive, sourceDirectory, "PostProcessUberPS");
+
+	// A missing shader would silently fall back at runtime
+	if (!shadersValid)
+		return false;
+
+	return archive.WriteToFile(WideToNarrow(FixPath(SHADER_ARCHIVE_FILE)));
+}
+
+void Game::CreateMaterial(
+	std::shared_ptr<ManagedTexture> albedo,
+	std::shared_ptr<ManagedTexture> normalMap,
+	std::shared_ptr<ManagedTexture> ormMap)
+{
 	std::shared_ptr<Material> mat = std::make_shared<Material>(XMFLOAT4(1, 1, 1, 1), pixelShader, vertexShader);
-	mat->textureSRVs.insert({ "Albedo", albedoSRV });
-	mat->textureSRVs.insert({ "NormalMap", normalsSRV });
-	mat->textureSRVs.insert({ "RoughnessMap", roughnessSRV });
-	mat->textureSRVs.insert({ "MetalnessMap", metalnessSRV });
+	mat->SetTexture("Albedo", albedo);
+	mat->SetTexture("NormalMap", normalMap);
+	mat->SetTexture("ORMMap", ormMap);
 	mat->samplers.insert({ "BasicSampler",samplerState });
-	mat->PrepareMaterial();
 
 	materials.push_back(mat);
 }
@@ -252,6 +523,9 @@ void Game::CreateGeometry()
 
 	gameEntities[6].GetTransform().SetScale(20, 1, 20);
 	gameEntities[6].GetTransform().SetPosition(0, -7, 0 );
+
+	// Orbits in Update(), so its shadow is redrawn every frame
+	gameEntities[3].SetStatic(false);
 }
 
 
@@ -264,10 +538,7 @@ void Game::OnResize()
 {
 	// Handle base-level DX resize stuff
 	DXCore::OnResize();
-	postProcess1.Resize(device, windowWidth, windowHeight);
-	postProcess2.Resize(device, windowWidth, windowHeight);
-	postProcess3.Resize(device, windowWidth, windowHeight);
-	postProcess4.Resize(device, windowWidth, windowHeight);
+	renderGraph.Resize(windowWidth, windowHeight);
 
 	shadowMap.Resize(windowWidth, windowHeight);
 
@@ -294,6 +565,51 @@ void Game::Update(float deltaTime, float totalTime)
 	mouseY = (Input::GetInstance().GetMouseY() / (float)windowHeight);
 
 	gameEntities[3].GetTransform().SetPosition(3*cos(totalTime), -3, 3*sin(totalTime));
+
+	StreamTextures();
+}
+
+// --------------------------------------------------------
+// Works out how much texture detail each visible entity needs
+// from how big it is on screen, then lets the TextureManager
+// stream mips in (or out) to match
+// --------------------------------------------------------
+void Game::StreamTextures()
+{
+	std::shared_ptr<Camera> camera = cameras[selectedCamera];
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 projection = camera->GetProjectionMatrix();
+	XMFLOAT3 cameraPosition = camera->GetTransform().GetPosition();
+
+	BoundingFrustum frustum(XMLoadFloat4x4(&projection));
+	frustum.Transform(frustum, XMMatrixInverse(0, XMLoadFloat4x4(&view)));
+
+	// World units one pixel spans, per unit of distance from the
+	// camera, at the resolution the scene is actually rendered at
+	float renderScale = dynamicResolutionEnabled ? dynamicResolution.GetScale() : 1.0f;
+	float pixelSpread = 2.0f / (fabsf(projection._22) * windowHeight * renderScale);
+
+	for (GameEntity& entity : gameEntities)
+	{
+		std::shared_ptr<Mesh> mesh = entity.GetMesh();
+		XMFLOAT3 scale = entity.GetTransform().GetScale();
+
+		BoundingSphere bounds = entity.GetBounds();
+		if (!frustum.Intersects(bounds))
+			continue;
+
+		// Distance to the nearest point of the bounds, but no closer than the near plane
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - XMLoadFloat3(&cameraPosition))) - bounds.Radius;
+		distance = max(distance, 0.1f);
+
+		// Scaling an entity up spreads its texture coordinates out
+		float largestScale = max(fabsf(scale.x), max(fabsf(scale.y), fabsf(scale.z)));
+		float uvPerWorldUnit = largestScale > 0 ? mesh->GetUVDensity() / largestScale : 0;
+
+		entity.GetMaterial()->RequestDetail(uvPerWorldUnit * distance * pixelSpread);
+	}
+
+	TextureManager::GetInstance().UpdateStreaming();
 }
 
 // --------------------------------------------------------
@@ -305,30 +621,114 @@ void Game::Draw(float deltaTime, float totalTime)
 	// - These things should happen ONCE PER FRAME
 	// - At the beginning of Game::Draw() before drawing *anything*
 	{
-		// Clear the back buffer (erases what's on the screen)
-		float bgColor[4] = { ambientColor.x, ambientColor.y, ambientColor.z, 1};
-		context->ClearRenderTargetView(backBufferRTV.Get(), bgColor);
+		StateCache::GetInstance().BeginFrame();
+		SharedConstantBuffers::GetInstance().BeginFrame();
 
-		postProcess1.ClearRTV(context, bgColor);
-		postProcess2.ClearRTV(context, bgColor);
-		postProcess3.ClearRTV(context, bgColor);
-		postProcess4.ClearRTV(context, bgColor);
+		// Color targets are cleared by the render graph, and
+		// only when the pass writing them needs it
 
 		// Clear the depth buffer (resets per-pixel occlusion information)
 		context->ClearDepthStencilView(depthBufferDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
 	}
 
-	shadowMap.DrawShadowMap(context,gameEntities,backBufferRTV, depthBufferDSV);
+	// Give up resolution when frames run over budget, and take it
+	// back when there's time to spare.  The GPU's time is used, as
+	// the CPU's includes waiting on vsync in Present(), which rounds
+	// every frame up to the refresh interval and hides the spare time.
+	FrameTimingQueries& frameTiming = frameTimingQueries[frameTimingFrame++ % FrameTimingLatency];
+	if (frameTimingFrame > FrameTimingLatency)
+	{
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint = {};
+		UINT64 start = 0;
+		UINT64 end = 0;
+		if (context->GetData(frameTiming.disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+			context->GetData(frameTiming.start.Get(), &start, sizeof(start), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+			context->GetData(frameTiming.end.Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK &&
+			!disjoint.Disjoint && end > start)
+		{
+			if (dynamicResolutionEnabled)
+				dynamicResolution.Update((float)((double)(end - start) / disjoint.Frequency));
+		}
+	}
+	context->Begin(frameTiming.disjoint.Get());
+	context->End(frameTiming.start.Get());
+
+	float renderScale = dynamicResolutionEnabled ? dynamicResolution.GetScale() : 1.0f;
+	renderWidth = max((unsigned int)(windowWidth * renderScale), 1u);
+	renderHeight = max((unsigned int)(windowHeight * renderScale), 1u);
+	bool upscale = renderWidth < windowWidth || renderHeight < windowHeight;
 
-	context->OMSetRenderTargets(1, postProcess1.ppRTV.GetAddressOf(), depthBufferDSV.Get()); //Setup First Post Processing Target
-	
-	RenderScene();
+	if (shadowsEnabled)
+	{
+		// The first directional light casts the shadows, which are
+		// refitted to wherever the camera is looking
+		for (const Light& light : lights)
+		{
+			if (light.Type != LIGHT_TYPE_DIRECTIONAL)
+				continue;
+
+			shadowMap.UpdateCascades(cameras[selectedCamera], light.Direction);
+			break;
+		}
+
+		// Point and spot lights share the atlas, sized by how much
+		// of the screen they cover at this frame's resolution
+		shadowAtlas.Update(lights, cameras[selectedCamera], gameEntities, (int)renderHeight);
+		shadowAtlas.Draw(gameEntities);
 
-	ppVS->SetShader();
-	//postProcess1.RenderPostProcess(context, postProcess2.ppRTV, depthBufferDSV);
-	//postProcess2.RenderPostProcess(context, postProcess3.ppRTV, depthBufferDSV);
-	//postProcess3.RenderPostProcess(context, postProcess4.ppRTV, depthBufferDSV);
-	postProcess1.RenderPostProcess(context, backBufferRTV, 0);
+		shadowMap.DrawShadowMap(context,gameEntities,backBufferRTV, depthBufferDSV);
+	}
+
+	// The scene, then each effect that's turned on reading the one
+	// before it, with the last writing the back buffer
+	std::vector<std::pair<std::string, PostProcess*>> effects;
+	if (fusedPostProcessing)
+	{
+		if (fusedPostProcess.IsEnabled()) effects.push_back({ "Post-Processing", &fusedPostProcess });
+	}
+	else
+	{
+		if (sharpenAmount > 0) effects.push_back({ "Sharpen", &sharpenPostProcess });
+		if (blurAmount >= 1) effects.push_back({ "Blur", &blurPostProcess });
+		if (pixelIntensity > 0) effects.push_back({ "Pixelize", &pixelizePostProcess });
+		if (chromaticAberration) effects.push_back({ "Chromatic Aberration", &chromaticAberrationPostProcess });
+	}
+
+	renderGraph.Reset();
+	RenderGraph::Resource backBuffer = renderGraph.Import("Back Buffer", backBufferRTV.Get());
+	RenderGraph::Resource sceneColor = effects.empty() && !upscale ? backBuffer : renderGraph.CreateTarget("Scene Color");
+
+	if (upscale)
+	{
+		renderGraph.SetContentSize(sceneColor, renderWidth, renderHeight);
+		if (effects.empty() || !effects[0].second->CanUpscale())
+			effects.insert(effects.begin(), { "Upscale", &upscalePostProcess });
+	}
+
+	float bgColor[4] = { ambientColor.x, ambientColor.y, ambientColor.z, 1 };
+	renderGraph.AddPass("Scene", {}, sceneColor, [&]()
+	{
+		D3D11_VIEWPORT viewport = {};
+		viewport.Width = (float)renderWidth;
+		viewport.Height = (float)renderHeight;
+		viewport.MaxDepth = 1.0f;
+		StateCache::GetInstance().SetViewport(viewport);
+		StateCache::GetInstance().SetRenderTarget(renderGraph.GetRTV(sceneColor), depthBufferDSV.Get());
+		RenderScene();
+	}, bgColor);
+
+	RenderGraph::Resource previous = sceneColor;
+	for (size_t i = 0; i < effects.size(); i++)
+	{
+		RenderGraph::Resource output = i + 1 == effects.size() ? backBuffer : renderGraph.CreateTarget(effects[i].first);
+		effects[i].second->AddToGraph(renderGraph, context, effects[i].first, previous, output);
+		previous = output;
+	}
+
+	renderGraph.Execute();
+
+	// The UI goes over whatever the graph left in the back buffer
+	StateCache::GetInstance().SetRenderTarget(backBufferRTV.Get(), 0);
 
 	ImGui::Render(); // Turns this frames UI into renderable triangles
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData()); // Draws it to the screen
@@ -337,8 +737,10 @@ void Game::Draw(float deltaTime, float totalTime)
 	// - These should happen exactly ONCE PER FRAME
 	// - At the very end of the frame (after drawing *everything*)
 	{
-		ID3D11ShaderResourceView* nullSRVs[128] = {};
-		context->PSSetShaderResources(0, 128, nullSRVs);
+		StateCache::GetInstance().PSClearShaderResources();
+
+		context->End(frameTiming.end.Get());
+		context->End(frameTiming.disjoint.Get());
 
 		// Present the back buffer to the user
 		//  - Puts the results of what we've drawn onto the window
@@ -347,26 +749,175 @@ void Game::Draw(float deltaTime, float totalTime)
 		swapChain->Present(vsyncNecessary ? 1 : 0, vsyncNecessary ? 0 : DXGI_PRESENT_ALLOW_TEARING);
 
 		// Must re-bind buffers after presenting, as they become unbound
-		context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
+		StateCache::GetInstance().SetRenderTarget(backBufferRTV.Get(), depthBufferDSV.Get());
 	}
 }
 
 void Game::RenderScene()
 {
-	for (GameEntity entity : gameEntities)
+	// Directional lights go in the LightBuffer, and everything
+	// else is binned into froxels for the pixel shader to look up
+	std::shared_ptr<Camera> camera = cameras[selectedCamera];
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 projection = camera->GetProjectionMatrix();
+
+	ShaderData::LightBuffer lightData = {};
+	unsigned int directionalCount = 0;
+	for (const Light& light : lights)
+	{
+		if (light.Type == LIGHT_TYPE_DIRECTIONAL && directionalCount < sizeof(lightData.directionalLights) / sizeof(Light))
+			lightData.directionalLights[directionalCount++] = light;
+	}
+
+	lightClusters.Build(
+		TextureManager::GetInstance().GetJobSystem(),
+		lights,
+		view,
+		projection,
+		camera->GetNearClip(),
+		camera->GetFarClip(),
+		renderWidth,
+		renderHeight);
+
+	// Only entities the camera can see are drawn, and without
+	// clustering each gets a list of just the lights reaching it
+	BoundingFrustum frustum(XMLoadFloat4x4(&projection));
+	frustum.Transform(frustum, XMMatrixInverse(0, XMLoadFloat4x4(&view)));
+
+	std::vector<GameEntity*> visibleEntities;
+	std::vector<XMFLOAT4> visibleBounds;
+	for (GameEntity& entity : gameEntities)
+	{
+		BoundingSphere bounds = entity.GetBounds();
+		if (!frustum.Intersects(bounds))
+			continue;
+
+		visibleEntities.push_back(&entity);
+		visibleBounds.push_back(XMFLOAT4(bounds.Center.x, bounds.Center.y, bounds.Center.z, bounds.Radius));
+	}
+
+	// Front to back for the pre-pass, so nearer surfaces hide
+	// the ones behind before they write depth
+	if (depthPrepass)
+	{
+		XMVECTOR viewForward = XMVectorSet(view._13, view._23, view._33, 0);
+		std::vector<std::pair<float, size_t>> drawOrder(visibleEntities.size());
+		for (size_t i = 0; i < visibleEntities.size(); i++)
+			drawOrder[i] = std::make_pair(XMVectorGetX(XMVector3Dot(XMLoadFloat4(&visibleBounds[i]), viewForward)), i);
+		std::sort(drawOrder.begin(), drawOrder.end());
+
+		std::vector<GameEntity*> sortedEntities(visibleEntities.size());
+		std::vector<XMFLOAT4> sortedBounds(visibleBounds.size());
+		for (size_t i = 0; i < drawOrder.size(); i++)
+		{
+			sortedEntities[i] = visibleEntities[drawOrder[i].second];
+			sortedBounds[i] = visibleBounds[drawOrder[i].second];
+		}
+		visibleEntities.swap(sortedEntities);
+		visibleBounds.swap(sortedBounds);
+	}
+
+	// Every visible entity's world-view-projection in one batch,
+	// shared by the pre-pass and the main pass
+	XMFLOAT4X4 viewProjection;
+	XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&view) * XMLoadFloat4x4(&projection));
+
+	std::vector<XMFLOAT4X4> worlds(visibleEntities.size());
+	std::vector<XMFLOAT4X4> worldViewProjections(visibleEntities.size());
+	for (size_t i = 0; i < visibleEntities.size(); i++)
+		worlds[i] = visibleEntities[i]->GetTransform().GetWorldMatrix();
+	MatrixBatch::Multiply(worlds.data(), worlds.size(), viewProjection, worldViewProjections.data());
+
+	if (!clusteredLighting)
+		lightClusters.BuildEntityLists(visibleBounds);
+	lightClusters.Upload();
+
+	// Pick the cheapest pixel shader variant for each material this frame
+	ShaderPermutationKey frameKey;
+	frameKey.lightBucket = ShaderPermutationKey::BucketForLightCount(directionalCount);
+	frameKey.shadows = shadowsEnabled;
+	frameKey.clusteredLights = clusteredLighting;
+
+	for (auto& material : materials)
 	{
-		entity.GetMaterial()->pixelShader->SetShaderResourceView("ShadowMap", shadowMap.shadowSRV.Get());
-		entity.GetMaterial()->pixelShader->SetSamplerState("ShadowSampler", shadowMap.shadowSampler);
-		entity.GetMaterial()->pixelShader->SetData("lights", &lights[0], sizeof(Light) * (int)lights.size());
+		ShaderPermutationKey key = frameKey;
+		key.normalMap = material->HasNormalMap();
+		key.pbrTextures = material->HasPBRTextures();
+		key.packedORM = material->HasPackedORM();
+		material->pixelShader = pixelShaderPermutations->Get(key);
+	}
 
-		entity.GetMaterial()->vertexShader->SetMatrix4x4("lightView", shadowMap.shadowViewMatrix);
-		entity.GetMaterial()->vertexShader->SetMatrix4x4("lightProjection", shadowMap.shadowProjectionMatrix);
+	// Constant data that's the same for every shader this frame,
+	// uploaded once to the shared buffers
+	SharedConstantBuffers& sharedBuffers = SharedConstantBuffers::GetInstance();
+
+	ShaderData::FrameBuffer frameData = {};
+	frameData.view = view;
+	frameData.projection = projection;
+	for (int i = 0; i < ShadowMap::MaxCascades; i++)
+		frameData.shadowViewProjections[i] = shadowMap.cascadeViewProjections[i];
+	frameData.shadowCascadeSplits = XMFLOAT4(shadowMap.cascadeSplits[0], shadowMap.cascadeSplits[1], shadowMap.cascadeSplits[2], shadowMap.cascadeSplits[3]);
+	frameData.shadowCascadeCount = shadowMap.cascadeCount;
+	sharedBuffers.Update("FrameBuffer", frameData);
+
+	lightData.directionalLightCount = (int)directionalCount;
+	lightData.cameraPos = camera->GetTransform().GetPosition();
+	lightData.clusterCounts = XMUINT3(LightClusters::TilesX, LightClusters::TilesY, LightClusters::Slices);
+	lightData.clusterDepthScale = lightClusters.GetDepthScale();
+	lightData.clusterDepthBias = lightClusters.GetDepthBias();
+	lightData.clusterTileSize = lightClusters.GetTileSize();
+	sharedBuffers.Update("LightBuffer", lightData);
+
+	// Statistics from a few frames ago are ready by now
+	ID3D11Query* statsQuery = sceneStatsQueries[sceneStatsFrame++ % SceneStatsLatency].Get();
+	D3D11_QUERY_DATA_PIPELINE_STATISTICS stats = {};
+	if (sceneStatsFrame > SceneStatsLatency && context->GetData(statsQuery, &stats, sizeof(stats), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK)
+		scenePixelShaderInvocations = stats.PSInvocations;
+	context->Begin(statsQuery);
+
+	StateCache& cache = StateCache::GetInstance();
+	prepassDrawCount = 0;
+	if (depthPrepass)
+	{
+		// Depth only, from the position stream, with no pixel shader
+		depthPrepassVertexShader->SetShader();
+		cache.SetPixelShader(0);
+
+		ShaderData::DepthPrepassVertexShaderConstantBuffer prepassData = {};
+		for (size_t i = 0; i < visibleEntities.size(); i++)
+		{
+			prepassData.worldViewProjection = worldViewProjections[i];
+			depthPrepassVertexShader->SetBufferData(prepassData);
+			depthPrepassVertexShader->CopyAllBufferData();
+			visibleEntities[i]->GetMesh()->DrawPositionsOnly(context);
+			prepassDrawCount++;
+		}
 
-		entity.Draw(context, cameras[selectedCamera]);
+		cache.SetDepthStencilState(prepassMatchState.Get(), 0);
 	}
 
+	// Every variant declares these at the same registers
+	shadowMap.Bind();
+	lightClusters.Bind();
+	shadowAtlas.Bind();
+
+	for (size_t i = 0; i < visibleEntities.size(); i++)
+	{
+		GameEntity& entity = *visibleEntities[i];
+		XMUINT2 lightRange(0, 0);
+		if (!clusteredLighting)
+			lightRange = XMUINT2(lightClusters.GetEntityRanges()[i].offset, lightClusters.GetEntityRanges()[i].count);
+
+		entity.Draw(context, worldViewProjections[i], lightRange);
+	}
+	sceneDrawCount = (unsigned int)visibleEntities.size();
+
+	if (depthPrepass)
+		cache.SetDepthStencilState(0, 0);
+	context->End(statsQuery);
+
 	sky->ambient = ambientColor;
-	sky->Draw(context, cameras[selectedCamera]);
+	sky->Draw(context);
 }
 
 #pragma region ImGui
@@ -401,6 +952,30 @@ void Game::BuildUI(float deltaTime, float totalTime)
 	{
 		ImGui::TextColored(detailsColor, " - Framerate: %f fps", ImGui::GetIO().Framerate);
 		ImGui::TextColored(detailsColor, " - Window Resolution: %dx%d", windowWidth, windowHeight);
+		ImGui::TextColored(detailsColor, " - State Changes Issued: %u", StateCache::GetInstance().GetIssuedCallCount());
+		ImGui::TextColored(detailsColor, " - State Changes Filtered: %u", StateCache::GetInstance().GetFilteredCallCount());
+		ImGui::TextColored(detailsColor, " - Shared Buffer Updates: %u", SharedConstantBuffers::GetInstance().GetUpdateCount());
+		ImGui::Checkbox("Depth Pre-Pass", &depthPrepass);
+		ImGui::TextColored(detailsColor, " - Opaque Draws: %u pre-pass + %u shaded", prepassDrawCount, sceneDrawCount);
+		ImGui::TextColored(detailsColor, " - Fragments Shaded: %llu (%.2f per pixel)", scenePixelShaderInvocations, (double)scenePixelShaderInvocations / (renderWidth * renderHeight));
+		if (ImGui::Checkbox("Dynamic Resolution", &dynamicResolutionEnabled))
+			dynamicResolution.Reset();
+		ImGui::TextColored(detailsColor, " - Render Scale: %.2f (%ux%u, %.1f ms GPU average)", dynamicResolutionEnabled ? dynamicResolution.GetScale() : 1.0f, renderWidth, renderHeight, dynamicResolution.GetSmoothedFrameTime() * 1000.0f);
+		if (dynamicResolutionEnabled)
+		{
+			float budget = dynamicResolution.targetFrameTime * 1000.0f;
+			if (ImGui::SliderFloat("Frame Budget (ms)", &budget, 4.0f, 50.0f, "%.1f"))
+				dynamicResolution.targetFrameTime = budget / 1000.0f;
+			ImGui::SliderFloat("Min Render Scale", &dynamicResolution.minScale, 0.25f, dynamicResolution.maxScale);
+			ImGui::SliderFloat("Max Render Scale", &dynamicResolution.maxScale, dynamicResolution.minScale, 1.0f);	// Targets are only window-sized
+		}
+
+		TextureManager& textures = TextureManager::GetInstance();
+		ImGui::TextColored(detailsColor, " - Texture Cache Hit Rate: %.0f%% (%u of %u)", textures.GetHitRate() * 100.0f, textures.GetHitCount(), textures.GetRequestCount());
+		ImGui::TextColored(detailsColor, " - Textures Resident: %zu (%.1f of %.0f MB)", textures.GetTextureCount(), textures.GetBytesResident() / (1024.0f * 1024.0f), textures.GetBudget() / (1024.0f * 1024.0f));
+		ImGui::TextColored(detailsColor, " - Texture Memory Saved: %.1f MB", textures.GetBytesSaved() / (1024.0f * 1024.0f));
+		ImGui::TextColored(detailsColor, " - Textures Streamed: %zu (%.1f MB if fully resident)", textures.GetStreamedTextureCount(), textures.GetStreamedBytesIfFullyResident() / (1024.0f * 1024.0f));
+		ImGui::TextColored(detailsColor, " - Mips Streamed In/Evicted: %u/%u (%zu in flight)", textures.GetMipsStreamedIn(), textures.GetMipsEvicted(), textures.GetStreamingRequestCount());
 		ImGui::ColorEdit3("Ambient Color", &ambientColor.x);
 
 		// Create a button and test for a click
@@ -493,6 +1068,38 @@ void Game::BuildUI(float deltaTime, float totalTime)
 
 	if (ImGui::TreeNode("Lights"))
 	{
+		ImGui::Checkbox("Shadows", &shadowsEnabled);
+		ImGui::SliderInt("Shadow Cascades", &shadowMap.cascadeCount, 2, ShadowMap::MaxCascades);
+		ImGui::SliderFloat("Cascade Split Blend", &shadowMap.splitBlend, 0.0f, 1.0f, "%.2f");
+		for (int i = 0; i < shadowMap.cascadeCount; i++)
+		{
+			ImGui::TextColored(detailsColor, " - Cascade %d: to %.2f units deep, %.2f units across, %d static (cached) + %d dynamic of %d casters",
+				i, shadowMap.cascadeSplits[i], shadowMap.cascadeRadii[i] * 2, shadowMap.staticCasterCounts[i], shadowMap.dynamicCasterCounts[i], shadowMap.casterCandidates);
+		}
+		ImGui::SliderInt("Cached Cascade Redraws Per Frame", &shadowMap.staticRedrawsPerFrame, 0, ShadowMap::MaxCascades - 1);
+		ImGui::TextColored(detailsColor, " - Static Cache Redraws: %d this frame, %u total", shadowMap.staticRedraws, shadowMap.totalStaticRedraws);
+		ImGui::TextColored(detailsColor, " - Shadow Atlas: %d lights in %zu tiles, %.0f%% of %dx%d used",
+			shadowAtlas.GetShadowedLightCount(), shadowAtlas.GetTileCount(), shadowAtlas.GetOccupancy() * 100.0f, ShadowAtlas::AtlasSize, ShadowAtlas::AtlasSize);
+		ImGui::TextColored(detailsColor, " - Shadow Atlas Tiles Redrawn: %d this frame, %u total", shadowAtlas.GetTilesRedrawn(), shadowAtlas.GetTotalTilesRedrawn());
+		ImGui::TextColored(detailsColor, " - Shader Variants Loaded: %zu (%zu using the fallback)", pixelShaderPermutations->GetLoadedCount(), pixelShaderPermutations->GetFallbackCount());
+		ImGui::Checkbox("Clustered Lighting", &clusteredLighting);
+		if (clusteredLighting)
+		{
+			ImGui::TextColored(detailsColor, " - Clustered Lights: %zu in %u of %u froxels (at most %u per froxel)",
+				lightClusters.GetLocalLights().size(),
+				lightClusters.GetOccupiedClusterCount(),
+				LightClusters::ClusterCount,
+				lightClusters.GetMostLightsInCluster());
+		}
+		else
+		{
+			size_t entityCount = lightClusters.GetEntityRanges().size();
+			ImGui::TextColored(detailsColor, " - Per-Entity Lights: %.1f of %zu on average, over %zu visible entities",
+				entityCount ? (float)lightClusters.GetEntityIndices().size() / entityCount : 0.0f,
+				lightClusters.GetLocalLights().size(),
+				entityCount);
+		}
+
 		for (int i = 0; i < lights.size(); i++)
 		{
 			std::string string = "Light #" + std::to_string(i+1) + " - ";
@@ -537,13 +1144,45 @@ void Game::BuildUI(float deltaTime, float totalTime)
 			}
 		}
 
+		if (ImGui::TreeNode("Residency"))
+		{
+			for (auto& t : TextureManager::GetInstance().GetTextures())
+			{
+				const ManagedTexture& texture = *t.second;
+				if (texture.streamPath.empty())
+					continue;
+
+				ImGui::TextColored(detailsColor, " - %ux%u %s: mips %u-%zu resident, %u wanted%s (%.2f MB)",
+					texture.layout.width,
+					texture.layout.height,
+					TextureCooker::GetFormatName(texture.layout.format),
+					texture.residentMip,
+					texture.layout.mipOffsets.size() - 1,
+					texture.requestedMip,
+					texture.streaming ? ", loading" : "",
+					texture.bytes / (1024.0f * 1024.0f));
+			}
+
+			ImGui::TreePop();
+		}
+
 		ImGui::TreePop();
 	}
 	if (ImGui::TreeNode("Post Processing"))
 	{
 		ImGui::DragFloat("Sharpen Intensity", &sharpenAmount, 0.1f, 0, 10, "%.01f");
 		ImGui::DragFloat("Blur Intensity", &blurAmount, 0.1f, 0, 10, "%.01f");
+		ImGui::Checkbox("Half Resolution Blur", &blurHalfResolution);
 		ImGui::DragFloat("Pixel Intensity", &pixelIntensity, 0.1f, 0, 10, "%.01f");
+		ImGui::Checkbox("Chromatic Aberration", &chromaticAberration);
+		ImGui::Checkbox("Fuse Effects", &fusedPostProcessing);
+
+		ImGui::Text("Passes: %d run, %d culled", renderGraph.GetExecutedPassCount(), renderGraph.GetCulledPassCount());
+		ImGui::Text("Targets: %d transient in %d pooled, %d clears",
+			renderGraph.GetTransientCount(),
+			(int)renderGraph.GetPooledTargetCount(),
+			renderGraph.GetClearCount());
+		ImGui::Text("Fused variants loaded: %zu (%zu using the fallback)", postProcessPermutations->GetLoadedCount(), postProcessPermutations->GetFallbackCount());
 
 		ImGui::TreePop();
 	}
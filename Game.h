@@ -12,7 +12,13 @@
 #include "Lights.h"
 #include "Sky.h"
 #include "ShadowMap.h"
+#include "ShadowAtlas.h"
 #include "PostProcess.h"
+#include "RenderGraph.h"
+#include "DynamicResolution.h"
+#include "ShaderArchive.h"
+#include "ShaderPermutation.h"
+#include "LightClusters.h"
 
 #include <memory>
 #include <vector>
@@ -28,17 +34,23 @@ public:
 	// Overridden setup and game loop methods, which
 	// will be called automatically
 	void Init();
+	static bool BuildShaderArchive(const std::wstring& sourceDirectory);
 	void OnResize();
 	void Update(float deltaTime, float totalTime);
 	void ImGuiUpdate(float deltaTime, float totalTime);
 	void BuildUI(float deltaTime, float totalTime);
 	void Draw(float deltaTime, float totalTime);
 	void RenderScene();
+	void StreamTextures();
 
 	//ImGui test value
 	bool showImGuiDemoWindow = false;
 	bool randomizeColorOffset = false;
 	int ImGuiMaterialIndex = 0;
+	bool shadowsEnabled = true;
+	bool clusteredLighting = true;
+	bool depthPrepass = true;
+	bool dynamicResolutionEnabled = true;
 	DirectX::XMFLOAT3 ambientColor = { 0.5f,0.5f,0.5f };
 
 	std::vector<GameEntity> gameEntities;
@@ -61,21 +73,42 @@ public:
 	//Materials
 	std::vector<std::shared_ptr<Material>> materials;
 
+	//Point and spot lights, binned per froxel each frame
+	LightClusters lightClusters;
+
 	//Shadow Map
 	ShadowMap shadowMap;
+	ShadowAtlas shadowAtlas;
 
 	//Post Processing
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> ppSampler;
 	std::shared_ptr<SimpleVertexShader> ppVS;
 
-	PostProcess postProcess1;
-	PostProcess postProcess2;
-	PostProcess postProcess3;
-	PostProcess postProcess4;
+	// Rebuilt every frame from the effects that are turned on
+	RenderGraph renderGraph;
+
+	PostProcess sharpenPostProcess;
+	GaussianBlurPostProcess blurPostProcess;
+	PostProcess pixelizePostProcess;
+	PostProcess chromaticAberrationPostProcess;
+
+	// All of the above in as few passes as possible
+	FusedPostProcess fusedPostProcess;
+	bool fusedPostProcessing = true;
+
+	// The scene is drawn to the top left of a window-sized target
+	// at this frame's scale, and stretched back out by the first
+	// post-process pass (or this one, if that pass can't)
+	DynamicResolution dynamicResolution;
+	PostProcess upscalePostProcess;
+	unsigned int renderWidth = 1;
+	unsigned int renderHeight = 1;
 
 	float blurAmount = 0;
+	bool blurHalfResolution = false;
 	float pixelIntensity = 0;
 	float sharpenAmount = 0;
+	bool chromaticAberration = false;
 
 	float mouseX;
 	float mouseY;
@@ -84,19 +117,57 @@ private:
 
 	// Initialization helper methods - feel free to customize, combine, remove, etc.
 	void LoadShaders(); 
+	template<typename T, typename... Args> std::shared_ptr<T> LoadShader(const std::wstring& name, const Args&... args);
 	void CreateGeometry();
-	void CreateMaterial(std::wstring albedoFile, std::wstring normalFile, std::wstring roughnessFile, std::wstring metalnessFile);
+	void CreateMaterial(
+		std::shared_ptr<ManagedTexture> albedo,
+		std::shared_ptr<ManagedTexture> normalMap,
+		std::shared_ptr<ManagedTexture> ormMap);
 	
 	std::shared_ptr<SimplePixelShader> pixelShader;
 	std::shared_ptr<SimplePixelShader> ppPS1;
 	std::shared_ptr<SimplePixelShader> ppPS2;
 	std::shared_ptr<SimplePixelShader> ppPS3;
 	std::shared_ptr<SimplePixelShader> ppPS4;
+	std::shared_ptr<SimplePixelShader> ppCopyPS;
+	std::shared_ptr<SimplePixelShader> ppUberPS;
 
 	std::shared_ptr<SimpleVertexShader> vertexShader;
 	std::shared_ptr<SimpleVertexShader> shadowMapVertexShader;
+	std::shared_ptr<SimpleVertexShader> depthPrepassVertexShader;
+	std::shared_ptr<SimplePixelShader> skyPixelShader;
+	std::shared_ptr<SimpleVertexShader> skyVertexShader;
+
+	ShaderArchive shaderArchive;
+	std::shared_ptr<ShaderPermutationCache<ShaderPermutationKey>> pixelShaderPermutations;
+	std::shared_ptr<ShaderPermutationCache<PostProcessPermutationKey>> postProcessPermutations;
 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState;
 
+	// After the depth pre-pass, the main pass only draws where
+	// the depth already matches, and leaves it alone
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> prepassMatchState;
+
+	// Pipeline statistics for the opaque passes, a few frames
+	// behind so reading them back never stalls
+	static const int SceneStatsLatency = 4;
+	Microsoft::WRL::ComPtr<ID3D11Query> sceneStatsQueries[SceneStatsLatency];
+	unsigned int sceneStatsFrame = 0;
+	unsigned long long scenePixelShaderInvocations = 0;
+	unsigned int prepassDrawCount = 0;
+	unsigned int sceneDrawCount = 0;
+
+	// GPU timestamps around each whole frame, read back the same
+	// way, for dynamic resolution
+	static const int FrameTimingLatency = 4;
+	struct FrameTimingQueries
+	{
+		Microsoft::WRL::ComPtr<ID3D11Query> disjoint;
+		Microsoft::WRL::ComPtr<ID3D11Query> start;
+		Microsoft::WRL::ComPtr<ID3D11Query> end;
+	};
+	FrameTimingQueries frameTimingQueries[FrameTimingLatency];
+	unsigned int frameTimingFrame = 0;
+
 };
 
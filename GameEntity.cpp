@@ -26,24 +26,43 @@ std::shared_ptr<Material> GameEntity::GetMaterial()
 	return material;
 }
 
-void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera)
+bool GameEntity::IsStatic()
 {
-	DirectX::XMFLOAT2 mousePos = DirectX::XMFLOAT2((float)Input::GetInstance().GetMouseX(), (float)Input::GetInstance().GetMouseY());
-	material->PrepareMaterial();
+	return isStatic;
+}
 
-	//Set Pixel Shader and Load Data
-	material->pixelShader->SetFloat4("surfaceColor", material->surfaceColor);
-	material->pixelShader->SetFloat2("mousePos", mousePos);
-	material->pixelShader->SetFloat("roughness", material->roughness);
-	material->pixelShader->SetFloat3("cameraPos", camera->GetTransform().GetPosition());
-	
-	material->pixelShader->CopyAllBufferData();
+void GameEntity::SetStatic(bool _isStatic)
+{
+	isStatic = _isStatic;
+}
+
+DirectX::BoundingSphere GameEntity::GetBounds()
+{
+	DirectX::XMFLOAT4X4 world = transform.GetWorldMatrix();
+
+	DirectX::BoundingSphere bounds(mesh->GetBoundsCenter(), mesh->GetBoundsRadius());
+	bounds.Transform(bounds, DirectX::XMLoadFloat4x4(&world));
+	return bounds;
+}
+
+// --------------------------------------------------------
+// Draws the entity with its material.  The per-frame data
+// (camera, lights, shadow matrices) is already in the shared
+// constant buffers, and the material binds its own baked
+// constants, so only the entity's transforms (and its light
+// list, if it has one) are set here.
+// --------------------------------------------------------
+void GameEntity::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const DirectX::XMFLOAT4X4& worldViewProjection, DirectX::XMUINT2 lightRange)
+{
+	material->PrepareMaterial(context);
 
 	//Set Vertex Shader and Load Data
-	material->vertexShader->SetMatrix4x4("world", transform.GetWorldMatrix());
-	material->vertexShader->SetMatrix4x4("view", camera->GetViewMatrix());
-	material->vertexShader->SetMatrix4x4("projection", camera->GetProjectionMatrix());
-	material->vertexShader->SetMatrix4x4("worldInvTranspose", transform.GetWorldInverseTransposeMatrix());
+	ShaderData::VertexShaderConstantBuffer vsData = {};
+	vsData.world = transform.GetWorldMatrix();
+	vsData.worldInvTranspose = transform.GetWorldInverseTransposeMatrix();
+	vsData.worldViewProjection = worldViewProjection;
+	vsData.lightRange = lightRange;
+	material->vertexShader->SetBufferData(vsData);
 
 	material->vertexShader->CopyAllBufferData();
 
@@ -5,7 +5,9 @@
 #include "SimpleShader.h"
 #include "Material.h"
 #include "Lights.h"
+#include "ShaderData.h"
 
+#include <DirectXCollision.h>
 #include <memory>
 
 class GameEntity
@@ -14,6 +16,7 @@ private:
 	Transform transform;
 	std::shared_ptr<Mesh> mesh;
 	std::shared_ptr<Material> material;
+	bool isStatic = true;
 
 public:
 
@@ -23,6 +26,19 @@ public:
 	Transform& GetTransform();
 	std::shared_ptr<Material> GetMaterial();
 
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera);
+	// The mesh's bounding sphere, in world space
+	DirectX::BoundingSphere GetBounds();
+
+	// worldViewProjection - this frame's world matrix times the camera's
+	//                       view and projection (see MatrixBatch.h)
+	// lightRange - offset and count of this draw's point and spot
+	//              lights, when they aren't clustered (see LightClusters.h)
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const DirectX::XMFLOAT4X4& worldViewProjection, DirectX::XMUINT2 lightRange = DirectX::XMUINT2(0, 0));
 	void SetMaterial(std::shared_ptr<Material> newMat);
+
+	// Static entities are expected to stay put, so their shadows
+	// can be cached (see ShadowMap.h).  Moving one still works,
+	// but redraws the cache.
+	bool IsStatic();
+	void SetStatic(bool _isStatic);
 };
\ No newline at end of file
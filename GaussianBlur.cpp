@@ -0,0 +1,167 @@
+#include "GaussianBlur.h"
+
+#include <algorithm>
+#include <cmath>
+
+float GaussianBlur::GetSigma(float boxRadius)
+{
+	// The shader's box loop truncates the radius, and a box of
+	// 2r+1 texels has a variance of r(r+1)/3
+	float r = floorf(std::max(boxRadius, 0.0f));
+	return sqrtf(r * (r + 1) / 3.0f);
+}
+
+std::vector<float> GaussianBlur::GetWeights(float sigma)
+{
+	// Three standard deviations holds all but a sliver of the
+	// curve, as long as the folded taps still fit
+	int radius = std::min((int)ceilf(sigma * 3.0f), (GaussianBlurTaps::MaxTaps - 1) * 2);
+
+	std::vector<float> weights(radius + 1);
+	float total = 0;
+	for (int i = 0; i <= radius; i++)
+	{
+		weights[i] = sigma > 0 ? expf(-(float)(i * i) / (2 * sigma * sigma)) : 1.0f;
+		total += i == 0 ? weights[i] : weights[i] * 2;
+	}
+
+	for (float& weight : weights)
+		weight /= total;
+
+	return weights;
+}
+
+GaussianBlurTaps GaussianBlur::GetTaps(float sigma)
+{
+	std::vector<float> weights = GetWeights(sigma);
+
+	GaussianBlurTaps taps = {};
+	taps.offsets[0] = 0;
+	taps.weights[0] = weights[0];
+	taps.count = 1;
+
+	// Texels i and i+1 share one fetch, placed between them so the
+	// filter hardware blends them in proportion to their weights
+	int radius = (int)weights.size() - 1;
+	for (int i = 1; i <= radius; i += 2)
+	{
+		float a = weights[i];
+		float b = i + 1 <= radius ? weights[i + 1] : 0.0f;
+
+		taps.weights[taps.count] = a + b;
+		taps.offsets[taps.count] = (i * a + (i + 1) * b) / (a + b);
+		taps.count++;
+	}
+
+	return taps;
+}
+
+void GaussianBlur::SeparableReference(const std::vector<float>& source, int width, int height, const std::vector<float>& offsets, const std::vector<float>& weights, std::vector<float>& result)
+{
+	std::vector<float> temp(source.size());
+	std::vector<float> output(source.size());
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const std::vector<float>& input = pass == 0 ? source : temp;
+		std::vector<float>& target = pass == 0 ? temp : output;
+
+		int length = pass == 0 ? width : height;
+		for (int y = 0; y < height; y++)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				// Linear filtering along the pass's axis, with both
+				// texels of each fetch clamped to the image
+				auto fetch = [&](float position, int channel)
+				{
+					float base = floorf(position);
+					float t = position - base;
+					int a = std::min(std::max((int)base, 0), length - 1);
+					int b = std::min(std::max((int)base + 1, 0), length - 1);
+
+					int ia = pass == 0 ? (y * width + a) : (a * width + x);
+					int ib = pass == 0 ? (y * width + b) : (b * width + x);
+					return input[ia * 4 + channel] * (1 - t) + input[ib * 4 + channel] * t;
+				};
+
+				float center = (float)(pass == 0 ? x : y);
+				for (int c = 0; c < 4; c++)
+				{
+					float total = 0;
+					for (size_t i = 0; i < offsets.size(); i++)
+					{
+						total += fetch(center + offsets[i], c) * weights[i];
+						if (offsets[i] != 0)
+							total += fetch(center - offsets[i], c) * weights[i];
+					}
+					target[(y * width + x) * 4 + c] = total;
+				}
+			}
+		}
+	}
+
+	result.swap(output);
+}
+
+void GaussianBlur::BoxBlurReference(const std::vector<float>& source, int width, int height, int radius, std::vector<float>& result)
+{
+	// The box is separable too, so this matches the old shader's
+	// (2r+1)^2 loop of clamped samples
+	std::vector<float> offsets(radius + 1);
+	std::vector<float> weights(radius + 1, 1.0f / (2 * radius + 1));
+	for (int i = 0; i <= radius; i++)
+		offsets[i] = (float)i;
+
+	SeparableReference(source, width, height, offsets, weights, result);
+}
+
+void GaussianBlur::GaussianBlurReference(const std::vector<float>& source, int width, int height, const GaussianBlurTaps& taps, std::vector<float>& result)
+{
+	std::vector<float> offsets(taps.offsets, taps.offsets + taps.count);
+	std::vector<float> weights(taps.weights, taps.weights + taps.count);
+	SeparableReference(source, width, height, offsets, weights, result);
+}
+
+void GaussianBlur::Compare(float boxRadius, float& unfoldedError, float& boxError)
+{
+	// Soft shapes and a few hard edges, different in each channel
+	const int width = 64;
+	const int height = 48;
+	std::vector<float> source(width * height * 4);
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float* texel = &source[(y * width + x) * 4];
+			texel[0] = 0.5f + 0.5f * sinf(x * 0.15f) * cosf(y * 0.2f);
+			texel[1] = (float)x / (width - 1);
+			texel[2] = ((x / 16 + y / 16) % 2) ? 0.8f : 0.2f;
+			texel[3] = 1.0f;
+		}
+	}
+
+	float sigma = GetSigma(boxRadius);
+
+	std::vector<float> folded;
+	GaussianBlurReference(source, width, height, GetTaps(sigma), folded);
+
+	std::vector<float> weights = GetWeights(sigma);
+	std::vector<float> offsets(weights.size());
+	for (size_t i = 0; i < offsets.size(); i++)
+		offsets[i] = (float)i;
+
+	std::vector<float> unfolded;
+	SeparableReference(source, width, height, offsets, weights, unfolded);
+
+	std::vector<float> box;
+	BoxBlurReference(source, width, height, (int)floorf(std::max(boxRadius, 0.0f)), box);
+
+	unfoldedError = 0;
+	boxError = 0;
+	for (size_t i = 0; i < source.size(); i++)
+	{
+		unfoldedError = std::max(unfoldedError, fabsf(folded[i] - unfolded[i]));
+		boxError = std::max(boxError, fabsf(folded[i] - box[i]));
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+// --------------------------------------------------------
+// One side of a symmetric blur kernel, folded so each pair
+// of neighbouring texels is read with a single bilinear fetch
+// (matches the taps in PostProcessBlurPS.hlsl)
+// --------------------------------------------------------
+struct GaussianBlurTaps
+{
+	static const int MaxTaps = 12; // Must match MAX_BLUR_TAPS in PostProcessBlurPS.hlsl
+
+	int count;				// Including the center tap
+	float offsets[MaxTaps];	// In texels - the center's is 0
+	float weights[MaxTaps];	// Every tap but the center is applied on both sides
+};
+
+// --------------------------------------------------------
+// A separable Gaussian blur, sized by the radius of the box
+// blur it replaced: the Gaussian gets the same variance as a
+// (2r+1) texel box, so the same radius blurs about as much.
+//
+// Nothing in here depends on Direct3D.  The CPU references
+// blur RGBA float images (row by row, edges clamped like the
+// ClampSampler) with the same math as the shaders, so the
+// taps can be checked anywhere (see Tests/GaussianBlurTest.cpp).
+// --------------------------------------------------------
+class GaussianBlur
+{
+public:
+	// Standard deviation, in texels, matching a box blur of this radius
+	static float GetSigma(float boxRadius);
+
+	// Normalized weights for texels 0 through R on one side
+	static std::vector<float> GetWeights(float sigma);
+	static GaussianBlurTaps GetTaps(float sigma);
+
+	static void BoxBlurReference(const std::vector<float>& source, int width, int height, int radius, std::vector<float>& result);
+	static void GaussianBlurReference(const std::vector<float>& source, int width, int height, const GaussianBlurTaps& taps, std::vector<float>& result);
+
+	// Blurs a test pattern with the folded taps, with a texel by texel
+	// Gaussian, and with the box blur, and returns the largest channel
+	// difference of the folded taps from each.  The first should only
+	// be rounding, the second how much the kernels' shapes differ.
+	static void Compare(float boxRadius, float& unfoldedError, float& boxError);
+
+private:
+	// Two 1D passes, horizontal then vertical, each summing
+	// taps at (offset, weight) on both sides of every texel
+	static void SeparableReference(const std::vector<float>& source, int width, int height, const std::vector<float>& offsets, const std::vector<float>& weights, std::vector<float>& result);
+};
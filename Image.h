@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+// --------------------------------------------------------
+// A decoded image in system memory: tightly packed 8-bit
+// RGBA, top row first.
+// --------------------------------------------------------
+struct Image
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	std::vector<unsigned char> pixels;
+};
+
+// --------------------------------------------------------
+// An image and its mips, largest first, ready to become the
+// initial data of a texture
+// --------------------------------------------------------
+struct MipChain
+{
+	std::vector<Image> levels;
+};
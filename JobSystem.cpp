@@ -0,0 +1,117 @@
+#include "JobSystem.h"
+
+JobSystem::JobSystem(int workerCount)
+{
+	if (workerCount < 0)
+		workerCount = (int)std::thread::hardware_concurrency() - 1;
+
+	for (int i = 0; i < workerCount; i++)
+		workers.push_back(std::thread(&JobSystem::WorkerLoop, this));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+void JobSystem::Submit(std::function<void()> job)
+{
+	// Nobody would ever pick it up
+	if (workers.empty())
+	{
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+void JobSystem::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobMutex);
+			jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+			// Finish whatever is queued before shutting down
+			if (jobs.empty())
+				return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		job();
+	}
+}
+
+bool JobSystem::RunPendingJob()
+{
+	std::function<void()> job;
+	{
+		std::lock_guard<std::mutex> lock(jobMutex);
+		if (jobs.empty())
+			return false;
+
+		job = std::move(jobs.front());
+		jobs.pop_front();
+	}
+
+	job();
+	return true;
+}
+
+// --------------------------------------------------------
+// Each helper job (and the caller) pulls the next index until
+// they run out.  While waiting for helpers to finish, the caller
+// runs other queued jobs instead of blocking, so nested calls
+// can't deadlock the pool.
+// --------------------------------------------------------
+void JobSystem::ParallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+	if (count == 0)
+		return;
+
+	std::atomic<size_t> next(0);
+	std::atomic<unsigned int> activeHelpers(0);
+
+	auto work = [&]()
+	{
+		size_t i;
+		while ((i = next++) < count)
+			body(i);
+	};
+
+	// No point waking more helpers than there are items
+	size_t helperCount = count - 1 < workers.size() ? count - 1 : workers.size();
+	activeHelpers = (unsigned int)helperCount;
+	for (size_t h = 0; h < helperCount; h++)
+	{
+		Submit([&]()
+		{
+			work();
+			activeHelpers--;
+		});
+	}
+
+	work();
+
+	while (activeHelpers > 0)
+	{
+		if (!RunPendingJob())
+			std::this_thread::yield();
+	}
+}
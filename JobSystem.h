@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// --------------------------------------------------------
+// A fixed pool of worker threads that run queued jobs.
+//
+// Portable (standard library only), so the CPU-side texture
+// pipeline built on it can also run outside the game.
+// --------------------------------------------------------
+class JobSystem
+{
+public:
+	// Negative means one per hardware thread, less the thread that
+	// calls ParallelFor().  With no workers everything runs inline.
+	explicit JobSystem(int workerCount = -1);
+	~JobSystem();
+
+	JobSystem(JobSystem const&) = delete;
+	void operator=(JobSystem const&) = delete;
+
+	void Submit(std::function<void()> job);
+
+	// Runs body(0) through body(count - 1) across the workers and
+	// the calling thread, returning once all of them are done.
+	// Safe to call from inside a job.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+	unsigned int GetWorkerCount() { return (unsigned int)workers.size(); }
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex jobMutex;
+	std::condition_variable jobAvailable;
+	bool stopping = false;
+
+	void WorkerLoop();
+
+	// Runs one queued job on the calling thread, if there is one
+	bool RunPendingJob();
+};
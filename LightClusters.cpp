@@ -0,0 +1,319 @@
+#include "LightClusters.h"
+#include "StateCache.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define CLUSTERS_SSE2 1
+#include <emmintrin.h>
+#else
+#define CLUSTERS_SSE2 0
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	const unsigned int ClustersPerSlice = LightClusters::TilesX * LightClusters::TilesY;
+	static_assert(ClustersPerSlice % 4 == 0, "Froxels are tested four at a time");
+
+	// Smallest capacity a structured buffer is created with
+	const unsigned int MinBufferCapacity = 64;
+}
+
+LightClusters::LightClusters()
+{
+	boundsMinX.resize(ClusterCount);
+	boundsMinY.resize(ClusterCount);
+	boundsMinZ.resize(ClusterCount);
+	boundsMaxX.resize(ClusterCount);
+	boundsMaxY.resize(ClusterCount);
+	boundsMaxZ.resize(ClusterCount);
+	clusterLights.resize(ClusterCount);
+	ranges.resize(ClusterCount);
+}
+
+LightClusters::~LightClusters() { }
+
+void LightClusters::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->device = device;
+	this->context = context;
+}
+
+// --------------------------------------------------------
+// Works out which froxels each point and spot light reaches.
+// Slices are independent, so each one is binned as its own job.
+// --------------------------------------------------------
+void LightClusters::Build(
+	JobSystem& jobs,
+	const std::vector<Light>& lights,
+	const XMFLOAT4X4& view,
+	const XMFLOAT4X4& projection,
+	float nearZ,
+	float farZ,
+	unsigned int width,
+	unsigned int height)
+{
+	if (projection._11 != boundsProjectionX || projection._22 != boundsProjectionY || nearZ != boundsNear || farZ != boundsFar)
+		BuildClusterBounds(projection._11, projection._22, nearZ, farZ);
+
+	tileSize = XMFLOAT2((float)width / TilesX, (float)height / TilesY);
+
+	// Bounding spheres in view space, skipping lights entirely
+	// in front of the near plane or behind the far plane
+	localLights.clear();
+	lightBounds.clear();
+	for (const Light& light : lights)
+	{
+		if (light.Type != LIGHT_TYPE_POINT && light.Type != LIGHT_TYPE_SPOT)
+			continue;
+
+		const XMFLOAT3& p = light.Position;
+		LocalLightBounds bounds;
+		bounds.x = p.x * view._11 + p.y * view._21 + p.z * view._31 + view._41;
+		bounds.y = p.x * view._12 + p.y * view._22 + p.z * view._32 + view._42;
+		bounds.z = p.x * view._13 + p.y * view._23 + p.z * view._33 + view._43;
+		bounds.radius = light.Range;
+
+		if (bounds.z + bounds.radius < nearZ || bounds.z - bounds.radius > farZ)
+			continue;
+
+		bounds.firstSlice = GetSlice(bounds.z - bounds.radius);
+		bounds.lastSlice = GetSlice(bounds.z + bounds.radius);
+
+		localLights.push_back(light);
+		lightBounds.push_back(bounds);
+	}
+
+	jobs.ParallelFor(Slices, [&](size_t slice) { BinSlice((unsigned int)slice); });
+
+	// Pack every froxel's list into one index buffer
+	indices.clear();
+	occupiedClusters = 0;
+	mostLightsInCluster = 0;
+	for (unsigned int i = 0; i < ClusterCount; i++)
+	{
+		const std::vector<unsigned int>& list = clusterLights[i];
+		ranges[i].offset = (unsigned int)indices.size();
+		ranges[i].count = (unsigned int)list.size();
+		indices.insert(indices.end(), list.begin(), list.end());
+
+		if (!list.empty())
+			occupiedClusters++;
+		mostLightsInCluster = max(mostLightsInCluster, ranges[i].count);
+	}
+}
+
+// --------------------------------------------------------
+// View space bounding boxes of every froxel.  Slice k spans
+// near * (far / near)^(k / Slices) to the start of slice k + 1,
+// which keeps froxels roughly cube shaped at every depth.
+// --------------------------------------------------------
+void LightClusters::BuildClusterBounds(float projectionX, float projectionY, float nearZ, float farZ)
+{
+	boundsProjectionX = projectionX;
+	boundsProjectionY = projectionY;
+	boundsNear = nearZ;
+	boundsFar = farZ;
+
+	float depthRatio = farZ / nearZ;
+	depthScale = Slices / std::log(depthRatio);
+	depthBias = -std::log(nearZ) * depthScale;
+
+	for (unsigned int z = 0; z < Slices; z++)
+	{
+		float sliceNear = nearZ * std::pow(depthRatio, (float)z / Slices);
+		float sliceFar = nearZ * std::pow(depthRatio, (float)(z + 1) / Slices);
+
+		for (unsigned int y = 0; y < TilesY; y++)
+		{
+			// Tile rows run down the screen, NDC runs up
+			float top = 1.0f - 2.0f * y / TilesY;
+			float bottom = 1.0f - 2.0f * (y + 1) / TilesY;
+
+			for (unsigned int x = 0; x < TilesX; x++)
+			{
+				float left = -1.0f + 2.0f * x / TilesX;
+				float right = -1.0f + 2.0f * (x + 1) / TilesX;
+
+				// The tile's edges spread out with depth, so the box
+				// has to hold its corners at both ends of the slice
+				unsigned int i = (z * TilesY + y) * TilesX + x;
+				boundsMinX[i] = min(left * sliceNear, left * sliceFar) / projectionX;
+				boundsMaxX[i] = max(right * sliceNear, right * sliceFar) / projectionX;
+				boundsMinY[i] = min(bottom * sliceNear, bottom * sliceFar) / projectionY;
+				boundsMaxY[i] = max(top * sliceNear, top * sliceFar) / projectionY;
+				boundsMinZ[i] = sliceNear;
+				boundsMaxZ[i] = sliceFar;
+			}
+		}
+	}
+}
+
+unsigned int LightClusters::GetSlice(float viewZ)
+{
+	if (viewZ <= boundsNear)
+		return 0;
+
+	float slice = std::log(viewZ) * depthScale + depthBias;
+	return min((unsigned int)max(slice, 0.0f), Slices - 1);
+}
+
+// --------------------------------------------------------
+// Tests every light that spans this slice against all of its
+// froxels, appending the light to the lists of those it touches
+// --------------------------------------------------------
+void LightClusters::BinSlice(unsigned int slice)
+{
+	unsigned int first = slice * ClustersPerSlice;
+	for (unsigned int i = first; i < first + ClustersPerSlice; i++)
+		clusterLights[i].clear();
+
+	for (unsigned int l = 0; l < (unsigned int)lightBounds.size(); l++)
+	{
+		const LocalLightBounds& light = lightBounds[l];
+		if (slice < light.firstSlice || slice > light.lastSlice)
+			continue;
+
+		float radiusSquared = light.radius * light.radius;
+
+#if CLUSTERS_SSE2
+		// Squared distance from the sphere's center to each box
+		__m128 centerX = _mm_set1_ps(light.x);
+		__m128 centerY = _mm_set1_ps(light.y);
+		__m128 centerZ = _mm_set1_ps(light.z);
+		__m128 radius2 = _mm_set1_ps(radiusSquared);
+		__m128 zero = _mm_setzero_ps();
+
+		for (unsigned int i = first; i < first + ClustersPerSlice; i += 4)
+		{
+			__m128 dx = _mm_add_ps(
+				_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boundsMinX[i]), centerX), zero),
+				_mm_max_ps(_mm_sub_ps(centerX, _mm_loadu_ps(&boundsMaxX[i])), zero));
+			__m128 dy = _mm_add_ps(
+				_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boundsMinY[i]), centerY), zero),
+				_mm_max_ps(_mm_sub_ps(centerY, _mm_loadu_ps(&boundsMaxY[i])), zero));
+			__m128 dz = _mm_add_ps(
+				_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boundsMinZ[i]), centerZ), zero),
+				_mm_max_ps(_mm_sub_ps(centerZ, _mm_loadu_ps(&boundsMaxZ[i])), zero));
+
+			__m128 distance2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int hits = _mm_movemask_ps(_mm_cmple_ps(distance2, radius2));
+
+			for (unsigned int j = 0; hits; j++, hits >>= 1)
+			{
+				if (hits & 1)
+					clusterLights[i + j].push_back(l);
+			}
+		}
+#else
+		for (unsigned int i = first; i < first + ClustersPerSlice; i++)
+		{
+			float dx = max(boundsMinX[i] - light.x, 0.0f) + max(light.x - boundsMaxX[i], 0.0f);
+			float dy = max(boundsMinY[i] - light.y, 0.0f) + max(light.y - boundsMaxY[i], 0.0f);
+			float dz = max(boundsMinZ[i] - light.z, 0.0f) + max(light.z - boundsMaxZ[i], 0.0f);
+
+			if (dx * dx + dy * dy + dz * dz <= radiusSquared)
+				clusterLights[i].push_back(l);
+		}
+#endif
+	}
+}
+
+// --------------------------------------------------------
+// Sphere-sphere tests between every entity and every local
+// light, packed into one index list like the froxels' lists
+// --------------------------------------------------------
+void LightClusters::BuildEntityLists(const std::vector<XMFLOAT4>& spheres)
+{
+	entityRanges.resize(spheres.size());
+	entityIndices.clear();
+
+	for (size_t e = 0; e < spheres.size(); e++)
+	{
+		const XMFLOAT4& sphere = spheres[e];
+		entityRanges[e].offset = (unsigned int)entityIndices.size();
+
+		for (unsigned int l = 0; l < (unsigned int)localLights.size(); l++)
+		{
+			const Light& light = localLights[l];
+			float dx = light.Position.x - sphere.x;
+			float dy = light.Position.y - sphere.y;
+			float dz = light.Position.z - sphere.z;
+			float reach = light.Range + sphere.w;
+
+			if (dx * dx + dy * dy + dz * dz <= reach * reach)
+				entityIndices.push_back(l);
+		}
+
+		entityRanges[e].count = (unsigned int)entityIndices.size() - entityRanges[e].offset;
+	}
+}
+
+void LightClusters::Upload()
+{
+	WriteBuffer(lightBuffer, localLights.data(), (unsigned int)localLights.size(), sizeof(Light));
+	WriteBuffer(rangeBuffer, ranges.data(), (unsigned int)ranges.size(), sizeof(ClusterLightRange));
+	WriteBuffer(indexBuffer, indices.data(), (unsigned int)indices.size(), sizeof(unsigned int));
+	WriteBuffer(entityIndexBuffer, entityIndices.data(), (unsigned int)entityIndices.size(), sizeof(unsigned int));
+}
+
+void LightClusters::Bind()
+{
+	ID3D11ShaderResourceView* srvs[] = { lightBuffer.srv.Get(), rangeBuffer.srv.Get(), indexBuffer.srv.Get(), entityIndexBuffer.srv.Get() };
+	StateCache::GetInstance().PSSetShaderResources(FirstSlot, 4, srvs);
+}
+
+// --------------------------------------------------------
+// Overwrites a dynamic structured buffer, recreating it at
+// twice the size whenever the data no longer fits
+// --------------------------------------------------------
+bool LightClusters::WriteBuffer(DynamicBuffer& target, const void* data, unsigned int count, unsigned int stride)
+{
+	if (!device || !context)
+		return false;
+
+	if (count > target.capacity || !target.buffer)
+	{
+		unsigned int capacity = max(target.capacity, MinBufferCapacity);
+		while (capacity < count)
+			capacity *= 2;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = capacity * stride;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = stride;
+
+		target.buffer.Reset();
+		target.srv.Reset();
+		target.capacity = 0;
+		if (FAILED(device->CreateBuffer(&desc, 0, target.buffer.GetAddressOf())))
+			return false;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = capacity;
+		if (FAILED(device->CreateShaderResourceView(target.buffer.Get(), &srvDesc, target.srv.GetAddressOf())))
+			return false;
+
+		target.capacity = capacity;
+	}
+
+	if (count == 0)
+		return true;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(target.buffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return false;
+
+	memcpy(mapped.pData, data, (size_t)count * stride);
+	context->Unmap(target.buffer.Get(), 0);
+	return true;
+}
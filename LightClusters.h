@@ -0,0 +1,156 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include <DirectXMath.h>
+
+#include <memory>
+#include <vector>
+
+#include "JobSystem.h"
+#include "Lights.h"
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// Which of the local lights reach one cluster (or entity): a
+// run of ClusterLightIndices (matches the shader's uint2)
+// --------------------------------------------------------
+struct ClusterLightRange
+{
+	unsigned int offset;
+	unsigned int count;
+};
+
+// --------------------------------------------------------
+// Clustered forward lighting.  The view frustum is cut into
+// a grid of froxels (screen tiles, each split into slices
+// that get exponentially deeper), and every point and spot
+// light is binned into the froxels its range touches.  The
+// pixel shader then only loops over the lights in its own
+// froxel, so the number of lights in the scene is no longer
+// capped by the LightBuffer's array.
+//
+// Binning runs on the CPU: the depth slices are spread across
+// the job system, and each light's sphere is tested against
+// four froxel bounding boxes at a time with SSE2.  The results
+// go to the GPU in structured buffers.
+//
+// Directional lights touch every froxel, so they're left to
+// the LightBuffer.
+//
+// Without clustering, each draw can instead get its own list:
+// the local lights whose ranges overlap the entity's bounds.
+// --------------------------------------------------------
+class LightClusters
+{
+public:
+	static const unsigned int TilesX = 16;
+	static const unsigned int TilesY = 9;
+	static const unsigned int Slices = 24;
+	static const unsigned int ClusterCount = TilesX * TilesY * Slices;
+	static const unsigned int FirstSlot = 5;	// LocalLights through EntityLightIndices in Lighting.hlsli
+
+	LightClusters();
+	~LightClusters();
+
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Bins the point and spot lights for a camera drawing to a
+	// width x height target.  The projection must be symmetric.
+	void Build(
+		JobSystem& jobs,
+		const std::vector<Light>& lights,
+		const DirectX::XMFLOAT4X4& view,
+		const DirectX::XMFLOAT4X4& projection,
+		float nearZ,
+		float farZ,
+		unsigned int width,
+		unsigned int height);
+
+	// Per-draw lists of the lights from the last Build() that
+	// overlap each world space bounding sphere (xyz center, w radius)
+	void BuildEntityLists(const std::vector<DirectX::XMFLOAT4>& spheres);
+
+	// Copies the last Build() and BuildEntityLists() to the GPU
+	// buffers, growing them if needed
+	void Upload();
+
+	// Binds LocalLights, ClusterLightRanges, ClusterLightIndices
+	// and EntityLightIndices for every pixel shader that includes
+	// Lighting.hlsli - once per frame, after Upload()
+	void Bind();
+
+	// The shader's froxel lookup: slice = log(viewZ) * scale + bias
+	float GetDepthScale() { return depthScale; }
+	float GetDepthBias() { return depthBias; }
+	DirectX::XMFLOAT2 GetTileSize() { return tileSize; }
+
+	// Results of the last Build()
+	const std::vector<Light>& GetLocalLights() { return localLights; }
+	const std::vector<ClusterLightRange>& GetRanges() { return ranges; }
+	const std::vector<unsigned int>& GetIndices() { return indices; }
+	unsigned int GetOccupiedClusterCount() { return occupiedClusters; }
+	unsigned int GetMostLightsInCluster() { return mostLightsInCluster; }
+
+	// Results of the last BuildEntityLists(), one range per sphere
+	const std::vector<ClusterLightRange>& GetEntityRanges() { return entityRanges; }
+	const std::vector<unsigned int>& GetEntityIndices() { return entityIndices; }
+
+private:
+	// A light's bounding sphere in view space, and the slices it spans
+	struct LocalLightBounds
+	{
+		float x, y, z;
+		float radius;
+		unsigned int firstSlice;
+		unsigned int lastSlice;
+	};
+
+	// One structured buffer that's rewritten every frame
+	struct DynamicBuffer
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+		unsigned int capacity = 0;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	DynamicBuffer lightBuffer;
+	DynamicBuffer rangeBuffer;
+	DynamicBuffer indexBuffer;
+	DynamicBuffer entityIndexBuffer;
+
+	// Froxel bounding boxes in view space, as separate arrays so
+	// four neighbours load into one register.  Only rebuilt when
+	// the projection or the near/far planes change.
+	std::vector<float> boundsMinX, boundsMinY, boundsMinZ;
+	std::vector<float> boundsMaxX, boundsMaxY, boundsMaxZ;
+	float boundsProjectionX = 0;
+	float boundsProjectionY = 0;
+	float boundsNear = 0;
+	float boundsFar = 0;
+
+	float depthScale = 0;
+	float depthBias = 0;
+	DirectX::XMFLOAT2 tileSize = DirectX::XMFLOAT2(1, 1);
+
+	std::vector<Light> localLights;
+	std::vector<LocalLightBounds> lightBounds;
+	std::vector<std::vector<unsigned int>> clusterLights;	// Per froxel, reused between frames
+
+	std::vector<ClusterLightRange> ranges;
+	std::vector<unsigned int> indices;
+	unsigned int occupiedClusters = 0;
+	unsigned int mostLightsInCluster = 0;
+
+	std::vector<ClusterLightRange> entityRanges;
+	std::vector<unsigned int> entityIndices;
+
+	void BuildClusterBounds(float projectionX, float projectionY, float nearZ, float farZ);
+	unsigned int GetSlice(float viewZ);
+	void BinSlice(unsigned int slice);
+
+	bool WriteBuffer(DynamicBuffer& target, const void* data, unsigned int count, unsigned int stride);
+};
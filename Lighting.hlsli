@@ -1,5 +1,6 @@
 #ifndef __Lighting__ // Each .hlsli file needs a unique identifier!
 #include "PBR.hlsli"
+#include "FrameBuffer.hlsli"
 #define __Lighting__
 
 #define LIGHT_TYPE_DIRECTIONAL 0
@@ -7,7 +8,19 @@
 #define LIGHT_TYPE_SPOT 2
 
 #define MAX_SPECULAR_EXPONENT 256.0f
-#define MAX_NUM_LIGHTS 10
+#define MAX_NUM_LIGHTS 10 // Directional - point and spot lights are clustered
+
+// Permutation defines - the offline permutation compiler sets these
+// (see ShaderPermutation.h), and the defaults build the full shader
+#ifndef LIGHT_COUNT_BUCKET
+#define LIGHT_COUNT_BUCKET MAX_NUM_LIGHTS // Most directional lights this variant loops over
+#endif
+#ifndef SHADOWS
+#define SHADOWS 1
+#endif
+#ifndef CLUSTERED_LIGHTS
+#define CLUSTERED_LIGHTS 1 // Otherwise each draw has its own list of point and spot lights
+#endif
 
 // Struct representing the data we expect to receive from earlier pipeline stages
 // - Should match the output of our corresponding vertex shader
@@ -26,7 +39,7 @@ struct VertexToPixel
     float3 normal : NORMAL;
     float3 worldPosition : POSITION;
     float3 tangent : TANGENT;
-    float4 shadowMapPos : SHADOW_POSITION;
+    nointerpolation uint2 lightRange : LIGHT_RANGE; // The draw's run of EntityLightIndices
 };
 
 struct Light
@@ -38,16 +51,46 @@ struct Light
     float Intensity;
     float3 Color;
     float SpotFalloff;
-    float3 Padding;
+    int ShadowIndex; // First of its ShadowTiles, or -1
+    float2 Padding;
 };
 
+// Shared by every pixel shader, and filled once per frame
+// (see SharedConstantBuffers.h)
 cbuffer LightBuffer : register(b1)
 {
-    Light lights[MAX_NUM_LIGHTS];
-    float roughness;
+    Light directionalLights[MAX_NUM_LIGHTS];
     float3 cameraPos;
+    int directionalLightCount;
+
+    // Froxel grid the point and spot lights are binned into (see LightClusters.h)
+    uint3 clusterCounts;
+    float clusterDepthScale; // Slice = log(view depth) * scale + bias
+    float2 clusterTileSize; // In pixels
+    float clusterDepthBias;
 }
 
+// Every point and spot light near the camera, and the run of
+// ClusterLightIndices that lists the ones reaching each froxel
+StructuredBuffer<Light> LocalLights : register(t5);
+StructuredBuffer<uint2> ClusterLightRanges : register(t6); // Offset, count
+StructuredBuffer<uint> ClusterLightIndices : register(t7);
+
+// The lights that reach each entity's bounds, for when clustering is off
+StructuredBuffer<uint> EntityLightIndices : register(t8);
+
+// Point and spot light shadows, packed into one depth texture
+// (see ShadowAtlas.h).  A point light has six tiles in a row,
+// one per cube face: +X, -X, +Y, -Y, +Z, -Z.
+struct ShadowTile
+{
+    matrix viewProjection;
+    float4 rect; // Offset and size, in atlas UVs
+};
+Texture2D ShadowAtlas : register(t9);
+StructuredBuffer<ShadowTile> ShadowTiles : register(t10);
+SamplerComparisonState ShadowSampler : register(s1);
+
 float3 DirectionalLight(Light light, VertexToPixel input, float3 surfaceColor, float3 toCam, float3 specColor, float roughness, float metalness)
 {
     float diff = DiffusePBR(input.normal, -light.Direction);
@@ -70,6 +113,7 @@ float Attenuate(Light light, float3 worldPos)
 float3 PointLight(Light light, VertexToPixel input, float3 surfaceColor, float3 toCam, float3 specColor, float roughness, float metalness)
 {   
     float3 toLight = normalize(light.Position - input.worldPosition);
+    float atten = Attenuate(light, input.worldPosition);
 
     // Calculate the light amounts
     float diff = DiffusePBR(input.normal, toLight);
@@ -78,32 +122,102 @@ float3 PointLight(Light light, VertexToPixel input, float3 surfaceColor, float3
     // Calculate diffuse with energy conservation, including cutting diffuse for metals
     float3 balancedDiff = DiffuseEnergyConserve(diff, F, metalness);
     // Combine the final diffuse and specular values for this light
-    return (balancedDiff * surfaceColor + spec) * light.Intensity * light.Color;
+    // - Fading out to nothing at the range keeps the clusters'
+    //   culling from showing up as hard edges
+    return (balancedDiff * surfaceColor + spec) * atten * light.Intensity * light.Color;
+}
+
+float3 SpotLight(Light light, VertexToPixel input, float3 surfaceColor, float3 toCam, float3 specColor, float roughness, float metalness)
+{
+    float3 toLight = normalize(light.Position - input.worldPosition);
+    float penumbra = pow(saturate(dot(-toLight, light.Direction)), light.SpotFalloff);
+    return PointLight(light, input, surfaceColor, toCam, specColor, roughness, metalness) * penumbra;
+}
+
+// How much of a shadowed point or spot light reaches this point
+float LocalShadowAmount(Light light, float3 worldPos)
+{
+    uint tileIndex = (uint)light.ShadowIndex;
+    if (light.Type == LIGHT_TYPE_POINT)
+    {
+        // The cube face is the one facing the way the point is furthest
+        float3 fromLight = worldPos - light.Position;
+        float3 axis = abs(fromLight);
+        if (axis.x >= axis.y && axis.x >= axis.z)
+            tileIndex += fromLight.x < 0 ? 1 : 0;
+        else if (axis.y >= axis.z)
+            tileIndex += fromLight.y < 0 ? 3 : 2;
+        else
+            tileIndex += fromLight.z < 0 ? 5 : 4;
+    }
+
+    ShadowTile tile = ShadowTiles[tileIndex];
+    float4 shadowPos = mul(tile.viewProjection, float4(worldPos, 1));
+    shadowPos.xyz /= shadowPos.w;
+    float2 uv = shadowPos.xy * float2(0.5f, -0.5f) + 0.5f;
+
+    // Keep the filter from reaching into the neighbouring tiles
+    float2 atlasSize;
+    ShadowAtlas.GetDimensions(atlasSize.x, atlasSize.y);
+    float2 inset = 0.5f / atlasSize;
+    float2 atlasUV = clamp(tile.rect.xy + uv * tile.rect.zw, tile.rect.xy + inset, tile.rect.xy + tile.rect.zw - inset);
+    return ShadowAtlas.SampleCmpLevelZero(ShadowSampler, atlasUV, shadowPos.z).r;
+}
+
+// Index of the froxel this pixel falls in
+uint GetCluster(VertexToPixel input)
+{
+    float viewDepth = mul(view, float4(input.worldPosition, 1)).z;
+    uint3 cluster;
+    cluster.xy = min(uint2(input.screenPosition.xy / clusterTileSize), clusterCounts.xy - 1);
+    cluster.z = (uint)clamp(log(viewDepth) * clusterDepthScale + clusterDepthBias, 0, clusterCounts.z - 1);
+    return (cluster.z * clusterCounts.y + cluster.y) * clusterCounts.x + cluster.x;
 }
 
 float3 CalcLights(VertexToPixel input, float3 surfaceColor, float3 specularColor, float roughness, float metalness, float shadowMapShadowAmount)
 {
-    float3 light;
+    float3 light = 0;
     float3 toCam = normalize(cameraPos - input.worldPosition);
 
-    for (int i = 0; i < 5; i++)
+    for (int i = 0; i < LIGHT_COUNT_BUCKET; i++)
     {
-        switch (lights[i].Type)
+        if (i >= directionalLightCount)
+            break;
+
+        float3 lightAdditive = DirectionalLight(directionalLights[i], input, surfaceColor, toCam, specularColor, roughness, metalness);
+#if SHADOWS
+        if (i == 0)
         {
-            case LIGHT_TYPE_DIRECTIONAL:
-                float lightAdditive = DirectionalLight(lights[i], input, surfaceColor, toCam, specularColor, roughness, metalness);
-                if (i == 0)
-                {
-                    lightAdditive *= shadowMapShadowAmount;
-                }
-                light += lightAdditive;
-                break;
-            case LIGHT_TYPE_POINT:
-                light += PointLight(lights[i], input, surfaceColor, toCam, specularColor, roughness, metalness);
-                break;
-            case LIGHT_TYPE_SPOT:
-                break;
+            lightAdditive *= shadowMapShadowAmount;
         }
+#endif
+        light += lightAdditive;
+    }
+
+#if CLUSTERED_LIGHTS
+    // Only the point and spot lights that reach this pixel's froxel
+    uint2 range = ClusterLightRanges[GetCluster(input)];
+#else
+    // Only the point and spot lights that reach this entity
+    uint2 range = input.lightRange;
+#endif
+    for (uint j = 0; j < range.y; j++)
+    {
+#if CLUSTERED_LIGHTS
+        Light local = LocalLights[ClusterLightIndices[range.x + j]];
+#else
+        Light local = LocalLights[EntityLightIndices[range.x + j]];
+#endif
+        float3 lightAdditive;
+        if (local.Type == LIGHT_TYPE_SPOT)
+            lightAdditive = SpotLight(local, input, surfaceColor, toCam, specularColor, roughness, metalness);
+        else
+            lightAdditive = PointLight(local, input, surfaceColor, toCam, specularColor, roughness, metalness);
+#if SHADOWS
+        if (local.ShadowIndex >= 0)
+            lightAdditive *= LocalShadowAmount(local, input.worldPosition);
+#endif
+        light += lightAdditive;
     }
     
     return light;
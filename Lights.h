@@ -6,7 +6,7 @@
 #define LIGHT_TYPE_SPOT 2
 
 struct Light {
-	Light() : Type(LIGHT_TYPE_DIRECTIONAL), Direction(1,0,0), Range(10), Position(0,0,0), Intensity(1), Color(1, 1, 1), Padding(0,0,0), SpotFalloff(0) { }
+	Light() : Type(LIGHT_TYPE_DIRECTIONAL), Direction(1,0,0), Range(10), Position(0,0,0), Intensity(1), Color(1, 1, 1), SpotFalloff(0), ShadowIndex(-1), Padding(0,0) { }
 
 	int Type;
 	DirectX::XMFLOAT3 Direction;
@@ -15,5 +15,6 @@ struct Light {
 	float Intensity;
 	DirectX::XMFLOAT3 Color;
 	float SpotFalloff;
-	DirectX::XMFLOAT3 Padding;
+	int ShadowIndex;	// First of its tiles in the shadow atlas (see ShadowAtlas.h), or -1
+	DirectX::XMFLOAT2 Padding;
 };
\ No newline at end of file
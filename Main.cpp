@@ -1,6 +1,8 @@
 
 #include <Windows.h>
+#include <algorithm>
 #include "Game.h"
+#include "PathHelpers.h"
 
 // --------------------------------------------------------
 // Entry point for a graphical (non-console) Windows application
@@ -11,6 +13,20 @@ int WINAPI WinMain(
 	_In_ LPSTR lpCmdLine,				// Command line params
 	_In_ int nCmdShow)					// How the window should be shown (we ignore this)
 {
+	// Offline shader archive build (run by the post-build event),
+	// which needs neither a window nor Direct3D.  The argument
+	// after the flag is the directory holding the .hlsl sources.
+	const char* buildFlag = strstr(lpCmdLine, "--build-shader-archive");
+	if (buildFlag)
+	{
+		std::string sourceDirectory = buildFlag + strlen("--build-shader-archive");
+		sourceDirectory.erase(std::remove(sourceDirectory.begin(), sourceDirectory.end(), '"'), sourceDirectory.end());
+		sourceDirectory.erase(0, sourceDirectory.find_first_not_of(' '));
+		sourceDirectory.erase(sourceDirectory.find_last_not_of(' ') + 1);
+
+		return Game::BuildShaderArchive(NarrowToWide(sourceDirectory)) ? 0 : 1;
+	}
+
 #if defined(DEBUG) | defined(_DEBUG)
 	// Enable memory leak detection as a quick and dirty
 	// way of determining if we forgot to clean something up
@@ -1,18 +1,184 @@
 #include "Material.h"
+#include "ShaderData.h"
+#include "StateCache.h"
 
 Material::Material(DirectX::XMFLOAT4 _colorTint, std::shared_ptr<SimplePixelShader> _ps, std::shared_ptr<SimpleVertexShader> _vs)
-	: surfaceColor(_colorTint), pixelShader(_ps), vertexShader(_vs) { }
+	: surfaceColor(_colorTint), pixelShader(_ps), vertexShader(_vs), roughness(0.5f), metalness(0.0f) { }
 
-void Material::PrepareMaterial()
+// --------------------------------------------------------
+// Sets the material's shaders, textures, samplers and constants.
+// Textures and samplers each go out as one range call.
+// --------------------------------------------------------
+void Material::PrepareMaterial(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 {
-	pixelShader->SetShader();
+	// The shader can change (see ShaderPermutationCache), and its
+	// slots along with it
+	if (bindings.shader != pixelShader.get())
+		BakeBindings(context);
+	// Streaming replaces textures as their mips come and go
+	else if (bindings.residencyVersion != TextureManager::GetInstance().GetResidencyVersion())
+		BakeTextureBindings();
+
+	// The material's constants replace the shader's own buffer
+	// in that slot, so don't bind that one just to overwrite it
+	if (bindings.constantBuffer)
+		pixelShader->SetShaderExceptBuffer(bindings.constantBufferSlot);
+	else
+		pixelShader->SetShader();
 	vertexShader->SetShader();
 
-	for (auto& t : textureSRVs) { pixelShader->SetShaderResourceView(t.first.c_str(), t.second); }
-	for (auto& s : samplers) { pixelShader->SetSamplerState(s.first.c_str(), s.second); }
+	StateCache& cache = StateCache::GetInstance();
+	if (!bindings.srvs.empty())
+		cache.PSSetShaderResources(bindings.srvStartSlot, (unsigned int)bindings.srvs.size(), bindings.srvs.data());
+	if (!bindings.samplers.empty())
+		cache.PSSetSamplers(bindings.samplerStartSlot, (unsigned int)bindings.samplers.size(), bindings.samplers.data());
+	if (bindings.constantBuffer)
+		cache.PSSetConstantBuffer(bindings.constantBufferSlot, bindings.constantBuffer.Get());
+}
+
+void Material::SetTexture(std::string name, std::shared_ptr<ManagedTexture> texture)
+{
+	if (!texture)
+		return;
+
+	managedTextures[name] = texture;
+	textureSRVs[name] = texture->srv;
+	InvalidateBindings();
+}
+
+void Material::InvalidateBindings()
+{
+	bindings = Bindings();
+}
+
+void Material::RequestDetail(float uvPerPixel)
+{
+	TextureManager& textureManager = TextureManager::GetInstance();
+	for (auto& t : managedTextures)
+		textureManager.RequestDetail(t.second, uvPerPixel);
+}
+
+// Lays out (slot, resource) pairs as one contiguous array
+template<typename T>
+static void BuildSlotRange(const std::vector<std::pair<unsigned int, T*>>& slots, unsigned int& startSlot, std::vector<T*>& range)
+{
+	range.clear();
+	if (slots.empty())
+		return;
+
+	unsigned int first = slots[0].first;
+	unsigned int last = slots[0].first;
+	for (auto& s : slots)
+	{
+		first = min(first, s.first);
+		last = max(last, s.first);
+	}
+
+	startSlot = first;
+	range.assign(last - first + 1, 0);
+	for (auto& s : slots)
+		range[s.first - first] = s.second;
+}
+
+// --------------------------------------------------------
+// Resolves every texture and sampler name to its register in
+// the current pixel shader, and creates the immutable buffer
+// holding the material's constants
+// --------------------------------------------------------
+void Material::BakeBindings(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	bindings = Bindings();
+	bindings.shader = pixelShader.get();
+
+	BakeTextureBindings();
+
+	std::vector<std::pair<unsigned int, ID3D11SamplerState*>> samplerSlots;
+	for (auto& s : samplers)
+	{
+		const SimpleSampler* info = pixelShader->GetSamplerInfo(s.first);
+		if (info) samplerSlots.push_back({ info->BindIndex, s.second.Get() });
+	}
+	BuildSlotRange(samplerSlots, bindings.samplerStartSlot, bindings.samplers);
+
+	// Only bake the constants if the shader's buffer is the one we expect
+	ShaderData::PixelShaderConstantBuffer data = {};
+	const SimpleConstantBuffer* cbInfo = 0;
+	for (unsigned int i = 0; i < pixelShader->GetBufferCount(); i++)
+	{
+		const SimpleConstantBuffer* cb = pixelShader->GetBufferInfo(i);
+		if (cb->BindIndex == ShaderData::PixelShaderConstantBuffer::BindIndex && cb->Size == sizeof(data))
+			cbInfo = cb;
+	}
+
+	if (!cbInfo)
+		return;
+
+	data.surfaceColor = surfaceColor;
+	data.roughness = roughness;
+	data.metalness = metalness;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.ByteWidth = sizeof(data);
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	D3D11_SUBRESOURCE_DATA initialData = {};
+	initialData.pSysMem = &data;
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	context->GetDevice(device.GetAddressOf());
+	device->CreateBuffer(&desc, &initialData, bindings.constantBuffer.GetAddressOf());
+	bindings.constantBufferSlot = cbInfo->BindIndex;
+}
+
+// --------------------------------------------------------
+// Picks up the current version of every managed texture, then
+// resolves the texture names against the current pixel shader
+// --------------------------------------------------------
+void Material::BakeTextureBindings()
+{
+	for (auto& t : managedTextures)
+		textureSRVs[t.first] = t.second->srv;
+
+	// Names the shader doesn't use (like a normal map in a variant
+	// without normal mapping) are simply left out
+	std::vector<std::pair<unsigned int, ID3D11ShaderResourceView*>> srvSlots;
+	for (auto& t : textureSRVs)
+	{
+		const SimpleSRV* info = pixelShader->GetShaderResourceViewInfo(t.first);
+		if (info) srvSlots.push_back({ info->BindIndex, t.second.Get() });
+	}
+	BuildSlotRange(srvSlots, bindings.srvStartSlot, bindings.srvs);
+
+	bindings.residencyVersion = TextureManager::GetInstance().GetResidencyVersion();
+}
+
+// A texture only counts if it actually loaded
+static bool HasTexture(const std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>& srvs, const char* name)
+{
+	auto found = srvs.find(name);
+	return found != srvs.end() && found->second;
+}
+
+bool Material::HasNormalMap()
+{
+	return HasTexture(textureSRVs, "NormalMap");
+}
+
+// Without a packed map or both separate ones, the roughness
+// and metalness constants are used instead
+bool Material::HasPBRTextures()
+{
+	return HasPackedORM() || (HasTexture(textureSRVs, "RoughnessMap") && HasTexture(textureSRVs, "MetalnessMap"));
+}
+
+// Roughness and metalness packed into the green and blue channels of one texture
+bool Material::HasPackedORM()
+{
+	return HasTexture(textureSRVs, "ORMMap");
 }
 
 Material::~Material()
 {
 
-}
\ No newline at end of file
+}
@@ -1,7 +1,9 @@
 #pragma once
 #include <DirectXMath.h>
 #include "SimpleShader.h"
+#include "TextureManager.h"
 #include <memory>
+#include <vector>
 
 class Material
 {
@@ -10,11 +12,56 @@ public:
 	std::shared_ptr<SimpleVertexShader> vertexShader;
 	DirectX::XMFLOAT4 surfaceColor;
 	float roughness;
+	float metalness;
 
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> textureSRVs;
 	std::unordered_map<std::string, Microsoft::WRL::ComPtr<ID3D11SamplerState>> samplers;
 
+	// Holding these keeps the textures in TextureManager's cache
+	std::unordered_map<std::string, std::shared_ptr<ManagedTexture>> managedTextures;
+
 	Material(DirectX::XMFLOAT4 _colorTint, std::shared_ptr<SimplePixelShader> _ps, std::shared_ptr<SimpleVertexShader> _vs);
-	void PrepareMaterial();
+	void PrepareMaterial(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	// Uses a texture from the TextureManager, doing nothing if it failed to load
+	void SetTexture(std::string name, std::shared_ptr<ManagedTexture> texture);
+
+	// Call after changing the textures, samplers or constants above,
+	// so the baked bindings get rebuilt on the next draw
+	void InvalidateBindings();
+
+	// Asks the TextureManager to stream in enough mips of every
+	// texture for one screen pixel to cover uvPerPixel of them
+	void RequestDetail(float uvPerPixel);
+
+	// Which shader features this material's textures need (see ShaderPermutation.h)
+	bool HasNormalMap();
+	bool HasPBRTextures();
+	bool HasPackedORM();
 	~Material();
-};
\ No newline at end of file
+
+private:
+	// Everything needed to bind this material, resolved against
+	// one particular pixel shader so drawing needs no name lookups
+	struct Bindings
+	{
+		SimplePixelShader* shader = 0;
+
+		unsigned int residencyVersion = 0;	// TextureManager's, when the srvs were baked
+		unsigned int srvStartSlot = 0;
+
+		// Slot ordered, with nulls for any unused slots in between
+		std::vector<ID3D11ShaderResourceView*> srvs;
+		unsigned int samplerStartSlot = 0;
+		std::vector<ID3D11SamplerState*> samplers;
+
+		// surfaceColor, roughness and metalness, which never change
+		Microsoft::WRL::ComPtr<ID3D11Buffer> constantBuffer;
+		unsigned int constantBufferSlot = 0;
+	};
+
+	Bindings bindings;
+
+	void BakeBindings(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void BakeTextureBindings();
+};
@@ -0,0 +1,27 @@
+#include "MatrixBatch.h"
+
+using namespace DirectX;
+
+void MatrixBatch::Multiply(const XMFLOAT4X4* matrices, size_t count, const XMFLOAT4X4& shared, XMFLOAT4X4* results)
+{
+	XMMATRIX b = XMLoadFloat4x4(&shared);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		XMMATRIX a = XMLoadFloat4x4(&matrices[i]);
+
+		// Each row of the result mixes the shared matrix's rows
+		// by one row of the other
+		XMMATRIX result;
+		for (int row = 0; row < 4; row++)
+		{
+			XMVECTOR r = XMVectorMultiply(XMVectorSplatX(a.r[row]), b.r[0]);
+			r = XMVectorMultiplyAdd(XMVectorSplatY(a.r[row]), b.r[1], r);
+			r = XMVectorMultiplyAdd(XMVectorSplatZ(a.r[row]), b.r[2], r);
+			r = XMVectorMultiplyAdd(XMVectorSplatW(a.r[row]), b.r[3], r);
+			result.r[row] = r;
+		}
+
+		XMStoreFloat4x4(&results[i], result);
+	}
+}
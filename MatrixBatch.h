@@ -0,0 +1,19 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+// --------------------------------------------------------
+// Multiplies a batch of matrices by the same matrix, such as
+// every visible entity's world matrix by the camera's view
+// and projection, so vertex shaders get one finished matrix
+// per draw instead of building it for every vertex.
+//
+// The shared matrix stays in SIMD registers for the whole
+// batch, and each row of a result is four multiply-adds.
+// --------------------------------------------------------
+class MatrixBatch
+{
+public:
+	// results[i] = matrices[i] * shared (row vectors, as in DirectXMath)
+	static void Multiply(const DirectX::XMFLOAT4X4* matrices, size_t count, const DirectX::XMFLOAT4X4& shared, DirectX::XMFLOAT4X4* results);
+};
@@ -2,6 +2,7 @@
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <d3d11.h>
 #include "Vertex.h"
+#include "StateCache.h"
 #include <fstream>
 #include <vector>
 
@@ -10,16 +11,21 @@ using namespace DirectX;
 Mesh::Mesh() 
 {
 	indexCount = 0;
+	boundsCenter = XMFLOAT3(0, 0, 0);
+	boundsRadius = 0;
+	uvDensity = 0;
 };
 
 Mesh::Mesh(Vertex vertices[], unsigned int vertexNum, unsigned int indices[], unsigned int indexNum, Microsoft::WRL::ComPtr<ID3D11Device> device)
 {
 	indexCount = indexNum;
 	CalculateTangents(&vertices[0], vertexNum, &indices[0], indexCount);
+	CalculateBounds(&vertices[0], vertexNum, &indices[0], indexCount);
 	CreateBuffers(&vertices[0], vertexNum, &indices[0], device);
 };
 
-Mesh::Mesh(const wchar_t* filename, Microsoft::WRL::ComPtr<ID3D11Device> device) : indexCount(0)
+Mesh::Mesh(const wchar_t* filename, Microsoft::WRL::ComPtr<ID3D11Device> device)
+	: indexCount(0), boundsCenter(0, 0, 0), boundsRadius(0), uvDensity(0)
 {
 	// Author: Chris Cascioli
 	// Purpose: Basic .OBJ 3D model loading, supporting positions, uvs and normals
@@ -232,14 +238,26 @@ Mesh::Mesh(const wchar_t* filename, Microsoft::WRL::ComPtr<ID3D11Device> device)
 	//    sophisticated model loading library like TinyOBJLoader or The Open Asset Importer Library
 
 	CalculateTangents(&verts[0], vertCounter, &indices[0], indexCount);
+	CalculateBounds(&verts[0], vertCounter, &indices[0], indexCount);
 	CreateBuffers(&verts[0], vertCounter, &indices[0], device);
 }
 
 void Mesh::CreateBuffers(Vertex* vertices, int vertexNum, unsigned int* indices, Microsoft::WRL::ComPtr<ID3D11Device> device)
 {
-	// Create a VERTEX BUFFER
-	// - This holds the vertex data of triangles for a single object
-	// - This buffer is created on the GPU, which is where the data needs to
+	// Split the vertices into their two streams
+	std::vector<XMFLOAT3> positions(vertexNum);
+	std::vector<VertexAttributes> attributes(vertexNum);
+	for (int i = 0; i < vertexNum; i++)
+	{
+		positions[i] = vertices[i].Position;
+		attributes[i].Normal = vertices[i].Normal;
+		attributes[i].UV = vertices[i].UV;
+		attributes[i].Tangent = vertices[i].Tangent;
+	}
+
+	// Create the VERTEX BUFFERS
+	// - These hold the vertex data of triangles for a single object
+	// - They're created on the GPU, which is where the data needs to
 	//    be if we want the GPU to act on it (as in: draw it to the screen)
 	{
 		// First, we need to describe the buffer we want Direct3D to make on the GPU
@@ -247,7 +265,7 @@ void Mesh::CreateBuffers(Vertex* vertices, int vertexNum, unsigned int* indices,
 		//  - After the buffer is created, this description variable is unnecessary
 		D3D11_BUFFER_DESC vbd = {};
 		vbd.Usage = D3D11_USAGE_IMMUTABLE;			 // Will NEVER change
-		vbd.ByteWidth = sizeof(Vertex) * vertexNum; // Number of vertices in the buffer
+		vbd.ByteWidth = sizeof(XMFLOAT3) * vertexNum; // Number of vertices in the buffer
 		vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;    // Tells Direct3D this is a vertex buffer
 		vbd.CPUAccessFlags = 0;						 // Note: We cannot access the data from C++ (this is good)
 		vbd.MiscFlags = 0;
@@ -257,11 +275,16 @@ void Mesh::CreateBuffers(Vertex* vertices, int vertexNum, unsigned int* indices,
 		// - This is how we initially fill the buffer with data
 		// - Essentially, we're specifying a pointer to the data to copy
 		D3D11_SUBRESOURCE_DATA initialVertexData = {};
-		initialVertexData.pSysMem = vertices;
+		initialVertexData.pSysMem = positions.data();
 
 		// Actually create the buffer on the GPU with the initial data
 		// - Once we do this, we'll NEVER CHANGE DATA IN THE BUFFER AGAIN
-		device->CreateBuffer(&vbd, &initialVertexData, vertexBuffer.GetAddressOf());
+		device->CreateBuffer(&vbd, &initialVertexData, positionBuffer.GetAddressOf());
+
+		// The attributes are the same, but bigger
+		vbd.ByteWidth = sizeof(VertexAttributes) * vertexNum;
+		initialVertexData.pSysMem = attributes.data();
+		device->CreateBuffer(&vbd, &initialVertexData, attributeBuffer.GetAddressOf());
 	}
 
 	// Create an INDEX BUFFER
@@ -293,9 +316,14 @@ void Mesh::CreateBuffers(Vertex* vertices, int vertexNum, unsigned int* indices,
 
 Mesh::~Mesh() {};
 
-Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetVertexBuffer() 
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetPositionBuffer()
 {
-	return vertexBuffer;
+	return positionBuffer;
+};
+
+Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetAttributeBuffer()
+{
+	return attributeBuffer;
 };
 
 Microsoft::WRL::ComPtr<ID3D11Buffer> Mesh::GetIndexBuffer()
@@ -308,14 +336,45 @@ unsigned int Mesh::GetIndexCount()
 	return indexCount;
 };
 
+DirectX::XMFLOAT3 Mesh::GetBoundsCenter()
+{
+	return boundsCenter;
+}
+
+float Mesh::GetBoundsRadius()
+{
+	return boundsRadius;
+}
+
+float Mesh::GetUVDensity()
+{
+	return uvDensity;
+}
+
+// --------------------------------------------------------
+// Shaders reading only POSITION get a layout for just the
+// position stream, so DrawPositionsOnly() can skip the other
+// --------------------------------------------------------
+const InputSlotMap& Mesh::GetInputSlots()
+{
+	static const InputSlotMap slots =
+	{
+		{ "POSITION", PositionSlot },
+		{ "NORMAL", AttributeSlot },
+		{ "TEXCOORD", AttributeSlot },
+		{ "TANGENT", AttributeSlot },
+	};
+	return slots;
+}
+
 void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 {
 	//Load Buffers
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-
-	context->IASetVertexBuffers(0, 1, vertexBuffer.GetAddressOf(), &stride, &offset);
-	context->IASetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	// Entities sharing a mesh skip the rebind thanks to the state cache
+	StateCache& cache = StateCache::GetInstance();
+	cache.SetVertexBuffer(PositionSlot, positionBuffer.Get(), sizeof(XMFLOAT3), 0);
+	cache.SetVertexBuffer(AttributeSlot, attributeBuffer.Get(), sizeof(VertexAttributes), 0);
+	cache.SetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
 
 	// Tell Direct3D to draw
 	//  - Begins the rendering pipeline on the GPU
@@ -329,6 +388,20 @@ void Mesh::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 		0);    // Offset to add to each index when looking up vertices
 }
 
+// --------------------------------------------------------
+// Draws with only the position stream bound, a third of the
+// bytes per vertex.  The attribute slot is left alone -
+// shaders reading just POSITION never fetch from it.
+// --------------------------------------------------------
+void Mesh::DrawPositionsOnly(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	StateCache& cache = StateCache::GetInstance();
+	cache.SetVertexBuffer(PositionSlot, positionBuffer.Get(), sizeof(XMFLOAT3), 0);
+	cache.SetIndexBuffer(indexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+
+	context->DrawIndexed(indexCount, 0, 0);
+}
+
 // --------------------------------------------------------
 // Calculates the tangents of the vertices in a mesh
 // - Code originally adapted from: http://www.terathon.com/code/tangent.html
@@ -398,4 +471,52 @@ void Mesh::CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices,
 		// Store the tangent
 		XMStoreFloat3(&verts[i].Tangent, tangent);
 	}
-}
\ No newline at end of file
+}
+
+// --------------------------------------------------------
+// Finds a sphere around the vertices (centered on their box),
+// and how densely the texture coordinates are spread over the
+// surface, which texture streaming uses to pick a mip
+// --------------------------------------------------------
+void Mesh::CalculateBounds(Vertex* verts, int numVerts, unsigned int* indices, int numIndices)
+{
+	if (numVerts <= 0)
+		return;
+
+	XMVECTOR minCorner = XMLoadFloat3(&verts[0].Position);
+	XMVECTOR maxCorner = minCorner;
+	for (int i = 1; i < numVerts; i++)
+	{
+		XMVECTOR position = XMLoadFloat3(&verts[i].Position);
+		minCorner = XMVectorMin(minCorner, position);
+		maxCorner = XMVectorMax(maxCorner, position);
+	}
+
+	XMVECTOR center = XMVectorScale(XMVectorAdd(minCorner, maxCorner), 0.5f);
+	XMVECTOR radius = XMVectorZero();
+	for (int i = 0; i < numVerts; i++)
+		radius = XMVectorMax(radius, XMVector3Length(XMVectorSubtract(XMLoadFloat3(&verts[i].Position), center)));
+
+	XMStoreFloat3(&boundsCenter, center);
+	boundsRadius = XMVectorGetX(radius);
+
+	// Ratio of total UV area to total surface area, as a length
+	float worldArea = 0;
+	float uvArea = 0;
+	for (int i = 0; i + 2 < numIndices; i += 3)
+	{
+		Vertex& v0 = verts[indices[i]];
+		Vertex& v1 = verts[indices[i + 1]];
+		Vertex& v2 = verts[indices[i + 2]];
+
+		XMVECTOR edge1 = XMVectorSubtract(XMLoadFloat3(&v1.Position), XMLoadFloat3(&v0.Position));
+		XMVECTOR edge2 = XMVectorSubtract(XMLoadFloat3(&v2.Position), XMLoadFloat3(&v0.Position));
+		worldArea += 0.5f * XMVectorGetX(XMVector3Length(XMVector3Cross(edge1, edge2)));
+
+		float u1 = v1.UV.x - v0.UV.x, w1 = v1.UV.y - v0.UV.y;
+		float u2 = v2.UV.x - v0.UV.x, w2 = v2.UV.y - v0.UV.y;
+		uvArea += 0.5f * fabsf(u1 * w2 - u2 * w1);
+	}
+
+	uvDensity = worldArea > 0 ? sqrtf(uvArea / worldArea) : 0;
+}
@@ -2,25 +2,52 @@
 #include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
 #include <d3d11.h>
 #include "Vertex.h"
+#include "SimpleShader.h"
 
 class Mesh
 {
 private:
-	Microsoft::WRL::ComPtr<ID3D11Buffer> vertexBuffer;
+	// Two vertex streams: positions in PositionSlot, and the
+	// rest of each Vertex in AttributeSlot
+	Microsoft::WRL::ComPtr<ID3D11Buffer> positionBuffer;
+	Microsoft::WRL::ComPtr<ID3D11Buffer> attributeBuffer;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> indexBuffer;
 	unsigned int indexCount;
 
+	// Bounding sphere in the mesh's own space
+	DirectX::XMFLOAT3 boundsCenter;
+	float boundsRadius;
+
+	// Texture coordinates per unit of surface, averaged over every triangle
+	float uvDensity;
+
 	void CreateBuffers(Vertex* vertices, int vertexNum, unsigned int* indices, Microsoft::WRL::ComPtr<ID3D11Device> device);
 public:
+	static const unsigned int PositionSlot = 0;
+	static const unsigned int AttributeSlot = 1;
+
+	// Where each Vertex semantic lives, for creating the vertex
+	// shaders that draw meshes
+	static const InputSlotMap& GetInputSlots();
+
 	Mesh();
 	Mesh(const wchar_t* filename, Microsoft::WRL::ComPtr<ID3D11Device> device);
 	Mesh(Vertex vertices[], unsigned int vertexNum, unsigned int indices[], unsigned int indexNum, Microsoft::WRL::ComPtr<ID3D11Device> device);
 	~Mesh();
 	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
-	Microsoft::WRL::ComPtr<ID3D11Buffer> GetVertexBuffer();
+	// Binds only the position stream, for shaders whose input is
+	// just a POSITION (depth and shadow passes)
+	void DrawPositionsOnly(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetPositionBuffer();
+	Microsoft::WRL::ComPtr<ID3D11Buffer> GetAttributeBuffer();
 	Microsoft::WRL::ComPtr<ID3D11Buffer> GetIndexBuffer();
 	void CalculateTangents(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
+	void CalculateBounds(Vertex* verts, int numVerts, unsigned int* indices, int numIndices);
 	unsigned int GetIndexCount();
+	DirectX::XMFLOAT3 GetBoundsCenter();
+	float GetBoundsRadius();
+	float GetUVDensity();
 };
 
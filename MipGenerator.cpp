@@ -0,0 +1,462 @@
+#include "MipGenerator.h"
+
+#include <cmath>
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define MIPS_SSE2 1
+#include <emmintrin.h>
+#else
+#define MIPS_SSE2 0
+#endif
+
+namespace
+{
+	// A level while it's being filtered: RGBA floats, four per pixel
+	struct FloatImage
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		std::vector<float> pixels;
+	};
+
+	// One RGBA pixel, in a single register where possible
+#if MIPS_SSE2
+	typedef __m128 Pixel;
+	Pixel LoadPixel(const float* p) { return _mm_loadu_ps(p); }
+	void StorePixel(float* p, Pixel v) { _mm_storeu_ps(p, v); }
+	Pixel Splat(float value) { return _mm_set1_ps(value); }
+	Pixel Add(Pixel a, Pixel b) { return _mm_add_ps(a, b); }
+	Pixel Mul(Pixel a, Pixel b) { return _mm_mul_ps(a, b); }
+#else
+	struct Pixel { float c[4]; };
+	Pixel LoadPixel(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+	void StorePixel(float* p, Pixel v) { for (int i = 0; i < 4; i++) p[i] = v.c[i]; }
+	Pixel Splat(float value) { return { { value, value, value, value } }; }
+	Pixel Add(Pixel a, Pixel b) { for (int i = 0; i < 4; i++) a.c[i] += b.c[i]; return a; }
+	Pixel Mul(Pixel a, Pixel b) { for (int i = 0; i < 4; i++) a.c[i] *= b.c[i]; return a; }
+#endif
+
+	// Enough rows per job to be worth the overhead
+	const unsigned int RowsPerJob = 16;
+
+	// Normal variance below this is treated as none (about 17/255
+	// roughness once widened, so real bumps are still caught)
+	const float ToksvigMinVariance = 1e-5f;
+
+	template<typename Body>
+	void ForEachRowBand(JobSystem& jobs, unsigned int rows, const Body& body)
+	{
+		jobs.ParallelFor((rows + RowsPerJob - 1) / RowsPerJob, [&](size_t band)
+		{
+			unsigned int begin = (unsigned int)band * RowsPerJob;
+			unsigned int end = begin + RowsPerJob < rows ? begin + RowsPerJob : rows;
+			for (unsigned int y = begin; y < end; y++)
+				body(y);
+		});
+	}
+
+	float EncodeSRGB(float linear)
+	{
+		return linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+	}
+
+	float DecodeSRGB(float encoded)
+	{
+		return encoded <= 0.04045f ? encoded / 12.92f : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+	}
+
+	// --------------------------------------------------------
+	// Lookup tables for both directions.  Encoding is indexed by
+	// the square root of the linear value, which spreads the
+	// entries out where sRGB changes fastest (near black); every
+	// entry is then within a tenth of a step of the exact curve.
+	// --------------------------------------------------------
+	struct SRGBTables
+	{
+		static const int EncodeSize = 4096;
+
+		float toLinear[256];
+		unsigned char fromLinear[EncodeSize];
+
+		SRGBTables()
+		{
+			for (int i = 0; i < 256; i++)
+				toLinear[i] = DecodeSRGB(i / 255.0f);
+
+			for (int i = 0; i < EncodeSize; i++)
+			{
+				float root = i / (float)(EncodeSize - 1);
+				fromLinear[i] = (unsigned char)(EncodeSRGB(root * root) * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const SRGBTables& GetSRGBTables()
+	{
+		static SRGBTables tables;
+		return tables;
+	}
+
+	// --------------------------------------------------------
+	// Taps for halving a level.  Destination pixel x covers
+	// source pixels 2x and 2x+1, and reads source pixels from
+	// 2x + first onwards.
+	// --------------------------------------------------------
+	struct Kernel
+	{
+		int first;
+		std::vector<float> weights;
+	};
+
+	double BesselI0(double x)
+	{
+		double sum = 1;
+		double term = 1;
+		for (int k = 1; term > sum * 1e-12; k++)
+		{
+			double half = x / (2 * k);
+			term *= half * half;
+			sum += term;
+		}
+		return sum;
+	}
+
+	Kernel MakeKernel(MipFilter filter)
+	{
+		Kernel kernel;
+		if (filter == MipFilter::Box)
+		{
+			kernel.first = 0;
+			kernel.weights = { 0.5f, 0.5f };
+			return kernel;
+		}
+
+		// Same defaults as NVTT: three destination pixels either side
+		const int width = 3;
+		const double alpha = 4;
+		const double pi = 3.14159265358979323846;
+
+		kernel.first = 1 - 2 * width;
+		double total = 0;
+		std::vector<double> weights;
+		for (int offset = kernel.first; offset <= 2 * width; offset++)
+		{
+			// From the destination pixel's center, in destination pixels
+			double d = (offset - 0.5) / 2;
+			double sinc = std::sin(pi * d) / (pi * d);
+			double t = d / width;
+			double window = BesselI0(alpha * std::sqrt(1 - t * t)) / BesselI0(alpha);
+
+			weights.push_back(sinc * window);
+			total += weights.back();
+		}
+
+		for (double weight : weights)
+			kernel.weights.push_back((float)(weight / total));
+
+		return kernel;
+	}
+
+	const Kernel& GetKernel(MipFilter filter)
+	{
+		static const Kernel box = MakeKernel(MipFilter::Box);
+		static const Kernel kaiser = MakeKernel(MipFilter::Kaiser);
+		return filter == MipFilter::Box ? box : kaiser;
+	}
+
+	int EdgeIndex(int i, int size, bool wrap)
+	{
+		if (wrap)
+		{
+			i %= size;
+			return i < 0 ? i + size : i;
+		}
+
+		return i < 0 ? 0 : (i >= size ? size - 1 : i);
+	}
+
+	// --------------------------------------------------------
+	// Halves the image in each dimension that's larger than one
+	// pixel, filtering rows then columns
+	// --------------------------------------------------------
+	void Downsample(JobSystem& jobs, const FloatImage& src, FloatImage& dest, const Kernel& kernel, bool wrap)
+	{
+		int taps = (int)kernel.weights.size();
+
+		FloatImage half;
+		const FloatImage* rows = &src;
+		if (src.width > 1)
+		{
+			half.width = src.width / 2;
+			half.height = src.height;
+			half.pixels.resize((size_t)half.width * half.height * 4);
+
+			// Where each output pixel's taps land, wrapped or clamped
+			std::vector<int> columns((size_t)half.width * taps);
+			for (unsigned int x = 0; x < half.width; x++)
+			{
+				for (int t = 0; t < taps; t++)
+					columns[x * taps + t] = EdgeIndex((int)x * 2 + kernel.first + t, (int)src.width, wrap) * 4;
+			}
+
+			ForEachRowBand(jobs, half.height, [&](unsigned int y)
+			{
+				const float* in = &src.pixels[(size_t)y * src.width * 4];
+				float* out = &half.pixels[(size_t)y * half.width * 4];
+				for (unsigned int x = 0; x < half.width; x++)
+				{
+					const int* column = &columns[x * taps];
+					Pixel sum = Splat(0);
+					for (int t = 0; t < taps; t++)
+						sum = Add(sum, Mul(LoadPixel(in + column[t]), Splat(kernel.weights[t])));
+					StorePixel(out + x * 4, sum);
+				}
+			});
+
+			rows = &half;
+		}
+
+		if (rows->height == 1)
+		{
+			dest = std::move(half);
+			return;
+		}
+
+		dest.width = rows->width;
+		dest.height = rows->height / 2;
+		dest.pixels.resize((size_t)dest.width * dest.height * 4);
+
+		// Whole rows at a time, so every tap streams through memory
+		ForEachRowBand(jobs, dest.height, [&](unsigned int y)
+		{
+			float* out = &dest.pixels[(size_t)y * dest.width * 4];
+			for (int t = 0; t < taps; t++)
+			{
+				int row = EdgeIndex((int)y * 2 + kernel.first + t, (int)rows->height, wrap);
+				const float* in = &rows->pixels[(size_t)row * rows->width * 4];
+				Pixel weight = Splat(kernel.weights[t]);
+
+				for (unsigned int x = 0; x < dest.width; x++)
+				{
+					Pixel sum = t == 0 ? Splat(0) : LoadPixel(out + x * 4);
+					StorePixel(out + x * 4, Add(sum, Mul(LoadPixel(in + x * 4), weight)));
+				}
+			}
+		});
+	}
+
+	void ToFloat(JobSystem& jobs, const Image& image, bool srgb, FloatImage& out)
+	{
+		const float* toLinear = GetSRGBTables().toLinear;
+
+		out.width = image.width;
+		out.height = image.height;
+		out.pixels.resize((size_t)image.width * image.height * 4);
+
+		ForEachRowBand(jobs, image.height, [&](unsigned int y)
+		{
+			size_t start = (size_t)y * image.width * 4;
+			for (size_t i = start; i < start + image.width * 4; i += 4)
+			{
+				for (int ch = 0; ch < 3; ch++)
+					out.pixels[i + ch] = srgb ? toLinear[image.pixels[i + ch]] : image.pixels[i + ch] / 255.0f;
+				out.pixels[i + 3] = image.pixels[i + 3] / 255.0f;
+			}
+		});
+	}
+
+	// Back to 8 bits, leaving the float copy untouched for the next level
+	void ToImage(JobSystem& jobs, const FloatImage& level, const MipSettings& settings, Image& out)
+	{
+		const unsigned char* fromLinear = GetSRGBTables().fromLinear;
+
+		out.width = level.width;
+		out.height = level.height;
+		out.pixels.resize((size_t)level.width * level.height * 4);
+
+		ForEachRowBand(jobs, level.height, [&](unsigned int y)
+		{
+			const float* in = &level.pixels[(size_t)y * level.width * 4];
+			unsigned char* row = &out.pixels[(size_t)y * level.width * 4];
+			for (unsigned int x = 0; x < level.width; x++)
+			{
+				float pixel[4] = { in[x * 4], in[x * 4 + 1], in[x * 4 + 2], in[x * 4 + 3] };
+
+				if (settings.normalMap)
+				{
+					float n[3] = { pixel[0] * 2 - 1, pixel[1] * 2 - 1, pixel[2] * 2 - 1 };
+					float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					for (int ch = 0; ch < 3; ch++)
+						pixel[ch] = length > 1e-6f ? n[ch] / length * 0.5f + 0.5f : (ch == 2 ? 1.0f : 0.5f);
+				}
+
+#if MIPS_SSE2
+				__m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pixel), _mm_setzero_ps()), _mm_set1_ps(1));
+				__m128i quantized = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, _mm_set1_ps(255)), _mm_set1_ps(0.5f)));
+				quantized = _mm_packs_epi32(quantized, quantized);
+				int packed = _mm_cvtsi128_si32(_mm_packus_epi16(quantized, quantized));
+				for (int ch = 0; ch < 4; ch++)
+					row[x * 4 + ch] = (unsigned char)(packed >> (ch * 8));
+
+				if (settings.srgb)
+				{
+					alignas(16) int index[4];
+					__m128 scaled = _mm_mul_ps(_mm_sqrt_ps(clamped), _mm_set1_ps(SRGBTables::EncodeSize - 1.0f));
+					_mm_store_si128((__m128i*)index, _mm_cvttps_epi32(_mm_add_ps(scaled, _mm_set1_ps(0.5f))));
+					for (int ch = 0; ch < 3; ch++)
+						row[x * 4 + ch] = fromLinear[index[ch]];
+				}
+#else
+				for (int ch = 0; ch < 4; ch++)
+				{
+					float value = pixel[ch] < 0 ? 0 : (pixel[ch] > 1 ? 1 : pixel[ch]);
+					row[x * 4 + ch] = settings.srgb && ch < 3 ?
+						fromLinear[(int)(std::sqrt(value) * (SRGBTables::EncodeSize - 1) + 0.5f)] :
+						(unsigned char)(value * 255 + 0.5f);
+				}
+#endif
+			}
+		});
+	}
+}
+
+MipSettings MipGenerator::SettingsForSemantic(TextureSemantic semantic)
+{
+	MipSettings settings;
+	switch (semantic)
+	{
+	case TextureSemantic::NormalMap:
+		settings.normalMap = true;
+		break;
+
+	// Data, not color, and a sharper filter's ringing would show
+	// up as speckles in the lighting
+	case TextureSemantic::Roughness:
+	case TextureSemantic::Metalness:
+	case TextureSemantic::PackedORM:
+		settings.filter = MipFilter::Box;
+		break;
+
+	default:
+		settings.srgb = true;
+		break;
+	}
+
+	return settings;
+}
+
+void MipGenerator::Generate(JobSystem& jobs, MipChain& chain, const MipSettings& settings)
+{
+	if (chain.levels.empty())
+		return;
+
+	chain.levels.resize(1);
+	const Kernel& kernel = GetKernel(settings.filter);
+
+	FloatImage current;
+	ToFloat(jobs, chain.levels[0], settings.srgb, current);
+
+	while (current.width > 1 || current.height > 1)
+	{
+		FloatImage next;
+		Downsample(jobs, current, next, kernel, settings.wrap);
+
+		chain.levels.push_back(Image());
+		ToImage(jobs, next, settings, chain.levels.back());
+
+		current = std::move(next);
+	}
+}
+
+void MipGenerator::Generate(JobSystem& jobs, const std::vector<MipChain*>& chains, const MipSettings& settings)
+{
+	jobs.ParallelFor(chains.size(), [&](size_t i)
+	{
+		Generate(jobs, *chains[i], settings);
+	});
+}
+
+void MipGenerator::ApplyToksvig(JobSystem& jobs, MipChain& roughness, unsigned int channel, const Image& normalMap)
+{
+	if (roughness.levels.empty() || normalMap.pixels.empty() || channel > 3)
+		return;
+
+	// Box filtered unit normals, left unnormalized: the shorter the
+	// average, the more the normals under it disagree
+	std::vector<FloatImage> normals(1);
+	ToFloat(jobs, normalMap, false, normals[0]);
+	for (size_t i = 0; i < normals[0].pixels.size(); i += 4)
+	{
+		float* n = &normals[0].pixels[i];
+		for (int ch = 0; ch < 3; ch++)
+			n[ch] = n[ch] * 2 - 1;
+
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		for (int ch = 0; ch < 3; ch++)
+			n[ch] = length > 1e-6f ? n[ch] / length : (ch == 2 ? 1.0f : 0.0f);
+	}
+
+	while (normals.back().width > 1 || normals.back().height > 1)
+	{
+		FloatImage next;
+		Downsample(jobs, normals.back(), next, GetKernel(MipFilter::Box), true);
+		normals.push_back(std::move(next));
+	}
+
+	for (Image& level : roughness.levels)
+	{
+		// The largest normal mip that fits in this level
+		const FloatImage* n = &normals.back();
+		for (const FloatImage& candidate : normals)
+		{
+			if (candidate.width <= level.width && candidate.height <= level.height)
+			{
+				n = &candidate;
+				break;
+			}
+		}
+
+		// The full size normals haven't been averaged, so any
+		// variance there is just rounding
+		if (n == &normals[0])
+			continue;
+
+		ForEachRowBand(jobs, level.height, [&](unsigned int y)
+		{
+			unsigned int ny = y * n->height / level.height;
+			for (unsigned int x = 0; x < level.width; x++)
+			{
+				unsigned int nx = x * n->width / level.width;
+				const float* average = &n->pixels[((size_t)ny * n->width + nx) * 4];
+
+				float length = std::sqrt(average[0] * average[0] + average[1] * average[1] + average[2] * average[2]);
+				length = length < 1e-4f ? 1e-4f : (length > 1 ? 1 : length);
+				float variance = (1 - length) / length;
+
+				// Anything this small is float error over flat normals, which
+				// the fourth root below would still turn into visible roughness
+				if (variance < ToksvigMinVariance)
+					continue;
+
+				// Widen the lobe in alpha squared, which the shader uses
+				unsigned char& value = level.pixels[((size_t)y * level.width + x) * 4 + channel];
+				float alpha = (value / 255.0f) * (value / 255.0f);
+				float alpha2 = alpha * alpha + 2 * variance;
+				alpha2 = alpha2 > 1 ? 1 : alpha2;
+				value = (unsigned char)(std::sqrt(std::sqrt(alpha2)) * 255 + 0.5f);
+			}
+		});
+	}
+}
+
+float MipGenerator::SRGBToLinear(unsigned char value)
+{
+	return GetSRGBTables().toLinear[value];
+}
+
+unsigned char MipGenerator::LinearToSRGB(float value)
+{
+	value = value < 0 ? 0 : (value > 1 ? 1 : value);
+	return GetSRGBTables().fromLinear[(int)(std::sqrt(value) * (SRGBTables::EncodeSize - 1) + 0.5f)];
+}
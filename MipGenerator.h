@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "Image.h"
+#include "JobSystem.h"
+#include "TextureCooker.h"
+
+enum class MipFilter
+{
+	Box,		// 2x2 average, cheap and soft
+	Kaiser		// Kaiser windowed sinc, keeps detail without aliasing
+};
+
+// --------------------------------------------------------
+// How a texture's mips should be filtered
+// --------------------------------------------------------
+struct MipSettings
+{
+	MipFilter filter = MipFilter::Kaiser;
+	bool srgb = false;			// Color is gamma encoded, so filter it in linear space
+	bool normalMap = false;		// Renormalize each mip's normals (stored as xyz * 0.5 + 0.5)
+	bool wrap = true;			// Filter across the edges of tiling textures, rather than clamping
+};
+
+// --------------------------------------------------------
+// Builds mip chains on the CPU, so they can be cooked along
+// with the top level.
+//
+// Every level is filtered from a floating point copy of the
+// one above it, so rounding doesn't build up down the chain.
+// Each pixel is one SSE register, and the rows of each level
+// are spread across the job system, as are whole images.
+//
+// Portable, like the rest of the import pipeline.
+// --------------------------------------------------------
+class MipGenerator
+{
+public:
+	static MipSettings SettingsForSemantic(TextureSemantic semantic);
+
+	// Replaces everything below the top level with mips down to 1x1
+	static void Generate(JobSystem& jobs, MipChain& chain, const MipSettings& settings);
+	static void Generate(JobSystem& jobs, const std::vector<MipChain*>& chains, const MipSettings& settings);
+
+	// Toksvig-style specular anti-aliasing: where a mip averages
+	// normals that point different ways, widens the roughness in
+	// the given channel to match, so highlights fade out instead
+	// of sparkling in the distance.  Roughness is perceptual (the
+	// shader squares it), and the normal map needn't be the same
+	// size as the roughness map.
+	static void ApplyToksvig(JobSystem& jobs, MipChain& roughness, unsigned int channel, const Image& normalMap);
+
+	static float SRGBToLinear(unsigned char value);
+	static unsigned char LinearToSRGB(float value);
+};
@@ -1,18 +1,35 @@
 #include "Lighting.hlsli"
 
+// Permutation defines (see ShaderPermutation.h) - the
+// defaults build the full-featured shader
+#ifndef NORMAL_MAP
+#define NORMAL_MAP 1
+#endif
+#ifndef PBR_TEXTURES
+#define PBR_TEXTURES 1 // Otherwise roughness & metalness are constants
+#endif
+#ifndef PACKED_ORM
+#define PACKED_ORM 0 // Roughness & metalness in the green & blue of one texture
+#endif
+
 cbuffer ConstantBuffer : register(b0)
 {
     float4 surfaceColor;
+    float roughness;
+    float metalness;
 }
 
 Texture2D Albedo : register(t0);
 Texture2D NormalMap : register(t1);
+#if PACKED_ORM
+Texture2D ORMMap : register(t2);
+#else
 Texture2D RoughnessMap : register(t2);
 Texture2D MetalnessMap : register(t3);
+#endif
 SamplerState BasicSampler : register(s0);
 
-Texture2D ShadowMap : register(t4);
-SamplerComparisonState ShadowSampler : register(s1);
+Texture2DArray ShadowMap : register(t4); // One slice per cascade (ShadowSampler is in Lighting.hlsli)
 // --------------------------------------------------------
 // The entry point (main method) for our pixel shader
 // 
@@ -24,29 +41,57 @@ SamplerComparisonState ShadowSampler : register(s1);
 // --------------------------------------------------------
 float4 main(VertexToPixel input) : SV_TARGET
 {    
-    // Perform the perspective divide (divide by W) ourselves
-    input.shadowMapPos /= input.shadowMapPos.w;
+#if SHADOWS
+    // Use the first cascade that reaches past this pixel
+    float viewDepth = mul(view, float4(input.worldPosition, 1)).z;
+    uint cascade = 0;
+    [unroll]
+    for (uint c = 0; c < MAX_SHADOW_CASCADES - 1; c++)
+    {
+        if ((int)c < shadowCascadeCount - 1 && viewDepth > shadowCascadeSplits[c])
+            cascade = c + 1;
+    }
+
+    // Orthographic, so there's no need to divide by W
+    float4 shadowMapPos = mul(shadowViewProjections[cascade], float4(input.worldPosition, 1));
     // Convert the normalized device coordinates to UVs for sampling
-    float2 shadowUV = input.shadowMapPos.xy * 0.5f + 0.5f;
+    float2 shadowUV = shadowMapPos.xy * 0.5f + 0.5f;
     shadowUV.y = 1 - shadowUV.y; // Flip the Y
     // Grab the distances we need: light-to-pixel and closest-surface
-    float distToLight = input.shadowMapPos.z;
+    float distToLight = shadowMapPos.z;
     // Get a ratio of comparison results using SampleCmpLevelZero()
-    float shadowAmount = ShadowMap.SampleCmpLevelZero(ShadowSampler, shadowUV, distToLight).r;
+    float shadowAmount = ShadowMap.SampleCmpLevelZero(ShadowSampler, float3(shadowUV, cascade), distToLight).r;
+#else
+    float shadowAmount = 1.0f;
+#endif
 
-    float3 unpackedNormal = normalize(NormalMap.Sample(BasicSampler, input.uv).rgb * 2 - 1);
-    
     float3 albedoColor = pow(Albedo.Sample(BasicSampler, input.uv).rgb, 2.2f);
-    float roughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
-    float metalness = MetalnessMap.Sample(BasicSampler, input.uv).r;
-    float3 specularColor = lerp(F0_NON_METAL, albedoColor.rgb, metalness);
+#if PBR_TEXTURES && PACKED_ORM
+    // Occlusion is in red, but there's no ambient term to apply it to
+    float2 roughnessMetalness = ORMMap.Sample(BasicSampler, input.uv).gb;
+    float surfaceRoughness = roughnessMetalness.x;
+    float surfaceMetalness = roughnessMetalness.y;
+#elif PBR_TEXTURES
+    float surfaceRoughness = RoughnessMap.Sample(BasicSampler, input.uv).r;
+    float surfaceMetalness = MetalnessMap.Sample(BasicSampler, input.uv).r;
+#else
+    float surfaceRoughness = roughness;
+    float surfaceMetalness = metalness;
+#endif
+    float3 specularColor = lerp(F0_NON_METAL, albedoColor.rgb, surfaceMetalness);
     
     input.normal = normalize(input.normal);
+#if NORMAL_MAP
+    // Normal maps are cooked to BC5, which only keeps x and y, so
+    // rebuild z (always positive in tangent space) from them
+    float2 normalXY = NormalMap.Sample(BasicSampler, input.uv).rg * 2 - 1;
+    float3 unpackedNormal = float3(normalXY, sqrt(saturate(1 - dot(normalXY, normalXY))));
     float3 T = normalize(input.tangent); // Must be normalized here or before
     T = normalize(T - input.normal * dot(T, input.normal)); // Gram-Schmidt assumes T&N are normalized!
     input.normal = mul(unpackedNormal, float3x3(T, cross(T, input.normal), input.normal)); // Note multiplication order!
+#endif
         
-    float3 totalLight = CalcLights(input, surfaceColor.xyz,specularColor,roughness,metalness, shadowAmount);
+    float3 totalLight = CalcLights(input, surfaceColor.xyz, specularColor, surfaceRoughness, surfaceMetalness, shadowAmount);
  
     return float4(pow(surfaceColor.xyz * albedoColor * totalLight, 1.0f / 2.2f), 1);
-}
\ No newline at end of file
+}
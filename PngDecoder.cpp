@@ -0,0 +1,815 @@
+#include "PngDecoder.h"
+
+#include <cstdint>
+#include <cstring>
+
+// --------------------------------------------------------
+// Inflate (RFC 1951) and the zlib wrapper around it (RFC 1950).
+//
+// Huffman codes are decoded with a lookup table indexed by the
+// next FastBits bits of input, which covers nearly every symbol
+// in practice; longer codes fall back to a canonical search.
+// --------------------------------------------------------
+namespace
+{
+	const int FastBits = 10;
+	const int MaxCodeLength = 15;
+
+	const uint16_t LengthBase[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t LengthExtra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t DistanceBase[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t DistanceExtra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	// Order the code length code lengths are stored in
+	const uint8_t CodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	unsigned int ReverseBits(unsigned int code, int length)
+	{
+		unsigned int reversed = 0;
+		for (int i = 0; i < length; i++)
+		{
+			reversed = (reversed << 1) | (code & 1);
+			code >>= 1;
+		}
+
+		return reversed;
+	}
+
+	class Huffman
+	{
+	public:
+		// Fast table entries are (length << 9) | symbol, zero if the
+		// code is longer than FastBits
+		uint16_t fast[1 << FastBits];
+
+		// Canonical code data for the slow path.  Codes are compared
+		// MSB first, left aligned to 16 bits.
+		uint32_t maxCode[MaxCodeLength + 2];
+		uint16_t firstCode[MaxCodeLength + 1];
+		uint16_t firstSymbol[MaxCodeLength + 1];
+		uint8_t symbolLength[288];
+		uint16_t symbolValue[288];
+
+		bool Build(const uint8_t* lengths, int count)
+		{
+			int lengthCounts[MaxCodeLength + 1] = {};
+			for (int i = 0; i < count; i++)
+				lengthCounts[lengths[i]]++;
+			lengthCounts[0] = 0;
+
+			memset(fast, 0, sizeof(fast));
+
+			int nextCode[MaxCodeLength + 1] = {};
+			int code = 0;
+			int symbol = 0;
+			for (int len = 1; len <= MaxCodeLength; len++)
+			{
+				nextCode[len] = code;
+				firstCode[len] = (uint16_t)code;
+				firstSymbol[len] = (uint16_t)symbol;
+				code += lengthCounts[len];
+
+				// Over-subscribed code
+				if (lengthCounts[len] && code - 1 >= (1 << len))
+					return false;
+
+				maxCode[len] = (uint32_t)code << (16 - len);
+				code <<= 1;
+				symbol += lengthCounts[len];
+			}
+			maxCode[MaxCodeLength + 1] = 0x10000;
+
+			for (int i = 0; i < count; i++)
+			{
+				int len = lengths[i];
+				if (len == 0)
+					continue;
+
+				int index = nextCode[len] - firstCode[len] + firstSymbol[len];
+				symbolLength[index] = (uint8_t)len;
+				symbolValue[index] = (uint16_t)i;
+
+				if (len <= FastBits)
+				{
+					unsigned int reversed = ReverseBits(nextCode[len], len);
+					for (unsigned int j = reversed; j < (1u << FastBits); j += (1u << len))
+						fast[j] = (uint16_t)((len << 9) | i);
+				}
+
+				nextCode[len]++;
+			}
+
+			return true;
+		}
+	};
+
+	class Inflater
+	{
+	public:
+		Inflater(const unsigned char* data, size_t size, std::vector<unsigned char>& out, size_t expectedSize)
+			: data(data), size(size), pos(0), bitBuffer(0), bitCount(0), out(out), outPos(0), expectedSize(expectedSize) { }
+
+		bool Run()
+		{
+			out.resize(expectedSize);
+
+			bool finalBlock = false;
+			while (!finalBlock)
+			{
+				finalBlock = ReadBits(1) != 0;
+				unsigned int type = ReadBits(2);
+
+				bool ok = false;
+				if (type == 0) ok = StoredBlock();
+				else if (type == 1) ok = FixedBlock();
+				else if (type == 2) ok = DynamicBlock();
+
+				if (!ok || Overrun())
+					return false;
+			}
+
+			return outPos == expectedSize;
+		}
+
+	private:
+		const unsigned char* data;
+		size_t size;
+		size_t pos;
+		uint64_t bitBuffer;
+		int bitCount;
+
+		// Sized up front, since we know exactly how much is coming
+		std::vector<unsigned char>& out;
+		size_t outPos;
+		size_t expectedSize;
+
+		Huffman literals;
+		Huffman distances;
+
+		// Past the end of the input, zeros are shifted in so the hot
+		// loop needs no bounds checks; Overrun() catches it afterwards
+		void Refill()
+		{
+			while (bitCount <= 56)
+			{
+				uint64_t byte = pos < size ? data[pos] : 0;
+				pos++;
+				bitBuffer |= byte << bitCount;
+				bitCount += 8;
+			}
+		}
+
+		bool Overrun() const
+		{
+			// Bytes that were pulled into the bit buffer but not used
+			// don't count as reading past the end
+			return pos - bitCount / 8 > size;
+		}
+
+		unsigned int ReadBits(int count)
+		{
+			if (bitCount < count)
+				Refill();
+
+			unsigned int value = (unsigned int)(bitBuffer & ((1ull << count) - 1));
+			bitBuffer >>= count;
+			bitCount -= count;
+			return value;
+		}
+
+		int Decode(const Huffman& huffman)
+		{
+			if (bitCount < 16)
+				Refill();
+
+			uint16_t entry = huffman.fast[bitBuffer & ((1 << FastBits) - 1)];
+			if (entry)
+			{
+				int length = entry >> 9;
+				bitBuffer >>= length;
+				bitCount -= length;
+				return entry & 511;
+			}
+
+			// Longer code, so compare MSB first against each length's range
+			unsigned int code = ReverseBits((unsigned int)(bitBuffer & 0xFFFF), 16);
+			int length;
+			for (length = FastBits + 1; length <= MaxCodeLength; length++)
+			{
+				if (code < huffman.maxCode[length])
+					break;
+			}
+
+			if (length > MaxCodeLength)
+				return -1;
+
+			int index = (code >> (16 - length)) - huffman.firstCode[length] + huffman.firstSymbol[length];
+			if (index < 0 || index >= 288 || huffman.symbolLength[index] != length)
+				return -1;
+
+			bitBuffer >>= length;
+			bitCount -= length;
+			return huffman.symbolValue[index];
+		}
+
+		bool StoredBlock()
+		{
+			// Stored data starts on a byte boundary
+			ReadBits(bitCount & 7);
+
+			unsigned int length = ReadBits(16);
+			unsigned int complement = ReadBits(16);
+			if ((length ^ 0xFFFF) != complement)
+				return false;
+
+			// Drain whatever is still in the bit buffer first
+			while (length > 0 && bitCount >= 8)
+			{
+				if (outPos >= expectedSize)
+					return false;
+
+				out[outPos++] = (unsigned char)ReadBits(8);
+				length--;
+			}
+
+			// Refill() may have read ahead, so rewind to the real position
+			pos -= bitCount / 8;
+			bitBuffer = 0;
+			bitCount = 0;
+
+			if (pos > size || length > size - pos || length > expectedSize - outPos)
+				return false;
+
+			memcpy(out.data() + outPos, data + pos, length);
+			outPos += length;
+			pos += length;
+			return true;
+		}
+
+		bool FixedBlock()
+		{
+			uint8_t lengths[288 + 30];
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			memset(lengths + 288, 5, 30);
+
+			if (!literals.Build(lengths, 288) || !distances.Build(lengths + 288, 30))
+				return false;
+
+			return DecodeSymbols();
+		}
+
+		bool DynamicBlock()
+		{
+			int literalCount = ReadBits(5) + 257;
+			int distanceCount = ReadBits(5) + 1;
+			int codeLengthCount = ReadBits(4) + 4;
+
+			uint8_t codeLengthLengths[19] = {};
+			for (int i = 0; i < codeLengthCount; i++)
+				codeLengthLengths[CodeLengthOrder[i]] = (uint8_t)ReadBits(3);
+
+			Huffman codeLengths;
+			if (!codeLengths.Build(codeLengthLengths, 19))
+				return false;
+
+			// Literal and distance code lengths are one run-length coded list
+			uint8_t lengths[288 + 32] = {};
+			int total = literalCount + distanceCount;
+			int count = 0;
+			while (count < total)
+			{
+				int symbol = Decode(codeLengths);
+				if (symbol < 0 || symbol > 18)
+					return false;
+
+				if (symbol < 16)
+				{
+					lengths[count++] = (uint8_t)symbol;
+					continue;
+				}
+
+				int repeat;
+				uint8_t value = 0;
+				if (symbol == 16)
+				{
+					if (count == 0)
+						return false;
+
+					repeat = ReadBits(2) + 3;
+					value = lengths[count - 1];
+				}
+				else if (symbol == 17)
+					repeat = ReadBits(3) + 3;
+				else
+					repeat = ReadBits(7) + 11;
+
+				if (count + repeat > total)
+					return false;
+
+				memset(lengths + count, value, repeat);
+				count += repeat;
+			}
+
+			// Without an end-of-block code the block could never finish
+			if (lengths[256] == 0)
+				return false;
+
+			if (!literals.Build(lengths, literalCount) || !distances.Build(lengths + literalCount, distanceCount))
+				return false;
+
+			return DecodeSymbols();
+		}
+
+		bool DecodeSymbols()
+		{
+			while (true)
+			{
+				int symbol = Decode(literals);
+				if (symbol < 0)
+					return false;
+
+				if (symbol < 256)
+				{
+					if (outPos >= expectedSize)
+						return false;
+
+					out[outPos++] = (unsigned char)symbol;
+					continue;
+				}
+
+				if (symbol == 256)
+					return true;
+
+				symbol -= 257;
+				if (symbol >= 29)
+					return false;
+
+				size_t length = LengthBase[symbol] + ReadBits(LengthExtra[symbol]);
+
+				int distanceSymbol = Decode(distances);
+				if (distanceSymbol < 0 || distanceSymbol >= 30)
+					return false;
+
+				size_t distance = DistanceBase[distanceSymbol] + ReadBits(DistanceExtra[distanceSymbol]);
+				if (distance > outPos || length > expectedSize - outPos)
+					return false;
+
+				// Byte by byte, since the copy may overlap what it's writing
+				unsigned char* dest = out.data() + outPos;
+				const unsigned char* from = dest - distance;
+				for (size_t i = 0; i < length; i++)
+					dest[i] = from[i];
+				outPos += length;
+
+				if (Overrun())
+					return false;
+			}
+		}
+	};
+
+	uint32_t ReadBigEndian(const unsigned char* bytes)
+	{
+		return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+	}
+
+	bool Fail(std::string* error, const char* message)
+	{
+		if (error) *error = message;
+		return false;
+	}
+
+	unsigned char Paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = p > a ? p - a : a - p;
+		int pb = p > b ? p - b : b - p;
+		int pc = p > c ? p - c : c - p;
+		if (pa <= pb && pa <= pc) return (unsigned char)a;
+		if (pb <= pc) return (unsigned char)b;
+		return (unsigned char)c;
+	}
+
+	// --------------------------------------------------------
+	// Everything needed to turn a row of raw samples into RGBA
+	// --------------------------------------------------------
+	struct PngFormat
+	{
+		unsigned int width = 0;
+		unsigned int height = 0;
+		int bitDepth = 0;
+		int colorType = 0;
+		int channels = 0;
+		bool interlaced = false;
+
+		unsigned char palette[256][4];
+		unsigned int paletteSize = 0;
+
+		// tRNS for gray/RGB images: the one color that's fully transparent
+		bool hasColorKey = false;
+		uint16_t colorKey[3] = {};
+
+		size_t RowBytes(unsigned int pixels) const
+		{
+			return ((size_t)pixels * channels * bitDepth + 7) / 8;
+		}
+
+		int FilterStride() const
+		{
+			int bits = channels * bitDepth;
+			return bits < 8 ? 1 : bits / 8;
+		}
+	};
+
+	// Reverses the per-row filter in place; prior is the previous
+	// unfiltered row, or null for the first row
+	bool Unfilter(int filter, unsigned char* row, const unsigned char* prior, size_t length, int stride)
+	{
+		switch (filter)
+		{
+		case 0:
+			break;
+
+		case 1:
+			for (size_t i = stride; i < length; i++)
+				row[i] = (unsigned char)(row[i] + row[i - stride]);
+			break;
+
+		case 2:
+			if (prior)
+			{
+				for (size_t i = 0; i < length; i++)
+					row[i] = (unsigned char)(row[i] + prior[i]);
+			}
+			break;
+
+		case 3:
+			for (size_t i = 0; i < length; i++)
+			{
+				int left = i >= (size_t)stride ? row[i - stride] : 0;
+				int up = prior ? prior[i] : 0;
+				row[i] = (unsigned char)(row[i] + ((left + up) >> 1));
+			}
+			break;
+
+		case 4:
+			for (size_t i = 0; i < length; i++)
+			{
+				int left = i >= (size_t)stride ? row[i - stride] : 0;
+				int up = prior ? prior[i] : 0;
+				int upLeft = prior && i >= (size_t)stride ? prior[i - stride] : 0;
+				row[i] = (unsigned char)(row[i] + Paeth(left, up, upLeft));
+			}
+			break;
+
+		default:
+			return false;
+		}
+
+		return true;
+	}
+
+	// Gets sample number index from a row of packed samples,
+	// at the image's original bit depth
+	unsigned int GetSample(const unsigned char* row, size_t index, int bitDepth)
+	{
+		switch (bitDepth)
+		{
+		case 8: return row[index];
+		case 16: return ((unsigned int)row[index * 2] << 8) | row[index * 2 + 1];
+		default:
+		{
+			size_t bit = index * bitDepth;
+			int shift = 8 - bitDepth - (int)(bit & 7);
+			return (row[bit >> 3] >> shift) & ((1 << bitDepth) - 1);
+		}
+		}
+	}
+
+	// --------------------------------------------------------
+	// Converts one unfiltered row to RGBA, writing pixel x of
+	// the row to dest[x * destStep]
+	// --------------------------------------------------------
+	void ExpandRow(const PngFormat& format, const unsigned char* row, unsigned int pixels, unsigned char* dest, size_t destStep)
+	{
+		// The common cases, with no conversion to speak of
+		if (format.bitDepth == 8 && format.colorType == 6)
+		{
+			for (unsigned int x = 0; x < pixels; x++, row += 4, dest += destStep)
+				memcpy(dest, row, 4);
+			return;
+		}
+
+		if (format.bitDepth == 8 && format.colorType == 2 && !format.hasColorKey)
+		{
+			for (unsigned int x = 0; x < pixels; x++, row += 3, dest += destStep)
+			{
+				dest[0] = row[0];
+				dest[1] = row[1];
+				dest[2] = row[2];
+				dest[3] = 255;
+			}
+			return;
+		}
+
+		int maxValue = (1 << format.bitDepth) - 1;
+		for (unsigned int x = 0; x < pixels; x++, dest += destStep)
+		{
+			size_t first = (size_t)x * format.channels;
+			unsigned int s[4] = {};
+			for (int c = 0; c < format.channels; c++)
+				s[c] = GetSample(row, first + c, format.bitDepth);
+
+			// Scale to 8 bits: 16-bit keeps the high byte, low
+			// bit depths stretch to cover 0-255
+			auto to8 = [&](unsigned int v) -> unsigned char
+			{
+				if (format.bitDepth == 16) return (unsigned char)(v >> 8);
+				if (format.bitDepth == 8) return (unsigned char)v;
+				return (unsigned char)(v * 255 / maxValue);
+			};
+
+			switch (format.colorType)
+			{
+			case 0: // Gray
+				dest[0] = dest[1] = dest[2] = to8(s[0]);
+				dest[3] = format.hasColorKey && s[0] == format.colorKey[0] ? 0 : 255;
+				break;
+
+			case 2: // RGB
+				dest[0] = to8(s[0]);
+				dest[1] = to8(s[1]);
+				dest[2] = to8(s[2]);
+				dest[3] = format.hasColorKey &&
+					s[0] == format.colorKey[0] &&
+					s[1] == format.colorKey[1] &&
+					s[2] == format.colorKey[2] ? 0 : 255;
+				break;
+
+			case 3: // Palette (out of range indices are black)
+				if (s[0] < format.paletteSize)
+					memcpy(dest, format.palette[s[0]], 4);
+				else
+				{
+					dest[0] = dest[1] = dest[2] = 0;
+					dest[3] = 255;
+				}
+				break;
+
+			case 4: // Gray + alpha
+				dest[0] = dest[1] = dest[2] = to8(s[0]);
+				dest[3] = to8(s[1]);
+				break;
+
+			case 6: // RGBA
+				dest[0] = to8(s[0]);
+				dest[1] = to8(s[1]);
+				dest[2] = to8(s[2]);
+				dest[3] = to8(s[3]);
+				break;
+			}
+		}
+	}
+
+	// --------------------------------------------------------
+	// Unfilters and expands one (sub)image: either the whole
+	// picture, or one Adam7 pass that lands on every stepX'th
+	// pixel of every stepY'th row starting at (startX, startY)
+	// --------------------------------------------------------
+	bool DecodePass(
+		const PngFormat& format,
+		unsigned char*& src,
+		unsigned int passWidth, unsigned int passHeight,
+		unsigned int startX, unsigned int startY,
+		unsigned int stepX, unsigned int stepY,
+		Image& image)
+	{
+		size_t rowBytes = format.RowBytes(passWidth);
+		int stride = format.FilterStride();
+		unsigned char* prior = 0;
+
+		for (unsigned int y = 0; y < passHeight; y++)
+		{
+			int filter = *src;
+			unsigned char* row = src + 1;
+			if (!Unfilter(filter, row, prior, rowBytes, stride))
+				return false;
+
+			unsigned char* dest = &image.pixels[(((size_t)(startY + y * stepY) * image.width) + startX) * 4];
+			ExpandRow(format, row, passWidth, dest, (size_t)stepX * 4);
+
+			prior = row;
+			src += rowBytes + 1;
+		}
+
+		return true;
+	}
+
+	const unsigned char Signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+	// Starting position and spacing of each Adam7 pass
+	const unsigned int Adam7StartX[7] = { 0, 4, 0, 2, 0, 1, 0 };
+	const unsigned int Adam7StartY[7] = { 0, 0, 4, 0, 2, 0, 1 };
+	const unsigned int Adam7StepX[7] = { 8, 8, 4, 4, 2, 2, 1 };
+	const unsigned int Adam7StepY[7] = { 8, 8, 8, 4, 4, 2, 2 };
+
+	// Far larger than any texture D3D11 accepts
+	const unsigned int MaxDimension = 1 << 16;
+}
+
+bool PngDecoder::IsPng(const unsigned char* data, size_t size)
+{
+	return size >= 8 && memcmp(data, Signature, 8) == 0;
+}
+
+bool PngDecoder::Inflate(const unsigned char* data, size_t size, std::vector<unsigned char>& out, size_t expectedSize)
+{
+	// zlib header: deflate, no preset dictionary, valid check bits
+	if (size < 2)
+		return false;
+
+	unsigned int cmf = data[0];
+	unsigned int flg = data[1];
+	if ((cmf & 15) != 8 || (flg & 32) || ((cmf << 8) | flg) % 31 != 0)
+		return false;
+
+	// The Adler-32 trailer isn't checked; a damaged stream almost
+	// always fails to decode to the expected size anyway
+	Inflater inflater(data + 2, size - 2, out, expectedSize);
+	return inflater.Run();
+}
+
+// --------------------------------------------------------
+// Walks the chunks, gathers the compressed image data, then
+// inflates, unfilters and converts it to RGBA
+// --------------------------------------------------------
+bool PngDecoder::Decode(const unsigned char* data, size_t size, Image& image, std::string* error)
+{
+	if (!IsPng(data, size))
+		return Fail(error, "Not a PNG file");
+
+	PngFormat format;
+	std::vector<unsigned char> compressed;
+	bool seenHeader = false;
+	bool seenEnd = false;
+
+	size_t pos = 8;
+	while (!seenEnd)
+	{
+		if (size - pos < 12)
+			return Fail(error, "Truncated chunk");
+
+		uint32_t length = ReadBigEndian(data + pos);
+		const unsigned char* type = data + pos + 4;
+		const unsigned char* chunk = data + pos + 8;
+		if (length > size - pos - 12)
+			return Fail(error, "Truncated chunk");
+
+		// Chunk CRCs aren't checked, for the same reason as Adler-32
+		pos += 12 + (size_t)length;
+
+		if (memcmp(type, "IHDR", 4) == 0)
+		{
+			if (length != 13)
+				return Fail(error, "Bad IHDR chunk");
+
+			format.width = ReadBigEndian(chunk);
+			format.height = ReadBigEndian(chunk + 4);
+			format.bitDepth = chunk[8];
+			format.colorType = chunk[9];
+			format.interlaced = chunk[12] == 1;
+
+			if (format.width == 0 || format.height == 0 || format.width > MaxDimension || format.height > MaxDimension)
+				return Fail(error, "Unsupported image size");
+
+			if (chunk[10] != 0 || chunk[11] != 0 || chunk[12] > 1)
+				return Fail(error, "Unsupported compression, filter or interlace method");
+
+			int depth = format.bitDepth;
+			bool validDepth;
+			switch (format.colorType)
+			{
+			case 0: format.channels = 1; validDepth = depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16; break;
+			case 2: format.channels = 3; validDepth = depth == 8 || depth == 16; break;
+			case 3: format.channels = 1; validDepth = depth == 1 || depth == 2 || depth == 4 || depth == 8; break;
+			case 4: format.channels = 2; validDepth = depth == 8 || depth == 16; break;
+			case 6: format.channels = 4; validDepth = depth == 8 || depth == 16; break;
+			default: validDepth = false; break;
+			}
+
+			if (!validDepth)
+				return Fail(error, "Invalid color type and bit depth");
+
+			seenHeader = true;
+		}
+		else if (!seenHeader)
+		{
+			return Fail(error, "Missing IHDR chunk");
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			if (length % 3 != 0 || length / 3 > 256)
+				return Fail(error, "Bad PLTE chunk");
+
+			format.paletteSize = length / 3;
+			for (unsigned int i = 0; i < format.paletteSize; i++)
+			{
+				format.palette[i][0] = chunk[i * 3 + 0];
+				format.palette[i][1] = chunk[i * 3 + 1];
+				format.palette[i][2] = chunk[i * 3 + 2];
+				format.palette[i][3] = 255;
+			}
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (format.colorType == 3)
+			{
+				for (unsigned int i = 0; i < length && i < format.paletteSize; i++)
+					format.palette[i][3] = chunk[i];
+			}
+			else if (format.colorType == 0 && length >= 2)
+			{
+				format.hasColorKey = true;
+				format.colorKey[0] = (uint16_t)((chunk[0] << 8) | chunk[1]);
+			}
+			else if (format.colorType == 2 && length >= 6)
+			{
+				format.hasColorKey = true;
+				for (int c = 0; c < 3; c++)
+					format.colorKey[c] = (uint16_t)((chunk[c * 2] << 8) | chunk[c * 2 + 1]);
+			}
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+		{
+			compressed.insert(compressed.end(), chunk, chunk + length);
+		}
+		else if (memcmp(type, "IEND", 4) == 0)
+		{
+			seenEnd = true;
+		}
+		else if ((type[0] & 32) == 0)
+		{
+			// Uppercase first letter means we're not allowed to ignore it
+			return Fail(error, "Unknown critical chunk");
+		}
+	}
+
+	if (format.colorType == 3 && format.paletteSize == 0)
+		return Fail(error, "Missing PLTE chunk");
+
+	// Work out exactly how much data the filtered rows take up
+	size_t expectedSize = 0;
+	if (format.interlaced)
+	{
+		for (int pass = 0; pass < 7; pass++)
+		{
+			unsigned int w = (format.width - Adam7StartX[pass] + Adam7StepX[pass] - 1) / Adam7StepX[pass];
+			unsigned int h = (format.height - Adam7StartY[pass] + Adam7StepY[pass] - 1) / Adam7StepY[pass];
+			if (format.width > Adam7StartX[pass] && format.height > Adam7StartY[pass])
+				expectedSize += (format.RowBytes(w) + 1) * h;
+		}
+	}
+	else
+	{
+		expectedSize = (format.RowBytes(format.width) + 1) * format.height;
+	}
+
+	std::vector<unsigned char> filtered;
+	if (!Inflate(compressed.data(), compressed.size(), filtered, expectedSize))
+		return Fail(error, "Corrupt image data");
+
+	image.width = format.width;
+	image.height = format.height;
+	image.pixels.resize((size_t)format.width * format.height * 4);
+
+	unsigned char* src = filtered.data();
+	if (format.interlaced)
+	{
+		for (int pass = 0; pass < 7; pass++)
+		{
+			if (format.width <= Adam7StartX[pass] || format.height <= Adam7StartY[pass])
+				continue;
+
+			unsigned int w = (format.width - Adam7StartX[pass] + Adam7StepX[pass] - 1) / Adam7StepX[pass];
+			unsigned int h = (format.height - Adam7StartY[pass] + Adam7StepY[pass] - 1) / Adam7StepY[pass];
+			if (!DecodePass(format, src, w, h, Adam7StartX[pass], Adam7StartY[pass], Adam7StepX[pass], Adam7StepY[pass], image))
+				return Fail(error, "Bad row filter");
+		}
+	}
+	else if (!DecodePass(format, src, format.width, format.height, 0, 0, 1, 1, image))
+	{
+		return Fail(error, "Bad row filter");
+	}
+
+	return true;
+}
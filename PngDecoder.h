@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Image.h"
+
+// --------------------------------------------------------
+// Decodes PNG files without any OS image API, so textures
+// can be decoded on worker threads (and on any platform).
+//
+// Handles every standard color type and bit depth, palettes,
+// tRNS transparency and Adam7 interlacing.  The result is always
+// 8-bit RGBA; 16-bit channels keep their high byte.
+// --------------------------------------------------------
+class PngDecoder
+{
+public:
+	static bool IsPng(const unsigned char* data, size_t size);
+
+	// Returns false (and fills in error, if given) on malformed
+	// or truncated data
+	static bool Decode(const unsigned char* data, size_t size, Image& image, std::string* error = 0);
+
+	// Decompresses a zlib stream whose uncompressed size is known
+	// up front, which is always the case for PNG image data
+	static bool Inflate(const unsigned char* data, size_t size, std::vector<unsigned char>& out, size_t expectedSize);
+};
@@ -1,78 +1,219 @@
 #include "PostProcess.h"
+#include "StateCache.h"
+#include "ShaderData.h"
 
-PostProcess::PostProcess(Microsoft::WRL::ComPtr<ID3D11Device> device, int _windowWidth, int _windowHeight, Microsoft::WRL::ComPtr<ID3D11SamplerState> _ppSampler, std::shared_ptr<SimplePixelShader> _ppPS)
+PostProcess::PostProcess(Microsoft::WRL::ComPtr<ID3D11SamplerState> _ppSampler, std::shared_ptr<SimpleVertexShader> _ppVS, std::shared_ptr<SimplePixelShader> _ppPS)
 {
-	// Describe the texture we're creating
-	textureDesc.Width = _windowWidth;
-	textureDesc.Height = _windowHeight;
-	textureDesc.ArraySize = 1;
-	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	textureDesc.CPUAccessFlags = 0;
-	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	textureDesc.MipLevels = 1;
-	textureDesc.MiscFlags = 0;
-	textureDesc.SampleDesc.Count = 1;
-	textureDesc.SampleDesc.Quality = 0;
-	textureDesc.Usage = D3D11_USAGE_DEFAULT;
-	// Create the resource (no need to track it after the views are created below)
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ppTexture;
-	device->CreateTexture2D(&textureDesc, 0, ppTexture.GetAddressOf());
-
-	// Create the Render Target View
-	rtvDesc.Format = textureDesc.Format;
-	rtvDesc.Texture2D.MipSlice = 0;
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-	device->CreateRenderTargetView(ppTexture.Get(), &rtvDesc, ppRTV.ReleaseAndGetAddressOf());
-	// Create the Shader Resource View
-	// By passing it a null description for the SRV, we
-	// get a "default" SRV that has access to the entire resource
-	device->CreateShaderResourceView(ppTexture.Get(), 0, ppSRV.ReleaseAndGetAddressOf());
-
 	ppSampler = _ppSampler;
-	windowWidth = _windowWidth;
-	windowHeight = _windowHeight;
+	ppVS = _ppVS;
 	ppPS = _ppPS;
 }
 
-void PostProcess::ClearRTV(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, float *bgColor)
+void PostProcess::AddToGraph(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output)
 {
-	context->ClearRenderTargetView(ppRTV.Get(), bgColor);
+	// Covers every pixel, so the output never needs clearing
+	graph.AddPass(name, { input }, output, [this, &graph, context, input, output]()
+	{
+		RenderPostProcess(context, graph, input, output);
+	});
 }
 
-void PostProcess::Resize(Microsoft::WRL::ComPtr<ID3D11Device> device, int _windowWidth, int _windowHeight)
+bool PostProcess::CanUpscale()
 {
-	windowWidth = _windowWidth;
-	windowHeight = _windowHeight;
-
-	textureDesc.Width = _windowWidth;
-	textureDesc.Height = _windowHeight;
-
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> ppTexture;
-	device->CreateTexture2D(&textureDesc, 0, ppTexture.GetAddressOf());
-
-	// Create the Render Target View
-	device->CreateRenderTargetView(ppTexture.Get(), &rtvDesc, ppRTV.ReleaseAndGetAddressOf());
-	// Create the Shader Resource View
-	// By passing it a null description for the SRV, we
-	// get a "default" SRV that has access to the entire resource
-	device->CreateShaderResourceView(ppTexture.Get(), 0, ppSRV.ReleaseAndGetAddressOf());
+	return ppPS && ppPS->HasVariable("sourceScale");
 }
 
-void PostProcess::RenderPostProcess(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> renderTarget, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferSRV)
+void PostProcess::RenderPostProcess(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, RenderGraph& graph, RenderGraph::Resource input, RenderGraph::Resource output)
 {
-	context->OMSetRenderTargets(1, renderTarget.GetAddressOf(), 0);
-
-	ppPS->SetShader();
-	ppPS->SetShaderResourceView("Pixels", ppSRV.Get());
-	ppPS->SetSamplerState("ClampSampler", ppSampler.Get());
+	BeginPass(ppPS, graph, input, output);
 
 	//Post Process assumes that any data that expects window dimensions will use these names
-	ppPS->SetFloat("windowWidth", windowWidth);
-	ppPS->SetFloat("windowHeight", windowHeight);
+	ppPS->SetFloat("windowWidth", (float)graph.GetWidth(output));
+	ppPS->SetFloat("windowHeight", (float)graph.GetHeight(output));
 
 	for (auto& t : pixelShaderFloatData) { ppPS->SetFloat(t.first.c_str(), *t.second); }
 
 	ppPS->CopyAllBufferData();
 
 	context->Draw(3, 0); // Draw exactly 3 vertices (one triangle)
+}
+
+void PostProcess::BeginPass(std::shared_ptr<SimplePixelShader> pixelShader, RenderGraph& graph, RenderGraph::Resource input, RenderGraph::Resource output)
+{
+	StateCache& cache = StateCache::GetInstance();
+	cache.SetRenderTarget(graph.GetRTV(output), 0);
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.Width = (float)graph.GetWidth(output);
+	viewport.Height = (float)graph.GetHeight(output);
+	viewport.MaxDepth = 1.0f;
+	cache.SetViewport(viewport);
+
+	ppVS->SetShader();
+	pixelShader->SetShader();
+	pixelShader->SetShaderResourceView("Pixels", graph.GetSRV(input));
+	pixelShader->SetSamplerState("ClampSampler", ppSampler.Get());
+
+	// Shaders that can upscale read only the part of the input that
+	// holds the image, and stop at its last texels' centers so the
+	// filter never blends in what's past them
+	float width = (float)graph.GetWidth(input);
+	float height = (float)graph.GetHeight(input);
+	float contentWidth = (float)graph.GetContentWidth(input);
+	float contentHeight = (float)graph.GetContentHeight(input);
+	pixelShader->SetFloat2("sourceScale", DirectX::XMFLOAT2(contentWidth / width, contentHeight / height));
+	pixelShader->SetFloat2("sourceMax", DirectX::XMFLOAT2((contentWidth - 0.5f) / width, (contentHeight - 0.5f) / height));
+}
+
+GaussianBlurPostProcess::GaussianBlurPostProcess(
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> _ppSampler,
+	std::shared_ptr<SimpleVertexShader> _ppVS,
+	std::shared_ptr<SimplePixelShader> _blurPS,
+	std::shared_ptr<SimplePixelShader> _copyPS,
+	float* _boxRadius,
+	bool* _halfResolution)
+	: PostProcess(_ppSampler, _ppVS, _blurPS),
+	copyPostProcess(_ppSampler, _ppVS, _copyPS)
+{
+	boxRadius = _boxRadius;
+	halfResolution = _halfResolution;
+}
+
+bool GaussianBlurPostProcess::CanUpscale()
+{
+	// Downsampling reads the input with the copy shader
+	return *halfResolution;
+}
+
+void GaussianBlurPostProcess::AddToGraph(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output)
+{
+	// The blur is measured in full resolution texels
+	unsigned int divisor = *halfResolution ? 2 : 1;
+	GaussianBlurTaps taps = GaussianBlur::GetTaps(GaussianBlur::GetSigma(*boxRadius) / divisor);
+
+	RenderGraph::Resource source = input;
+	RenderGraph::Resource blurred = output;
+	if (*halfResolution)
+	{
+		source = graph.CreateTarget(name + " Downsampled", DXGI_FORMAT_R8G8B8A8_UNORM, divisor);
+		blurred = graph.CreateTarget(name + " Blurred", DXGI_FORMAT_R8G8B8A8_UNORM, divisor);
+		copyPostProcess.AddToGraph(graph, context, name + " Downsample", input, source);
+	}
+
+	RenderGraph::Resource across = graph.CreateTarget(name + " Across", DXGI_FORMAT_R8G8B8A8_UNORM, divisor);
+	AddBlurPass(graph, context, name + " Across", source, across, taps, true);
+	AddBlurPass(graph, context, name + " Down", across, blurred, taps, false);
+
+	if (*halfResolution)
+		copyPostProcess.AddToGraph(graph, context, name + " Upsample", blurred, output);
+}
+
+void GaussianBlurPostProcess::AddBlurPass(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output, const GaussianBlurTaps& taps, bool across)
+{
+	ShaderData::PostProcessBlurPSExternalData psData = {};
+	for (int i = 0; i < taps.count; i++)
+		psData.taps[i] = DirectX::XMFLOAT4(taps.offsets[i], taps.weights[i], 0, 0);
+	psData.tapCount = taps.count;
+
+	// Steps are in the input's texels
+	psData.texelStep = across ?
+		DirectX::XMFLOAT2(1.0f / graph.GetWidth(input), 0) :
+		DirectX::XMFLOAT2(0, 1.0f / graph.GetHeight(input));
+
+	graph.AddPass(name, { input }, output, [this, &graph, context, input, output, psData]()
+	{
+		BeginPass(ppPS, graph, input, output);
+
+		ppPS->SetBufferData(psData);
+		ppPS->CopyAllBufferData();
+
+		context->Draw(3, 0);
+	});
+}
+
+FusedPostProcess::FusedPostProcess(
+	Microsoft::WRL::ComPtr<ID3D11SamplerState> _ppSampler,
+	std::shared_ptr<SimpleVertexShader> _ppVS,
+	std::shared_ptr<ShaderPermutationCache<PostProcessPermutationKey>> _permutations,
+	GaussianBlurPostProcess* _blur,
+	float* _sharpenAmount,
+	float* _blurAmount,
+	float* _pixelLevel,
+	bool* _chromaticAberration)
+	: PostProcess(_ppSampler, _ppVS, 0)
+{
+	permutations = _permutations;
+	blur = _blur;
+	sharpenAmount = _sharpenAmount;
+	blurAmount = _blurAmount;
+	pixelLevel = _pixelLevel;
+	chromaticAberration = _chromaticAberration;
+}
+
+bool FusedPostProcess::IsEnabled()
+{
+	return *sharpenAmount > 0 || *blurAmount >= 1 || *pixelLevel > 0 || *chromaticAberration;
+}
+
+bool FusedPostProcess::CanUpscale()
+{
+	// The first pass is a fused one, unless the blur comes first
+	return *blurAmount < 1 || *sharpenAmount > 0 || blur->CanUpscale();
+}
+
+void FusedPostProcess::AddToGraph(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output)
+{
+	PostProcessPermutationKey key;
+	key.sharpen = *sharpenAmount > 0;
+	key.pixelize = *pixelLevel > 0;
+	key.chromaticAberration = *chromaticAberration;
+
+	if (*blurAmount < 1)
+	{
+		AddFusedPass(graph, context, name, input, output, key);
+		return;
+	}
+
+	// Sharpening before the blur, and the UV effects after it
+	PostProcessPermutationKey before;
+	before.sharpen = key.sharpen;
+	before.pixelize = false;
+	before.chromaticAberration = false;
+
+	PostProcessPermutationKey after = key;
+	after.sharpen = false;
+
+	RenderGraph::Resource source = input;
+	if (before.Any())
+	{
+		source = graph.CreateTarget(name + " Sharpened");
+		AddFusedPass(graph, context, name + " Sharpen", input, source, before);
+	}
+
+	RenderGraph::Resource blurred = after.Any() ? graph.CreateTarget(name + " Blurred") : output;
+	blur->AddToGraph(graph, context, name + " Blur", source, blurred);
+
+	if (after.Any())
+		AddFusedPass(graph, context, name, blurred, output, after);
+}
+
+void FusedPostProcess::AddFusedPass(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output, const PostProcessPermutationKey& key)
+{
+	std::shared_ptr<SimplePixelShader> shader = permutations->Get(key);
+
+	graph.AddPass(name, { input }, output, [this, &graph, context, input, output, shader, key]()
+	{
+		BeginPass(shader, graph, input, output);
+
+		// Variables the permutation compiled out are skipped
+		for (auto& t : pixelShaderFloatData) { shader->SetFloat(t.first.c_str(), *t.second); }
+
+		// Only the fallback (every effect compiled in) still has these
+		shader->SetFloat("sharpenEnabled", key.sharpen ? 1.0f : 0.0f);
+		shader->SetFloat("pixelizeEnabled", key.pixelize ? 1.0f : 0.0f);
+		shader->SetFloat("chromaticAberrationEnabled", key.chromaticAberration ? 1.0f : 0.0f);
+		shader->CopyAllBufferData();
+
+		context->Draw(3, 0);
+	});
 }
\ No newline at end of file
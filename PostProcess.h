@@ -1,29 +1,111 @@
 #pragma once
 #include <memory>
 #include "SimpleShader.h"
+#include "RenderGraph.h"
+#include "GaussianBlur.h"
+#include "ShaderPermutation.h"
 
+// --------------------------------------------------------
+// A full-screen effect.  It doesn't own a target: the render
+// graph hands it the previous pass's output to read and a
+// pooled (or the back) buffer to write.
+// --------------------------------------------------------
 class PostProcess
 {
 public:
-	Microsoft::WRL::ComPtr<ID3D11RenderTargetView> ppRTV; // For rendering
-
 	std::unordered_map<std::string, float*> pixelShaderFloatData;
 
 	PostProcess() {};
-	PostProcess(Microsoft::WRL::ComPtr<ID3D11Device> device, int _windowWidth, int _windowHeight, Microsoft::WRL::ComPtr<ID3D11SamplerState> _ppSampler, std::shared_ptr<SimplePixelShader> _ppPS);
-	~PostProcess() {};
+	PostProcess(Microsoft::WRL::ComPtr<ID3D11SamplerState> _ppSampler, std::shared_ptr<SimpleVertexShader> _ppVS, std::shared_ptr<SimplePixelShader> _ppPS);
+	virtual ~PostProcess() {};
 
-	void ClearRTV(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, float *bgColor);
-	void Resize(Microsoft::WRL::ComPtr<ID3D11Device> device, int _windowWidth, int _windowHeight);
-	void RenderPostProcess(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> renderTarget, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferSRV);
-private:
-	D3D11_TEXTURE2D_DESC textureDesc = {};
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc = {};
+	// Adds the passes that run this effect on input, writing output
+	virtual void AddToGraph(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output);
+	void RenderPostProcess(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, RenderGraph& graph, RenderGraph::Resource input, RenderGraph::Resource output);
 
+	// True if the first pass can read an input that only partly holds
+	// the image (see RenderGraph::SetContentSize) and stretch it to fit
+	virtual bool CanUpscale();
+protected:
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> ppSampler;
-	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> ppSRV; // For sampling
+	std::shared_ptr<SimpleVertexShader> ppVS;
 	std::shared_ptr<SimplePixelShader> ppPS;
 
-	int windowWidth;
-	int windowHeight;
+	// Binds the target (with a matching viewport), shaders and input
+	void BeginPass(std::shared_ptr<SimplePixelShader> pixelShader, RenderGraph& graph, RenderGraph::Resource input, RenderGraph::Resource output);
+};
+
+// --------------------------------------------------------
+// A separable Gaussian blur in two passes, across into a
+// temporary target and then down into the output, with the
+// taps from GaussianBlur.h.
+//
+// At half resolution the input is first shrunk to a quarter
+// of the pixels and the result stretched back out, so each
+// pass shades a quarter as many pixels with about half the
+// taps.
+// --------------------------------------------------------
+class GaussianBlurPostProcess : public PostProcess
+{
+public:
+	GaussianBlurPostProcess() {};
+	GaussianBlurPostProcess(
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> _ppSampler,
+		std::shared_ptr<SimpleVertexShader> _ppVS,
+		std::shared_ptr<SimplePixelShader> _blurPS,
+		std::shared_ptr<SimplePixelShader> _copyPS,
+		float* _boxRadius,
+		bool* _halfResolution);
+
+	void AddToGraph(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output) override;
+	bool CanUpscale() override;
+private:
+	PostProcess copyPostProcess;	// Down and up sampling
+	float* boxRadius = 0;
+	bool* halfResolution = 0;
+
+	void AddBlurPass(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output, const GaussianBlurTaps& taps, bool across);
+};
+
+// --------------------------------------------------------
+// Sharpen, blur, pixelize and chromatic aberration in as few
+// full-screen passes as their sampling allows, instead of a
+// read and write of the frame for each.
+//
+// Pixelize and chromatic aberration only move where the
+// effect before them is read, and sharpening is a small
+// kernel that can be read anywhere, so all three fold into
+// one pass of PostProcessUberPS, compiled for just the
+// effects that are on.  Blurring needs its neighbours'
+// blurred results, so it keeps its own separable passes:
+// sharpening is fused before it and the others after.
+// --------------------------------------------------------
+class FusedPostProcess : public PostProcess
+{
+public:
+	FusedPostProcess() {};
+	FusedPostProcess(
+		Microsoft::WRL::ComPtr<ID3D11SamplerState> _ppSampler,
+		std::shared_ptr<SimpleVertexShader> _ppVS,
+		std::shared_ptr<ShaderPermutationCache<PostProcessPermutationKey>> _permutations,
+		GaussianBlurPostProcess* _blur,
+		float* _sharpenAmount,
+		float* _blurAmount,
+		float* _pixelLevel,
+		bool* _chromaticAberration);
+
+	// True if any of the effects is on
+	bool IsEnabled();
+
+	void AddToGraph(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output) override;
+	bool CanUpscale() override;
+private:
+	std::shared_ptr<ShaderPermutationCache<PostProcessPermutationKey>> permutations;
+	GaussianBlurPostProcess* blur = 0;
+	float* sharpenAmount = 0;
+	float* blurAmount = 0;
+	float* pixelLevel = 0;
+	bool* chromaticAberration = 0;
+
+	void AddFusedPass(RenderGraph& graph, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const std::string& name, RenderGraph::Resource input, RenderGraph::Resource output, const PostProcessPermutationKey& key);
 };
\ No newline at end of file
@@ -1,8 +1,11 @@
+// Must match GaussianBlurTaps::MaxTaps
+#define MAX_BLUR_TAPS 12
+
 cbuffer externalData : register(b0)
 {
-    float blurRadius;
-    float windowWidth;
-    float windowHeight;
+    float4 taps[MAX_BLUR_TAPS]; // x: offset in texels, y: weight (see GaussianBlur.h)
+    float2 texelStep;           // One texel along this pass's axis, in UVs
+    int tapCount;
 }
 
 struct VertexToPixel
@@ -14,25 +17,19 @@ struct VertexToPixel
 Texture2D Pixels : register(t0);
 SamplerState ClampSampler : register(s0);
 
+// One direction of a separable Gaussian - run once across and
+// once down.  Each tap past the center lands between two texels,
+// so the bilinear filter reads both with a single fetch.
 float4 main(VertexToPixel input) : SV_TARGET
 {
-    // Track the total color and number of samples
-    float4 total = 0;
-    int sampleCount = 0;
-    // Loop through the "box"
-    for (int x = -blurRadius; x <= blurRadius; x++)
+    float4 total = Pixels.Sample(ClampSampler, input.uv) * taps[0].y;
+
+    for (int i = 1; i < tapCount; i++)
     {
-        for (int y = -blurRadius; y <= blurRadius; y++)
-        {
-            // Calculate the uv for this sample
-            float2 uv = input.uv;
-            uv += float2(x * (1 / windowWidth), y * (1 / windowHeight));
-            // Add this color to the running total
-            total += Pixels.Sample(ClampSampler, uv);
-            sampleCount++;
-        }
+        float2 offset = texelStep * taps[i].x;
+        total += Pixels.Sample(ClampSampler, input.uv + offset) * taps[i].y;
+        total += Pixels.Sample(ClampSampler, input.uv - offset) * taps[i].y;
     }
-    
-    // Return the average
-    return total / sampleCount;
+
+    return total;
 }
\ No newline at end of file
@@ -0,0 +1,24 @@
+cbuffer externalData : register(b0)
+{
+    float2 sourceScale; // Part of the input that holds the image (see PostProcess::BeginPass)
+    float2 sourceMax;
+}
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+Texture2D Pixels : register(t0);
+SamplerState ClampSampler : register(s0);
+
+// Resamples to the target's size.  Going down by half, every
+// pixel lands between four source texels and gets their
+// average, and going up it blends the nearest four.  Only the
+// part of the input holding the image is read, so this also
+// upscales a scene drawn at a lower resolution.
+float4 main(VertexToPixel input) : SV_TARGET
+{
+    return Pixels.Sample(ClampSampler, min(input.uv * sourceScale, sourceMax));
+}
\ No newline at end of file
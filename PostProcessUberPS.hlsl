@@ -0,0 +1,100 @@
+// Every effect is on unless a permutation turns it off
+// (see PostProcessPermutationKey).  This default build is also
+// the fallback for a variant missing from the archive, so the
+// *Enabled switches turn each effect off at runtime as well -
+// a variant compiles out the switches along with its effects.
+#ifndef SHARPEN
+#define SHARPEN 1
+#endif
+#ifndef PIXELIZE
+#define PIXELIZE 1
+#endif
+#ifndef CHROMATIC_ABERRATION
+#define CHROMATIC_ABERRATION 1
+#endif
+
+cbuffer externalData : register(b0)
+{
+    float sharpenAmount;
+    float pixelLevel;
+    float mouseX;
+    float mouseY;
+    float2 sourceScale; // Part of the input that holds the image (see PostProcess::BeginPass)
+    float2 sourceMax;
+    float sharpenEnabled; // 0 or 1
+    float pixelizeEnabled;
+    float chromaticAberrationEnabled;
+}
+
+struct VertexToPixel
+{
+    float4 position : SV_POSITION;
+    float2 uv : TEXCOORD0;
+};
+
+Texture2D Pixels : register(t0);
+SamplerState ClampSampler : register(s0);
+
+// The input, stretched so its image fills the screen
+float3 Source(float2 uv)
+{
+    return Pixels.Sample(ClampSampler, min(uv * sourceScale, sourceMax)).rgb;
+}
+
+// The first effect, read straight from the input.  Sharpening
+// is a small kernel around wherever it's asked for, so it
+// works at any of the UVs the later effects move to.
+float3 Sharpened(float2 uv)
+{
+#if SHARPEN
+    float amount = 0.3 * sharpenAmount * sharpenEnabled;
+
+    float neighbor = amount * -1.0;
+    float center = amount * 4.0 + 1.0;
+    
+    float offset = 0.0025;
+    
+    return Source(uv + float2(0, offset)) * neighbor
+      + Source(uv + float2(-offset, 0)) * neighbor
+      + Source(uv) * center
+      + Source(uv + float2(offset, 0)) * neighbor
+      + Source(uv + float2(0, -offset)) * neighbor;
+#else
+    return Source(uv);
+#endif
+}
+
+// Pixelizing only moves where the effect before it is read
+float3 Pixelized(float2 uv)
+{
+#if PIXELIZE
+    if (pixelizeEnabled > 0)
+    {
+        float pixelSize = 0.005 * pixelLevel+0.0001;
+        uv = float2(uv.r - (uv.r % pixelSize) + pixelSize/2, uv.g - (uv.g % pixelSize) + pixelSize/2);
+    }
+#endif
+    return Sharpened(uv);
+}
+
+// The effects from PostProcessSharpenPS, PostProcessPixelizePS and
+// PostProcessChromaticAberrationPS, in that order, in one pass
+float4 main(VertexToPixel input) : SV_TARGET
+{
+#if CHROMATIC_ABERRATION
+    float redOffset = 0.009;
+    float greenOffset = 0.006;
+    float blueOffset = -0.006;
+
+    float2 direction = (input.uv - float2(mouseX, mouseY)) * chromaticAberrationEnabled;
+
+    // Each channel reads everything before it from its own UV
+    float3 color;
+    color.r = Pixelized(input.uv + (direction * float2(redOffset.rr))).r;
+    color.g = Pixelized(input.uv + (direction * float2(greenOffset.rr))).g;
+    color.b = Pixelized(input.uv + (direction * float2(blueOffset.rr))).b;
+    return float4(color, 1);
+#else
+    return float4(Pixelized(input.uv), 1);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include "RenderGraph.h"
+
+#include <cstring>
+
+// --------------------------------------------------------
+// Pool
+// --------------------------------------------------------
+void RenderTargetPool::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> _device, unsigned int _width, unsigned int _height)
+{
+	device = _device;
+	Invalidate(_width, _height);
+}
+
+int RenderTargetPool::Acquire(DXGI_FORMAT format, unsigned int divisor)
+{
+	for (size_t i = 0; i < targets.size(); i++)
+	{
+		if (!targets[i].inUse && targets[i].format == format && targets[i].divisor == divisor)
+		{
+			targets[i].inUse = true;
+			return (int)i;
+		}
+	}
+
+	// Nothing free, so make a new one
+	D3D11_TEXTURE2D_DESC textureDesc = {};
+	textureDesc.Width = max(width / divisor, 1u);
+	textureDesc.Height = max(height / divisor, 1u);
+	textureDesc.ArraySize = 1;
+	textureDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	textureDesc.Format = format;
+	textureDesc.MipLevels = 1;
+	textureDesc.SampleDesc.Count = 1;
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
+
+	// No need to track the texture after the views are created
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	device->CreateTexture2D(&textureDesc, 0, texture.GetAddressOf());
+
+	Target target = {};
+	target.format = format;
+	target.divisor = divisor;
+	target.inUse = true;
+	device->CreateRenderTargetView(texture.Get(), 0, target.rtv.GetAddressOf());
+	device->CreateShaderResourceView(texture.Get(), 0, target.srv.GetAddressOf());
+	targets.push_back(target);
+
+	return (int)targets.size() - 1;
+}
+
+void RenderTargetPool::Release(int target)
+{
+	targets[target].inUse = false;
+}
+
+void RenderTargetPool::Invalidate(unsigned int _width, unsigned int _height)
+{
+	width = _width;
+	height = _height;
+	targets.clear();
+}
+
+// --------------------------------------------------------
+// Graph
+// --------------------------------------------------------
+RenderGraph::RenderGraph()
+{
+}
+
+RenderGraph::~RenderGraph()
+{
+}
+
+void RenderGraph::Initialize(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> _context,
+	unsigned int width,
+	unsigned int height)
+{
+	context = _context;
+	pool.Initialize(device, width, height);
+}
+
+void RenderGraph::Resize(unsigned int width, unsigned int height)
+{
+	pool.Invalidate(width, height);
+}
+
+void RenderGraph::Reset()
+{
+	resources.clear();
+	passes.clear();
+}
+
+RenderGraph::Resource RenderGraph::Import(const std::string& name, ID3D11RenderTargetView* rtv)
+{
+	ResourceNode resource = {};
+	resource.name = name;
+	resource.importedRTV = rtv;
+	resource.divisor = 1;
+	resource.target = -1;
+	resources.push_back(resource);
+	return (Resource)resources.size() - 1;
+}
+
+RenderGraph::Resource RenderGraph::CreateTarget(const std::string& name, DXGI_FORMAT format, unsigned int divisor)
+{
+	ResourceNode resource = {};
+	resource.name = name;
+	resource.format = format;
+	resource.divisor = divisor;
+	resource.target = -1;
+	resources.push_back(resource);
+	return (Resource)resources.size() - 1;
+}
+
+void RenderGraph::AddPass(
+	const std::string& name,
+	const std::vector<Resource>& inputs,
+	Resource output,
+	std::function<void()> execute,
+	const float* clearColor)
+{
+	PassNode pass = {};
+	pass.name = name;
+	pass.inputs = inputs;
+	pass.output = output;
+	pass.execute = execute;
+	pass.clear = clearColor != 0;
+	if (clearColor)
+		memcpy(pass.clearColor, clearColor, sizeof(pass.clearColor));
+	passes.push_back(pass);
+}
+
+// --------------------------------------------------------
+// Walks the passes backwards from the imported targets, so
+// a pass is only kept if something kept reads what it writes
+// --------------------------------------------------------
+void RenderGraph::Cull()
+{
+	for (ResourceNode& resource : resources)
+	{
+		resource.needed = resource.importedRTV != 0;
+		resource.lastReader = -1;
+	}
+
+	for (int p = (int)passes.size() - 1; p >= 0; p--)
+	{
+		PassNode& pass = passes[p];
+		pass.live = resources[pass.output].needed;
+		if (!pass.live)
+			continue;
+
+		for (Resource input : pass.inputs)
+		{
+			resources[input].needed = true;
+			if (resources[input].lastReader < 0)
+				resources[input].lastReader = p;
+		}
+	}
+}
+
+void RenderGraph::Execute()
+{
+	Cull();
+
+	executedPasses = 0;
+	culledPasses = 0;
+	clears = 0;
+	transients = 0;
+
+	for (size_t p = 0; p < passes.size(); p++)
+	{
+		PassNode& pass = passes[p];
+		if (!pass.live)
+		{
+			culledPasses++;
+			continue;
+		}
+
+		// The output is given a target before the inputs give theirs
+		// back, so a pass never writes what it's reading
+		ResourceNode& output = resources[pass.output];
+		if (!output.importedRTV && output.target < 0)
+		{
+			output.target = pool.Acquire(output.format, output.divisor);
+			transients++;
+		}
+
+		if (pass.clear)
+		{
+			context->ClearRenderTargetView(GetRTV(pass.output), pass.clearColor);
+			clears++;
+		}
+
+		pass.execute();
+		executedPasses++;
+
+		for (Resource input : pass.inputs)
+		{
+			ResourceNode& resource = resources[input];
+			if (resource.lastReader == (int)p && resource.target >= 0)
+			{
+				pool.Release(resource.target);
+				resource.target = -1;
+			}
+		}
+	}
+
+	// Anything written but never read goes back too
+	for (ResourceNode& resource : resources)
+	{
+		if (resource.target >= 0)
+		{
+			pool.Release(resource.target);
+			resource.target = -1;
+		}
+	}
+}
+
+ID3D11RenderTargetView* RenderGraph::GetRTV(Resource resource)
+{
+	ResourceNode& node = resources[resource];
+	if (node.importedRTV)
+		return node.importedRTV;
+
+	return node.target >= 0 ? pool.Get(node.target).rtv.Get() : 0;
+}
+
+ID3D11ShaderResourceView* RenderGraph::GetSRV(Resource resource)
+{
+	ResourceNode& node = resources[resource];
+	return node.target >= 0 ? pool.Get(node.target).srv.Get() : 0;
+}
+
+unsigned int RenderGraph::GetWidth(Resource resource)
+{
+	return max(pool.GetWidth() / resources[resource].divisor, 1u);
+}
+
+unsigned int RenderGraph::GetHeight(Resource resource)
+{
+	return max(pool.GetHeight() / resources[resource].divisor, 1u);
+}
+
+void RenderGraph::SetContentSize(Resource resource, unsigned int width, unsigned int height)
+{
+	resources[resource].contentWidth = width;
+	resources[resource].contentHeight = height;
+}
+
+unsigned int RenderGraph::GetContentWidth(Resource resource)
+{
+	unsigned int width = resources[resource].contentWidth;
+	return width ? min(width, GetWidth(resource)) : GetWidth(resource);
+}
+
+unsigned int RenderGraph::GetContentHeight(Resource resource)
+{
+	unsigned int height = resources[resource].contentHeight;
+	return height ? min(height, GetHeight(resource)) : GetHeight(resource);
+}
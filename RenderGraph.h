@@ -0,0 +1,163 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Color targets that are only needed for part of a frame, the
+// size of the window or a fraction of it.  Targets are handed
+// out by format and size, given back once their last reader
+// is done, and kept for later passes and frames until the
+// window changes size.
+// --------------------------------------------------------
+class RenderTargetPool
+{
+public:
+	struct Target
+	{
+		Microsoft::WRL::ComPtr<ID3D11RenderTargetView> rtv;
+		Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+		DXGI_FORMAT format;
+		unsigned int divisor;	// Of the window's size
+		bool inUse;
+	};
+
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> _device, unsigned int _width, unsigned int _height);
+
+	// Index of a free target with this format and size, created if
+	// there isn't one
+	int Acquire(DXGI_FORMAT format, unsigned int divisor);
+	void Release(int target);
+	const Target& Get(int target) { return targets[target]; }
+
+	// Drops every target, so the next ones are created at the new size
+	void Invalidate(unsigned int _width, unsigned int _height);
+
+	unsigned int GetWidth() { return width; }
+	unsigned int GetHeight() { return height; }
+	size_t GetTargetCount() { return targets.size(); }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	unsigned int width = 0;
+	unsigned int height = 0;
+	std::vector<Target> targets;
+};
+
+// --------------------------------------------------------
+// A frame's full-screen passes, described up front by what
+// each one reads and writes, then run in one go.
+//
+// Passes whose output is never read (directly or through
+// other passes) by something that reaches an imported target,
+// like the back buffer, are culled.  Transient targets only
+// exist from the pass that writes them to the last pass that
+// reads them, so they share the pool's textures: a chain of
+// effects ping-pongs between two.  Targets are only cleared
+// when the pass writing them asks for it.
+//
+// The graph is rebuilt every frame with Reset(), so passes can
+// come and go as effects are turned on and off.
+// --------------------------------------------------------
+class RenderGraph
+{
+public:
+	typedef int Resource;
+
+	RenderGraph();
+	~RenderGraph();
+
+	void Initialize(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> _context,
+		unsigned int width,
+		unsigned int height);
+
+	// Transient targets are recreated at the new size when next used
+	void Resize(unsigned int width, unsigned int height);
+
+	// Forgets the last frame's passes and resources
+	void Reset();
+
+	// A target that lives outside the graph, such as the back buffer.
+	// Passes that write one are never culled.
+	Resource Import(const std::string& name, ID3D11RenderTargetView* rtv);
+
+	// A target that only lives as long as its passes need it, the
+	// window's size divided by divisor
+	Resource CreateTarget(const std::string& name, DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM, unsigned int divisor = 1);
+
+	// A pass that reads the inputs and writes the output.  The output
+	// is cleared first only if a clear color is given, so passes that
+	// cover every pixel shouldn't pass one.
+	void AddPass(
+		const std::string& name,
+		const std::vector<Resource>& inputs,
+		Resource output,
+		std::function<void()> execute,
+		const float* clearColor = 0);
+
+	// Culls, assigns targets and runs the passes in the order they were added
+	void Execute();
+
+	// Only valid while the passes using the resource are running
+	ID3D11RenderTargetView* GetRTV(Resource resource);
+	ID3D11ShaderResourceView* GetSRV(Resource resource);
+	unsigned int GetWidth(Resource resource);
+	unsigned int GetHeight(Resource resource);
+
+	// How much of a target, from its top left corner, holds the image
+	// when a pass only drew to part of it.  All of it by default.
+	void SetContentSize(Resource resource, unsigned int width, unsigned int height);
+	unsigned int GetContentWidth(Resource resource);
+	unsigned int GetContentHeight(Resource resource);
+
+	// Results of the last Execute()
+	int GetExecutedPassCount() { return executedPasses; }
+	int GetCulledPassCount() { return culledPasses; }
+	int GetClearCount() { return clears; }
+	int GetTransientCount() { return transients; }
+	size_t GetPooledTargetCount() { return pool.GetTargetCount(); }
+
+private:
+	struct ResourceNode
+	{
+		std::string name;
+		ID3D11RenderTargetView* importedRTV;	// Null for transients
+		DXGI_FORMAT format;
+		unsigned int divisor;
+		unsigned int contentWidth;	// 0 for the whole target
+		unsigned int contentHeight;
+		int target;		// In the pool, while it's alive
+		int lastReader;	// Index of the last live pass that reads it
+		bool needed;
+	};
+
+	struct PassNode
+	{
+		std::string name;
+		std::vector<Resource> inputs;
+		Resource output;
+		std::function<void()> execute;
+		bool clear;
+		float clearColor[4];
+		bool live;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	RenderTargetPool pool;
+
+	std::vector<ResourceNode> resources;
+	std::vector<PassNode> passes;
+
+	int executedPasses = 0;
+	int culledPasses = 0;
+	int clears = 0;
+	int transients = 0;
+
+	void Cull();
+};
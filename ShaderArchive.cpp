@@ -0,0 +1,297 @@
+#include "ShaderArchive.h"
+
+#include <fstream>
+#include <iterator>
+
+// --------------------------------------------------------
+// Helpers for reading and writing the archive's primitive
+// types.  The reader never reads past the end of the data,
+// so a truncated or corrupt archive simply fails to parse.
+// --------------------------------------------------------
+namespace
+{
+	class ArchiveWriter
+	{
+	public:
+		std::vector<unsigned char> bytes;
+
+		void WriteUInt(uint32_t value)
+		{
+			for (int i = 0; i < 4; i++)
+				bytes.push_back((unsigned char)((value >> (i * 8)) & 0xFF));
+		}
+
+		void WriteBytes(const unsigned char* data, size_t size)
+		{
+			WriteUInt((uint32_t)size);
+			bytes.insert(bytes.end(), data, data + size);
+		}
+
+		void WriteString(const std::string& str)
+		{
+			WriteBytes((const unsigned char*)str.data(), str.size());
+		}
+	};
+
+	class ArchiveReader
+	{
+	public:
+		ArchiveReader(const unsigned char* data, size_t size) : data(data), size(size), pos(0), failed(false) { }
+
+		bool Failed() const { return failed; }
+		bool AtEnd() const { return pos == size; }
+
+		uint32_t ReadUInt()
+		{
+			if (!Require(4)) return 0;
+
+			uint32_t value = 0;
+			for (int i = 0; i < 4; i++)
+				value |= (uint32_t)data[pos + i] << (i * 8);
+
+			pos += 4;
+			return value;
+		}
+
+		// Reads a count that will be used to size a container, rejecting
+		// counts that couldn't possibly fit in the remaining data
+		uint32_t ReadCount(size_t minBytesPerElement)
+		{
+			uint32_t count = ReadUInt();
+			if (!failed && (size_t)count * minBytesPerElement > size - pos)
+				failed = true;
+
+			return failed ? 0 : count;
+		}
+
+		void ReadBytes(std::vector<unsigned char>& out)
+		{
+			uint32_t length = ReadUInt();
+			if (!Require(length)) return;
+
+			out.assign(data + pos, data + pos + length);
+			pos += length;
+		}
+
+		std::string ReadString()
+		{
+			uint32_t length = ReadUInt();
+			if (!Require(length)) return std::string();
+
+			std::string str((const char*)data + pos, length);
+			pos += length;
+			return str;
+		}
+
+	private:
+		const unsigned char* data;
+		size_t size;
+		size_t pos;
+		bool failed;
+
+		bool Require(size_t count)
+		{
+			if (failed || count > size - pos)
+				failed = true;
+
+			return !failed;
+		}
+	};
+
+	void ReadResources(ArchiveReader& reader, std::vector<ShaderResourceDesc>& out)
+	{
+		uint32_t count = reader.ReadCount(8);
+		out.resize(count);
+		for (ShaderResourceDesc& res : out)
+		{
+			res.Name = reader.ReadString();
+			res.BindIndex = reader.ReadUInt();
+		}
+	}
+
+	void WriteResources(ArchiveWriter& writer, const std::vector<ShaderResourceDesc>& resources)
+	{
+		writer.WriteUInt((uint32_t)resources.size());
+		for (const ShaderResourceDesc& res : resources)
+		{
+			writer.WriteString(res.Name);
+			writer.WriteUInt(res.BindIndex);
+		}
+	}
+}
+
+ShaderArchive::ShaderArchive() { }
+
+ShaderArchive::~ShaderArchive() { }
+
+// --------------------------------------------------------
+// Loads and parses an entire archive with a single read
+//
+// Returns false if the file is missing or malformed, in
+// which case the archive is left empty
+// --------------------------------------------------------
+bool ShaderArchive::ReadFromFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	std::vector<unsigned char> data(
+		(std::istreambuf_iterator<char>(file)),
+		std::istreambuf_iterator<char>());
+
+	return Parse(data.data(), data.size());
+}
+
+// --------------------------------------------------------
+// Parses an archive that has already been loaded into memory
+// --------------------------------------------------------
+bool ShaderArchive::Parse(const unsigned char* data, size_t size)
+{
+	entries.clear();
+
+	ArchiveReader reader(data, size);
+	if (reader.ReadUInt() != Magic || reader.ReadUInt() != Version)
+		return false;
+
+	// Smallest possible entry is six zero-length strings/counts:
+	// name, bytecode, constant buffers, SRVs, samplers and inputs
+	uint32_t entryCount = reader.ReadCount(6 * 4);
+	std::vector<ShaderArchiveEntry> parsed(entryCount);
+
+	for (ShaderArchiveEntry& entry : parsed)
+	{
+		entry.Name = reader.ReadString();
+		reader.ReadBytes(entry.Bytecode);
+
+		ShaderReflectionData& refl = entry.Reflection;
+
+		refl.ConstantBuffers.resize(reader.ReadCount(5 * 4));
+		for (ShaderConstantBufferDesc& cb : refl.ConstantBuffers)
+		{
+			cb.Name = reader.ReadString();
+			cb.Type = reader.ReadUInt();
+			cb.Size = reader.ReadUInt();
+			cb.BindIndex = reader.ReadUInt();
+
+			cb.Variables.resize(reader.ReadCount(3 * 4));
+			for (ShaderVariableDesc& var : cb.Variables)
+			{
+				var.Name = reader.ReadString();
+				var.ByteOffset = reader.ReadUInt();
+				var.Size = reader.ReadUInt();
+			}
+		}
+
+		ReadResources(reader, refl.ShaderResourceViews);
+		ReadResources(reader, refl.Samplers);
+
+		refl.InputElements.resize(reader.ReadCount(5 * 4));
+		for (ShaderInputElementDesc& elem : refl.InputElements)
+		{
+			elem.SemanticName = reader.ReadString();
+			elem.SemanticIndex = reader.ReadUInt();
+			elem.Format = reader.ReadUInt();
+			elem.InputSlot = reader.ReadUInt();
+			elem.PerInstance = reader.ReadUInt();
+		}
+
+		if (reader.Failed())
+			return false;
+	}
+
+	// Trailing garbage means this isn't a file we wrote
+	if (reader.Failed() || !reader.AtEnd())
+		return false;
+
+	entries.swap(parsed);
+	return true;
+}
+
+// --------------------------------------------------------
+// Adds a shader to the archive, replacing any existing
+// shader with the same name
+// --------------------------------------------------------
+void ShaderArchive::AddEntry(const ShaderArchiveEntry& entry)
+{
+	for (ShaderArchiveEntry& existing : entries)
+	{
+		if (existing.Name == entry.Name)
+		{
+			existing = entry;
+			return;
+		}
+	}
+
+	entries.push_back(entry);
+}
+
+std::vector<unsigned char> ShaderArchive::Serialize() const
+{
+	ArchiveWriter writer;
+	writer.WriteUInt(Magic);
+	writer.WriteUInt(Version);
+	writer.WriteUInt((uint32_t)entries.size());
+
+	for (const ShaderArchiveEntry& entry : entries)
+	{
+		writer.WriteString(entry.Name);
+		writer.WriteBytes(entry.Bytecode.data(), entry.Bytecode.size());
+
+		const ShaderReflectionData& refl = entry.Reflection;
+
+		writer.WriteUInt((uint32_t)refl.ConstantBuffers.size());
+		for (const ShaderConstantBufferDesc& cb : refl.ConstantBuffers)
+		{
+			writer.WriteString(cb.Name);
+			writer.WriteUInt(cb.Type);
+			writer.WriteUInt(cb.Size);
+			writer.WriteUInt(cb.BindIndex);
+
+			writer.WriteUInt((uint32_t)cb.Variables.size());
+			for (const ShaderVariableDesc& var : cb.Variables)
+			{
+				writer.WriteString(var.Name);
+				writer.WriteUInt(var.ByteOffset);
+				writer.WriteUInt(var.Size);
+			}
+		}
+
+		WriteResources(writer, refl.ShaderResourceViews);
+		WriteResources(writer, refl.Samplers);
+
+		writer.WriteUInt((uint32_t)refl.InputElements.size());
+		for (const ShaderInputElementDesc& elem : refl.InputElements)
+		{
+			writer.WriteString(elem.SemanticName);
+			writer.WriteUInt(elem.SemanticIndex);
+			writer.WriteUInt(elem.Format);
+			writer.WriteUInt(elem.InputSlot);
+			writer.WriteUInt(elem.PerInstance);
+		}
+	}
+
+	return writer.bytes;
+}
+
+bool ShaderArchive::WriteToFile(const std::string& path) const
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	std::vector<unsigned char> data = Serialize();
+	file.write((const char*)data.data(), data.size());
+	return file.good();
+}
+
+const ShaderArchiveEntry* ShaderArchive::Find(const std::string& name) const
+{
+	for (const ShaderArchiveEntry& entry : entries)
+	{
+		if (entry.Name == name)
+			return &entry;
+	}
+
+	return 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Pre-reflected shader data, stored alongside the bytecode
+// so shaders can be created without calling D3DReflect().
+//
+// Nothing in here depends on Direct3D headers - enum values
+// (buffer types, DXGI formats, etc.) are stored as plain
+// integers - so the archive can be read on any platform.
+// --------------------------------------------------------
+struct ShaderVariableDesc
+{
+	std::string Name;
+	uint32_t ByteOffset = 0;
+	uint32_t Size = 0;
+};
+
+struct ShaderConstantBufferDesc
+{
+	std::string Name;
+	uint32_t Type = 0;		// D3D_CBUFFER_TYPE
+	uint32_t Size = 0;
+	uint32_t BindIndex = 0;
+	std::vector<ShaderVariableDesc> Variables;
+};
+
+// Used for both SRVs and samplers
+struct ShaderResourceDesc
+{
+	std::string Name;
+	uint32_t BindIndex = 0;
+};
+
+struct ShaderInputElementDesc
+{
+	std::string SemanticName;
+	uint32_t SemanticIndex = 0;
+	uint32_t Format = 0;		// DXGI_FORMAT
+	uint32_t InputSlot = 0;
+	uint32_t PerInstance = 0;	// Non-zero for per-instance data
+};
+
+struct ShaderReflectionData
+{
+	std::vector<ShaderConstantBufferDesc> ConstantBuffers;
+	std::vector<ShaderResourceDesc> ShaderResourceViews;
+	std::vector<ShaderResourceDesc> Samplers;
+	std::vector<ShaderInputElementDesc> InputElements; // Vertex shaders only
+};
+
+struct ShaderArchiveEntry
+{
+	std::string Name;	// File name without the .cso extension
+	std::vector<unsigned char> Bytecode;
+	ShaderReflectionData Reflection;
+};
+
+// --------------------------------------------------------
+// A single file holding every compiled shader the game uses,
+// along with each shader's reflection data.
+//
+// File layout (all integers are little-endian uint32):
+//   magic, version, entry count
+//   per entry: name, bytecode, constant buffers (each with
+//   its variables), SRVs, samplers, input elements
+// Strings and byte arrays are stored as a length followed
+// by the raw bytes.
+// --------------------------------------------------------
+class ShaderArchive
+{
+public:
+	static const uint32_t Magic = 0x30343553; // "S540"
+	static const uint32_t Version = 3;	// Bump whenever reflection changes, so old archives are rebuilt
+
+	ShaderArchive();
+	~ShaderArchive();
+
+	// Reading
+	bool ReadFromFile(const std::string& path);
+	bool Parse(const unsigned char* data, size_t size);
+
+	// Writing
+	void AddEntry(const ShaderArchiveEntry& entry);
+	std::vector<unsigned char> Serialize() const;
+	bool WriteToFile(const std::string& path) const;
+
+	// Lookup
+	const ShaderArchiveEntry* Find(const std::string& name) const;
+	const std::vector<ShaderArchiveEntry>& GetEntries() const { return entries; }
+	size_t GetEntryCount() const { return entries.size(); }
+
+private:
+	std::vector<ShaderArchiveEntry> entries;
+};
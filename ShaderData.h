@@ -0,0 +1,220 @@
+// --------------------------------------------------------
+// GENERATED by ShaderDataTool from the compiled shaders
+// - don't edit by hand, changes will be overwritten.
+//
+// One struct per constant buffer in each shader, laid out
+// to match the HLSL packing rules.  Fill one in and pass it
+// to ISimpleShader::SetBufferData().
+// --------------------------------------------------------
+#pragma once
+
+#include <cstddef>
+#include <DirectXMath.h>
+
+#include "Lights.h"
+
+// HLSL struct types used by the buffers below - the C++
+// versions are declared by hand and must match exactly
+static_assert(sizeof(Light) == 64, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, Type) == 0, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, Direction) == 4, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, Range) == 16, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, Position) == 20, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, Intensity) == 32, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, Color) == 36, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, SpotFalloff) == 48, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, ShadowIndex) == 52, "Light doesn't match its HLSL layout");
+static_assert(offsetof(Light, Padding) == 56, "Light doesn't match its HLSL layout");
+
+namespace ShaderData
+{
+	// DepthPrepassVertexShader.hlsl - cbuffer ConstantBuffer : register(b0)
+	struct DepthPrepassVertexShaderConstantBuffer
+	{
+		static const unsigned int BindIndex = 0;
+
+		DirectX::XMFLOAT4X4 worldViewProjection;
+	};
+	static_assert(sizeof(DepthPrepassVertexShaderConstantBuffer) == 64, "DepthPrepassVertexShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(DepthPrepassVertexShaderConstantBuffer, worldViewProjection) == 0, "DepthPrepassVertexShaderConstantBuffer doesn't match its HLSL layout");
+
+	// cbuffer FrameBuffer - shared, see SharedConstantBuffers.h
+	struct FrameBuffer
+	{
+		DirectX::XMFLOAT4X4 view;
+		DirectX::XMFLOAT4X4 projection;
+		DirectX::XMFLOAT4X4 shadowViewProjections[4];
+		DirectX::XMFLOAT4 shadowCascadeSplits;
+		int shadowCascadeCount;
+		unsigned char padding0[12];
+	};
+	static_assert(sizeof(FrameBuffer) == 416, "FrameBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(FrameBuffer, view) == 0, "FrameBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(FrameBuffer, projection) == 64, "FrameBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(FrameBuffer, shadowViewProjections) == 128, "FrameBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(FrameBuffer, shadowCascadeSplits) == 384, "FrameBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(FrameBuffer, shadowCascadeCount) == 400, "FrameBuffer doesn't match its HLSL layout");
+
+	// cbuffer LightBuffer - shared, see SharedConstantBuffers.h
+	struct LightBuffer
+	{
+		Light directionalLights[10];
+		DirectX::XMFLOAT3 cameraPos;
+		int directionalLightCount;
+		DirectX::XMUINT3 clusterCounts;
+		float clusterDepthScale;
+		DirectX::XMFLOAT2 clusterTileSize;
+		float clusterDepthBias;
+		unsigned char padding0[4];
+	};
+	static_assert(sizeof(LightBuffer) == 688, "LightBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(LightBuffer, directionalLights) == 0, "LightBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(LightBuffer, cameraPos) == 640, "LightBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(LightBuffer, directionalLightCount) == 652, "LightBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(LightBuffer, clusterCounts) == 656, "LightBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(LightBuffer, clusterDepthScale) == 668, "LightBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(LightBuffer, clusterTileSize) == 672, "LightBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(LightBuffer, clusterDepthBias) == 680, "LightBuffer doesn't match its HLSL layout");
+
+	// PixelShader.hlsl - cbuffer ConstantBuffer : register(b0)
+	struct PixelShaderConstantBuffer
+	{
+		static const unsigned int BindIndex = 0;
+
+		DirectX::XMFLOAT4 surfaceColor;
+		float roughness;
+		float metalness;
+		unsigned char padding0[8];
+	};
+	static_assert(sizeof(PixelShaderConstantBuffer) == 32, "PixelShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(PixelShaderConstantBuffer, surfaceColor) == 0, "PixelShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(PixelShaderConstantBuffer, roughness) == 16, "PixelShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(PixelShaderConstantBuffer, metalness) == 20, "PixelShaderConstantBuffer doesn't match its HLSL layout");
+
+	// PostProcessBlurPS.hlsl - cbuffer externalData : register(b0)
+	struct PostProcessBlurPSExternalData
+	{
+		static const unsigned int BindIndex = 0;
+
+		DirectX::XMFLOAT4 taps[12];
+		DirectX::XMFLOAT2 texelStep;
+		int tapCount;
+		unsigned char padding0[4];
+	};
+	static_assert(sizeof(PostProcessBlurPSExternalData) == 208, "PostProcessBlurPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessBlurPSExternalData, taps) == 0, "PostProcessBlurPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessBlurPSExternalData, texelStep) == 192, "PostProcessBlurPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessBlurPSExternalData, tapCount) == 200, "PostProcessBlurPSExternalData doesn't match its HLSL layout");
+
+	// PostProcessChromaticAberrationPS.hlsl - cbuffer externalData : register(b0)
+	struct PostProcessChromaticAberrationPSExternalData
+	{
+		static const unsigned int BindIndex = 0;
+
+		float mouseX;
+		float mouseY;
+		unsigned char padding0[8];
+	};
+	static_assert(sizeof(PostProcessChromaticAberrationPSExternalData) == 16, "PostProcessChromaticAberrationPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessChromaticAberrationPSExternalData, mouseX) == 0, "PostProcessChromaticAberrationPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessChromaticAberrationPSExternalData, mouseY) == 4, "PostProcessChromaticAberrationPSExternalData doesn't match its HLSL layout");
+
+	// PostProcessCopyPS.hlsl - cbuffer externalData : register(b0)
+	struct PostProcessCopyPSExternalData
+	{
+		static const unsigned int BindIndex = 0;
+
+		DirectX::XMFLOAT2 sourceScale;
+		DirectX::XMFLOAT2 sourceMax;
+	};
+	static_assert(sizeof(PostProcessCopyPSExternalData) == 16, "PostProcessCopyPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessCopyPSExternalData, sourceScale) == 0, "PostProcessCopyPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessCopyPSExternalData, sourceMax) == 8, "PostProcessCopyPSExternalData doesn't match its HLSL layout");
+
+	// PostProcessPixelizePS.hlsl - cbuffer externalData : register(b0)
+	struct PostProcessPixelizePSExternalData
+	{
+		static const unsigned int BindIndex = 0;
+
+		float pixelLevel;
+		unsigned char padding0[12];
+	};
+	static_assert(sizeof(PostProcessPixelizePSExternalData) == 16, "PostProcessPixelizePSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessPixelizePSExternalData, pixelLevel) == 0, "PostProcessPixelizePSExternalData doesn't match its HLSL layout");
+
+	// PostProcessSharpenPS.hlsl - cbuffer externalData : register(b0)
+	struct PostProcessSharpenPSExternalData
+	{
+		static const unsigned int BindIndex = 0;
+
+		float sharpenAmount;
+		unsigned char padding0[12];
+	};
+	static_assert(sizeof(PostProcessSharpenPSExternalData) == 16, "PostProcessSharpenPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessSharpenPSExternalData, sharpenAmount) == 0, "PostProcessSharpenPSExternalData doesn't match its HLSL layout");
+
+	// PostProcessUberPS.hlsl - cbuffer externalData : register(b0)
+	struct PostProcessUberPSExternalData
+	{
+		static const unsigned int BindIndex = 0;
+
+		float sharpenAmount;
+		float pixelLevel;
+		float mouseX;
+		float mouseY;
+		DirectX::XMFLOAT2 sourceScale;
+		DirectX::XMFLOAT2 sourceMax;
+		float sharpenEnabled;
+		float pixelizeEnabled;
+		float chromaticAberrationEnabled;
+		unsigned char padding0[4];
+	};
+	static_assert(sizeof(PostProcessUberPSExternalData) == 48, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, sharpenAmount) == 0, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, pixelLevel) == 4, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, mouseX) == 8, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, mouseY) == 12, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, sourceScale) == 16, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, sourceMax) == 24, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, sharpenEnabled) == 32, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, pixelizeEnabled) == 36, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(PostProcessUberPSExternalData, chromaticAberrationEnabled) == 40, "PostProcessUberPSExternalData doesn't match its HLSL layout");
+
+	// ShadowMapVertexShader.hlsl - cbuffer externalData : register(b0)
+	struct ShadowMapVertexShaderExternalData
+	{
+		static const unsigned int BindIndex = 0;
+
+		DirectX::XMFLOAT4X4 worldViewProjection;
+	};
+	static_assert(sizeof(ShadowMapVertexShaderExternalData) == 64, "ShadowMapVertexShaderExternalData doesn't match its HLSL layout");
+	static_assert(offsetof(ShadowMapVertexShaderExternalData, worldViewProjection) == 0, "ShadowMapVertexShaderExternalData doesn't match its HLSL layout");
+
+	// SkyPixelShader.hlsl - cbuffer ConstantBuffer : register(b0)
+	struct SkyPixelShaderConstantBuffer
+	{
+		static const unsigned int BindIndex = 0;
+
+		DirectX::XMFLOAT3 ambient;
+		unsigned char padding0[4];
+	};
+	static_assert(sizeof(SkyPixelShaderConstantBuffer) == 16, "SkyPixelShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(SkyPixelShaderConstantBuffer, ambient) == 0, "SkyPixelShaderConstantBuffer doesn't match its HLSL layout");
+
+	// VertexShader.hlsl - cbuffer ConstantBuffer : register(b0)
+	struct VertexShaderConstantBuffer
+	{
+		static const unsigned int BindIndex = 0;
+
+		DirectX::XMFLOAT4X4 world;
+		DirectX::XMFLOAT4X4 worldInvTranspose;
+		DirectX::XMFLOAT4X4 worldViewProjection;
+		DirectX::XMUINT2 lightRange;
+		unsigned char padding0[8];
+	};
+	static_assert(sizeof(VertexShaderConstantBuffer) == 208, "VertexShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(VertexShaderConstantBuffer, world) == 0, "VertexShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(VertexShaderConstantBuffer, worldInvTranspose) == 64, "VertexShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(VertexShaderConstantBuffer, worldViewProjection) == 128, "VertexShaderConstantBuffer doesn't match its HLSL layout");
+	static_assert(offsetof(VertexShaderConstantBuffer, lightRange) == 192, "VertexShaderConstantBuffer doesn't match its HLSL layout");
+}
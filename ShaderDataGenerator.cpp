@@ -0,0 +1,393 @@
+#include "ShaderDataGenerator.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	unsigned int RoundUp16(unsigned int size)
+	{
+		return (size + 15) & ~15u;
+	}
+
+	// Size of one element of a type, following the HLSL constant buffer
+	// packing rules (every matrix row/column starts a new register)
+	unsigned int ElementSize(ID3D11ShaderReflectionType* type, const D3D11_SHADER_TYPE_DESC& desc)
+	{
+		switch (desc.Class)
+		{
+		case D3D_SVC_SCALAR:
+		case D3D_SVC_VECTOR:
+			return desc.Columns * 4;
+
+		case D3D_SVC_MATRIX_ROWS:
+			return (desc.Rows - 1) * 16 + desc.Columns * 4;
+
+		case D3D_SVC_MATRIX_COLUMNS:
+			return (desc.Columns - 1) * 16 + desc.Rows * 4;
+
+		case D3D_SVC_STRUCT:
+		{
+			// Ends wherever its last member does
+			if (desc.Members == 0)
+				return 0;
+
+			ID3D11ShaderReflectionType* last = type->GetMemberTypeByIndex(desc.Members - 1);
+			D3D11_SHADER_TYPE_DESC lastDesc;
+			last->GetDesc(&lastDesc);
+
+			unsigned int lastSize = ElementSize(last, lastDesc);
+			if (lastDesc.Elements > 0)
+				lastSize += (lastDesc.Elements - 1) * RoundUp16(lastSize);
+
+			return lastDesc.Offset + lastSize;
+		}
+
+		default:
+			return 0;
+		}
+	}
+
+	// The C++ type with the same layout as a single element, or an
+	// empty string if there isn't one
+	std::string CppTypeName(const D3D11_SHADER_TYPE_DESC& desc)
+	{
+		if (desc.Class == D3D_SVC_STRUCT)
+			return desc.Name;
+
+		std::string scalar;
+		std::string vector;
+		switch (desc.Type)
+		{
+		case D3D_SVT_FLOAT: scalar = "float"; vector = "DirectX::XMFLOAT"; break;
+		case D3D_SVT_INT:
+		case D3D_SVT_BOOL: scalar = "int"; vector = "DirectX::XMINT"; break; // HLSL bools are 4 bytes
+		case D3D_SVT_UINT: scalar = "unsigned int"; vector = "DirectX::XMUINT"; break;
+		default: return "";
+		}
+
+		switch (desc.Class)
+		{
+		case D3D_SVC_SCALAR:
+			return scalar;
+
+		case D3D_SVC_VECTOR:
+			return vector + std::to_string(desc.Columns);
+
+		case D3D_SVC_MATRIX_ROWS:
+		case D3D_SVC_MATRIX_COLUMNS:
+			// Only 4x4 matrices pack without gaps
+			if (desc.Type == D3D_SVT_FLOAT && desc.Rows == 4 && desc.Columns == 4)
+				return "DirectX::XMFLOAT4X4";
+			return "";
+
+		default:
+			return "";
+		}
+	}
+
+	// Turns an HLSL cbuffer name into something usable in a C++ identifier
+	std::string IdentifierPart(const std::string& name)
+	{
+		std::string result;
+		for (char c : name)
+		{
+			if (isalnum((unsigned char)c) || c == '_')
+				result += c;
+		}
+
+		if (!result.empty())
+			result[0] = (char)toupper((unsigned char)result[0]);
+
+		return result;
+	}
+}
+
+ShaderDataGenerator::ShaderDataGenerator() { }
+
+ShaderDataGenerator::~ShaderDataGenerator() { }
+
+void ShaderDataGenerator::AddInclude(const std::string& header)
+{
+	includes.push_back(header);
+}
+
+void ShaderDataGenerator::AddSharedBuffer(const std::string& name)
+{
+	sharedBuffers.push_back(name);
+}
+
+// --------------------------------------------------------
+// Reflects every constant buffer in a compiled shader.  Each
+// one becomes a struct named after the shader and the buffer
+// (e.g. "ConstantBuffer" in VertexShader.cso becomes
+// ShaderData::VertexShaderConstantBuffer), except for shared
+// buffers, which are just named after the buffer.
+//
+// Returns false if a shared buffer's layout differs from
+// another shader's version of it.
+// --------------------------------------------------------
+bool ShaderDataGenerator::AddShader(const std::string& shaderName, Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob)
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
+	HRESULT hr = D3DReflect(
+		shaderBlob->GetBufferPointer(),
+		shaderBlob->GetBufferSize(),
+		IID_ID3D11ShaderReflection,
+		(void**)refl.GetAddressOf());
+
+	if (hr != S_OK)
+		return false;
+
+	D3D11_SHADER_DESC shaderDesc;
+	refl->GetDesc(&shaderDesc);
+
+	for (unsigned int i = 0; i < shaderDesc.ConstantBuffers; i++)
+	{
+		ID3D11ShaderReflectionConstantBuffer* cb = refl->GetConstantBufferByIndex(i);
+		D3D11_SHADER_BUFFER_DESC bufferDesc;
+		cb->GetDesc(&bufferDesc);
+
+		// Skip texture and structured buffers
+		if (bufferDesc.Type != D3D_CT_CBUFFER)
+			continue;
+
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		if (refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc) != S_OK)
+			continue;
+
+		bool shared = std::find(sharedBuffers.begin(), sharedBuffers.end(), bufferDesc.Name) != sharedBuffers.end();
+
+		StructDesc desc;
+		desc.Name = shared ? IdentifierPart(bufferDesc.Name) : shaderName + IdentifierPart(bufferDesc.Name);
+		desc.Source = shared ?
+			std::string("cbuffer ") + bufferDesc.Name + " - shared, see SharedConstantBuffers.h" :
+			shaderName + ".hlsl - cbuffer " + bufferDesc.Name + " : register(b" + std::to_string(bindDesc.BindPoint) + ")";
+		desc.BindIndex = bindDesc.BindPoint;
+		desc.Size = bufferDesc.Size;
+		desc.Shared = shared;
+
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			ID3D11ShaderReflectionVariable* var = cb->GetVariableByIndex(v);
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			var->GetDesc(&varDesc);
+
+			desc.Members.push_back(ReflectMember(var->GetType(), varDesc.Name, varDesc.StartOffset, varDesc.Size));
+		}
+
+		std::sort(desc.Members.begin(), desc.Members.end(),
+			[](const Member& a, const Member& b) { return a.Offset < b.Offset; });
+
+		if (shared)
+		{
+			// Every shader must agree on the layout of a shared buffer
+			auto existing = std::find_if(constantBuffers.begin(), constantBuffers.end(),
+				[&](const StructDesc& other) { return other.Name == desc.Name; });
+
+			if (existing != constantBuffers.end())
+			{
+				if (!SameLayout(*existing, desc))
+					return false;
+
+				continue;
+			}
+		}
+
+		// Re-adding a shader replaces its old buffers
+		constantBuffers.erase(
+			std::remove_if(constantBuffers.begin(), constantBuffers.end(),
+				[&](const StructDesc& existing) { return existing.Name == desc.Name; }),
+			constantBuffers.end());
+		constantBuffers.push_back(desc);
+	}
+
+	return true;
+}
+
+ShaderDataGenerator::Member ShaderDataGenerator::ReflectMember(ID3D11ShaderReflectionType* type, const std::string& name, unsigned int offset, unsigned int size)
+{
+	D3D11_SHADER_TYPE_DESC typeDesc;
+	type->GetDesc(&typeDesc);
+
+	if (typeDesc.Class == D3D_SVC_STRUCT)
+		ReflectStruct(type, typeDesc);
+
+	Member member;
+	member.Name = name;
+	member.Type = CppTypeName(typeDesc);
+	member.Offset = offset;
+	member.Size = size;
+	member.Elements = typeDesc.Elements;
+
+	// HLSL starts each array element on a new register, so a C++
+	// array only lines up if the elements fill whole registers
+	if (member.Elements > 0 && ElementSize(type, typeDesc) % 16 != 0)
+		member.Type = "";
+
+	return member;
+}
+
+// --------------------------------------------------------
+// Records the layout of an HLSL struct type, so the C++ type
+// of the same name can be checked against it
+// --------------------------------------------------------
+void ShaderDataGenerator::ReflectStruct(ID3D11ShaderReflectionType* type, const D3D11_SHADER_TYPE_DESC& typeDesc)
+{
+	for (const StructDesc& existing : hlslStructs)
+	{
+		if (existing.Name == typeDesc.Name)
+			return;
+	}
+
+	StructDesc desc;
+	desc.Name = typeDesc.Name;
+	desc.BindIndex = 0;
+	desc.Shared = false;
+	desc.Size = ElementSize(type, typeDesc);
+
+	for (unsigned int i = 0; i < typeDesc.Members; i++)
+	{
+		ID3D11ShaderReflectionType* memberType = type->GetMemberTypeByIndex(i);
+		D3D11_SHADER_TYPE_DESC memberDesc;
+		memberType->GetDesc(&memberDesc);
+
+		unsigned int memberSize = ElementSize(memberType, memberDesc);
+		if (memberDesc.Elements > 0)
+			memberSize += (memberDesc.Elements - 1) * RoundUp16(memberSize);
+
+		desc.Members.push_back(ReflectMember(memberType, type->GetMemberTypeName(i), memberDesc.Offset, memberSize));
+	}
+
+	// Nested structs were added first, so they're checked first
+	hlslStructs.push_back(desc);
+}
+
+std::string ShaderDataGenerator::Generate() const
+{
+	std::string out;
+	out += "// --------------------------------------------------------\n";
+	out += "// GENERATED by ShaderDataTool from the compiled shaders\n";
+	out += "// - don't edit by hand, changes will be overwritten.\n";
+	out += "//\n";
+	out += "// One struct per constant buffer in each shader, laid out\n";
+	out += "// to match the HLSL packing rules.  Fill one in and pass it\n";
+	out += "// to ISimpleShader::SetBufferData().\n";
+	out += "// --------------------------------------------------------\n";
+	out += "#pragma once\n\n";
+	out += "#include <cstddef>\n";
+	out += "#include <DirectXMath.h>\n";
+
+	if (!includes.empty())
+	{
+		out += "\n";
+		for (const std::string& header : includes)
+			out += "#include \"" + header + "\"\n";
+	}
+
+	if (!hlslStructs.empty())
+	{
+		out += "\n// HLSL struct types used by the buffers below - the C++\n";
+		out += "// versions are declared by hand and must match exactly\n";
+		for (const StructDesc& desc : hlslStructs)
+			WriteAsserts(out, desc, "");
+	}
+
+	// Sorted so the output doesn't depend on file enumeration order
+	std::vector<StructDesc> sorted = constantBuffers;
+	std::sort(sorted.begin(), sorted.end(),
+		[](const StructDesc& a, const StructDesc& b) { return a.Name < b.Name; });
+
+	out += "\nnamespace ShaderData\n{\n";
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		if (i > 0) out += "\n";
+		WriteStruct(out, sorted[i]);
+	}
+	out += "}\n";
+
+	return out;
+}
+
+void ShaderDataGenerator::WriteStruct(std::string& out, const StructDesc& desc)
+{
+	out += "\t// " + desc.Source + "\n";
+	out += "\tstruct " + desc.Name + "\n\t{\n";
+
+	// Shared buffers may be bound to a different register in each shader
+	if (!desc.Shared)
+		out += "\t\tstatic const unsigned int BindIndex = " + std::to_string(desc.BindIndex) + ";\n\n";
+
+	unsigned int cursor = 0;
+	unsigned int padCount = 0;
+	for (const Member& member : desc.Members)
+	{
+		if (member.Offset > cursor)
+			out += "\t\tunsigned char padding" + std::to_string(padCount++) + "[" + std::to_string(member.Offset - cursor) + "];\n";
+
+		if (member.Type.empty())
+			out += "\t\tunsigned char " + member.Name + "[" + std::to_string(member.Size) + "]; // No C++ type with a matching layout\n";
+		else if (member.Elements > 0)
+			out += "\t\t" + member.Type + " " + member.Name + "[" + std::to_string(member.Elements) + "];\n";
+		else
+			out += "\t\t" + member.Type + " " + member.Name + ";\n";
+
+		cursor = member.Offset + member.Size;
+	}
+
+	// Buffers are always a multiple of 16 bytes
+	if (desc.Size > cursor)
+		out += "\t\tunsigned char padding" + std::to_string(padCount++) + "[" + std::to_string(desc.Size - cursor) + "];\n";
+
+	out += "\t};\n";
+	WriteAsserts(out, desc, "\t");
+}
+
+bool ShaderDataGenerator::SameLayout(const StructDesc& a, const StructDesc& b)
+{
+	if (a.Size != b.Size || a.Members.size() != b.Members.size())
+		return false;
+
+	for (size_t i = 0; i < a.Members.size(); i++)
+	{
+		const Member& ma = a.Members[i];
+		const Member& mb = b.Members[i];
+		if (ma.Name != mb.Name || ma.Type != mb.Type || ma.Offset != mb.Offset || ma.Size != mb.Size || ma.Elements != mb.Elements)
+			return false;
+	}
+
+	return true;
+}
+
+void ShaderDataGenerator::WriteAsserts(std::string& out, const StructDesc& desc, const std::string& indent)
+{
+	std::string message = "\"" + desc.Name + " doesn't match its HLSL layout\"";
+
+	out += indent + "static_assert(sizeof(" + desc.Name + ") == " + std::to_string(desc.Size) + ", " + message + ");\n";
+	for (const Member& member : desc.Members)
+		out += indent + "static_assert(offsetof(" + desc.Name + ", " + member.Name + ") == " + std::to_string(member.Offset) + ", " + message + ");\n";
+}
+
+bool ShaderDataGenerator::WriteToFile(const std::wstring& path, bool& changed) const
+{
+	std::string contents = Generate();
+	changed = false;
+
+	std::ifstream existing(path, std::ios::binary);
+	if (existing.is_open())
+	{
+		std::string old((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+		if (old == contents)
+			return true;
+	}
+	existing.close();
+	changed = true;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write(contents.data(), contents.size());
+	return file.good();
+}
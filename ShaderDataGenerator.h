@@ -0,0 +1,80 @@
+#pragma once
+
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#include <wrl/client.h>
+
+#include <string>
+#include <vector>
+
+// --------------------------------------------------------
+// Writes ShaderData.h: one packed C++ struct per shader
+// constant buffer, laid out exactly like the HLSL version,
+// with static_asserts on every offset and on the size.
+//
+// Filling one of these structs and handing it to
+// ISimpleShader::SetBufferData() uploads the whole buffer in
+// a single copy.  If a shader's buffers change, regenerating
+// the header updates the structs, and any C++ type a buffer
+// refers to (like Light) that no longer matches its HLSL
+// struct fails to compile.
+//
+// Run by ShaderDataTool, as a build step between compiling the
+// shaders and compiling the game, so the game is never built
+// against structs from older shaders.
+// --------------------------------------------------------
+class ShaderDataGenerator
+{
+public:
+	ShaderDataGenerator();
+	~ShaderDataGenerator();
+
+	// Headers that declare the C++ versions of HLSL struct types
+	void AddInclude(const std::string& header);
+
+	// Buffers shared between shaders get a single struct named
+	// after the buffer, and must be identical in every shader
+	void AddSharedBuffer(const std::string& name);
+
+	// Reflects all of the shader's constant buffers
+	bool AddShader(const std::string& shaderName, Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
+
+	std::string Generate() const;
+
+	// Leaves the file untouched if nothing changed, to avoid
+	// needlessly rebuilding everything that includes it, and
+	// reports whether it was rewritten
+	bool WriteToFile(const std::wstring& path, bool& changed) const;
+
+private:
+	struct Member
+	{
+		std::string Name;
+		std::string Type;		// Empty if there's no matching C++ type
+		unsigned int Offset;
+		unsigned int Size;
+		unsigned int Elements;	// Zero if not an array
+	};
+
+	struct StructDesc
+	{
+		std::string Name;
+		std::string Source;		// Where the struct came from, for comments
+		unsigned int BindIndex;
+		unsigned int Size;
+		bool Shared;			// Bound by name rather than register
+		std::vector<Member> Members;
+	};
+
+	std::vector<std::string> includes;
+	std::vector<std::string> sharedBuffers;
+	std::vector<StructDesc> constantBuffers;
+	std::vector<StructDesc> hlslStructs; // Declared elsewhere, only checked
+
+	Member ReflectMember(ID3D11ShaderReflectionType* type, const std::string& name, unsigned int offset, unsigned int size);
+	void ReflectStruct(ID3D11ShaderReflectionType* type, const D3D11_SHADER_TYPE_DESC& typeDesc);
+
+	static bool SameLayout(const StructDesc& a, const StructDesc& b);
+	static void WriteStruct(std::string& out, const StructDesc& desc);
+	static void WriteAsserts(std::string& out, const StructDesc& desc, const std::string& indent);
+};
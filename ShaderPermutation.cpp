@@ -0,0 +1,101 @@
+#include "ShaderPermutation.h"
+
+// Lighting.hlsli's MAX_NUM_LIGHTS is the largest bucket
+const unsigned int ShaderPermutationKey::LightBuckets[ShaderPermutationKey::LightBucketCount] = { 1, 2, 5, 10 };
+
+unsigned int ShaderPermutationKey::BucketForLightCount(unsigned int lightCount)
+{
+	for (unsigned int i = 0; i < LightBucketCount; i++)
+	{
+		if (lightCount <= LightBuckets[i])
+			return i;
+	}
+
+	return LightBucketCount - 1;
+}
+
+unsigned int ShaderPermutationKey::GetIndex() const
+{
+	return
+		(lightBucket << 5) |
+		((clusteredLights ? 1 : 0) << 4) |
+		((pbrTextures && packedORM ? 1 : 0) << 3) |
+		((shadows ? 1 : 0) << 2) |
+		((normalMap ? 1 : 0) << 1) |
+		(pbrTextures ? 1 : 0);
+}
+
+ShaderPermutationKey ShaderPermutationKey::FromIndex(unsigned int index)
+{
+	ShaderPermutationKey key;
+	key.lightBucket = (index >> 5) % LightBucketCount;
+	key.clusteredLights = (index & 16) != 0;
+	key.packedORM = (index & 8) != 0;
+	key.shadows = (index & 4) != 0;
+	key.normalMap = (index & 2) != 0;
+	key.pbrTextures = (index & 1) != 0;
+	return key;
+}
+
+bool ShaderPermutationKey::IsDistinct() const
+{
+	// Packing only changes anything when textures are sampled
+	return pbrTextures || !packedORM;
+}
+
+std::string ShaderPermutationKey::GetName(const std::string& baseName) const
+{
+	return baseName +
+		"_L" + std::to_string(LightBuckets[lightBucket]) +
+		"_S" + (shadows ? "1" : "0") +
+		"_N" + (normalMap ? "1" : "0") +
+		"_T" + (pbrTextures ? "1" : "0") +
+		"_O" + (pbrTextures && packedORM ? "1" : "0") +
+		"_C" + (clusteredLights ? "1" : "0");
+}
+
+std::vector<std::pair<std::string, std::string>> ShaderPermutationKey::GetDefines() const
+{
+	return {
+		{ "LIGHT_COUNT_BUCKET", std::to_string(LightBuckets[lightBucket]) },
+		{ "SHADOWS", shadows ? "1" : "0" },
+		{ "NORMAL_MAP", normalMap ? "1" : "0" },
+		{ "PBR_TEXTURES", pbrTextures ? "1" : "0" },
+		{ "PACKED_ORM", pbrTextures && packedORM ? "1" : "0" },
+		{ "CLUSTERED_LIGHTS", clusteredLights ? "1" : "0" },
+	};
+}
+
+unsigned int PostProcessPermutationKey::GetIndex() const
+{
+	return
+		((chromaticAberration ? 1 : 0) << 2) |
+		((pixelize ? 1 : 0) << 1) |
+		(sharpen ? 1 : 0);
+}
+
+PostProcessPermutationKey PostProcessPermutationKey::FromIndex(unsigned int index)
+{
+	PostProcessPermutationKey key;
+	key.chromaticAberration = (index & 4) != 0;
+	key.pixelize = (index & 2) != 0;
+	key.sharpen = (index & 1) != 0;
+	return key;
+}
+
+std::string PostProcessPermutationKey::GetName(const std::string& baseName) const
+{
+	return baseName +
+		"_S" + (sharpen ? "1" : "0") +
+		"_P" + (pixelize ? "1" : "0") +
+		"_A" + (chromaticAberration ? "1" : "0");
+}
+
+std::vector<std::pair<std::string, std::string>> PostProcessPermutationKey::GetDefines() const
+{
+	return {
+		{ "SHARPEN", sharpen ? "1" : "0" },
+		{ "PIXELIZE", pixelize ? "1" : "0" },
+		{ "CHROMATIC_ABERRATION", chromaticAberration ? "1" : "0" },
+	};
+}
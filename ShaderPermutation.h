@@ -0,0 +1,142 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "SimpleShader.h"
+#include "ShaderArchive.h"
+
+// --------------------------------------------------------
+// Identifies one compiled variant of a shader.  Each field
+// maps to a preprocessor define in Lighting.hlsli/PixelShader.hlsl,
+// letting a variant skip work the current material or frame
+// doesn't need.
+// --------------------------------------------------------
+struct ShaderPermutationKey
+{
+	unsigned int lightBucket = LightBucketCount - 1;	// Index into LightBuckets
+	bool shadows = true;			// Sample the shadow map for light 0
+	bool normalMap = true;			// Perturb normals with a normal map
+	bool pbrTextures = true;		// Roughness/metalness from textures instead of constants
+	bool packedORM = false;			// Those come from one packed ORM texture (only with pbrTextures)
+	bool clusteredLights = true;	// Point/spot lights from the pixel's froxel, not the entity's own list
+
+	// Max directional lights each variant's loop is compiled for
+	static const unsigned int LightBucketCount = 4;
+	static const unsigned int LightBuckets[LightBucketCount];
+
+	static const unsigned int Count = LightBucketCount * 2 * 2 * 2 * 2 * 2;
+
+	// Smallest bucket that fits the given number of lights
+	static unsigned int BucketForLightCount(unsigned int lightCount);
+
+	unsigned int GetIndex() const;
+	static ShaderPermutationKey FromIndex(unsigned int index);
+
+	// False if another key compiles to the same shader
+	bool IsDistinct() const;
+
+	// Name of this variant in the shader archive (e.g. "PixelShader_L5_S1_N1_T1_O0_C1")
+	std::string GetName(const std::string& baseName) const;
+
+	// Name/value pairs to pass to the shader compiler
+	std::vector<std::pair<std::string, std::string>> GetDefines() const;
+};
+
+// --------------------------------------------------------
+// Identifies one combination of the post-processing effects
+// fused into a single pass of PostProcessUberPS.hlsl.  Each
+// field maps to a preprocessor define there.
+// --------------------------------------------------------
+struct PostProcessPermutationKey
+{
+	bool sharpen = true;
+	bool pixelize = true;
+	bool chromaticAberration = true;
+
+	static const unsigned int Count = 2 * 2 * 2;
+
+	unsigned int GetIndex() const;
+	static PostProcessPermutationKey FromIndex(unsigned int index);
+	bool IsDistinct() const { return true; }
+
+	// True if any effect is on
+	bool Any() const { return sharpen || pixelize || chromaticAberration; }
+
+	// Name of this variant in the shader archive (e.g. "PostProcessUberPS_S1_P0_A1")
+	std::string GetName(const std::string& baseName) const;
+
+	// Name/value pairs to pass to the shader compiler
+	std::vector<std::pair<std::string, std::string>> GetDefines() const;
+};
+
+// --------------------------------------------------------
+// Creates shader variants from the shader archive on first
+// use and hands back the same instance afterwards.  Variants
+// missing from the archive fall back to the full-featured shader.
+//
+// Key is one of the permutation keys above.
+// --------------------------------------------------------
+template<typename Key>
+class ShaderPermutationCache
+{
+public:
+	ShaderPermutationCache(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		const ShaderArchive* archive,
+		std::string baseName,
+		std::shared_ptr<SimplePixelShader> fallback)
+		: device(device), context(context), archive(archive), baseName(baseName), fallback(fallback) { }
+	~ShaderPermutationCache() { }
+
+	std::shared_ptr<SimplePixelShader> Get(const Key& key);
+
+	// Variants actually loaded, and keys left with the fallback
+	// because the archive didn't have (or couldn't create) theirs
+	size_t GetLoadedCount() { return shaders.size() - fallbackCount; }
+	size_t GetFallbackCount() { return fallbackCount; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	const ShaderArchive* archive;
+	std::string baseName;
+	std::shared_ptr<SimplePixelShader> fallback;
+
+	std::unordered_map<unsigned int, std::shared_ptr<SimplePixelShader>> shaders;
+	size_t fallbackCount = 0;
+};
+
+// --------------------------------------------------------
+// Gets the variant for the given key, creating it from the
+// archive the first time it's requested
+// --------------------------------------------------------
+template<typename Key>
+std::shared_ptr<SimplePixelShader> ShaderPermutationCache<Key>::Get(const Key& key)
+{
+	unsigned int index = key.GetIndex();
+
+	auto found = shaders.find(index);
+	if (found != shaders.end())
+		return found->second;
+
+	std::shared_ptr<SimplePixelShader> shader = fallback;
+
+	const ShaderArchiveEntry* entry = archive ? archive->Find(key.GetName(baseName)) : 0;
+	if (entry)
+	{
+		std::shared_ptr<SimplePixelShader> variant = std::make_shared<SimplePixelShader>(device, context, *entry);
+		if (variant->IsShaderValid())
+			shader = variant;
+	}
+
+	// Remember misses too, so we only search the archive once per key
+	if (shader == fallback)
+		fallbackCount++;
+	shaders.insert({ index, shader });
+	return shader;
+}
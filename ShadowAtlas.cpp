@@ -0,0 +1,557 @@
+#include "ShadowAtlas.h"
+#include "StateCache.h"
+#include "ShaderData.h"
+#include "MatrixBatch.h"
+
+#include <DirectXCollision.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	// Local lights' shadows start this close to the light
+	const float ShadowNearClip = 0.05f;
+
+	// Smallest capacity the tile buffer is created with
+	const unsigned int MinTileCapacity = 64;
+
+	// Cube faces, in the order the pixel shader expects: +X, -X, +Y, -Y, +Z, -Z
+	const XMFLOAT3 FaceDirections[6] = { XMFLOAT3(1, 0, 0), XMFLOAT3(-1, 0, 0), XMFLOAT3(0, 1, 0), XMFLOAT3(0, -1, 0), XMFLOAT3(0, 0, 1), XMFLOAT3(0, 0, -1) };
+	const XMFLOAT3 FaceUps[6] = { XMFLOAT3(0, 1, 0), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 0, -1), XMFLOAT3(0, 0, 1), XMFLOAT3(0, 1, 0), XMFLOAT3(0, 1, 0) };
+
+	// FNV-1a
+	void HashBytes(uint64_t& hash, const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+}
+
+void QuadtreeAllocator::Initialize(int _levelCount)
+{
+	levelCount = _levelCount;
+	states.resize(levelCount);
+	for (int level = 0; level < levelCount; level++)
+		states[level].assign((size_t)1 << (2 * level), NodeFree);
+	usedArea = 0;
+}
+
+// --------------------------------------------------------
+// Looks for a free node at the given depth.  Nodes that are
+// already split are tried first, so free space stays in as
+// large pieces as possible.
+// --------------------------------------------------------
+bool QuadtreeAllocator::Allocate(int level, Node& node)
+{
+	if (level < 0 || level >= levelCount)
+		return false;
+
+	return AllocateBelow(0, 0, 0, level, node, false) || AllocateBelow(0, 0, 0, level, node, true);
+}
+
+bool QuadtreeAllocator::AllocateBelow(int level, int x, int y, int targetLevel, Node& node, bool splitFree)
+{
+	NodeState& state = State(level, x, y);
+	if (state == NodeUsed)
+		return false;
+
+	if (level == targetLevel)
+	{
+		if (state != NodeFree)
+			return false;
+
+		state = NodeUsed;
+		node = { level, x, y };
+		usedArea += 1u << (2 * (levelCount - 1 - level));
+		return true;
+	}
+
+	bool wasFree = state == NodeFree;
+	if (wasFree)
+	{
+		if (!splitFree)
+			return false;
+
+		state = NodeSplit;
+		for (int child = 0; child < 4; child++)
+			State(level + 1, x * 2 + (child & 1), y * 2 + (child >> 1)) = NodeFree;
+	}
+
+	for (int child = 0; child < 4; child++)
+	{
+		if (AllocateBelow(level + 1, x * 2 + (child & 1), y * 2 + (child >> 1), targetLevel, node, splitFree))
+			return true;
+	}
+
+	// Nothing fit, so don't leave it split for no reason
+	if (wasFree)
+		state = NodeFree;
+	return false;
+}
+
+// --------------------------------------------------------
+// Frees a node, then merges its parents back together for as
+// long as all four of their children are free
+// --------------------------------------------------------
+void QuadtreeAllocator::Free(const Node& node)
+{
+	State(node.level, node.x, node.y) = NodeFree;
+	usedArea -= 1u << (2 * (levelCount - 1 - node.level));
+
+	int level = node.level;
+	int x = node.x;
+	int y = node.y;
+	while (level > 0)
+	{
+		x /= 2;
+		y /= 2;
+		for (int child = 0; child < 4; child++)
+		{
+			if (State(level, x * 2 + (child & 1), y * 2 + (child >> 1)) != NodeFree)
+				return;
+		}
+
+		level--;
+		State(level, x, y) = NodeFree;
+	}
+}
+
+float QuadtreeAllocator::GetOccupancy()
+{
+	if (levelCount == 0)
+		return 0;
+
+	return (float)usedArea / (1u << (2 * (levelCount - 1)));
+}
+
+ShadowAtlas::ShadowAtlas() { }
+
+ShadowAtlas::~ShadowAtlas() { }
+
+void ShadowAtlas::Initialize(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	std::shared_ptr<SimpleVertexShader> _shadowMapVertexShader,
+	std::shared_ptr<SimpleVertexShader> _fullscreenVertexShader)
+{
+	this->device = device;
+	this->context = context;
+	shadowMapVertexShader = _shadowMapVertexShader;
+	fullscreenVertexShader = _fullscreenVertexShader;
+
+	allocator.Initialize(LevelCount);
+
+	D3D11_TEXTURE2D_DESC atlasDesc = {};
+	atlasDesc.Width = AtlasSize;
+	atlasDesc.Height = AtlasSize;
+	atlasDesc.ArraySize = 1;
+	atlasDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
+	atlasDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+	atlasDesc.MipLevels = 1;
+	atlasDesc.SampleDesc.Count = 1;
+	atlasDesc.Usage = D3D11_USAGE_DEFAULT;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> atlasTexture;
+	device->CreateTexture2D(&atlasDesc, 0, atlasTexture.GetAddressOf());
+
+	D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc = {};
+	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+	dsvDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
+	device->CreateDepthStencilView(atlasTexture.Get(), &dsvDesc, atlasDSV.GetAddressOf());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	device->CreateShaderResourceView(atlasTexture.Get(), &srvDesc, atlasSRV.GetAddressOf());
+
+	// Nothing has been drawn yet, so every tile starts out clear
+	context->ClearDepthStencilView(atlasDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+
+	D3D11_RASTERIZER_DESC rastDesc = {};
+	rastDesc.FillMode = D3D11_FILL_SOLID;
+	rastDesc.CullMode = D3D11_CULL_BACK;
+	rastDesc.DepthClipEnable = true;
+	rastDesc.DepthBias = 1000; // Min. precision units, not world units!
+	rastDesc.SlopeScaledDepthBias = 1.0f;
+	device->CreateRasterizerState(&rastDesc, shadowRasterizer.GetAddressOf());
+
+	// A single tile can't be cleared directly, so a full screen
+	// triangle writes the far plane's depth over it instead
+	D3D11_DEPTH_STENCIL_DESC clearDesc = {};
+	clearDesc.DepthEnable = true;
+	clearDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	clearDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	device->CreateDepthStencilState(&clearDesc, clearDepthState.GetAddressOf());
+}
+
+// --------------------------------------------------------
+// Ranks the local lights the camera can see, frees the tiles
+// of any that dropped out or want a different size, then hands
+// out tiles most important light first, shrinking them when the
+// atlas is too full for the size a light wants.
+// --------------------------------------------------------
+void ShadowAtlas::Update(
+	std::vector<Light>& lights,
+	std::shared_ptr<Camera> camera,
+	std::vector<GameEntity>& gameEntities,
+	int height)
+{
+	for (size_t i = lights.size(); i < lightShadows.size(); i++)
+		FreeTiles(lightShadows[i]);
+	lightShadows.resize(lights.size());
+
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMFLOAT4X4 projection = camera->GetProjectionMatrix();
+	BoundingFrustum frustum(XMLoadFloat4x4(&projection));
+	frustum.Transform(frustum, XMMatrixInverse(0, XMLoadFloat4x4(&view)));
+
+	// Importance is how many pixels across the light's range
+	// covers, weighted by its intensity
+	struct Candidate
+	{
+		int light;
+		float importance;
+		int level;
+	};
+	std::vector<Candidate> candidates;
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		Light& light = lights[i];
+		light.ShadowIndex = -1;
+		if (light.Type != LIGHT_TYPE_POINT && light.Type != LIGHT_TYPE_SPOT)
+			continue;
+		if (!frustum.Intersects(BoundingSphere(light.Position, light.Range)))
+			continue;
+
+		const XMFLOAT3& p = light.Position;
+		float viewZ = p.x * view._13 + p.y * view._23 + p.z * view._33 + view._43;
+		float coverage = (float)height;
+		if (viewZ > light.Range)
+			coverage = min(coverage, light.Range * projection._22 * height / viewZ);
+
+		// A cube face only sees part of what the light reaches
+		float tileSize = light.Type == LIGHT_TYPE_POINT ? coverage * 0.5f : coverage;
+		int level = (int)roundf(log2f(AtlasSize / max(tileSize, 1.0f)));
+		level = max(LargestTileLevel, min(level, LevelCount - 1));
+
+		candidates.push_back({ (int)i, coverage * light.Intensity, level });
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.importance > b.importance; });
+	if (candidates.size() > MaxShadowedLights)
+		candidates.resize(MaxShadowedLights);
+
+	// Lights keep their tiles unless they'd be more than one size off
+	std::vector<int> wantedLevels(lights.size(), -1);
+	for (const Candidate& candidate : candidates)
+		wantedLevels[candidate.light] = candidate.level;
+
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		LightShadow& shadow = lightShadows[i];
+		if (shadow.faceCount == 0)
+			continue;
+
+		int faceCount = lights[i].Type == LIGHT_TYPE_POINT ? 6 : 1;
+		if (wantedLevels[i] < 0 || shadow.faceCount != faceCount || abs(shadow.nodes[0].level - wantedLevels[i]) > 1)
+			FreeTiles(shadow);
+	}
+
+	tiles.clear();
+	tileViews.clear();
+	tileProjections.clear();
+	shadowedLightCount = 0;
+	for (const Candidate& candidate : candidates)
+	{
+		Light& light = lights[candidate.light];
+		LightShadow& shadow = lightShadows[candidate.light];
+		shadow.firstTile = -1;
+		shadow.redraw = false;
+
+		if (shadow.faceCount == 0)
+		{
+			int faceCount = light.Type == LIGHT_TYPE_POINT ? 6 : 1;
+			for (int level = candidate.level; level < LevelCount; level++)
+			{
+				if (AllocateTiles(shadow, faceCount, level))
+					break;
+			}
+
+			if (shadow.faceCount == 0)
+				continue;
+		}
+
+		AddTiles(light, shadow);
+		light.ShadowIndex = shadow.firstTile;
+		shadowedLightCount++;
+
+		// Only redraw what changed since the tiles were last drawn
+		uint64_t signature = GetSignature(light, shadow, gameEntities);
+		shadow.redraw = signature != shadow.signature;
+		shadow.signature = signature;
+	}
+}
+
+// --------------------------------------------------------
+// Clears, then redraws, every tile of the lights Update()
+// flagged.  Changes the render target and viewport.
+// --------------------------------------------------------
+void ShadowAtlas::Draw(std::vector<GameEntity>& gameEntities)
+{
+	StateCache& cache = StateCache::GetInstance();
+
+	tilesRedrawn = 0;
+	for (LightShadow& shadow : lightShadows)
+	{
+		if (shadow.redraw)
+			tilesRedrawn += shadow.faceCount;
+	}
+
+	if (tilesRedrawn > 0)
+	{
+		cache.SetRenderTarget(0, atlasDSV.Get());
+		cache.SetPixelShader(0);
+		cache.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+		// Clear the tiles by forcing the triangle's depth to 1
+		fullscreenVertexShader->SetShader();
+		cache.SetDepthStencilState(clearDepthState.Get(), 0);
+		for (LightShadow& shadow : lightShadows)
+		{
+			if (!shadow.redraw)
+				continue;
+
+			for (int f = 0; f < shadow.faceCount; f++)
+			{
+				D3D11_VIEWPORT viewport = GetViewport(shadow.nodes[f]);
+				viewport.MinDepth = 1.0f;
+				cache.SetViewport(viewport);
+				context->Draw(3, 0);
+			}
+		}
+		cache.SetDepthStencilState(0, 0);
+
+		shadowMapVertexShader->SetShader();
+		cache.SetRasterizerState(shadowRasterizer.Get());
+
+		// Bounds and world matrices are the same for every tile
+		std::vector<BoundingSphere> bounds;
+		std::vector<XMFLOAT4X4> worlds;
+		bounds.reserve(gameEntities.size());
+		worlds.reserve(gameEntities.size());
+		for (GameEntity& entity : gameEntities)
+		{
+			bounds.push_back(entity.GetBounds());
+			worlds.push_back(entity.GetTransform().GetWorldMatrix());
+		}
+		std::vector<XMFLOAT4X4> worldViewProjections(worlds.size());
+
+		ShaderData::ShadowMapVertexShaderExternalData vsData = {};
+		for (LightShadow& shadow : lightShadows)
+		{
+			if (!shadow.redraw)
+				continue;
+
+			for (int f = 0; f < shadow.faceCount; f++)
+			{
+				int tile = shadow.firstTile + f;
+				cache.SetViewport(GetViewport(shadow.nodes[f]));
+
+				BoundingFrustum tileFrustum(XMLoadFloat4x4(&tileProjections[tile]));
+				tileFrustum.Transform(tileFrustum, XMMatrixInverse(0, XMLoadFloat4x4(&tileViews[tile])));
+
+				MatrixBatch::Multiply(worlds.data(), worlds.size(), tiles[tile].viewProjection, worldViewProjections.data());
+				for (size_t e = 0; e < gameEntities.size(); e++)
+				{
+					if (!tileFrustum.Intersects(bounds[e]))
+						continue;
+
+					GameEntity& entity = gameEntities[e];
+					vsData.worldViewProjection = worldViewProjections[e];
+					shadowMapVertexShader->SetBufferData(vsData);
+					shadowMapVertexShader->CopyAllBufferData();
+					entity.GetMesh()->DrawPositionsOnly(context);
+				}
+			}
+
+			shadow.redraw = false;
+		}
+
+		cache.SetRasterizerState(0);
+		totalTilesRedrawn += tilesRedrawn;
+	}
+
+	// Upload this frame's tiles, growing the buffer if needed
+	unsigned int count = (unsigned int)tiles.size();
+	if (count > tileCapacity || !tileBuffer)
+	{
+		unsigned int capacity = max(tileCapacity, MinTileCapacity);
+		while (capacity < count)
+			capacity *= 2;
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = capacity * sizeof(ShadowAtlasTile);
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		desc.StructureByteStride = sizeof(ShadowAtlasTile);
+
+		tileBuffer.Reset();
+		tileSRV.Reset();
+		tileCapacity = 0;
+		if (FAILED(device->CreateBuffer(&desc, 0, tileBuffer.GetAddressOf())))
+			return;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = capacity;
+		if (FAILED(device->CreateShaderResourceView(tileBuffer.Get(), &srvDesc, tileSRV.GetAddressOf())))
+			return;
+
+		tileCapacity = capacity;
+	}
+
+	if (count == 0)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE mapped = {};
+	if (FAILED(context->Map(tileBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		return;
+	memcpy(mapped.pData, tiles.data(), count * sizeof(ShadowAtlasTile));
+	context->Unmap(tileBuffer.Get(), 0);
+}
+
+void ShadowAtlas::Bind()
+{
+	ID3D11ShaderResourceView* srvs[] = { atlasSRV.Get(), tileSRV.Get() };
+	StateCache::GetInstance().PSSetShaderResources(FirstSlot, 2, srvs);
+}
+
+// --------------------------------------------------------
+// Gives a light one tile per face, all the same size, or
+// nothing if they don't all fit
+// --------------------------------------------------------
+bool ShadowAtlas::AllocateTiles(LightShadow& shadow, int faceCount, int level)
+{
+	for (int f = 0; f < faceCount; f++)
+	{
+		if (!allocator.Allocate(level, shadow.nodes[f]))
+		{
+			for (int freed = 0; freed < f; freed++)
+				allocator.Free(shadow.nodes[freed]);
+			return false;
+		}
+	}
+
+	shadow.faceCount = faceCount;
+	shadow.signature = 0;
+	return true;
+}
+
+void ShadowAtlas::FreeTiles(LightShadow& shadow)
+{
+	for (int f = 0; f < shadow.faceCount; f++)
+		allocator.Free(shadow.nodes[f]);
+
+	shadow.faceCount = 0;
+	shadow.signature = 0;
+	shadow.redraw = false;
+}
+
+// --------------------------------------------------------
+// Adds this frame's tiles for a light: a 90 degree view down
+// each cube face for point lights, or one view wide enough
+// for the spot's cone (where it falls below 1/256)
+// --------------------------------------------------------
+void ShadowAtlas::AddTiles(const Light& light, LightShadow& shadow)
+{
+	shadow.firstTile = (int)tiles.size();
+
+	XMVECTOR position = XMLoadFloat3(&light.Position);
+	for (int f = 0; f < shadow.faceCount; f++)
+	{
+		XMMATRIX tileView;
+		XMMATRIX tileProjection;
+		if (light.Type == LIGHT_TYPE_POINT)
+		{
+			tileView = XMMatrixLookToLH(position, XMLoadFloat3(&FaceDirections[f]), XMLoadFloat3(&FaceUps[f]));
+			tileProjection = XMMatrixPerspectiveFovLH(XM_PIDIV2, 1.0f, ShadowNearClip, light.Range);
+		}
+		else
+		{
+			XMVECTOR direction = XMVector3Normalize(XMLoadFloat3(&light.Direction));
+			XMVECTOR up = fabsf(XMVectorGetY(direction)) > 0.99f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+			float halfAngle = acosf(powf(1.0f / 256.0f, 1.0f / max(light.SpotFalloff, 0.001f)));
+			float fov = max(XMConvertToRadians(10.0f), min(2 * halfAngle, XMConvertToRadians(150.0f)));
+
+			tileView = XMMatrixLookToLH(position, direction, up);
+			tileProjection = XMMatrixPerspectiveFovLH(fov, 1.0f, ShadowNearClip, light.Range);
+		}
+
+		const QuadtreeAllocator::Node& node = shadow.nodes[f];
+		float size = 1.0f / (1 << node.level);
+
+		ShadowAtlasTile tile;
+		XMStoreFloat4x4(&tile.viewProjection, tileView * tileProjection);
+		tile.rect = XMFLOAT4(node.x * size, node.y * size, size, size);
+		tiles.push_back(tile);
+
+		tileViews.emplace_back();
+		tileProjections.emplace_back();
+		XMStoreFloat4x4(&tileViews.back(), tileView);
+		XMStoreFloat4x4(&tileProjections.back(), tileProjection);
+	}
+}
+
+// --------------------------------------------------------
+// Hash of everything a light's tiles depend on: the light,
+// where its tiles are, and every entity within its range
+// --------------------------------------------------------
+uint64_t ShadowAtlas::GetSignature(const Light& light, const LightShadow& shadow, std::vector<GameEntity>& gameEntities)
+{
+	uint64_t hash = 14695981039346656037ull;
+	HashBytes(hash, &light.Type, sizeof(light.Type));
+	HashBytes(hash, &light.Position, sizeof(light.Position));
+	HashBytes(hash, &light.Direction, sizeof(light.Direction));
+	HashBytes(hash, &light.Range, sizeof(light.Range));
+	HashBytes(hash, &light.SpotFalloff, sizeof(light.SpotFalloff));
+	HashBytes(hash, shadow.nodes, sizeof(QuadtreeAllocator::Node) * shadow.faceCount);
+
+	BoundingSphere lightBounds(light.Position, light.Range);
+	for (GameEntity& entity : gameEntities)
+	{
+		if (!lightBounds.Intersects(entity.GetBounds()))
+			continue;
+
+		Mesh* mesh = entity.GetMesh().get();
+		XMFLOAT4X4 world = entity.GetTransform().GetWorldMatrix();
+		HashBytes(hash, &mesh, sizeof(mesh));
+		HashBytes(hash, &world, sizeof(world));
+	}
+
+	// Zero means "never drawn"
+	return hash != 0 ? hash : 1;
+}
+
+D3D11_VIEWPORT ShadowAtlas::GetViewport(const QuadtreeAllocator::Node& node)
+{
+	float size = (float)(AtlasSize >> node.level);
+
+	D3D11_VIEWPORT viewport = {};
+	viewport.TopLeftX = node.x * size;
+	viewport.TopLeftY = node.y * size;
+	viewport.Width = size;
+	viewport.Height = size;
+	viewport.MaxDepth = 1.0f;
+	return viewport;
+}
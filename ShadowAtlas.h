@@ -0,0 +1,160 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+#include <DirectXMath.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Camera.h"
+#include "GameEntity.h"
+#include "Lights.h"
+#include "SimpleShader.h"
+
+// --------------------------------------------------------
+// One shadow map in the atlas, as the pixel shader reads it
+// from ShadowTiles (matches the shader's ShadowTile)
+// --------------------------------------------------------
+struct ShadowAtlasTile
+{
+	DirectX::XMFLOAT4X4 viewProjection;
+	DirectX::XMFLOAT4 rect;	// Offset and size, in atlas UVs
+};
+
+// --------------------------------------------------------
+// Hands out square power-of-two tiles of a square texture.
+// Each node of the quadtree is free, split into four, or in
+// use, and freeing the last used child of a node merges it
+// back together.
+// --------------------------------------------------------
+class QuadtreeAllocator
+{
+public:
+	// A node, by its depth (0 is the whole texture) and position
+	// in the grid of nodes at that depth
+	struct Node
+	{
+		int level;
+		int x, y;
+	};
+
+	void Initialize(int _levelCount);
+
+	// False if no node at that depth is free
+	bool Allocate(int level, Node& node);
+	void Free(const Node& node);
+
+	// Fraction of the texture in use
+	float GetOccupancy();
+
+private:
+	enum NodeState : unsigned char { NodeFree, NodeSplit, NodeUsed };
+
+	int levelCount = 0;
+	std::vector<std::vector<NodeState>> states;	// Per level, row by row
+	unsigned int usedArea = 0;	// In nodes of the deepest level
+
+	NodeState& State(int level, int x, int y) { return states[level][y * (1 << level) + x]; }
+	bool AllocateBelow(int level, int x, int y, int targetLevel, Node& node, bool splitFree);
+};
+
+// --------------------------------------------------------
+// Shadows for point and spot lights, packed into one large
+// depth texture.  Every frame the local lights the camera can
+// see are ranked by their screen coverage and intensity, and
+// the most important ones get tiles sized to match: a spot
+// light gets one, and a point light one per cube face.
+//
+// A light keeps its tiles from frame to frame unless it wants
+// a size more than one step away from the one it has, and the
+// tiles are only redrawn when the light or anything in its
+// range moves.
+//
+// Each light's first tile goes in its ShadowIndex, so the
+// pixel shader can find it through LocalLights.
+// --------------------------------------------------------
+class ShadowAtlas
+{
+public:
+	static const int AtlasSize = 4096;
+	static const int LevelCount = 6;		// Down to 128x128 tiles
+	static const int LargestTileLevel = 2;	// 1024x1024
+	static const int MaxShadowedLights = 16;
+	static const unsigned int FirstSlot = 9;	// ShadowAtlas and ShadowTiles in Lighting.hlsli
+
+	ShadowAtlas();
+	~ShadowAtlas();
+
+	void Initialize(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		std::shared_ptr<SimpleVertexShader> _shadowMapVertexShader,
+		std::shared_ptr<SimpleVertexShader> _fullscreenVertexShader);
+
+	// Picks the shadowed lights, gives them tiles and sets their
+	// ShadowIndex (-1 for every other light).  Screen coverage is
+	// measured for a camera drawing to a target this many pixels high.
+	void Update(
+		std::vector<Light>& lights,
+		std::shared_ptr<Camera> camera,
+		std::vector<GameEntity>& gameEntities,
+		int height);
+
+	// Redraws the tiles that changed in the last Update(), and
+	// uploads ShadowTiles.  Changes the render target and viewport.
+	void Draw(std::vector<GameEntity>& gameEntities);
+
+	// Binds ShadowAtlas and ShadowTiles for every pixel shader
+	// that includes Lighting.hlsli - once per frame, after Draw()
+	void Bind();
+
+	// Results of the last Update() and Draw()
+	int GetShadowedLightCount() { return shadowedLightCount; }
+	size_t GetTileCount() { return tiles.size(); }
+	float GetOccupancy() { return allocator.GetOccupancy(); }
+	int GetTilesRedrawn() { return tilesRedrawn; }
+	unsigned int GetTotalTilesRedrawn() { return totalTilesRedrawn; }
+
+private:
+	// What a light had in the atlas, kept between frames
+	struct LightShadow
+	{
+		int faceCount = 0;	// 0 if it has no tiles
+		QuadtreeAllocator::Node nodes[6];
+		uint64_t signature = 0;	// Of what its tiles were last drawn with
+		bool redraw = false;
+		int firstTile = -1;	// In this frame's ShadowTiles
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::shared_ptr<SimpleVertexShader> shadowMapVertexShader;
+	std::shared_ptr<SimpleVertexShader> fullscreenVertexShader;
+
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> atlasDSV;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> atlasSRV;
+	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilState> clearDepthState;	// Writes depth everywhere
+
+	Microsoft::WRL::ComPtr<ID3D11Buffer> tileBuffer;
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> tileSRV;
+	unsigned int tileCapacity = 0;
+
+	QuadtreeAllocator allocator;
+	std::vector<LightShadow> lightShadows;	// Per light, by index
+	std::vector<ShadowAtlasTile> tiles;
+	std::vector<DirectX::XMFLOAT4X4> tileViews;
+	std::vector<DirectX::XMFLOAT4X4> tileProjections;
+
+	int shadowedLightCount = 0;
+	int tilesRedrawn = 0;
+	unsigned int totalTilesRedrawn = 0;
+
+	bool AllocateTiles(LightShadow& shadow, int faceCount, int level);
+	void FreeTiles(LightShadow& shadow);
+	void AddTiles(const Light& light, LightShadow& shadow);
+	uint64_t GetSignature(const Light& light, const LightShadow& shadow, std::vector<GameEntity>& gameEntities);
+	D3D11_VIEWPORT GetViewport(const QuadtreeAllocator::Node& node);
+};
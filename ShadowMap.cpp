@@ -1,20 +1,24 @@
 #include "ShadowMap.h"
+#include "StateCache.h"
+#include "ShaderData.h"
+#include "MatrixBatch.h"
+
+#include <cstring>
 
 using namespace DirectX;
 
-ShadowMap::ShadowMap() : shadowProjectionMatrix(XMFLOAT4X4()), shadowViewMatrix(XMFLOAT4X4()), windowHeight(0), windowWidth(0) { }
+ShadowMap::ShadowMap() : cascadeViews(), cascadeProjections(), cascadeViewProjections(), cascadeSplits(), cascadeRadii(), staticCasterCounts(), dynamicCasterCounts(), lightDirection(0, -1, 0), fittedViews(), fittedProjections(), fittedRadii(), windowHeight(0), windowWidth(0) { }
 
 ShadowMap::ShadowMap(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<SimpleVertexShader> _shadowMapVertexShader, int _windowWidth, int _windowHeight) 
-	: shadowMapVertexShader(_shadowMapVertexShader), windowWidth(_windowWidth), windowHeight(_windowHeight)
+	: cascadeViews(), cascadeProjections(), cascadeViewProjections(), cascadeSplits(), cascadeRadii(), staticCasterCounts(), dynamicCasterCounts(), lightDirection(0, -1, 0), fittedViews(), fittedProjections(), fittedRadii(),
+	shadowMapVertexShader(_shadowMapVertexShader), windowWidth(_windowWidth), windowHeight(_windowHeight)
 {
-	shadowProjectionMatrix = XMFLOAT4X4();
-	shadowViewMatrix = XMFLOAT4X4();
-
-	// Create the actual texture that will be the shadow map
+	// Create the actual texture that will be the shadow map, with
+	// room for the most cascades so the count can change freely
 	D3D11_TEXTURE2D_DESC shadowDesc = {};
 	shadowDesc.Width = shadowMapResolution; // Ideally a power of 2 (like 1024)
 	shadowDesc.Height = shadowMapResolution; // Ideally a power of 2 (like 1024)
-	shadowDesc.ArraySize = 1;
+	shadowDesc.ArraySize = MaxCascades;
 	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL | D3D11_BIND_SHADER_RESOURCE;
 	shadowDesc.CPUAccessFlags = 0;
 	shadowDesc.Format = DXGI_FORMAT_R32_TYPELESS;
@@ -23,25 +27,39 @@ ShadowMap::ShadowMap(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_pt
 	shadowDesc.SampleDesc.Count = 1;
 	shadowDesc.SampleDesc.Quality = 0;
 	shadowDesc.Usage = D3D11_USAGE_DEFAULT;
-	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
 	device->CreateTexture2D(&shadowDesc, 0, shadowTexture.GetAddressOf());
 
-	// Create the depth/stencil view
-	D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
-	shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	shadowDSDesc.Texture2D.MipSlice = 0;
-	device->CreateDepthStencilView(
-		shadowTexture.Get(),
-		&shadowDSDesc,
-		shadowDSV.GetAddressOf());
+	// The static casters' cache is only ever drawn to and copied from
+	shadowDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
+	device->CreateTexture2D(&shadowDesc, 0, staticTexture.GetAddressOf());
+
+	// Create a depth/stencil view for each cascade's slice
+	for (int i = 0; i < MaxCascades; i++)
+	{
+		D3D11_DEPTH_STENCIL_VIEW_DESC shadowDSDesc = {};
+		shadowDSDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		shadowDSDesc.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2DARRAY;
+		shadowDSDesc.Texture2DArray.MipSlice = 0;
+		shadowDSDesc.Texture2DArray.FirstArraySlice = i;
+		shadowDSDesc.Texture2DArray.ArraySize = 1;
+		device->CreateDepthStencilView(
+			shadowTexture.Get(),
+			&shadowDSDesc,
+			cascadeDSVs[i].GetAddressOf());
+		device->CreateDepthStencilView(
+			staticTexture.Get(),
+			&shadowDSDesc,
+			staticDSVs[i].GetAddressOf());
+	}
 
 	// Create the SRV for the shadow map
 	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = 1;
-	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MipLevels = 1;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = MaxCascades;
 	device->CreateShaderResourceView(
 		shadowTexture.Get(),
 		&srvDesc,
@@ -50,7 +68,7 @@ ShadowMap::ShadowMap(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_pt
 	D3D11_RASTERIZER_DESC shadowRastDesc = {};
 	shadowRastDesc.FillMode = D3D11_FILL_SOLID;
 	shadowRastDesc.CullMode = D3D11_CULL_BACK;
-	shadowRastDesc.DepthClipEnable = true;
+	shadowRastDesc.DepthClipEnable = false; // Casters closer than the near plane flatten onto it, rather than vanishing
 	shadowRastDesc.DepthBias = 1000; // Min. precision units, not world units!
 	shadowRastDesc.SlopeScaledDepthBias = 1.0f; // Bias more based on slope
 	device->CreateRasterizerState(&shadowRastDesc, &shadowRasterizer);
@@ -73,62 +91,299 @@ void ShadowMap::Resize(int _windowWidth, int _windowHeight)
 	windowHeight = _windowHeight;
 }
 
-void ShadowMap::MakeProjection(XMFLOAT3 direction)
+// --------------------------------------------------------
+// Refits every cascade to the camera's current view.  Split
+// distances blend between even and logarithmic spacing, then
+// each cascade's slice of the frustum is wrapped in a sphere,
+// which becomes an orthographic box facing along the light.
+// The boxes are only used once DrawShadowMap() redraws the
+// cascades' static casters.
+// --------------------------------------------------------
+void ShadowMap::UpdateCascades(std::shared_ptr<Camera> camera, XMFLOAT3 direction)
 {
+	cascadeCount = max(2, min(cascadeCount, MaxCascades));
+
+	XMFLOAT4X4 projection = camera->GetProjectionMatrix();
+	XMFLOAT4X4 view = camera->GetViewMatrix();
+	XMMATRIX cameraWorld = XMMatrixInverse(0, XMLoadFloat4x4(&view));
+
+	float nearZ = camera->GetNearClip();
+	float farZ = camera->GetFarClip();
+
+	// Squared slope of the frustum's corner edges, which go
+	// sideways this much per unit of depth
+	float cornerSlope = 1.0f / (projection._11 * projection._11) + 1.0f / (projection._22 * projection._22);
 
-	XMVECTOR lightDirection = XMVectorSet(direction.x, direction.y, direction.z, 0);
+	// The light's rotation alone, with an up vector that can't
+	// line up with the light
+	XMVECTOR normalizedDirection = XMVector3Normalize(XMLoadFloat3(&direction));
+	XMStoreFloat3(&lightDirection, normalizedDirection);
+	XMVECTOR up = fabsf(lightDirection.y) > 0.99f ? XMVectorSet(1, 0, 0, 0) : XMVectorSet(0, 1, 0, 0);
+	XMMATRIX lightRotation = XMMatrixLookToLH(XMVectorZero(), normalizedDirection, up);
 
-	XMMATRIX lightView = XMMatrixLookToLH(
-		-lightDirection * 10, // Position: "Backing up" 20 units from origin
-		lightDirection, // Direction: light's direction
-		XMVectorSet(0, 1, 0, 0)); // Up: World up vector (Y axis)
+	// The camera's frustum, to cut into one piece per cascade
+	BoundingFrustum cameraFrustum(XMLoadFloat4x4(&projection));
 
-	XMMATRIX lightProjection = XMMatrixOrthographicLH(
-		lightProjectionSize,
-		lightProjectionSize,
-		1.0f,
-		100.0f);
+	float sliceNear = nearZ;
+	for (int i = 0; i < cascadeCount; i++)
+	{
+		float t = (float)(i + 1) / cascadeCount;
+		float evenSplit = nearZ + (farZ - nearZ) * t;
+		float logSplit = nearZ * powf(farZ / nearZ, t);
+		float sliceFar = evenSplit + (logSplit - evenSplit) * splitBlend;
+		cascadeSplits[i] = sliceFar;
+
+		BoundingFrustum sliceFrustum = cameraFrustum;
+		sliceFrustum.Near = sliceNear;
+		sliceFrustum.Far = sliceFar;
+		sliceFrustum.Transform(cascadeFrusta[i], cameraWorld);
+
+		// The sphere through all of the slice's corners has its center
+		// on the view axis, unless the far corners alone are wider
+		float centerDepth = min((sliceNear + sliceFar) * 0.5f * (1 + cornerSlope), sliceFar);
+		float radius = sqrtf(sliceFar * sliceFar * cornerSlope + (sliceFar - centerDepth) * (sliceFar - centerDepth));
+
+		// Rounding keeps float error from changing the size (and so
+		// the texel size) from frame to frame
+		radius = ceilf(radius * 16.0f) / 16.0f;
+		fittedRadii[i] = radius;
+
+		XMVECTOR center = XMVector3TransformCoord(XMVectorSet(0, 0, centerDepth, 1), cameraWorld);
 
+		// Only move the box a whole texel at a time across the light's view
+		float texelSize = 2 * radius / shadowMapResolution;
+		XMFLOAT3 lightSpaceCenter;
+		XMStoreFloat3(&lightSpaceCenter, XMVector3TransformCoord(center, lightRotation));
+		lightSpaceCenter.x = floorf(lightSpaceCenter.x / texelSize) * texelSize;
+		lightSpaceCenter.y = floorf(lightSpaceCenter.y / texelSize) * texelSize;
 
-	XMStoreFloat4x4(&shadowViewMatrix, lightView);
-	XMStoreFloat4x4(&shadowProjectionMatrix, lightProjection);
+		// Start the box behind the sphere, far enough back to catch
+		// casters between the light and the slice.  It moves along
+		// the light in coarse steps too, and is a step deeper to
+		// make up for it, so the static cache isn't redrawn every
+		// time the camera moves.
+		float depthStep = radius * 0.25f;
+		float depthStart = lightSpaceCenter.z - radius - casterDistance;
+		depthStart = floorf(depthStart / depthStep) * depthStep;
+		XMMATRIX lightView = lightRotation * XMMatrixTranslation(-lightSpaceCenter.x, -lightSpaceCenter.y, -depthStart);
+		XMMATRIX lightProjection = XMMatrixOrthographicLH(2 * radius, 2 * radius, 0.0f, 2 * radius + casterDistance + depthStep);
+
+		XMStoreFloat4x4(&fittedViews[i], lightView);
+		XMStoreFloat4x4(&fittedProjections[i], lightProjection);
+
+		sliceNear = sliceFar;
+	}
 }
 
-void ShadowMap::DrawShadowMap(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::vector<GameEntity> gameEntities, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV)
+void ShadowMap::DrawShadowMap(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::vector<GameEntity>& gameEntities, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV)
 {
-	context->ClearDepthStencilView(shadowDSV.Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
-
-	ID3D11RenderTargetView* nullRTV{};
-	context->OMSetRenderTargets(1, &nullRTV, shadowDSV.Get());
+	StateCache& cache = StateCache::GetInstance();
 
-	context->PSSetShader(0, 0, 0);
-	context->RSSetState(shadowRasterizer.Get());
+	cache.SetPixelShader(0);
+	cache.SetRasterizerState(shadowRasterizer.Get());
 
 	D3D11_VIEWPORT viewport = {};
 	viewport.Width = (float)shadowMapResolution;
 	viewport.Height = (float)shadowMapResolution;
 	viewport.MaxDepth = 1.0f;
-	context->RSSetViewports(1, &viewport);
+	cache.SetViewport(viewport);
 
 	shadowMapVertexShader->SetShader();
-	shadowMapVertexShader->SetMatrix4x4("view", shadowViewMatrix);
-	shadowMapVertexShader->SetMatrix4x4("projection", shadowProjectionMatrix);
 
-	// Loop and draw all entities
-	for (GameEntity entity : gameEntities)
+	// Bounds are the same for every cascade
+	std::vector<BoundingSphere> bounds;
+	bounds.reserve(gameEntities.size());
+	for (GameEntity& entity : gameEntities)
+		bounds.push_back(entity.GetBounds());
+	casterCandidates = (int)gameEntities.size();
+
+	frame++;
+	uint64_t signature = GetStaticCasterSignature(gameEntities);
+
+	// A cache that was never drawn, or whose box changed size (so
+	// may no longer cover its slice), is redrawn straight away, as
+	// is the nearest cascade's.  Otherwise a cache is stale once
+	// its box or the static casters move, and the stale ones that
+	// have waited longest share the per-frame budget.
+	bool stale[MaxCascades] = {};
+	bool redraw[MaxCascades] = {};
+	for (int i = 0; i < cascadeCount; i++)
+	{
+		StaticCache& staticCache = staticCaches[i];
+		stale[i] = staticCache.casterSignature != signature ||
+			memcmp(&fittedViews[i], &cascadeViews[i], sizeof(XMFLOAT4X4)) != 0 ||
+			memcmp(&fittedProjections[i], &cascadeProjections[i], sizeof(XMFLOAT4X4)) != 0;
+		redraw[i] = !staticCache.valid || fittedRadii[i] != cascadeRadii[i] || (i == 0 && stale[i]);
+	}
+
+	for (int budget = staticRedrawsPerFrame; budget > 0; budget--)
+	{
+		int oldest = -1;
+		for (int i = 1; i < cascadeCount; i++)
+		{
+			if (stale[i] && !redraw[i] && (oldest < 0 || staticCaches[i].lastRedrawFrame < staticCaches[oldest].lastRedrawFrame))
+				oldest = i;
+		}
+
+		if (oldest < 0)
+			break;
+		redraw[oldest] = true;
+	}
+
+	staticRedraws = 0;
+	for (int i = 0; i < cascadeCount; i++)
 	{
-		shadowMapVertexShader->SetMatrix4x4("world", entity.GetTransform().GetWorldMatrix());
+		if (redraw[i])
+		{
+			// The cascade moves to where it's been fitted
+			cascadeViews[i] = fittedViews[i];
+			cascadeProjections[i] = fittedProjections[i];
+			cascadeRadii[i] = fittedRadii[i];
+			XMStoreFloat4x4(&cascadeViewProjections[i], XMLoadFloat4x4(&cascadeViews[i]) * XMLoadFloat4x4(&cascadeProjections[i]));
+
+			context->ClearDepthStencilView(staticDSVs[i].Get(), D3D11_CLEAR_DEPTH, 1.0f, 0);
+			cache.SetRenderTarget(0, staticDSVs[i].Get());
+			staticCasterCounts[i] = DrawCasters(context, i, gameEntities, bounds, true);
+
+			staticCaches[i].valid = true;
+			staticCaches[i].casterSignature = signature;
+			staticCaches[i].lastRedrawFrame = frame;
+			staticRedraws++;
+		}
+
+		// Start from the static casters, and add the dynamic ones
+		unsigned int slice = D3D11CalcSubresource(0, i, 1);
+		context->CopySubresourceRegion(shadowTexture.Get(), slice, 0, 0, 0, staticTexture.Get(), slice, 0);
+
+		cache.SetRenderTarget(0, cascadeDSVs[i].Get());
+		dynamicCasterCounts[i] = DrawCasters(context, i, gameEntities, bounds, false);
+	}
+	totalStaticRedraws += staticRedraws;
+
+	cache.SetRasterizerState(0);
+
+	viewport.Width = (float)windowWidth;
+	viewport.Height = (float)windowHeight;
+	cache.SetViewport(viewport);
+	cache.SetRenderTarget(backBufferRTV.Get(), depthBufferDSV.Get());
+}
+
+void ShadowMap::Bind()
+{
+	StateCache& cache = StateCache::GetInstance();
+	cache.PSSetShaderResource(TextureSlot, shadowSRV.Get());
+	cache.PSSetSampler(SamplerSlot, shadowSampler.Get());
+}
+
+// --------------------------------------------------------
+// Draws either the static or the dynamic entities that cast
+// into a cascade, to whatever depth buffer is bound.  Static
+// casters are drawn to the cache, which outlives the camera's
+// current view, so only the cascade's box decides those.
+// --------------------------------------------------------
+int ShadowMap::DrawCasters(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, int cascade, std::vector<GameEntity>& gameEntities, const std::vector<BoundingSphere>& bounds, bool staticCasters)
+{
+	// Gather the casters, then build all of their light space
+	// world-view-projections in one batch
+	std::vector<GameEntity*> casters;
+	std::vector<XMFLOAT4X4> worlds;
+	for (size_t e = 0; e < gameEntities.size(); e++)
+	{
+		GameEntity& entity = gameEntities[e];
+		if (entity.IsStatic() != staticCasters || !IsCaster(cascade, bounds[e], !staticCasters))
+			continue;
+
+		casters.push_back(&entity);
+		worlds.push_back(entity.GetTransform().GetWorldMatrix());
+	}
+
+	std::vector<XMFLOAT4X4> worldViewProjections(worlds.size());
+	MatrixBatch::Multiply(worlds.data(), worlds.size(), cascadeViewProjections[cascade], worldViewProjections.data());
+
+	ShaderData::ShadowMapVertexShaderExternalData vsData = {};
+	for (size_t i = 0; i < casters.size(); i++)
+	{
+		vsData.worldViewProjection = worldViewProjections[i];
+		shadowMapVertexShader->SetBufferData(vsData);
 		shadowMapVertexShader->CopyAllBufferData();
 
 		// Draw the mesh directly to avoid the entity's material
 		// Note: Your code may differ significantly here!
-		entity.GetMesh()->Draw(context);
+		casters[i]->GetMesh()->DrawPositionsOnly(context);
 	}
 
-	context->RSSetState(0);
+	return (int)casters.size();
+}
 
-	viewport.Width = (float)windowWidth;
-	viewport.Height = (float)windowHeight;
-	context->RSSetViewports(1, &viewport);
-	context->OMSetRenderTargets(1, backBufferRTV.GetAddressOf(), depthBufferDSV.Get());
-}
\ No newline at end of file
+// --------------------------------------------------------
+// FNV-1a hash of every static entity's mesh and world matrix,
+// which changes whenever one is moved, added or swapped out
+// --------------------------------------------------------
+uint64_t ShadowMap::GetStaticCasterSignature(std::vector<GameEntity>& gameEntities)
+{
+	uint64_t hash = 14695981039346656037ull;
+	auto hashBytes = [&hash](const void* data, size_t size)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	};
+
+	for (GameEntity& entity : gameEntities)
+	{
+		if (!entity.IsStatic())
+			continue;
+
+		Mesh* mesh = entity.GetMesh().get();
+		XMFLOAT4X4 world = entity.GetTransform().GetWorldMatrix();
+		hashBytes(&mesh, sizeof(mesh));
+		hashBytes(&world, sizeof(world));
+	}
+
+	return hash;
+}
+
+// --------------------------------------------------------
+// Whether anything in these bounds can shadow what the camera
+// sees of a cascade.  The bounds have to overlap the cascade's
+// box from the side, but may be any distance toward the light,
+// and their shadow (the bounds swept away from the light) has
+// to reach the cascade's part of the camera frustum (unless
+// useCameraFrustum is false).
+// --------------------------------------------------------
+bool ShadowMap::IsCaster(int cascade, const BoundingSphere& bounds, bool useCameraFrustum)
+{
+	XMVECTOR center = XMVectorSetW(XMLoadFloat3(&bounds.Center), 1);
+
+	// The box spans -radius to radius across, and 0 to its depth
+	// (the inverse of the orthographic projection's z scale) along
+	// the light, in the cascade's light space
+	XMFLOAT3 lightSpace;
+	XMStoreFloat3(&lightSpace, XMVector3TransformCoord(center, XMLoadFloat4x4(&cascadeViews[cascade])));
+	float halfSize = cascadeRadii[cascade] + bounds.Radius;
+	float depth = 1.0f / cascadeProjections[cascade]._33;
+	if (fabsf(lightSpace.x) > halfSize || fabsf(lightSpace.y) > halfSize || lightSpace.z - bounds.Radius > depth)
+		return false;
+
+	if (!useCameraFrustum)
+		return true;
+
+	// The frustum's plane normals point out, so the shadow misses
+	// it if the bounds are wholly outside any plane and the light
+	// pushes them further out
+	XMVECTOR planes[6];
+	cascadeFrusta[cascade].GetPlanes(&planes[0], &planes[1], &planes[2], &planes[3], &planes[4], &planes[5]);
+
+	XMVECTOR direction = XMLoadFloat3(&lightDirection);
+	for (int p = 0; p < 6; p++)
+	{
+		float distance = XMVectorGetX(XMVector4Dot(center, planes[p]));
+		if (distance > bounds.Radius && XMVectorGetX(XMVector3Dot(direction, planes[p])) >= 0)
+			return false;
+	}
+
+	return true;
+}
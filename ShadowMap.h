@@ -1,35 +1,118 @@
 #pragma once
 #include "DXCore.h"
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
 #include <memory>
 #include "SimpleShader.h"
 #include "GameEntity.h"
+#include "Camera.h"
 
+// --------------------------------------------------------
+// Cascaded shadow map for the main directional light.  The
+// camera's view is split into 2-4 depth ranges, and each gets
+// its own orthographic projection and slice of a texture array,
+// so nearby shadows get most of the resolution.
+//
+// Each cascade is fitted to a bounding sphere of its part of
+// the frustum, which doesn't change size as the camera turns,
+// and its position is snapped to whole shadow map texels.  That
+// keeps shadow edges from crawling while the camera moves.
+//
+// Only entities that can shadow something the camera sees in a
+// cascade are drawn into it.
+//
+// Static casters are drawn into a cached copy of each cascade,
+// which is only redrawn when the cascade's box or a static
+// caster moves.  Every frame just copies the cache and draws
+// the dynamic casters on top.  Redraws of the caches beyond the
+// nearest are time-sliced, with a stale cascade keeping its old
+// box until its turn comes.
+// --------------------------------------------------------
 class ShadowMap
 {
+public:
+	static const int MaxCascades = 4; // Must match MAX_SHADOW_CASCADES in FrameBuffer.hlsli
+	static const unsigned int TextureSlot = 4;	// ShadowMap in PixelShader.hlsl
+	static const unsigned int SamplerSlot = 1;	// ShadowSampler in Lighting.hlsli
+
+	int cascadeCount = 3;
+	float splitBlend = 0.75f;		// 0 splits the view evenly, 1 logarithmically
+	float casterDistance = 20.0f;	// How far toward the light casters outside a cascade still count
+	int staticRedrawsPerFrame = 1;	// Cached cascades past the first that may be redrawn each frame
+
 private:
 	int shadowMapResolution = 1024;
-	float lightProjectionSize = 30.0f; // Tweak for your scene!
 
-	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> shadowDSV;
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> shadowTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> cascadeDSVs[MaxCascades];
+
+	// Static casters only, in the same layout as the shadow map
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> staticTexture;
+	Microsoft::WRL::ComPtr<ID3D11DepthStencilView> staticDSVs[MaxCascades];
+
 	Microsoft::WRL::ComPtr<ID3D11RasterizerState> shadowRasterizer;
 	int windowWidth;
 	int windowHeight;
 	std::shared_ptr<SimpleVertexShader> shadowMapVertexShader;
 
+	// World space, from the last UpdateCascades()
+	DirectX::XMFLOAT3 lightDirection;
+	DirectX::BoundingFrustum cascadeFrusta[MaxCascades];	// The camera's view, cut to each cascade's depths
+
+	// Where each cascade would ideally be this frame, which only
+	// becomes its actual box once its static cache is redrawn
+	DirectX::XMFLOAT4X4 fittedViews[MaxCascades];
+	DirectX::XMFLOAT4X4 fittedProjections[MaxCascades];
+	float fittedRadii[MaxCascades];
+
+	// What each cascade's static cache was drawn with
+	struct StaticCache
+	{
+		bool valid = false;
+		uint64_t casterSignature = 0;
+		unsigned int lastRedrawFrame = 0;
+	};
+	StaticCache staticCaches[MaxCascades];
+	unsigned int frame = 0;
+
+	bool IsCaster(int cascade, const DirectX::BoundingSphere& bounds, bool useCameraFrustum);
+	int DrawCasters(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, int cascade, std::vector<GameEntity>& gameEntities, const std::vector<DirectX::BoundingSphere>& bounds, bool staticCasters);
+	static uint64_t GetStaticCasterSignature(std::vector<GameEntity>& gameEntities);
+
 public:
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> shadowSampler;
 
+	// One slice per cascade
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> shadowSRV;
 
-	DirectX::XMFLOAT4X4 shadowViewMatrix;
-	DirectX::XMFLOAT4X4 shadowProjectionMatrix;
+	// Fitted to the camera by UpdateCascades(), and taken up by
+	// each cascade when DrawShadowMap() redraws its static cache
+	DirectX::XMFLOAT4X4 cascadeViews[MaxCascades];
+	DirectX::XMFLOAT4X4 cascadeProjections[MaxCascades];
+	DirectX::XMFLOAT4X4 cascadeViewProjections[MaxCascades];
+	float cascadeSplits[MaxCascades];	// View depth each cascade reaches to
+	float cascadeRadii[MaxCascades];	// Of the bounding sphere each cascade covers
+
+	// How many entities were drawn into each cascade, out of how
+	// many: static ones as of the cache's last redraw
+	int staticCasterCounts[MaxCascades];
+	int dynamicCasterCounts[MaxCascades];
+	int casterCandidates = 0;
+
+	// Static caches redrawn by the last DrawShadowMap(), and in total
+	int staticRedraws = 0;
+	unsigned int totalStaticRedraws = 0;
 
 	ShadowMap();
 	ShadowMap(Microsoft::WRL::ComPtr<ID3D11Device> device, std::shared_ptr<SimpleVertexShader> _shadowMapVertexShader, int _windowWidth, int _windowHeight);
 	~ShadowMap();
 
 	void Resize(int _windowWidth, int _windowHeight);
-	void MakeProjection(DirectX::XMFLOAT3 direction);
-	void DrawShadowMap(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::vector<GameEntity> gameEntities, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV);
-};
\ No newline at end of file
+	void UpdateCascades(std::shared_ptr<Camera> camera, DirectX::XMFLOAT3 direction);
+	void DrawShadowMap(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::vector<GameEntity>& gameEntities, Microsoft::WRL::ComPtr<ID3D11RenderTargetView> backBufferRTV, Microsoft::WRL::ComPtr<ID3D11DepthStencilView> depthBufferDSV);
+
+	// Binds ShadowMap and ShadowSampler for the scene's pixel
+	// shaders - once per frame, after DrawShadowMap()
+	void Bind();
+};
@@ -1,9 +1,7 @@
 // Constant Buffer for external (C++) data
 cbuffer externalData : register(b0)
 {
-    matrix world;
-    matrix view;
-    matrix projection;
+    matrix worldViewProjection; // The light's, multiplied together on the CPU
 };
 
 struct VertexShaderInput
@@ -13,10 +11,7 @@ struct VertexShaderInput
 	//  |   Name          Semantic
 	//  |    |                |
 	//  v    v                v
-    float3 localPosition : POSITION; // XYZ position
-    float3 normal : NORMAL;
-    float2 uv : TEXCOORD;
-    float3 tangent : TANGENT;
+    float3 localPosition : POSITION; // XYZ position - the only stream bound (see Mesh::DrawPositionsOnly)
 };
 
 // --------------------------------------------------------
@@ -24,6 +19,5 @@ struct VertexShaderInput
 // --------------------------------------------------------
 float4 main(VertexShaderInput input) : SV_POSITION
 {
-    matrix wvp = mul(projection, mul(view, world));
-    return mul(wvp, float4(input.localPosition, 1.0f));
+    return mul(worldViewProjection, float4(input.localPosition, 1.0f));
 }
\ No newline at end of file
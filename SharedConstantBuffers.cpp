@@ -0,0 +1,99 @@
+#include "SharedConstantBuffers.h"
+
+// Singleton requirement
+SharedConstantBuffers* SharedConstantBuffers::instance;
+
+// --------------- Basic usage -----------------
+//
+// Register each shared buffer once at startup, before any
+// shaders are loaded:
+//
+//   SharedConstantBuffers& shared = SharedConstantBuffers::GetInstance();
+//   shared.Register("LightBuffer", sizeof(ShaderData::LightBuffer));
+//
+// Then fill it once per frame, rather than per shader:
+//
+//   shared.Update("LightBuffer", lightData);
+//
+// Variables in shared buffers can't be set through a shader's
+// SetFloat(), SetData(), etc. - that data would never reach
+// the GPU.
+// ---------------------------------------------
+
+SharedConstantBuffers::~SharedConstantBuffers()
+{
+
+}
+
+void SharedConstantBuffers::Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->device = device;
+	this->context = context;
+}
+
+// --------------------------------------------------------
+// Releases every buffer, since the singleton itself is
+// never destroyed
+// --------------------------------------------------------
+void SharedConstantBuffers::Shutdown()
+{
+	buffers.clear();
+	context.Reset();
+	device.Reset();
+}
+
+// --------------------------------------------------------
+// Creates the buffer for a name.  Reflected buffer sizes (and
+// so the ShaderData.h structs) are always a multiple of 16
+// bytes, and anything else is rejected, since Update() copies
+// the whole buffer from the caller's data.
+// --------------------------------------------------------
+bool SharedConstantBuffers::Register(const std::string& name, unsigned int size)
+{
+	if (size == 0 || size % 16 != 0)
+		return false;
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.ByteWidth = size;
+	desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	SharedBuffer shared;
+	shared.size = size;
+	if (device->CreateBuffer(&desc, 0, shared.buffer.GetAddressOf()) != S_OK)
+		return false;
+
+	buffers[name] = shared;
+	return true;
+}
+
+ID3D11Buffer* SharedConstantBuffers::Find(const std::string& name, unsigned int* size)
+{
+	auto found = buffers.find(name);
+	if (found == buffers.end())
+		return 0;
+
+	if (size) *size = found->second.size;
+	return found->second.buffer.Get();
+}
+
+// --------------------------------------------------------
+// Copies an entire buffer's worth of data to the GPU.  The
+// size must match what the buffer was registered with.
+// --------------------------------------------------------
+bool SharedConstantBuffers::Update(const std::string& name, const void* data, unsigned int size)
+{
+	auto found = buffers.find(name);
+	if (found == buffers.end() || found->second.size != size)
+		return false;
+
+	context->UpdateSubresource(found->second.buffer.Get(), 0, 0, data, 0, 0);
+	updates++;
+	return true;
+}
+
+void SharedConstantBuffers::BeginFrame()
+{
+	lastFrameUpdates = updates;
+	updates = 0;
+}
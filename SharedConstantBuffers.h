@@ -0,0 +1,77 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+
+#include <string>
+#include <unordered_map>
+
+// --------------------------------------------------------
+// Constant buffers that every shader declaring them shares,
+// such as the lights or the camera matrices.  There's only one
+// GPU buffer per name, filled once per frame, and SimpleShader
+// binds it in place of its own copy whenever a shader's
+// reflection contains a buffer by that name.
+//
+// Buffers must be registered before the shaders that use
+// them are loaded.
+// --------------------------------------------------------
+class SharedConstantBuffers
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static SharedConstantBuffers& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new SharedConstantBuffers();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	SharedConstantBuffers(SharedConstantBuffers const&) = delete;
+	void operator=(SharedConstantBuffers const&) = delete;
+
+private:
+	static SharedConstantBuffers* instance;
+	SharedConstantBuffers() {};
+#pragma endregion
+
+public:
+	~SharedConstantBuffers();
+
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void Shutdown();
+
+	// Creates the single GPU buffer for this name
+	bool Register(const std::string& name, unsigned int size);
+
+	// Returns null if no buffer with this name was registered
+	ID3D11Buffer* Find(const std::string& name, unsigned int* size = 0);
+
+	// Replaces the buffer's contents, usually with one of the
+	// structs in ShaderData.h
+	bool Update(const std::string& name, const void* data, unsigned int size);
+	template<typename T> bool Update(const std::string& name, const T& data) { return Update(name, &data, sizeof(T)); }
+
+	// Number of Update() calls since the last BeginFrame()
+	void BeginFrame();
+	unsigned int GetUpdateCount() { return lastFrameUpdates; }
+
+private:
+	struct SharedBuffer
+	{
+		Microsoft::WRL::ComPtr<ID3D11Buffer> buffer;
+		unsigned int size = 0;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::unordered_map<std::string, SharedBuffer> buffers;
+
+	unsigned int updates = 0;
+	unsigned int lastFrameUpdates = 0;
+};
@@ -1,4 +1,5 @@
 #include "SimpleShader.h"
+#include "StateCache.h"
 
 // Default error reporting state
 bool ISimpleShader::ReportErrors = false;
@@ -81,7 +82,8 @@ void ISimpleShader::CleanUp()
 bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 {
 	// Load the shader to a blob and ensure it worked
-	HRESULT hr = D3DReadFileToBlob(shaderFile, shaderBlob.GetAddressOf());
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	HRESULT hr = D3DReadFileToBlob(shaderFile, blob.GetAddressOf());
 	if (hr != S_OK)
 	{
 		if (ReportErrors)
@@ -94,10 +96,22 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
-	// Create the shader - Calls an overloaded version of this abstract
-	// method in the appropriate child class
-	shaderValid = CreateShader(shaderBlob);
-	if (!shaderValid)
+	// Set up shader reflection to get information about
+	// this shader and its variables,  buffers, etc.
+	ShaderReflectionData reflection;
+	if (!ReflectShader(blob, reflection))
+	{
+		if (ReportErrors)
+		{
+			LogError("SimpleShader::LoadShaderFile() - Error reflecting shader from file '");
+			LogW(shaderFile);
+			LogError("'.\n");
+		}
+
+		return false;
+	}
+
+	if (!LoadShader(blob, reflection))
 	{
 		if (ReportErrors)
 		{
@@ -109,23 +123,67 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		return false;
 	}
 
-	// Set up shader reflection to get information about
-	// this shader and its variables,  buffers, etc.
+	return true;
+}
+
+// --------------------------------------------------------
+// Creates the shader from bytecode and reflection data that
+// were stored in a shader archive.  No reflection happens here.
+//
+// entry - The archive entry for this shader
+// 
+// Returns true if shader is loaded properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShaderFromArchive(const ShaderArchiveEntry& entry)
+{
+	// The D3D creation functions (and GetShaderBlob()) expect a blob
+	Microsoft::WRL::ComPtr<ID3DBlob> blob;
+	if (D3DCreateBlob(entry.Bytecode.size(), blob.GetAddressOf()) != S_OK)
+		return false;
+
+	memcpy(blob->GetBufferPointer(), entry.Bytecode.data(), entry.Bytecode.size());
+
+	if (!LoadShader(blob, entry.Reflection))
+	{
+		if (ReportErrors)
+		{
+			LogError("SimpleShader::LoadShaderFromArchive() - Error creating shader '");
+			Log(entry.Name);
+			LogError("'. Ensure the type of shader (vertex, pixel, etc.) matches the SimpleShader type (SimpleVertexShader, SimplePixelShader, etc.) you're using.\n");
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Reflects compiled shader code into a ShaderReflectionData,
+// which holds everything needed to build this class's tables
+//
+// shaderBlob - The compiled shader code
+// reflection - Filled in with the shader's reflection data
+//
+// Returns true if reflection succeeded, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::ReflectShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection)
+{
+	reflection = ShaderReflectionData();
+
 	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
+	HRESULT hr = D3DReflect(
 		shaderBlob->GetBufferPointer(),
 		shaderBlob->GetBufferSize(),
 		IID_ID3D11ShaderReflection,
 		(void**)refl.GetAddressOf());
+	if (hr != S_OK)
+		return false;
 	
 	// Get the description of the shader
 	D3D11_SHADER_DESC shaderDesc;
 	refl->GetDesc(&shaderDesc);
 
-	// Create resource arrays
-	constantBufferCount = shaderDesc.ConstantBuffers;
-	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
-	
 	// Handle bound resources (like shaders and samplers)
 	unsigned int resourceCount = shaderDesc.BoundResources;
 	for (unsigned int r = 0; r < resourceCount; r++)
@@ -134,38 +192,26 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		D3D11_SHADER_INPUT_BIND_DESC resourceDesc;
 		refl->GetResourceBindingDesc(r, &resourceDesc);
 
+		ShaderResourceDesc res;
+		res.Name = resourceDesc.Name;
+		res.BindIndex = resourceDesc.BindPoint;
+
 		// Check the type
 		switch (resourceDesc.Type)
 		{
 		case D3D_SIT_STRUCTURED: // Treat structured buffers as texture resources
 		case D3D_SIT_TEXTURE: // A texture resource
-		{
-			// Create the SRV wrapper
-			SimpleSRV* srv = new SimpleSRV();
-			srv->BindIndex = resourceDesc.BindPoint;				// Shader bind point
-			srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
-
-			textureTable.insert(std::pair<std::string, SimpleSRV*>(resourceDesc.Name, srv));
-			shaderResourceViews.push_back(srv);
-		}
+			reflection.ShaderResourceViews.push_back(res);
 			break;
 
 		case D3D_SIT_SAMPLER: // A sampler resource
-		{
-			// Create the sampler wrapper
-			SimpleSampler* samp = new SimpleSampler();
-			samp->BindIndex = resourceDesc.BindPoint;			// Shader bind point
-			samp->Index = (unsigned int)samplerStates.size();	// Raw index
-
-			samplerTable.insert(std::pair<std::string, SimpleSampler*>(resourceDesc.Name, samp));
-			samplerStates.push_back(samp);
-		}
+			reflection.Samplers.push_back(res);
 			break;
 		}
 	}
 
 	// Loop through all constant buffers
-	for (unsigned int b = 0; b < constantBufferCount; b++)
+	for (unsigned int b = 0; b < shaderDesc.ConstantBuffers; b++)
 	{
 		// Get this buffer
 		ID3D11ShaderReflectionConstantBuffer* cb =
@@ -175,28 +221,189 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		D3D11_SHADER_BUFFER_DESC bufferDesc;
 		cb->GetDesc(&bufferDesc);
 
-		// Save the type, which we reference when setting these buffers
-		constantBuffers[b].Type = bufferDesc.Type;
-		
 		// Get the description of the resource binding, so
 		// we know exactly how it's bound in the shader
 		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
 		refl->GetResourceBindingDescByName(bufferDesc.Name, &bindDesc);
+
+		ShaderConstantBufferDesc cbDesc;
+		cbDesc.Name = bufferDesc.Name;
+		cbDesc.Type = bufferDesc.Type;
+		cbDesc.Size = bufferDesc.Size;
+		cbDesc.BindIndex = bindDesc.BindPoint;
+
+		// Loop through all variables in this buffer
+		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		{
+			// Get the description of the variable
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			cb->GetVariableByIndex(v)->GetDesc(&varDesc);
+
+			ShaderVariableDesc var;
+			var.Name = varDesc.Name;
+			var.ByteOffset = varDesc.StartOffset;
+			var.Size = varDesc.Size;
+			cbDesc.Variables.push_back(var);
+		}
+
+		reflection.ConstantBuffers.push_back(cbDesc);
+	}
+
+	// Only vertex shaders have an input layout
+	if (D3D11_SHVER_GET_TYPE(shaderDesc.Version) != D3D11_SHVER_VERTEX_SHADER)
+		return true;
+
+	// Read input layout description from shader info.  Code adapted from:
+	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
+	for (unsigned int i = 0; i < shaderDesc.InputParameters; i++)
+	{
+		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
+		refl->GetInputParameterDesc(i, &paramDesc);
+
+		// System values (like SV_VertexID) don't come from a vertex buffer
+		if (paramDesc.SystemValueType != D3D_NAME_UNDEFINED)
+			continue;
+
+		// Check the semantic name for "_PER_INSTANCE"
+		std::string perInstanceStr = "_PER_INSTANCE";
+		std::string sem = paramDesc.SemanticName;
+		int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
+		bool isPerInstance = 
+			lenDiff >= 0 &&
+			sem.compare(lenDiff, perInstanceStr.size(), perInstanceStr) == 0;
+
+		ShaderInputElementDesc element;
+		element.SemanticName = paramDesc.SemanticName;
+		element.SemanticIndex = paramDesc.SemanticIndex;
+		element.InputSlot = isPerInstance ? 1 : 0; // Assume per instance data comes from another input slot!
+		element.PerInstance = isPerInstance ? 1 : 0;
+
+		// Determine DXGI format
+		DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+		if (paramDesc.Mask == 1)
+		{
+			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) format = DXGI_FORMAT_R32_UINT;
+			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) format = DXGI_FORMAT_R32_SINT;
+			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) format = DXGI_FORMAT_R32_FLOAT;
+		}
+		else if (paramDesc.Mask <= 3)
+		{
+			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) format = DXGI_FORMAT_R32G32_UINT;
+			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) format = DXGI_FORMAT_R32G32_SINT;
+			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) format = DXGI_FORMAT_R32G32_FLOAT;
+		}
+		else if (paramDesc.Mask <= 7)
+		{
+			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) format = DXGI_FORMAT_R32G32B32_UINT;
+			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) format = DXGI_FORMAT_R32G32B32_SINT;
+			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) format = DXGI_FORMAT_R32G32B32_FLOAT;
+		}
+		else if (paramDesc.Mask <= 15)
+		{
+			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) format = DXGI_FORMAT_R32G32B32A32_UINT;
+			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) format = DXGI_FORMAT_R32G32B32A32_SINT;
+			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		}
+		element.Format = (uint32_t)format;
+
+		reflection.InputElements.push_back(element);
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------
+// Creates the shader and builds the variable table from
+// reflection data, which may have come from D3DReflect()
+// or from a shader archive.
+//
+// shaderBlob - The compiled shader code
+// reflection - The shader's reflection data
+// 
+// Returns true if shader is loaded properly, false otherwise
+// --------------------------------------------------------
+bool ISimpleShader::LoadShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, const ShaderReflectionData& reflection)
+{
+	this->shaderBlob = shaderBlob;
+
+	// Create the shader - Calls an overloaded version of this abstract
+	// method in the appropriate child class
+	shaderValid = CreateShader(shaderBlob);
+	if (!shaderValid)
+		return false;
+
+	// Create resource arrays
+	constantBufferCount = (unsigned int)reflection.ConstantBuffers.size();
+	constantBuffers = new SimpleConstantBuffer[constantBufferCount];
+	
+	// Handle bound resources (like shaders and samplers)
+	for (const ShaderResourceDesc& res : reflection.ShaderResourceViews)
+	{
+		// Create the SRV wrapper
+		SimpleSRV* srv = new SimpleSRV();
+		srv->BindIndex = res.BindIndex;							// Shader bind point
+		srv->Index = (unsigned int)shaderResourceViews.size();	// Raw index
+
+		textureTable.insert(std::pair<std::string, SimpleSRV*>(res.Name, srv));
+		shaderResourceViews.push_back(srv);
+	}
+
+	for (const ShaderResourceDesc& res : reflection.Samplers)
+	{
+		// Create the sampler wrapper
+		SimpleSampler* samp = new SimpleSampler();
+		samp->BindIndex = res.BindIndex;					// Shader bind point
+		samp->Index = (unsigned int)samplerStates.size();	// Raw index
+
+		samplerTable.insert(std::pair<std::string, SimpleSampler*>(res.Name, samp));
+		samplerStates.push_back(samp);
+	}
+
+	// Loop through all constant buffers
+	for (unsigned int b = 0; b < constantBufferCount; b++)
+	{
+		const ShaderConstantBufferDesc& bufferDesc = reflection.ConstantBuffers[b];
+
+		// Save the type, which we reference when setting these buffers
+		constantBuffers[b].Type = (D3D_CBUFFER_TYPE)bufferDesc.Type;
 		
 		// Set up the buffer and put its pointer in the table
-		constantBuffers[b].BindIndex = bindDesc.BindPoint;
+		constantBuffers[b].BindIndex = bufferDesc.BindIndex;
 		constantBuffers[b].Name = bufferDesc.Name;
 		cbTable.insert(std::pair<std::string, SimpleConstantBuffer*>(bufferDesc.Name, &constantBuffers[b]));
 
-		// Create this constant buffer
-		D3D11_BUFFER_DESC newBuffDesc = {};
-		newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
-		newBuffDesc.ByteWidth = ((bufferDesc.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
-		newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-		newBuffDesc.CPUAccessFlags = 0;
-		newBuffDesc.MiscFlags = 0;
-		newBuffDesc.StructureByteStride = 0;
-		device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
+		// Buffers shared between shaders bind the one registered
+		// buffer instead of getting a private copy
+		unsigned int sharedSize = 0;
+		ID3D11Buffer* sharedBuffer = SharedConstantBuffers::GetInstance().Find(bufferDesc.Name, &sharedSize);
+		if (sharedBuffer && sharedSize != bufferDesc.Size)
+		{
+			if (ReportWarnings)
+			{
+				LogWarning("SimpleShader::LoadShader() - Constant buffer '");
+				Log(bufferDesc.Name);
+				LogWarning("' doesn't match the size of the shared buffer with that name, so it won't be shared.\n");
+			}
+			sharedBuffer = 0;
+		}
+
+		if (sharedBuffer)
+		{
+			constantBuffers[b].ConstantBuffer = sharedBuffer;
+			constantBuffers[b].Shared = true;
+		}
+		else
+		{
+			// Create this constant buffer
+			D3D11_BUFFER_DESC newBuffDesc = {};
+			newBuffDesc.Usage = D3D11_USAGE_DEFAULT;
+			newBuffDesc.ByteWidth = ((bufferDesc.Size + 15) / 16) * 16; // Quick and dirty 16-byte alignment using integer division
+			newBuffDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+			newBuffDesc.CPUAccessFlags = 0;
+			newBuffDesc.MiscFlags = 0;
+			newBuffDesc.StructureByteStride = 0;
+			device->CreateBuffer(&newBuffDesc, 0, constantBuffers[b].ConstantBuffer.GetAddressOf());
+		}
 
 		// Set up the data buffer for this constant buffer
 		constantBuffers[b].Size = bufferDesc.Size;
@@ -204,33 +411,28 @@ bool ISimpleShader::LoadShaderFile(LPCWSTR shaderFile)
 		ZeroMemory(constantBuffers[b].LocalDataBuffer, bufferDesc.Size);
 
 		// Loop through all variables in this buffer
-		for (unsigned int v = 0; v < bufferDesc.Variables; v++)
+		for (const ShaderVariableDesc& varDesc : bufferDesc.Variables)
 		{
-			// Get this variable
-			ID3D11ShaderReflectionVariable* var =
-				cb->GetVariableByIndex(v);
-			
-			// Get the description of the variable and its type
-			D3D11_SHADER_VARIABLE_DESC varDesc;
-			var->GetDesc(&varDesc);
-
 			// Create the variable struct
 			SimpleShaderVariable varStruct = {};
 			varStruct.ConstantBufferIndex = b;
-			varStruct.ByteOffset = varDesc.StartOffset;
+			varStruct.ByteOffset = varDesc.ByteOffset;
 			varStruct.Size = varDesc.Size;
-			
-			// Get a string version
-			std::string varName(varDesc.Name);
 
-			// Add this variable to the table and the constant buffer
-			varTable.insert(std::pair<std::string, SimpleShaderVariable>(varName, varStruct));
+			// Add this variable to the table and the constant buffer.  Shared
+			// variables are left out of the table, since setting them here
+			// would never reach the GPU.
+			if (!constantBuffers[b].Shared)
+				varTable.insert(std::pair<std::string, SimpleShaderVariable>(varDesc.Name, varStruct));
 			constantBuffers[b].Variables.push_back(varStruct);
 		}
 	}
 
+	// Let derived classes handle anything extra (input layouts)
+	shaderValid = CreateInputLayout(reflection);
+
 	// All set
-	return true;
+	return shaderValid;
 }
 
 // --------------------------------------------------------
@@ -348,6 +550,10 @@ void ISimpleShader::CopyAllBufferData()
 	// Loop through the constant buffers and copy all data
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
+		// Shared buffers are filled elsewhere, once per frame
+		if (constantBuffers[i].Shared)
+			continue;
+
 		// Copy the entire local data buffer
 		deviceContext->UpdateSubresource(
 			constantBuffers[i].ConstantBuffer.Get(), 0, 0,
@@ -377,7 +583,7 @@ void ISimpleShader::CopyBufferData(unsigned int index)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = &this->constantBuffers[index];
-	if (!cb) return;
+	if (!cb || cb->Shared) return;
 
 	// Copy the data and get out
 	deviceContext->UpdateSubresource(
@@ -399,7 +605,7 @@ void ISimpleShader::CopyBufferData(std::string bufferName)
 
 	// Check for the buffer
 	SimpleConstantBuffer* cb = this->FindConstantBuffer(bufferName);
-	if (!cb) return;
+	if (!cb || cb->Shared) return;
 
 	// Copy the data and get out
 	deviceContext->UpdateSubresource(
@@ -455,6 +661,56 @@ bool ISimpleShader::SetData(std::string name, const void* data, unsigned int siz
 	return true;
 }
 
+// --------------------------------------------------------
+// Replaces the entire contents of a constant buffer with a
+// single copy, rather than setting each variable by name
+//
+// bindIndex - The register the buffer is bound to (bN)
+// data - The data to copy into the buffer
+// size - Must exactly match the size of the buffer
+//
+// See ShaderData.h for structs that match each buffer
+// --------------------------------------------------------
+bool ISimpleShader::SetBufferData(unsigned int bindIndex, const void* data, unsigned int size)
+{
+	// Only a handful of buffers per shader, so a linear search is fine
+	SimpleConstantBuffer* cb = 0;
+	for (unsigned int i = 0; i < constantBufferCount; i++)
+	{
+		if (constantBuffers[i].BindIndex == bindIndex)
+		{
+			cb = &constantBuffers[i];
+			break;
+		}
+	}
+
+	if (cb == 0 || cb->Shared)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetBufferData() - No unshared constant buffer is bound to register b");
+			Log(std::to_string(bindIndex));
+			LogWarning(".\n");
+		}
+		return false;
+	}
+
+	// A size mismatch means the C++ struct is out of date
+	if (size != cb->Size)
+	{
+		if (ReportWarnings)
+		{
+			LogWarning("SimpleShader::SetBufferData() - Constant buffer '");
+			Log(cb->Name);
+			LogWarning("' is a different size than the data being set. Rebuild to regenerate ShaderData.h.\n");
+		}
+		return false;
+	}
+
+	memcpy(cb->LocalDataBuffer, data, size);
+	return true;
+}
+
 // --------------------------------------------------------
 // Sets INTEGER data
 // --------------------------------------------------------
@@ -691,8 +947,8 @@ const SimpleConstantBuffer * ISimpleShader::GetBufferInfo(unsigned int index)
 // --------------------------------------------------------
 // Constructor just calls the base
 // --------------------------------------------------------
-SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile)
-	: ISimpleShader(device, context) 
+SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile, const InputSlotMap& inputSlots)
+	: ISimpleShader(device, context), inputSlots(inputSlots)
 { 
 	// Ensure we set to zero to successfully trigger
 	// the Input Layout creation during LoadShaderFile()
@@ -721,6 +977,17 @@ SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> devi
 	this->LoadShaderFile(shaderFile);
 }
 
+// --------------------------------------------------------
+// Constructor overload which creates the shader from a
+// shader archive entry, skipping reflection entirely
+// --------------------------------------------------------
+SimpleVertexShader::SimpleVertexShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const ShaderArchiveEntry& archiveEntry, const InputSlotMap& inputSlots)
+	: ISimpleShader(device, context), inputSlots(inputSlots)
+{
+	this->perInstanceCompatible = false;
+	this->LoadShaderFromArchive(archiveEntry);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -758,104 +1025,62 @@ bool SimpleVertexShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlo
 		shader.GetAddressOf());
 
 	// Did the creation work?
-	if (result != S_OK)
-		return false;
+	return (result == S_OK);
+}
 
+// --------------------------------------------------------
+// Creates an input layout that matches what the vertex
+// shader expects, using its (possibly pre-built) reflection data
+//
+// reflection - The shader's reflection data
+//
+// Elements are read from the slots given at construction,
+// or the slot reflection picked if theirs isn't listed.
+//
+// Always returns true - a missing input layout only
+// matters once something is drawn with this shader
+// --------------------------------------------------------
+bool SimpleVertexShader::CreateInputLayout(const ShaderReflectionData& reflection)
+{
 	// Do we already have an input layout?
 	// (This would come from one of the constructor overloads)
 	if (inputLayout)
 		return true;
 
-	// Vertex shader was created successfully, so we now use the
-	// shader code to re-reflect and create an input layout that 
-	// matches what the vertex shader expects.  Code adapted from:
-	// https://takinginitiative.wordpress.com/2011/12/11/directx-1011-basic-shader-reflection-automatic-input-layout-creation/
-
-	// Reflect shader info
-	Microsoft::WRL::ComPtr<ID3D11ShaderReflection> refl;
-	D3DReflect(
-		shaderBlob->GetBufferPointer(),
-		shaderBlob->GetBufferSize(),
-		IID_ID3D11ShaderReflection,
-		(void**)refl.GetAddressOf());
-	
-	// Get shader info
-	D3D11_SHADER_DESC shaderDesc;
-	refl->GetDesc(&shaderDesc);
+	// Shaders that only use system values (like SV_VertexID) need no layout
+	if (reflection.InputElements.empty())
+		return true;
 
-	// Read input layout description from shader info
 	std::vector<D3D11_INPUT_ELEMENT_DESC> inputLayoutDesc;
-	for (unsigned int i = 0; i< shaderDesc.InputParameters; i++)
+	for (const ShaderInputElementDesc& element : reflection.InputElements)
 	{
-		D3D11_SIGNATURE_PARAMETER_DESC paramDesc;
-		refl->GetInputParameterDesc(i, &paramDesc);
-
-		// Check the semantic name for "_PER_INSTANCE"
-		std::string perInstanceStr = "_PER_INSTANCE";
-		std::string sem = paramDesc.SemanticName;
-		int lenDiff = (int)sem.size() - (int)perInstanceStr.size();
-		bool isPerInstance = 
-			lenDiff >= 0 &&
-			sem.compare(lenDiff, perInstanceStr.size(), perInstanceStr) == 0;
-
 		// Fill out input element desc
 		D3D11_INPUT_ELEMENT_DESC elementDesc = {};
-		elementDesc.SemanticName = paramDesc.SemanticName;
-		elementDesc.SemanticIndex = paramDesc.SemanticIndex;
-		elementDesc.InputSlot = 0;
+		elementDesc.SemanticName = element.SemanticName.c_str();
+		elementDesc.SemanticIndex = element.SemanticIndex;
+		elementDesc.Format = (DXGI_FORMAT)element.Format;
+		auto slot = inputSlots.find(element.SemanticName);
+		elementDesc.InputSlot = slot != inputSlots.end() ? slot->second : element.InputSlot;
 		elementDesc.AlignedByteOffset = D3D11_APPEND_ALIGNED_ELEMENT;
-		elementDesc.InputSlotClass = D3D11_INPUT_PER_VERTEX_DATA;
-		elementDesc.InstanceDataStepRate = 0;
-
-		// Replace anything affected by "per instance" data
-		if (isPerInstance)
-		{
-			elementDesc.InputSlot = 1; // Assume per instance data comes from another input slot!
-			elementDesc.InputSlotClass = D3D11_INPUT_PER_INSTANCE_DATA;
-			elementDesc.InstanceDataStepRate = 1;
+		elementDesc.InputSlotClass = element.PerInstance ? D3D11_INPUT_PER_INSTANCE_DATA : D3D11_INPUT_PER_VERTEX_DATA;
+		elementDesc.InstanceDataStepRate = element.PerInstance ? 1 : 0;
 
+		if (element.PerInstance)
 			perInstanceCompatible = true;
-		}
-
-		// Determine DXGI format
-		if (paramDesc.Mask == 1)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 3)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 7)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32B32_FLOAT;
-		}
-		else if (paramDesc.Mask <= 15)
-		{
-			if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_UINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_UINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_SINT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_SINT;
-			else if (paramDesc.ComponentType == D3D_REGISTER_COMPONENT_FLOAT32) elementDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-		}
 
 		// Save element desc
 		inputLayoutDesc.push_back(elementDesc);
 	}
 
 	// Try to create Input Layout
-	HRESULT hr = device->CreateInputLayout(
+	device->CreateInputLayout(
 		&inputLayoutDesc[0], 
 		(unsigned int)inputLayoutDesc.size(), 
 		shaderBlob->GetBufferPointer(), 
 		shaderBlob->GetBufferSize(),
 		inputLayout.GetAddressOf());
 
-	// All done, clean up
+	// All done
 	return true;
 }
 
@@ -868,9 +1093,11 @@ void SimpleVertexShader::SetShaderAndCBs()
 	// Is shader valid?
 	if (!shaderValid) return;
 
-	// Set the shader and input layout
-	deviceContext->IASetInputLayout(inputLayout.Get());
-	deviceContext->VSSetShader(shader.Get(), 0, 0);
+	// Set the shader and input layout (through the state
+	// cache, so re-setting the same shader is free)
+	StateCache& cache = StateCache::GetInstance();
+	cache.SetInputLayout(inputLayout.Get());
+	cache.SetVertexShader(shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
@@ -880,10 +1107,9 @@ void SimpleVertexShader::SetShaderAndCBs()
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->VSSetConstantBuffers(
+		cache.VSSetConstantBuffer(
 			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			constantBuffers[i].ConstantBuffer.Get());
 	}
 }
 
@@ -911,7 +1137,7 @@ bool SimpleVertexShader::SetShaderResourceView(std::string name, Microsoft::WRL:
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().VSSetShaderResource(srvInfo->BindIndex, srv.Get());
 
 	// Success
 	return true;
@@ -941,7 +1167,7 @@ bool SimpleVertexShader::SetSamplerState(std::string name, Microsoft::WRL::ComPt
 	}
 
 	// Set the shader resource view
-	deviceContext->VSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().VSSetSampler(sampInfo->BindIndex, samplerState.Get());
 
 	// Success
 	return true;
@@ -962,6 +1188,16 @@ SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device
 	this->LoadShaderFile(shaderFile);
 }
 
+// --------------------------------------------------------
+// Constructor overload which creates the shader from a
+// shader archive entry, skipping reflection entirely
+// --------------------------------------------------------
+SimplePixelShader::SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const ShaderArchiveEntry& archiveEntry)
+	: ISimpleShader(device, context)
+{
+	this->LoadShaderFromArchive(archiveEntry);
+}
+
 // --------------------------------------------------------
 // Destructor - Clean up actual shader (base will be called automatically)
 // --------------------------------------------------------
@@ -1007,25 +1243,42 @@ bool SimplePixelShader::CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob
 // future  Direct3D drawing
 // --------------------------------------------------------
 void SimplePixelShader::SetShaderAndCBs()
+{
+	// No real slot is this high, so every buffer gets set
+	SetShaderAndCBs(D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT);
+}
+
+// --------------------------------------------------------
+// Sets the pixel shader and every constant buffer except the
+// one in the given slot, which the caller binds itself
+// --------------------------------------------------------
+void SimplePixelShader::SetShaderExceptBuffer(unsigned int skippedBindIndex)
+{
+	SetShaderAndCBs(skippedBindIndex);
+}
+
+void SimplePixelShader::SetShaderAndCBs(unsigned int skippedBindIndex)
 {
 	// Is shader valid?
 	if (!shaderValid) return;
 	
-	// Set the shader
-	deviceContext->PSSetShader(shader.Get(), 0, 0);
+	// Set the shader (through the state cache)
+	StateCache& cache = StateCache::GetInstance();
+	cache.SetPixelShader(shader.Get());
 
 	// Set the constant buffers
 	for (unsigned int i = 0; i < constantBufferCount; i++)
 	{
-		// Skip "buffers" that aren't true constant buffers
-		if (constantBuffers[i].Type != D3D11_CT_CBUFFER)
+		// Skip "buffers" that aren't true constant buffers, and
+		// the one the caller is taking care of
+		if (constantBuffers[i].Type != D3D11_CT_CBUFFER ||
+			constantBuffers[i].BindIndex == skippedBindIndex)
 			continue;
 
 		// This is a real constant buffer, so set it
-		deviceContext->PSSetConstantBuffers(
+		cache.PSSetConstantBuffer(
 			constantBuffers[i].BindIndex,
-			1,
-			constantBuffers[i].ConstantBuffer.GetAddressOf());
+			constantBuffers[i].ConstantBuffer.Get());
 	}
 }
 
@@ -1053,7 +1306,7 @@ bool SimplePixelShader::SetShaderResourceView(std::string name, Microsoft::WRL::
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetShaderResources(srvInfo->BindIndex, 1, srv.GetAddressOf());
+	StateCache::GetInstance().PSSetShaderResource(srvInfo->BindIndex, srv.Get());
 
 	// Success
 	return true;
@@ -1083,7 +1336,7 @@ bool SimplePixelShader::SetSamplerState(std::string name, Microsoft::WRL::ComPtr
 	}
 
 	// Set the shader resource view
-	deviceContext->PSSetSamplers(sampInfo->BindIndex, 1, samplerState.GetAddressOf());
+	StateCache::GetInstance().PSSetSampler(sampInfo->BindIndex, samplerState.Get());
 
 	// Success
 	return true;
@@ -11,6 +11,9 @@
 #include <vector>
 #include <string>
 
+#include "ShaderArchive.h"
+#include "SharedConstantBuffers.h"
+
 
 // --------------------------------------------------------
 // Used by simple shaders to store information about
@@ -36,6 +39,7 @@ struct SimpleConstantBuffer
 	unsigned int BindIndex = 0;
 	Microsoft::WRL::ComPtr<ID3D11Buffer> ConstantBuffer = 0;
 	unsigned char* LocalDataBuffer = 0;
+	bool Shared = false; // Owned by SharedConstantBuffers, which fills it
 	std::vector<SimpleShaderVariable> Variables;
 };
 
@@ -57,6 +61,13 @@ struct SimpleSampler
 	unsigned int BindIndex; // The register of the Sampler
 };
 
+// --------------------------------------------------------
+// The vertex buffer slot each input semantic is read from,
+// for vertex shaders whose input is split across streams.
+// Semantics that aren't listed keep the slot from reflection.
+// --------------------------------------------------------
+typedef std::unordered_map<std::string, unsigned int> InputSlotMap;
+
 // --------------------------------------------------------
 // Base abstract class for simplifying shader handling
 // --------------------------------------------------------
@@ -78,6 +89,11 @@ public:
 	// Sets arbitrary shader data
 	bool SetData(std::string name, const void* data, unsigned int size);
 
+	// Sets a whole constant buffer at once from one of the
+	// generated structs in ShaderData.h
+	bool SetBufferData(unsigned int bindIndex, const void* data, unsigned int size);
+	template<typename T> bool SetBufferData(const T& data) { return SetBufferData(T::BindIndex, &data, sizeof(T)); }
+
 	bool SetInt(std::string name, int data);
 	bool SetFloat(std::string name, float data);
 	bool SetFloat2(std::string name, const float data[2]);
@@ -118,6 +134,10 @@ public:
 	// Misc getters
 	Microsoft::WRL::ComPtr<ID3DBlob> GetShaderBlob() { return shaderBlob; }
 
+	// Extracts everything SimpleShader needs from compiled shader
+	// code, so it can be saved in a ShaderArchive ahead of time
+	static bool ReflectShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, ShaderReflectionData& reflection);
+
 	// Error reporting
 	static bool ReportErrors;
 	static bool ReportWarnings;
@@ -141,13 +161,18 @@ protected:
 	std::unordered_map<std::string, SimpleSRV*> textureTable;
 	std::unordered_map<std::string, SimpleSampler*> samplerTable;
 
-	// Initialization method
+	// Initialization methods
 	bool LoadShaderFile(LPCWSTR shaderFile);
+	bool LoadShaderFromArchive(const ShaderArchiveEntry& entry);
+	bool LoadShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob, const ShaderReflectionData& reflection);
 
 	// Pure virtual functions for dealing with shader types
 	virtual bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob) = 0;
 	virtual void SetShaderAndCBs() = 0;
 
+	// Only vertex shaders need anything beyond the common tables
+	virtual bool CreateInputLayout(const ShaderReflectionData& reflection) { return true; }
+
 	virtual void CleanUp();
 
 	// Helpers for finding data by name
@@ -171,8 +196,9 @@ protected:
 class SimpleVertexShader : public ISimpleShader
 {
 public:
-	SimpleVertexShader( Microsoft::WRL::ComPtr<ID3D11Device> device,  Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile);
+	SimpleVertexShader( Microsoft::WRL::ComPtr<ID3D11Device> device,  Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile, const InputSlotMap& inputSlots = InputSlotMap());
 	SimpleVertexShader( Microsoft::WRL::ComPtr<ID3D11Device> device,  Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile, Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout, bool perInstanceCompatible);
+	SimpleVertexShader( Microsoft::WRL::ComPtr<ID3D11Device> device,  Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const ShaderArchiveEntry& archiveEntry, const InputSlotMap& inputSlots = InputSlotMap());
 	~SimpleVertexShader();
 	Microsoft::WRL::ComPtr<ID3D11VertexShader> GetDirectXShader() { return shader; }
 	Microsoft::WRL::ComPtr<ID3D11InputLayout> GetInputLayout() { return inputLayout; }
@@ -183,9 +209,11 @@ public:
 
 protected:
 	bool perInstanceCompatible;
+	InputSlotMap inputSlots;
 	 Microsoft::WRL::ComPtr<ID3D11InputLayout> inputLayout;
 	 Microsoft::WRL::ComPtr<ID3D11VertexShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
+	bool CreateInputLayout(const ShaderReflectionData& reflection);
 	void SetShaderAndCBs();
 	void CleanUp();
 };
@@ -198,16 +226,22 @@ class SimplePixelShader : public ISimpleShader
 {
 public:
 	SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, LPCWSTR shaderFile);
+	SimplePixelShader(Microsoft::WRL::ComPtr<ID3D11Device> device, Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, const ShaderArchiveEntry& archiveEntry);
 	~SimplePixelShader();
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> GetDirectXShader() { return shader; }
 
 	bool SetShaderResourceView(std::string name, Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv);
 	bool SetSamplerState(std::string name, Microsoft::WRL::ComPtr<ID3D11SamplerState> samplerState);
 
+	// Like SetShader(), but leaves one constant buffer slot to
+	// the caller (like a material binding its own constants)
+	void SetShaderExceptBuffer(unsigned int skippedBindIndex);
+
 protected:
 	Microsoft::WRL::ComPtr<ID3D11PixelShader> shader;
 	bool CreateShader(Microsoft::WRL::ComPtr<ID3DBlob> shaderBlob);
 	void SetShaderAndCBs();
+	void SetShaderAndCBs(unsigned int skippedBindIndex);
 	void CleanUp();
 };
 
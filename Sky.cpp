@@ -1,16 +1,25 @@
 #include "Sky.h"
 #include <WICTextureLoader.h>
 #include "PathHelpers.h"
+#include "StateCache.h"
+#include "ShaderData.h"
+#include "MipGenerator.h"
+#include "TextureImporter.h"
+#include "TextureManager.h"
 
 Sky::Sky(
 	std::shared_ptr<Mesh> _mesh, 
 	Microsoft::WRL::ComPtr<ID3D11SamplerState> _sampleState, 
 	Microsoft::WRL::ComPtr<ID3D11Device> device, 
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, 
-	std::wstring cubeMapFilePath)
+	std::wstring cubeMapFilePath,
+	std::shared_ptr<SimplePixelShader> _ps,
+	std::shared_ptr<SimpleVertexShader> _vs)
 {
 	sampleState = _sampleState;
 	mesh = _mesh;
+	ps = _ps;
+	vs = _vs;
 
 	cubeMapTexture = CreateCubemap(
 		device,
@@ -32,9 +41,6 @@ Sky::Sky(
 	stencilDescription.DepthEnable = true;
 	stencilDescription.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;
 	device->CreateDepthStencilState(&stencilDescription, &stencilState);
-
-	ps = std::make_shared<SimplePixelShader>(device, context, FixPath(L"SkyPixelShader.cso").c_str());
-	vs = std::make_shared<SimpleVertexShader>(device, context, FixPath(L"SkyVertexShader.cso").c_str());
 }
 
 Sky::~Sky()
@@ -42,13 +48,69 @@ Sky::~Sky()
 
 }
 
+// --------------------------------------------------------
+// Decodes the six faces of a cube map and builds their mips in
+// parallel, then creates the cube map with all six faces as its
+// initial data.  If any face is in a format we can't decode
+// ourselves, falls back to loading the faces through WIC.
+// --------------------------------------------------------
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	const wchar_t* right,
+	const wchar_t* left,
+	const wchar_t* up,
+	const wchar_t* down,
+	const wchar_t* front,
+	const wchar_t* back)
+{
+	// Order matters here!  +X, -X, +Y, -Y, +Z, -Z
+	const wchar_t* files[6] = { right, left, up, down, front, back };
+
+	ImportedTexture faces[6];
+	std::vector<ImportedTexture*> toImport;
+	for (int i = 0; i < 6; i++)
+	{
+		faces[i].path = WideToNarrow(files[i]);
+		toImport.push_back(&faces[i]);
+	}
+
+	JobSystem& jobs = TextureManager::GetInstance().GetJobSystem();
+	TextureImporter importer(jobs);
+	importer.Import(toImport, false);
+
+	MipChain faceImages[6];
+	std::vector<MipChain*> faceChains;
+	bool allDecoded = true;
+	for (int i = 0; i < 6; i++)
+	{
+		allDecoded = allDecoded && faces[i].decoded;
+		faceImages[i] = std::move(faces[i].mips);
+		faceChains.push_back(&faceImages[i]);
+	}
+
+	// Mips keep the sky from shimmering where it's minified.  Faces
+	// don't tile, so clamp at their edges rather than wrapping.
+	MipSettings mipSettings;
+	mipSettings.srgb = true;
+	mipSettings.wrap = false;
+	if (allDecoded)
+		MipGenerator::Generate(jobs, faceChains, mipSettings);
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> cubeSRV;
+	if (allDecoded && TextureManager::CreateTexture(device.Get(), faceImages, 6, true, cubeSRV.GetAddressOf()) == S_OK)
+		return cubeSRV;
+
+	return CreateCubemapWIC(device, context, right, left, up, down, front, back);
+}
+
 // --------------------------------------------------------
 // Loads six individual textures (the six faces of a cube map), then
 // creates a blank cube map and copies each of the six textures to
 // another face.  Afterwards, creates a shader resource view for
 // the cube map and cleans up all of the temporary resources.
 // --------------------------------------------------------
-Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(
+Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemapWIC(
 	Microsoft::WRL::ComPtr<ID3D11Device> device,
 	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
 	const wchar_t* right,
@@ -133,24 +195,26 @@ Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> Sky::CreateCubemap(
 	return cubeSRV;
 }
 
-void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera)
+void Sky::Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
 {
-	context->RSSetState(rasterizerState.Get());
-	context->OMSetDepthStencilState(stencilState.Get(), 0);
+	StateCache& cache = StateCache::GetInstance();
+	cache.SetRasterizerState(rasterizerState.Get());
+	cache.SetDepthStencilState(stencilState.Get(), 0);
 
+	// The camera matrices are already in the shared FrameBuffer
 	vs->SetShader();
-	vs->SetMatrix4x4("view", camera->GetViewMatrix());
-	vs->SetMatrix4x4("projection", camera->GetProjectionMatrix());
-	vs->CopyAllBufferData();
+
+	ShaderData::SkyPixelShaderConstantBuffer psData = {};
+	psData.ambient = ambient;
 
 	ps->SetShader();
 	ps->SetSamplerState("SkyBoxSampler", sampleState);
 	ps->SetShaderResourceView("cubeMap", cubeMapTexture);
-	ps->SetFloat3("ambient", ambient);
+	ps->SetBufferData(psData);
 	ps->CopyAllBufferData();
 
 	mesh->Draw(context);
 
-	context->RSSetState(nullptr);
-	context->OMSetDepthStencilState(0, 0);
+	cache.SetRasterizerState(0);
+	cache.SetDepthStencilState(0, 0);
 }
\ No newline at end of file
@@ -18,7 +18,7 @@ private:
 	std::shared_ptr<SimpleVertexShader> vs;
 
 public:
-	Sky(std::shared_ptr<Mesh> _mesh,Microsoft::WRL::ComPtr<ID3D11SamplerState> _sampleState,Microsoft::WRL::ComPtr<ID3D11Device> device,Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,std::wstring cubeMapFilePath);
+	Sky(std::shared_ptr<Mesh> _mesh,Microsoft::WRL::ComPtr<ID3D11SamplerState> _sampleState,Microsoft::WRL::ComPtr<ID3D11Device> device,Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,std::wstring cubeMapFilePath,std::shared_ptr<SimplePixelShader> _ps,std::shared_ptr<SimpleVertexShader> _vs);
 	~Sky();
 	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemap(
 		Microsoft::WRL::ComPtr<ID3D11Device> device,
@@ -30,7 +30,18 @@ public:
 		const wchar_t* front, 
 		const wchar_t* back);
 
-	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context, std::shared_ptr<Camera> camera);
+	// The original loader, for faces TextureImporter can't decode
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> CreateCubemapWIC(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		const wchar_t* right,
+		const wchar_t* left,
+		const wchar_t* up,
+		const wchar_t* down,
+		const wchar_t* front,
+		const wchar_t* back);
+
+	void Draw(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
 
 	DirectX::XMFLOAT3 ambient;
 };
\ No newline at end of file
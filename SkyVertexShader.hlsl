@@ -17,11 +17,7 @@ struct VertexToPixel_Sky
     float3 sampleDir : DIRECTION;
 };
 
-cbuffer ConstantBuffer : register(b0)
-{
-    matrix view;
-    matrix projection;
-};
+#include "FrameBuffer.hlsli"
 
 VertexToPixel_Sky main(VertexShaderInput input)
 {
@@ -0,0 +1,285 @@
+#include "StateCache.h"
+
+// Singleton requirement
+StateCache* StateCache::instance;
+
+// --------------- Basic usage -----------------
+//
+// Anything that would normally call a state setter on
+// the device context (shaders, constant buffers, SRVs,
+// samplers, vertex/index buffers, rasterizer and depth
+// states, viewports, render targets) should go through
+// the cache instead:
+//
+//   StateCache& cache = StateCache::GetInstance();
+//   cache.SetRasterizerState(myRasterizer.Get());
+//   cache.PSSetShaderResource(0, mySRV.Get());
+//
+// The cache remembers what it last bound and drops calls
+// that wouldn't change anything.  Code that touches the
+// context directly (for instance a third party library that
+// doesn't restore its state) must call Invalidate() afterwards.
+// ---------------------------------------------
+
+StateCache::~StateCache()
+{
+
+}
+
+// --------------------------------------------------------
+// Saves the context that all state changes are forwarded to
+// --------------------------------------------------------
+void StateCache::Initialize(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context)
+{
+	this->context = context;
+	Invalidate();
+}
+
+// --------------------------------------------------------
+// Lets go of the context, since the singleton itself is
+// never destroyed
+// --------------------------------------------------------
+void StateCache::Shutdown()
+{
+	Invalidate();
+	outputResources[0] = 0;
+	outputResources[1] = 0;
+	context.Reset();
+}
+
+// --------------------------------------------------------
+// Publishes last frame's counters and starts a new frame.
+// Present() and resizing can unbind state behind our back,
+// so the cached state is thrown away too.
+// --------------------------------------------------------
+void StateCache::BeginFrame()
+{
+	lastFrameIssued = issuedCalls;
+	lastFrameFiltered = filteredCalls;
+	issuedCalls = 0;
+	filteredCalls = 0;
+
+	Invalidate();
+}
+
+// --------------------------------------------------------
+// Forgets everything we think is bound, so the next call
+// to each setter is always forwarded to the context
+// --------------------------------------------------------
+void StateCache::Invalidate()
+{
+	inputLayout.valid = false;
+	vertexShader.valid = false;
+	pixelShader.valid = false;
+
+	for (auto& cb : vsConstantBuffers) cb.valid = false;
+	for (auto& cb : psConstantBuffers) cb.valid = false;
+	for (auto& srv : vsShaderResources) srv.valid = false;
+	for (auto& srv : psShaderResources) srv.valid = false;
+	for (auto& s : vsSamplers) s.valid = false;
+	for (auto& s : psSamplers) s.valid = false;
+
+	topology.valid = false;
+	for (auto& vb : vertexBuffers) vb.valid = false;
+	indexBuffer.valid = false;
+
+	rasterizerState.valid = false;
+	depthStencilState.valid = false;
+	viewport.valid = false;
+	renderTarget.valid = false;
+}
+
+bool StateCache::Track(bool changed)
+{
+	if (changed) issuedCalls++;
+	else filteredCalls++;
+
+	return changed;
+}
+
+void StateCache::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (Track(inputLayout.Update(layout)))
+		context->IASetInputLayout(layout);
+}
+
+void StateCache::SetVertexShader(ID3D11VertexShader* shader)
+{
+	if (Track(vertexShader.Update(shader)))
+		context->VSSetShader(shader, 0, 0);
+}
+
+void StateCache::SetPixelShader(ID3D11PixelShader* shader)
+{
+	if (Track(pixelShader.Update(shader)))
+		context->PSSetShader(shader, 0, 0);
+}
+
+void StateCache::VSSetConstantBuffer(unsigned int slot, ID3D11Buffer* buffer)
+{
+	if (Track(vsConstantBuffers[slot].Update(buffer)))
+		context->VSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void StateCache::PSSetConstantBuffer(unsigned int slot, ID3D11Buffer* buffer)
+{
+	if (Track(psConstantBuffers[slot].Update(buffer)))
+		context->PSSetConstantBuffers(slot, 1, &buffer);
+}
+
+// --------------------------------------------------------
+// An SRV of the current output is bound as null, so the slot
+// is forgotten rather than remembered as holding the SRV, and
+// binding it again once the output changes isn't filtered out
+// --------------------------------------------------------
+void StateCache::VSSetShaderResource(unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	if (Track(vsShaderResources[slot].Update(srv)))
+		context->VSSetShaderResources(slot, 1, &srv);
+
+	if (IsBoundAsOutput(srv))
+		vsShaderResources[slot].valid = false;
+}
+
+void StateCache::PSSetShaderResource(unsigned int slot, ID3D11ShaderResourceView* srv)
+{
+	if (Track(psShaderResources[slot].Update(srv)))
+		context->PSSetShaderResources(slot, 1, &srv);
+
+	if (IsBoundAsOutput(srv))
+		psShaderResources[slot].valid = false;
+}
+
+void StateCache::VSSetSampler(unsigned int slot, ID3D11SamplerState* sampler)
+{
+	if (Track(vsSamplers[slot].Update(sampler)))
+		context->VSSetSamplers(slot, 1, &sampler);
+}
+
+void StateCache::PSSetSampler(unsigned int slot, ID3D11SamplerState* sampler)
+{
+	if (Track(psSamplers[slot].Update(sampler)))
+		context->PSSetSamplers(slot, 1, &sampler);
+}
+
+void StateCache::PSSetShaderResources(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs)
+{
+	bool changed = false;
+	for (unsigned int i = 0; i < count; i++)
+		changed |= psShaderResources[startSlot + i].Update(srvs[i]);
+
+	if (Track(changed))
+		context->PSSetShaderResources(startSlot, count, srvs);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (IsBoundAsOutput(srvs[i]))
+			psShaderResources[startSlot + i].valid = false;
+	}
+}
+
+void StateCache::PSSetSamplers(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers)
+{
+	bool changed = false;
+	for (unsigned int i = 0; i < count; i++)
+		changed |= psSamplers[startSlot + i].Update(samplers[i]);
+
+	if (Track(changed))
+		context->PSSetSamplers(startSlot, count, samplers);
+}
+
+// --------------------------------------------------------
+// Unbinds every pixel shader SRV in a single call, so textures
+// can safely be used as render targets next frame
+// --------------------------------------------------------
+void StateCache::PSClearShaderResources()
+{
+	ID3D11ShaderResourceView* nullSRVs[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT] = {};
+	context->PSSetShaderResources(0, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, nullSRVs);
+	issuedCalls++;
+
+	for (auto& srv : psShaderResources)
+	{
+		srv.value = 0;
+		srv.valid = true;
+	}
+}
+
+void StateCache::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY newTopology)
+{
+	if (Track(topology.Update(newTopology)))
+		context->IASetPrimitiveTopology(newTopology);
+}
+
+void StateCache::SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset)
+{
+	if (Track(vertexBuffers[slot].Update({ buffer, stride, offset })))
+		context->IASetVertexBuffers(slot, 1, &buffer, &stride, &offset);
+}
+
+void StateCache::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset)
+{
+	if (Track(indexBuffer.Update({ buffer, format, offset })))
+		context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void StateCache::SetRasterizerState(ID3D11RasterizerState* state)
+{
+	if (Track(rasterizerState.Update(state)))
+		context->RSSetState(state);
+}
+
+void StateCache::SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef)
+{
+	if (Track(depthStencilState.Update({ state, stencilRef })))
+		context->OMSetDepthStencilState(state, stencilRef);
+}
+
+void StateCache::SetViewport(const D3D11_VIEWPORT& vp)
+{
+	if (Track(viewport.Update({ vp.TopLeftX, vp.TopLeftY, vp.Width, vp.Height, vp.MinDepth, vp.MaxDepth })))
+		context->RSSetViewports(1, &vp);
+}
+
+// --------------------------------------------------------
+// Binds a single render target (or none) and a depth buffer.
+//
+// Binding a resource as an output silently unbinds it from
+// any input slots, so our idea of the bound SRVs may no longer
+// be accurate afterwards - forget them rather than guess.
+// --------------------------------------------------------
+void StateCache::SetRenderTarget(ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv)
+{
+	if (!Track(renderTarget.Update({ rtv, dsv })))
+		return;
+
+	context->OMSetRenderTargets(1, &rtv, dsv);
+
+	for (auto& srv : vsShaderResources) srv.valid = false;
+	for (auto& srv : psShaderResources) srv.valid = false;
+
+	// Only the addresses are kept, so the references are dropped
+	// right away - the views keep the resources alive while bound
+	ID3D11View* views[2] = { rtv, dsv };
+	for (int i = 0; i < 2; i++)
+	{
+		outputResources[i] = 0;
+		if (views[i])
+		{
+			views[i]->GetResource(&outputResources[i]);
+			outputResources[i]->Release();
+		}
+	}
+}
+
+bool StateCache::IsBoundAsOutput(ID3D11ShaderResourceView* srv)
+{
+	if (!srv || (!outputResources[0] && !outputResources[1]))
+		return false;
+
+	ID3D11Resource* resource = 0;
+	srv->GetResource(&resource);
+	resource->Release();
+
+	return resource == outputResources[0] || resource == outputResources[1];
+}
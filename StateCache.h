@@ -0,0 +1,172 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+
+// --------------------------------------------------------
+// Remembers a single piece of pipeline state so we can
+// tell whether setting it again would actually change anything
+// --------------------------------------------------------
+template<typename T>
+struct CachedState
+{
+	T value = {};
+	bool valid = false;
+
+	// Returns true (and remembers the new value) if the
+	// value differs from what we believe is currently bound
+	bool Update(const T& newValue)
+	{
+		if (valid && value == newValue)
+			return false;
+
+		value = newValue;
+		valid = true;
+		return true;
+	}
+};
+
+// --------------------------------------------------------
+// A shadow copy of the device context's bound state.  Every
+// state change goes through here, and calls that would rebind
+// what is already bound are dropped before reaching Direct3D.
+// --------------------------------------------------------
+class StateCache
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static StateCache& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new StateCache();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	StateCache(StateCache const&) = delete;
+	void operator=(StateCache const&) = delete;
+
+private:
+	static StateCache* instance;
+	StateCache() {};
+#pragma endregion
+
+public:
+	~StateCache();
+
+	void Initialize(Microsoft::WRL::ComPtr<ID3D11DeviceContext> context);
+	void Shutdown();
+	void BeginFrame();
+	void Invalidate();
+
+	// Shaders and their resources
+	void SetInputLayout(ID3D11InputLayout* inputLayout);
+	void SetVertexShader(ID3D11VertexShader* shader);
+	void SetPixelShader(ID3D11PixelShader* shader);
+	void VSSetConstantBuffer(unsigned int slot, ID3D11Buffer* buffer);
+	void PSSetConstantBuffer(unsigned int slot, ID3D11Buffer* buffer);
+	void VSSetShaderResource(unsigned int slot, ID3D11ShaderResourceView* srv);
+	void PSSetShaderResource(unsigned int slot, ID3D11ShaderResourceView* srv);
+	void VSSetSampler(unsigned int slot, ID3D11SamplerState* sampler);
+	void PSSetSampler(unsigned int slot, ID3D11SamplerState* sampler);
+	void PSClearShaderResources();
+
+	// Contiguous ranges of slots, set with a single call if any slot changed
+	void PSSetShaderResources(unsigned int startSlot, unsigned int count, ID3D11ShaderResourceView* const* srvs);
+	void PSSetSamplers(unsigned int startSlot, unsigned int count, ID3D11SamplerState* const* samplers);
+
+	// Input assembler
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology);
+	void SetVertexBuffer(unsigned int slot, ID3D11Buffer* buffer, unsigned int stride, unsigned int offset);
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, unsigned int offset);
+
+	// Rasterizer and output merger
+	void SetRasterizerState(ID3D11RasterizerState* state);
+	void SetDepthStencilState(ID3D11DepthStencilState* state, unsigned int stencilRef);
+	void SetViewport(const D3D11_VIEWPORT& viewport);
+	void SetRenderTarget(ID3D11RenderTargetView* rtv, ID3D11DepthStencilView* dsv);
+
+	// Stats from the most recently completed frame
+	unsigned int GetIssuedCallCount() { return lastFrameIssued; }
+	unsigned int GetFilteredCallCount() { return lastFrameFiltered; }
+
+private:
+	// Small comparable bundles for state that is set as a group
+	struct VertexBufferBinding
+	{
+		ID3D11Buffer* buffer;
+		unsigned int stride;
+		unsigned int offset;
+		bool operator==(const VertexBufferBinding& o) const { return buffer == o.buffer && stride == o.stride && offset == o.offset; }
+	};
+
+	struct IndexBufferBinding
+	{
+		ID3D11Buffer* buffer;
+		DXGI_FORMAT format;
+		unsigned int offset;
+		bool operator==(const IndexBufferBinding& o) const { return buffer == o.buffer && format == o.format && offset == o.offset; }
+	};
+
+	struct DepthStencilBinding
+	{
+		ID3D11DepthStencilState* state;
+		unsigned int stencilRef;
+		bool operator==(const DepthStencilBinding& o) const { return state == o.state && stencilRef == o.stencilRef; }
+	};
+
+	struct ViewportBinding
+	{
+		float x, y, width, height, minDepth, maxDepth;
+		bool operator==(const ViewportBinding& o) const
+		{
+			return x == o.x && y == o.y && width == o.width && height == o.height && minDepth == o.minDepth && maxDepth == o.maxDepth;
+		}
+	};
+
+	struct RenderTargetBinding
+	{
+		ID3D11RenderTargetView* rtv;
+		ID3D11DepthStencilView* dsv;
+		bool operator==(const RenderTargetBinding& o) const { return rtv == o.rtv && dsv == o.dsv; }
+	};
+
+	// Counts a call as issued or filtered, returning whether it should be issued
+	bool Track(bool changed);
+
+	// Whether an SRV views the bound render target or depth buffer,
+	// which Direct3D quietly binds as null instead
+	bool IsBoundAsOutput(ID3D11ShaderResourceView* srv);
+
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+
+	CachedState<ID3D11InputLayout*> inputLayout;
+	CachedState<ID3D11VertexShader*> vertexShader;
+	CachedState<ID3D11PixelShader*> pixelShader;
+	CachedState<ID3D11Buffer*> vsConstantBuffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+	CachedState<ID3D11Buffer*> psConstantBuffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+	CachedState<ID3D11ShaderResourceView*> vsShaderResources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+	CachedState<ID3D11ShaderResourceView*> psShaderResources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+	CachedState<ID3D11SamplerState*> vsSamplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+	CachedState<ID3D11SamplerState*> psSamplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+
+	CachedState<D3D11_PRIMITIVE_TOPOLOGY> topology;
+	CachedState<VertexBufferBinding> vertexBuffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+	CachedState<IndexBufferBinding> indexBuffer;
+
+	CachedState<ID3D11RasterizerState*> rasterizerState;
+	CachedState<DepthStencilBinding> depthStencilState;
+	CachedState<ViewportBinding> viewport;
+	CachedState<RenderTargetBinding> renderTarget;
+	ID3D11Resource* outputResources[2] = {};	// Behind the bound RTV and DSV, for comparison only
+
+	// Per-frame counters
+	unsigned int issuedCalls = 0;
+	unsigned int filteredCalls = 0;
+	unsigned int lastFrameIssued = 0;
+	unsigned int lastFrameFiltered = 0;
+};
@@ -0,0 +1,152 @@
+// --------------------------------------------------------
+// Drives DynamicResolution with synthetic frame times from a
+// simulated GPU, whose frames cost a fixed amount plus an
+// amount per pixel rendered, and checks that the scale:
+//  - settles where frames meet the budget
+//  - never leaves [minScale, maxScale], and sits at a limit
+//    when the budget can't (or can easily) be met
+//  - only moves once the controller is past the hysteresis
+//  - recovers from a spike under vsync, given the GPU's time
+// --------------------------------------------------------
+
+#include <cmath>
+#include <cstdio>
+
+#include "DynamicResolution.h"
+#include "TestCheck.h"
+
+namespace
+{
+	// What happened over a run of frames
+	struct RunResult
+	{
+		float lowestScale = 1e9f;
+		float highestScale = -1e9f;
+		float lastScale = 0;
+		float lastFrameTime = 0;
+		int changesInLastHalf = 0;
+		bool movedInsideHysteresis = false;
+	};
+
+	// Frames take fixedCost plus pixelCost at full resolution (scaled
+	// by the fraction of pixels drawn), give or take a few percent.
+	// With a refresh interval, the controller is fed the wall-clock
+	// time of a vsynced frame instead: whole refreshes.
+	RunResult Run(DynamicResolution& controller, int frames, float fixedCost, float pixelCost, float noise, float refreshInterval = 0)
+	{
+		RunResult result;
+		for (int frame = 0; frame < frames; frame++)
+		{
+			float scale = controller.GetScale();
+			float jitter = ((frame * 7919) % 13 - 6) / 6.0f;	// Repeatable, in [-1, 1]
+			float frameTime = (fixedCost + pixelCost * scale * scale) * (1 + noise * jitter);
+			if (refreshInterval > 0)
+				frameTime = ceilf(frameTime / refreshInterval) * refreshInterval;
+
+			controller.Update(frameTime);
+
+			// A change has to be a jump to what the controller wants,
+			// and either clear the hysteresis or reach a limit
+			float newScale = controller.GetScale();
+			if (newScale != scale)
+			{
+				bool atLimit = newScale == controller.minScale || newScale == controller.maxScale;
+				if (newScale != controller.GetDesiredScale() || (!atLimit && fabsf(newScale - scale) <= controller.hysteresis))
+					result.movedInsideHysteresis = true;
+
+				if (frame >= frames / 2)
+					result.changesInLastHalf++;
+			}
+
+			result.lowestScale = fminf(result.lowestScale, newScale);
+			result.highestScale = fmaxf(result.highestScale, newScale);
+			result.lastScale = newScale;
+			result.lastFrameTime = controller.GetSmoothedFrameTime();
+		}
+
+		return result;
+	}
+}
+
+int main()
+{
+	const float budget = 1.0f / 60.0f;
+
+	// Three times the budget at full resolution, so the scale
+	// has to settle well below 1
+	{
+		DynamicResolution controller;
+		controller.targetFrameTime = budget;
+		RunResult result = Run(controller, 1200, 0.002f, 0.040f, 0.05f);
+
+		printf("Heavy load settled at %.3f scale, %.2f ms (budget %.2f ms)\n", result.lastScale, result.lastFrameTime * 1000, budget * 1000);
+		Check(fabsf(result.lastFrameTime - budget) < budget * 0.1f, "converges to within 10% of the budget");
+		Check(result.lastScale > controller.minScale && result.lastScale < controller.maxScale, "settles between the limits");
+		Check(result.changesInLastHalf <= 2, "stays put once settled");
+		Check(!result.movedInsideHysteresis, "never moves inside the hysteresis band");
+	}
+
+	// Far more than the budget even at the smallest scale
+	{
+		DynamicResolution controller;
+		controller.targetFrameTime = budget;
+		controller.minScale = 0.6f;
+		controller.maxScale = 0.9f;
+		controller.Reset();
+		RunResult result = Run(controller, 600, 0.050f, 0.500f, 0.05f);
+
+		Check(result.lowestScale >= controller.minScale && result.highestScale <= controller.maxScale, "overload stays within the limits");
+		Check(result.lastScale == controller.minScale, "overload ends at the minimum scale");
+		Check(!result.movedInsideHysteresis, "overload never moves inside the hysteresis band");
+	}
+
+	// Easily within budget, after a spell of overload
+	{
+		DynamicResolution controller;
+		controller.targetFrameTime = budget;
+		controller.minScale = 0.6f;
+		controller.maxScale = 0.9f;
+		controller.Reset();
+		Run(controller, 300, 0.050f, 0.500f, 0.05f);
+		RunResult result = Run(controller, 600, 0.001f, 0.004f, 0.05f);
+
+		Check(result.lowestScale >= controller.minScale && result.highestScale <= controller.maxScale, "light load stays within the limits");
+		Check(result.lastScale == controller.maxScale, "light load recovers to the maximum scale");
+		Check(!result.movedInsideHysteresis, "light load never moves inside the hysteresis band");
+	}
+
+	// Right at the budget with noisy frames: the controller wobbles,
+	// but never by more than the hysteresis, so the scale holds
+	{
+		DynamicResolution controller;
+		controller.targetFrameTime = budget;
+		Run(controller, 600, 0.002f, 0.040f, 0.0f);
+		float settled = controller.GetScale();
+
+		RunResult result = Run(controller, 600, 0.002f, 0.040f, 0.08f);
+		Check(result.lowestScale == settled && result.highestScale == settled, "noise inside the hysteresis band doesn't change the scale");
+	}
+
+	// Under vsync, a frame with time to spare still takes a whole
+	// refresh on the CPU, so wall-clock time always reads as right
+	// on budget and the scale never climbs back after a spike.
+	// The GPU's own frame time (what Game feeds in) shows the room.
+	{
+		DynamicResolution wallClock;
+		wallClock.targetFrameTime = budget;
+		Run(wallClock, 300, 0.050f, 0.500f, 0.05f, budget);
+		RunResult stuck = Run(wallClock, 600, 0.002f, 0.010f, 0.05f, budget);
+
+		DynamicResolution gpuTime;
+		gpuTime.targetFrameTime = budget;
+		Run(gpuTime, 300, 0.050f, 0.500f, 0.05f);
+		RunResult recovered = Run(gpuTime, 600, 0.002f, 0.010f, 0.05f);
+
+		printf("After a spike under vsync: %.3f scale from wall-clock time, %.3f from GPU time\n", stuck.lastScale, recovered.lastScale);
+		Check(stuck.lastScale < gpuTime.maxScale, "vsynced wall-clock time hides the spare time");
+		Check(recovered.lastScale == gpuTime.maxScale, "GPU time recovers to the maximum scale under vsync");
+		Check(!recovered.movedInsideHysteresis, "GPU time never moves inside the hysteresis band");
+	}
+
+	return FinishChecks("dynamic resolution");
+}
@@ -0,0 +1,49 @@
+// --------------------------------------------------------
+// Checks the blur's folded Gaussian taps against a texel by
+// texel Gaussian and against the box blur they replaced, for
+// every radius the blur slider can pick.
+// --------------------------------------------------------
+
+#include <cmath>
+#include <cstdio>
+
+#include "GaussianBlur.h"
+#include "TestCheck.h"
+
+namespace
+{
+	// Folding pairs of texels into one fetch should only cost rounding
+	const float UnfoldedTolerance = 1e-4f;
+
+	// The kernels' shapes differ, but the same radius should blur
+	// about as much (the largest measured difference is about 0.072)
+	const float BoxTolerance = 0.08f;
+
+	const int MaxRadius = 10;
+}
+
+int main()
+{
+	printf("%6s %6s %5s %14s %12s\n", "Radius", "Sigma", "Taps", "vs. Unfolded", "vs. Box");
+	for (int radius = 1; radius <= MaxRadius; radius++)
+	{
+		float sigma = GaussianBlur::GetSigma((float)radius);
+		GaussianBlurTaps taps = GaussianBlur::GetTaps(sigma);
+
+		float unfoldedError, boxError;
+		GaussianBlur::Compare((float)radius, unfoldedError, boxError);
+		printf("%6d %6.3f %5d %14g %12g\n", radius, sigma, taps.count, unfoldedError, boxError);
+
+		// Both sides of every tap but the center should add up to one
+		float total = taps.weights[0];
+		for (int i = 1; i < taps.count; i++)
+			total += 2 * taps.weights[i];
+
+		Check(taps.count <= GaussianBlurTaps::MaxTaps, "taps fit in MaxTaps");
+		Check(std::fabs(total - 1.0f) < 1e-4f, "weights add up to one");
+		Check(unfoldedError <= UnfoldedTolerance, "folded taps match the unfolded Gaussian");
+		Check(boxError <= BoxTolerance, "Gaussian stays close to the box blur");
+	}
+
+	return FinishChecks("blur");
+}
@@ -0,0 +1,218 @@
+// --------------------------------------------------------
+// Checks that ShaderArchive reads back exactly what it wrote,
+// and that truncated or corrupt archives are rejected rather
+// than half loaded.
+// --------------------------------------------------------
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "ShaderArchive.h"
+#include "TestCheck.h"
+
+namespace
+{
+	// Something like a real vertex shader, using every part of the format
+	ShaderArchiveEntry MakeFullEntry()
+	{
+		ShaderArchiveEntry entry;
+		entry.Name = "VertexShader";
+		for (int i = 0; i < 300; i++)
+			entry.Bytecode.push_back((unsigned char)(i * 7));
+
+		ShaderConstantBufferDesc cb;
+		cb.Name = "ExternalData";
+		cb.Type = 0;
+		cb.Size = 208;
+		cb.BindIndex = 1;
+		cb.Variables.push_back({ "world", 0, 64 });
+		cb.Variables.push_back({ "worldInvTranspose", 64, 64 });
+		cb.Variables.push_back({ "worldViewProjection", 128, 64 });
+		cb.Variables.push_back({ "lightRange", 192, 8 });
+		entry.Reflection.ConstantBuffers.push_back(cb);
+
+		entry.Reflection.ShaderResourceViews.push_back({ "Albedo", 0 });
+		entry.Reflection.ShaderResourceViews.push_back({ "ShadowMap", 5 });
+		entry.Reflection.Samplers.push_back({ "BasicSampler", 0 });
+
+		ShaderInputElementDesc position;
+		position.SemanticName = "POSITION";
+		position.Format = 6;	// DXGI_FORMAT_R32G32B32_FLOAT
+		entry.Reflection.InputElements.push_back(position);
+
+		ShaderInputElementDesc uv;
+		uv.SemanticName = "TEXCOORD";
+		uv.Format = 16;		// DXGI_FORMAT_R32G32_FLOAT
+		uv.InputSlot = 1;
+		entry.Reflection.InputElements.push_back(uv);
+
+		return entry;
+	}
+
+	bool Equal(const ShaderArchiveEntry& a, const ShaderArchiveEntry& b)
+	{
+		const ShaderReflectionData& ra = a.Reflection;
+		const ShaderReflectionData& rb = b.Reflection;
+
+		if (a.Name != b.Name || a.Bytecode != b.Bytecode ||
+			ra.ConstantBuffers.size() != rb.ConstantBuffers.size() ||
+			ra.ShaderResourceViews.size() != rb.ShaderResourceViews.size() ||
+			ra.Samplers.size() != rb.Samplers.size() ||
+			ra.InputElements.size() != rb.InputElements.size())
+			return false;
+
+		for (size_t i = 0; i < ra.ConstantBuffers.size(); i++)
+		{
+			const ShaderConstantBufferDesc& ca = ra.ConstantBuffers[i];
+			const ShaderConstantBufferDesc& cb = rb.ConstantBuffers[i];
+			if (ca.Name != cb.Name || ca.Type != cb.Type || ca.Size != cb.Size ||
+				ca.BindIndex != cb.BindIndex || ca.Variables.size() != cb.Variables.size())
+				return false;
+
+			for (size_t v = 0; v < ca.Variables.size(); v++)
+			{
+				if (ca.Variables[v].Name != cb.Variables[v].Name ||
+					ca.Variables[v].ByteOffset != cb.Variables[v].ByteOffset ||
+					ca.Variables[v].Size != cb.Variables[v].Size)
+					return false;
+			}
+		}
+
+		for (size_t i = 0; i < ra.ShaderResourceViews.size(); i++)
+		{
+			if (ra.ShaderResourceViews[i].Name != rb.ShaderResourceViews[i].Name ||
+				ra.ShaderResourceViews[i].BindIndex != rb.ShaderResourceViews[i].BindIndex)
+				return false;
+		}
+
+		for (size_t i = 0; i < ra.Samplers.size(); i++)
+		{
+			if (ra.Samplers[i].Name != rb.Samplers[i].Name ||
+				ra.Samplers[i].BindIndex != rb.Samplers[i].BindIndex)
+				return false;
+		}
+
+		for (size_t i = 0; i < ra.InputElements.size(); i++)
+		{
+			const ShaderInputElementDesc& ea = ra.InputElements[i];
+			const ShaderInputElementDesc& eb = rb.InputElements[i];
+			if (ea.SemanticName != eb.SemanticName || ea.SemanticIndex != eb.SemanticIndex ||
+				ea.Format != eb.Format || ea.InputSlot != eb.InputSlot || ea.PerInstance != eb.PerInstance)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool Parses(const std::vector<unsigned char>& data)
+	{
+		ShaderArchive archive;
+		bool parsed = archive.Parse(data.data(), data.size());
+
+		// A failed parse must never leave anything half loaded
+		Check(parsed || archive.GetEntryCount() == 0, "failed parse left entries behind");
+		return parsed;
+	}
+
+	void WriteUInt(std::vector<unsigned char>& data, size_t offset, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+			data[offset + i] = (unsigned char)(value >> (i * 8));
+	}
+}
+
+int main()
+{
+	// The last entry is as small as an entry can be
+	ShaderArchiveEntry full = MakeFullEntry();
+	ShaderArchiveEntry minimal;
+
+	ShaderArchive written;
+	written.AddEntry(full);
+	written.AddEntry(minimal);
+
+	// Replacing an entry by name mustn't add a second one
+	written.AddEntry(full);
+	Check(written.GetEntryCount() == 2, "AddEntry replaces entries with the same name");
+
+	std::vector<unsigned char> data = written.Serialize();
+
+	// Round trip in memory
+	ShaderArchive read;
+	Check(read.Parse(data.data(), data.size()), "archive parses");
+	Check(read.GetEntryCount() == 2, "archive has both entries");
+	if (read.GetEntryCount() == 2)
+	{
+		Check(Equal(read.GetEntries()[0], full), "full entry round trips");
+		Check(Equal(read.GetEntries()[1], minimal), "minimal entry round trips");
+	}
+	Check(read.Find("VertexShader") != 0, "Find() finds an entry");
+	Check(read.Find("PixelShader") == 0, "Find() misses a missing entry");
+
+	// Round trip through a file
+	std::string path = "ShaderArchiveTest.tmp";
+	Check(written.WriteToFile(path), "archive writes to a file");
+	ShaderArchive fromFile;
+	Check(fromFile.ReadFromFile(path), "archive reads from a file");
+	Check(fromFile.GetEntryCount() == 2 && Equal(fromFile.GetEntries()[0], full), "file round trips");
+	remove(path.c_str());
+
+	Check(!ShaderArchive().ReadFromFile(path), "missing file is rejected");
+
+	// An empty archive is valid, and so is one holding nothing
+	// but the smallest possible entry
+	std::vector<unsigned char> empty = ShaderArchive().Serialize();
+	Check(Parses(empty), "empty archive parses");
+
+	ShaderArchive minimalOnly;
+	minimalOnly.AddEntry(minimal);
+	Check(Parses(minimalOnly.Serialize()), "archive of one minimal entry parses");
+
+	// Every truncation of a valid archive is rejected
+	bool allTruncationsRejected = true;
+	for (size_t size = 0; size < data.size(); size++)
+	{
+		std::vector<unsigned char> truncated(data.begin(), data.begin() + size);
+		if (Parses(truncated))
+		{
+			printf("  truncated to %zu of %zu bytes still parses\n", size, data.size());
+			allTruncationsRejected = false;
+		}
+	}
+	Check(allTruncationsRejected, "truncated archives are rejected");
+
+	// Trailing bytes
+	std::vector<unsigned char> trailing = data;
+	trailing.push_back(0);
+	Check(!Parses(trailing), "trailing garbage is rejected");
+
+	// Wrong magic or version
+	std::vector<unsigned char> badMagic = data;
+	badMagic[0] ^= 0xFF;
+	Check(!Parses(badMagic), "bad magic is rejected");
+
+	std::vector<unsigned char> badVersion = data;
+	WriteUInt(badVersion, 4, ShaderArchive::Version + 1);
+	Check(!Parses(badVersion), "other versions are rejected");
+
+	// Counts and lengths far larger than the data
+	std::vector<unsigned char> hugeCount = data;
+	WriteUInt(hugeCount, 8, 0xFFFFFFFF);
+	Check(!Parses(hugeCount), "huge entry count is rejected");
+
+	std::vector<unsigned char> hugeName = data;
+	WriteUInt(hugeName, 12, 0xFFFFFFFF);
+	Check(!Parses(hugeName), "huge string length is rejected");
+
+	// Corrupting any single length or count must be caught or
+	// at least parse without reading out of bounds
+	for (size_t offset = 12; offset + 4 <= data.size(); offset++)
+	{
+		std::vector<unsigned char> corrupt = data;
+		WriteUInt(corrupt, offset, 0x7FFFFFFF);
+		Parses(corrupt);
+	}
+
+	return FinishChecks("shader archive");
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdio>
+
+// --------------------------------------------------------
+// The one bit of shared machinery the tests need: count the
+// checks that fail, say which, and turn the count into the
+// program's exit code.
+//
+//   Check(archive.Parse(...), "archive parses");
+//   ...
+//   return FinishChecks("shader archive");
+// --------------------------------------------------------
+inline int& FailedCheckCount()
+{
+	static int failures = 0;
+	return failures;
+}
+
+inline bool Check(bool passed, const char* what)
+{
+	if (!passed)
+	{
+		printf("FAILED: %s\n", what);
+		FailedCheckCount()++;
+	}
+
+	return passed;
+}
+
+// Non-zero if anything failed
+inline int FinishChecks(const char* testName)
+{
+	if (FailedCheckCount() > 0)
+	{
+		printf("%d %s check(s) failed\n", FailedCheckCount(), testName);
+		return 1;
+	}
+
+	printf("All %s checks passed\n", testName);
+	return 0;
+}
@@ -0,0 +1,773 @@
+#include "TextureCooker.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define COOKER_SSE2 1
+#include <emmintrin.h>
+#else
+#define COOKER_SSE2 0
+#endif
+
+BlockFormat TextureCooker::AlbedoFormat = BlockFormat::BC7;
+
+namespace
+{
+	// One block's pixels, one array per channel, so four pixels
+	// fit in each SSE register
+	struct BlockPixels
+	{
+		alignas(16) float c[4][16];
+	};
+
+	void LoadBlock(const unsigned char* pixels, BlockPixels& block)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			for (int ch = 0; ch < 4; ch++)
+				block.c[ch][i] = pixels[i * 4 + ch];
+		}
+	}
+
+	float Clamp255(float value)
+	{
+		return value < 0 ? 0 : (value > 255 ? 255 : value);
+	}
+
+	// --------------------------------------------------------
+	// Finds the closest palette entry (by squared distance over
+	// the first channelCount channels) for every pixel, and
+	// returns the total error
+	// --------------------------------------------------------
+	float FindClosest(const BlockPixels& block, const float (*palette)[4], int paletteSize, int channelCount, unsigned char* indices)
+	{
+#if COOKER_SSE2
+		float totalError = 0;
+		for (int group = 0; group < 4; group++)
+		{
+			__m128 px[4];
+			for (int ch = 0; ch < channelCount; ch++)
+				px[ch] = _mm_load_ps(&block.c[ch][group * 4]);
+
+			__m128 best = _mm_set1_ps(1e30f);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int k = 0; k < paletteSize; k++)
+			{
+				__m128 distance = _mm_setzero_ps();
+				for (int ch = 0; ch < channelCount; ch++)
+				{
+					__m128 diff = _mm_sub_ps(px[ch], _mm_set1_ps(palette[k][ch]));
+					distance = _mm_add_ps(distance, _mm_mul_ps(diff, diff));
+				}
+
+				// Take index k wherever it's strictly closer
+				__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+				bestIndex = _mm_or_si128(
+					_mm_and_si128(closer, _mm_set1_epi32(k)),
+					_mm_andnot_si128(closer, bestIndex));
+				best = _mm_min_ps(distance, best);
+			}
+
+			alignas(16) int groupIndices[4];
+			alignas(16) float groupErrors[4];
+			_mm_store_si128((__m128i*)groupIndices, bestIndex);
+			_mm_store_ps(groupErrors, best);
+			for (int i = 0; i < 4; i++)
+			{
+				indices[group * 4 + i] = (unsigned char)groupIndices[i];
+				totalError += groupErrors[i];
+			}
+		}
+
+		return totalError;
+#else
+		float totalError = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			float best = 1e30f;
+			for (int k = 0; k < paletteSize; k++)
+			{
+				float distance = 0;
+				for (int ch = 0; ch < channelCount; ch++)
+				{
+					float diff = block.c[ch][i] - palette[k][ch];
+					distance += diff * diff;
+				}
+
+				if (distance < best)
+				{
+					best = distance;
+					indices[i] = (unsigned char)k;
+				}
+			}
+
+			totalError += best;
+		}
+
+		return totalError;
+#endif
+	}
+
+	// --------------------------------------------------------
+	// Fits a line through the block's colors: returns both ends
+	// of the segment along the principal axis that covers them
+	// --------------------------------------------------------
+	void FitEndpoints(const BlockPixels& block, int channelCount, float start[4], float end[4])
+	{
+		float mean[4] = {};
+		float lo[4], hi[4];
+		for (int ch = 0; ch < channelCount; ch++)
+		{
+			lo[ch] = 255;
+			hi[ch] = 0;
+			for (int i = 0; i < 16; i++)
+			{
+				float v = block.c[ch][i];
+				mean[ch] += v;
+				lo[ch] = v < lo[ch] ? v : lo[ch];
+				hi[ch] = v > hi[ch] ? v : hi[ch];
+			}
+			mean[ch] /= 16.0f;
+		}
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			for (int a = 0; a < channelCount; a++)
+			{
+				for (int b = a; b < channelCount; b++)
+					covariance[a][b] += (block.c[a][i] - mean[a]) * (block.c[b][i] - mean[b]);
+			}
+		}
+		for (int a = 0; a < channelCount; a++)
+		{
+			for (int b = 0; b < a; b++)
+				covariance[a][b] = covariance[b][a];
+		}
+
+		// Power iteration, starting from the bounding box diagonal
+		float axis[4] = {};
+		for (int ch = 0; ch < channelCount; ch++)
+			axis[ch] = hi[ch] - lo[ch];
+
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float next[4] = {};
+			float length = 0;
+			for (int a = 0; a < channelCount; a++)
+			{
+				for (int b = 0; b < channelCount; b++)
+					next[a] += covariance[a][b] * axis[b];
+				length += next[a] * next[a];
+			}
+
+			// A flat block has no direction, so keep the diagonal
+			if (length < 1e-8f)
+				break;
+
+			length = sqrtf(length);
+			for (int ch = 0; ch < channelCount; ch++)
+				axis[ch] = next[ch] / length;
+		}
+
+		float axisLength = 0;
+		for (int ch = 0; ch < channelCount; ch++)
+			axisLength += axis[ch] * axis[ch];
+
+		if (axisLength < 1e-8f)
+		{
+			for (int ch = 0; ch < channelCount; ch++)
+				start[ch] = end[ch] = mean[ch];
+			return;
+		}
+
+		axisLength = sqrtf(axisLength);
+		float tMin = 1e30f, tMax = -1e30f;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = 0;
+			for (int ch = 0; ch < channelCount; ch++)
+				t += (block.c[ch][i] - mean[ch]) * axis[ch] / axisLength;
+
+			tMin = t < tMin ? t : tMin;
+			tMax = t > tMax ? t : tMax;
+		}
+
+		for (int ch = 0; ch < channelCount; ch++)
+		{
+			start[ch] = Clamp255(mean[ch] + axis[ch] / axisLength * tMin);
+			end[ch] = Clamp255(mean[ch] + axis[ch] / axisLength * tMax);
+		}
+	}
+
+	// --------------------------------------------------------
+	// Given which palette entry each pixel picked, solves for the
+	// endpoints that minimize the squared error (least squares
+	// on pixel = (1 - w) * start + w * end)
+	// --------------------------------------------------------
+	bool RefineEndpoints(const BlockPixels& block, const unsigned char* indices, const float* weights, int channelCount, float start[4], float end[4])
+	{
+		float aa = 0, ab = 0, bb = 0;
+		float ax[4] = {}, bx[4] = {};
+		for (int i = 0; i < 16; i++)
+		{
+			float b = weights[indices[i]];
+			float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int ch = 0; ch < channelCount; ch++)
+			{
+				ax[ch] += a * block.c[ch][i];
+				bx[ch] += b * block.c[ch][i];
+			}
+		}
+
+		float determinant = aa * bb - ab * ab;
+		if (fabsf(determinant) < 1e-6f)
+			return false;
+
+		for (int ch = 0; ch < channelCount; ch++)
+		{
+			start[ch] = Clamp255((bb * ax[ch] - ab * bx[ch]) / determinant);
+			end[ch] = Clamp255((aa * bx[ch] - ab * ax[ch]) / determinant);
+		}
+
+		return true;
+	}
+
+	// --------------------------------------------------------
+	// BC1
+	// --------------------------------------------------------
+	const float BC1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	uint16_t To565(const float color[4])
+	{
+		unsigned int r = (unsigned int)(color[0] * 31.0f / 255.0f + 0.5f);
+		unsigned int g = (unsigned int)(color[1] * 63.0f / 255.0f + 0.5f);
+		unsigned int b = (unsigned int)(color[2] * 31.0f / 255.0f + 0.5f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void From565(uint16_t color, float out[4])
+	{
+		unsigned int r = (color >> 11) & 31;
+		unsigned int g = (color >> 5) & 63;
+		unsigned int b = color & 31;
+		out[0] = (float)((r << 3) | (r >> 2));
+		out[1] = (float)((g << 2) | (g >> 4));
+		out[2] = (float)((b << 3) | (b >> 2));
+		out[3] = 255;
+	}
+
+	struct BC1Encoding
+	{
+		uint16_t color0;
+		uint16_t color1;
+		unsigned char indices[16];
+		float error;
+	};
+
+	BC1Encoding EncodeBC1(const BlockPixels& block, const float start[4], const float end[4])
+	{
+		BC1Encoding encoding;
+		encoding.color0 = To565(end);
+		encoding.color1 = To565(start);
+
+		// color0 > color1 selects the four color mode
+		if (encoding.color0 < encoding.color1)
+		{
+			uint16_t swap = encoding.color0;
+			encoding.color0 = encoding.color1;
+			encoding.color1 = swap;
+		}
+
+		float palette[4][4];
+		From565(encoding.color0, palette[0]);
+		From565(encoding.color1, palette[1]);
+
+		// Equal endpoints would mean three color mode, but every
+		// pixel just uses the one color anyway
+		int paletteSize = encoding.color0 == encoding.color1 ? 1 : 4;
+		for (int ch = 0; ch < 3; ch++)
+		{
+			palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3.0f;
+			palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3.0f;
+		}
+
+		encoding.error = FindClosest(block, palette, paletteSize, 3, encoding.indices);
+		return encoding;
+	}
+
+	// --------------------------------------------------------
+	// BC7 (mode 6 only: one RGBA line, 7-bit endpoints plus a
+	// p-bit each, and 4-bit indices)
+	// --------------------------------------------------------
+	const int BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct BC7Encoding
+	{
+		unsigned char endpoints[2][4];	// 7 bits each
+		unsigned char pBits[2];
+		unsigned char indices[16];
+		float error;
+	};
+
+	// Picks the 7-bit values and shared p-bit that land closest
+	// to the endpoint once expanded back to 8 bits
+	void QuantizeBC7Endpoint(const float value[4], unsigned char quantized[4], unsigned char& pBit)
+	{
+		float bestError = 1e30f;
+		for (int p = 0; p < 2; p++)
+		{
+			unsigned char q[4];
+			float error = 0;
+			for (int ch = 0; ch < 4; ch++)
+			{
+				int v = (int)floorf((value[ch] - p) / 2.0f + 0.5f);
+				v = v < 0 ? 0 : (v > 127 ? 127 : v);
+				q[ch] = (unsigned char)v;
+
+				float diff = (float)((v << 1) | p) - value[ch];
+				error += diff * diff;
+			}
+
+			if (error < bestError)
+			{
+				bestError = error;
+				pBit = (unsigned char)p;
+				memcpy(quantized, q, 4);
+			}
+		}
+	}
+
+	BC7Encoding EncodeBC7(const BlockPixels& block, const float start[4], const float end[4])
+	{
+		BC7Encoding encoding;
+		QuantizeBC7Endpoint(start, encoding.endpoints[0], encoding.pBits[0]);
+		QuantizeBC7Endpoint(end, encoding.endpoints[1], encoding.pBits[1]);
+
+		int e0[4], e1[4];
+		for (int ch = 0; ch < 4; ch++)
+		{
+			e0[ch] = (encoding.endpoints[0][ch] << 1) | encoding.pBits[0];
+			e1[ch] = (encoding.endpoints[1][ch] << 1) | encoding.pBits[1];
+		}
+
+		float palette[16][4];
+		for (int i = 0; i < 16; i++)
+		{
+			for (int ch = 0; ch < 4; ch++)
+				palette[i][ch] = (float)(((64 - BC7Weights[i]) * e0[ch] + BC7Weights[i] * e1[ch] + 32) >> 6);
+		}
+
+		encoding.error = FindClosest(block, palette, 16, 4, encoding.indices);
+		return encoding;
+	}
+
+	// Appends bits to a block, least significant first
+	class BitWriter
+	{
+	public:
+		BitWriter(unsigned char* block, int size) : block(block), pos(0) { memset(block, 0, size); }
+
+		void Write(unsigned int value, int count)
+		{
+			for (int i = 0; i < count; i++, pos++)
+			{
+				if ((value >> i) & 1)
+					block[pos >> 3] |= (unsigned char)(1 << (pos & 7));
+			}
+		}
+
+	private:
+		unsigned char* block;
+		int pos;
+	};
+
+	// --------------------------------------------------------
+	// DDS file layout (with the DX10 extension header, which is
+	// the only way to describe BC7)
+	// --------------------------------------------------------
+	const uint32_t DDSMagic = 0x20534444;			// "DDS "
+	const uint32_t DDSFourCCDX10 = 0x30315844;		// "DX10"
+	const uint32_t DDSHeaderFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // Caps, height, width, pixel format, mip count, linear size
+	const uint32_t DDSPixelFormatFourCC = 0x4;
+	const uint32_t DDSCaps = 0x1000 | 0x400000 | 0x8; // Texture, mipmap, complex
+	const uint32_t DDSDimensionTexture2D = 3;
+
+	void WriteUInt(std::vector<unsigned char>& out, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+			out.push_back((unsigned char)((value >> (i * 8)) & 0xFF));
+	}
+
+	uint32_t ReadUInt(const unsigned char* in)
+	{
+		return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+	}
+
+	size_t GetLevelBytes(const Image& level, BlockFormat format)
+	{
+		size_t blocksWide = (level.width + 3) / 4;
+		size_t blocksHigh = (level.height + 3) / 4;
+		return blocksWide * blocksHigh * TextureCooker::GetBlockBytes(format);
+	}
+}
+
+BlockFormat TextureCooker::FormatForSemantic(TextureSemantic semantic)
+{
+	switch (semantic)
+	{
+	case TextureSemantic::NormalMap: return BlockFormat::BC5;
+	case TextureSemantic::Roughness:
+	case TextureSemantic::Metalness: return BlockFormat::BC4;
+	case TextureSemantic::PackedORM: return BlockFormat::BC7; // BC1 would bleed between unrelated channels
+	default: return AlbedoFormat;
+	}
+}
+
+const char* TextureCooker::GetFormatName(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1: return "bc1";
+	case BlockFormat::BC4: return "bc4";
+	case BlockFormat::BC5: return "bc5";
+	default: return "bc7";
+	}
+}
+
+unsigned int TextureCooker::GetBlockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+// Values of the matching DXGI_FORMAT_BCn_UNORM
+unsigned int TextureCooker::GetDXGIFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1: return 71;
+	case BlockFormat::BC4: return 80;
+	case BlockFormat::BC5: return 83;
+	default: return 98;
+	}
+}
+
+// --------------------------------------------------------
+// Only understands files Compress() wrote, which is all the
+// cache holds.  Needs just the headers, so a streamer can
+// work out where a mip is before reading it.
+// --------------------------------------------------------
+bool TextureCooker::ReadLayout(const unsigned char* header, size_t size, CookedLayout& layout)
+{
+	if (size < DDSHeaderSize || ReadUInt(header) != DDSMagic || ReadUInt(header + 84) != DDSFourCCDX10)
+		return false;
+
+	const BlockFormat formats[] = { BlockFormat::BC1, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7 };
+	uint32_t dxgiFormat = ReadUInt(header + 128);
+	bool known = false;
+	for (BlockFormat format : formats)
+	{
+		if (GetDXGIFormat(format) == dxgiFormat)
+		{
+			layout.format = format;
+			known = true;
+		}
+	}
+
+	layout.height = ReadUInt(header + 12);
+	layout.width = ReadUInt(header + 16);
+	uint32_t mipCount = ReadUInt(header + 28);
+	if (!known || layout.width == 0 || layout.height == 0 || mipCount == 0 || mipCount > 16)
+		return false;
+
+	layout.mipOffsets.clear();
+	layout.mipBytes.clear();
+	size_t offset = DDSHeaderSize;
+	for (uint32_t mip = 0; mip < mipCount; mip++)
+	{
+		size_t blocksWide = ((layout.width >> mip) + 3) / 4;
+		size_t blocksHigh = ((layout.height >> mip) + 3) / 4;
+		blocksWide = blocksWide > 0 ? blocksWide : 1;
+		blocksHigh = blocksHigh > 0 ? blocksHigh : 1;
+
+		layout.mipOffsets.push_back(offset);
+		layout.mipBytes.push_back(blocksWide * blocksHigh * GetBlockBytes(layout.format));
+		offset += layout.mipBytes.back();
+	}
+
+	layout.fileBytes = offset;
+	return true;
+}
+
+std::string TextureCooker::GetCacheFileName(uint64_t contentHash, BlockFormat format)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	std::string name;
+	for (int shift = 60; shift >= 0; shift -= 4)
+		name += digits[(contentHash >> shift) & 15];
+
+	return name + "_" + GetFormatName(format) + "_v" + std::to_string(Version) + ".dds";
+}
+
+bool TextureCooker::CanCompress(const MipChain& mips)
+{
+	return !mips.levels.empty() &&
+		mips.levels[0].width % 4 == 0 &&
+		mips.levels[0].height % 4 == 0;
+}
+
+// --------------------------------------------------------
+// Writes the DDS headers, then compresses each row of blocks
+// of each mip straight into place as a separate job
+// --------------------------------------------------------
+std::vector<unsigned char> TextureCooker::Compress(JobSystem& jobs, const MipChain& mips, BlockFormat format)
+{
+	std::vector<unsigned char> dds;
+	if (!CanCompress(mips))
+		return dds;
+
+	const Image& top = mips.levels[0];
+
+	WriteUInt(dds, DDSMagic);
+	WriteUInt(dds, 124);
+	WriteUInt(dds, DDSHeaderFlags);
+	WriteUInt(dds, top.height);
+	WriteUInt(dds, top.width);
+	WriteUInt(dds, (uint32_t)GetLevelBytes(top, format));
+	WriteUInt(dds, 0);								// Depth
+	WriteUInt(dds, (uint32_t)mips.levels.size());
+	for (int i = 0; i < 11; i++)
+		WriteUInt(dds, 0);							// Reserved
+
+	WriteUInt(dds, 32);								// Pixel format size
+	WriteUInt(dds, DDSPixelFormatFourCC);
+	WriteUInt(dds, DDSFourCCDX10);
+	for (int i = 0; i < 5; i++)
+		WriteUInt(dds, 0);							// Bit count and masks
+
+	WriteUInt(dds, DDSCaps);
+	for (int i = 0; i < 4; i++)
+		WriteUInt(dds, 0);							// Caps 2-4, reserved
+
+	WriteUInt(dds, GetDXGIFormat(format));
+	WriteUInt(dds, DDSDimensionTexture2D);
+	WriteUInt(dds, 0);								// Misc flags
+	WriteUInt(dds, 1);								// Array size
+	WriteUInt(dds, 0);								// Alpha mode
+
+	// Lay out every level first, so the jobs can write in parallel
+	struct BlockRow
+	{
+		const Image* level;
+		unsigned int row;
+		size_t offset;
+	};
+
+	unsigned int blockBytes = GetBlockBytes(format);
+	std::vector<BlockRow> rows;
+	size_t offset = dds.size();
+	for (const Image& level : mips.levels)
+	{
+		unsigned int blocksWide = (level.width + 3) / 4;
+		unsigned int blocksHigh = (level.height + 3) / 4;
+		for (unsigned int row = 0; row < blocksHigh; row++)
+		{
+			rows.push_back({ &level, row, offset });
+			offset += (size_t)blocksWide * blockBytes;
+		}
+	}
+	dds.resize(offset);
+
+	jobs.ParallelFor(rows.size(), [&](size_t r)
+	{
+		const BlockRow& blockRow = rows[r];
+		const Image& level = *blockRow.level;
+		unsigned int blocksWide = (level.width + 3) / 4;
+		unsigned char* out = &dds[blockRow.offset];
+
+		for (unsigned int bx = 0; bx < blocksWide; bx++, out += blockBytes)
+		{
+			// Mips smaller than a block repeat their edge pixels
+			unsigned char pixels[64];
+			for (unsigned int y = 0; y < 4; y++)
+			{
+				unsigned int sy = blockRow.row * 4 + y;
+				sy = sy < level.height ? sy : level.height - 1;
+				for (unsigned int x = 0; x < 4; x++)
+				{
+					unsigned int sx = bx * 4 + x;
+					sx = sx < level.width ? sx : level.width - 1;
+					memcpy(&pixels[(y * 4 + x) * 4], &level.pixels[((size_t)sy * level.width + sx) * 4], 4);
+				}
+			}
+
+			switch (format)
+			{
+			case BlockFormat::BC1: CompressBlockBC1(pixels, out); break;
+			case BlockFormat::BC4: CompressBlockBC4(pixels, 0, out); break;
+			case BlockFormat::BC5: CompressBlockBC5(pixels, out); break;
+			case BlockFormat::BC7: CompressBlockBC7(pixels, out); break;
+			}
+		}
+	});
+
+	return dds;
+}
+
+void TextureCooker::CompressBlockBC1(const unsigned char* pixels, unsigned char* block)
+{
+	BlockPixels px;
+	LoadBlock(pixels, px);
+
+	float start[4], end[4];
+	FitEndpoints(px, 3, start, end);
+	BC1Encoding best = EncodeBC1(px, start, end);
+
+	// EncodeBC1() may have swapped the endpoints, so refine from
+	// the ones the indices actually refer to
+	float color0[4], color1[4];
+	From565(best.color0, color0);
+	From565(best.color1, color1);
+	if (best.color0 != best.color1 && RefineEndpoints(px, best.indices, BC1Weights, 3, color0, color1))
+	{
+		BC1Encoding refined = EncodeBC1(px, color1, color0);
+		if (refined.error < best.error)
+			best = refined;
+	}
+
+	block[0] = (unsigned char)(best.color0 & 0xFF);
+	block[1] = (unsigned char)(best.color0 >> 8);
+	block[2] = (unsigned char)(best.color1 & 0xFF);
+	block[3] = (unsigned char)(best.color1 >> 8);
+
+	uint32_t indices = 0;
+	for (int i = 0; i < 16; i++)
+		indices |= (uint32_t)best.indices[i] << (i * 2);
+
+	for (int i = 0; i < 4; i++)
+		block[4 + i] = (unsigned char)((indices >> (i * 8)) & 0xFF);
+}
+
+// --------------------------------------------------------
+// Endpoints are the block's min and max, using the eight value
+// mode.  Each pixel's position between them is rounded to one
+// of eight steps by counting how many step midpoints it passes,
+// which SSE2 does eight pixels at a time.
+// --------------------------------------------------------
+void TextureCooker::CompressBlockBC4(const unsigned char* pixels, int channel, unsigned char* block)
+{
+	unsigned char values[16];
+	unsigned char lo = 255, hi = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		values[i] = pixels[i * 4 + channel];
+		lo = values[i] < lo ? values[i] : lo;
+		hi = values[i] > hi ? values[i] : hi;
+	}
+
+	memset(block, 0, 8);
+	block[0] = hi;
+	block[1] = lo;
+	if (hi == lo)
+		return;
+
+	// Steps from lo (0) to hi (7)
+	int range = hi - lo;
+	unsigned char steps[16];
+#if COOKER_SSE2
+	__m128i all = _mm_loadu_si128((const __m128i*)values);
+	__m128i zero = _mm_setzero_si128();
+	__m128i halves[2] = { _mm_unpacklo_epi8(all, zero), _mm_unpackhi_epi8(all, zero) };
+	for (int h = 0; h < 2; h++)
+	{
+		// 14 * (value - lo), compared against (2k - 1) * range
+		__m128i scaled = _mm_mullo_epi16(_mm_sub_epi16(halves[h], _mm_set1_epi16(lo)), _mm_set1_epi16(14));
+		__m128i count = _mm_setzero_si128();
+		for (int k = 1; k < 8; k++)
+		{
+			__m128i threshold = _mm_set1_epi16((short)((2 * k - 1) * range - 1));
+			count = _mm_sub_epi16(count, _mm_cmpgt_epi16(scaled, threshold));
+		}
+		halves[h] = count;
+	}
+	_mm_storeu_si128((__m128i*)steps, _mm_packus_epi16(halves[0], halves[1]));
+#else
+	for (int i = 0; i < 16; i++)
+		steps[i] = (unsigned char)(((values[i] - lo) * 14 + range) / (2 * range));
+#endif
+
+	// Index 0 is hi, 1 is lo, and 2-7 step from hi down to lo
+	static const unsigned char stepToIndex[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; i++)
+		indices |= (uint64_t)stepToIndex[steps[i]] << (i * 3);
+
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = (unsigned char)((indices >> (i * 8)) & 0xFF);
+}
+
+void TextureCooker::CompressBlockBC5(const unsigned char* pixels, unsigned char* block)
+{
+	CompressBlockBC4(pixels, 0, block);
+	CompressBlockBC4(pixels, 1, block + 8);
+}
+
+void TextureCooker::CompressBlockBC7(const unsigned char* pixels, unsigned char* block)
+{
+	BlockPixels px;
+	LoadBlock(pixels, px);
+
+	float start[4], end[4];
+	FitEndpoints(px, 4, start, end);
+	BC7Encoding best = EncodeBC7(px, start, end);
+
+	float weights[16];
+	for (int i = 0; i < 16; i++)
+		weights[i] = BC7Weights[i] / 64.0f;
+
+	if (RefineEndpoints(px, best.indices, weights, 4, start, end))
+	{
+		BC7Encoding refined = EncodeBC7(px, start, end);
+		if (refined.error < best.error)
+			best = refined;
+	}
+
+	// The first pixel's index is stored without its top bit, so it
+	// has to be in the lower half; flip the line around if it isn't
+	if (best.indices[0] >= 8)
+	{
+		for (int ch = 0; ch < 4; ch++)
+		{
+			unsigned char swap = best.endpoints[0][ch];
+			best.endpoints[0][ch] = best.endpoints[1][ch];
+			best.endpoints[1][ch] = swap;
+		}
+
+		unsigned char swap = best.pBits[0];
+		best.pBits[0] = best.pBits[1];
+		best.pBits[1] = swap;
+
+		for (int i = 0; i < 16; i++)
+			best.indices[i] = (unsigned char)(15 - best.indices[i]);
+	}
+
+	BitWriter writer(block, 16);
+	writer.Write(1 << 6, 7);	// Mode 6
+	for (int ch = 0; ch < 4; ch++)
+	{
+		writer.Write(best.endpoints[0][ch], 7);
+		writer.Write(best.endpoints[1][ch], 7);
+	}
+	writer.Write(best.pBits[0], 1);
+	writer.Write(best.pBits[1], 1);
+
+	writer.Write(best.indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		writer.Write(best.indices[i], 4);
+}
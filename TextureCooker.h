@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+#include "JobSystem.h"
+
+// --------------------------------------------------------
+// What a texture is used for, which decides how it's stored
+// --------------------------------------------------------
+enum class TextureSemantic
+{
+	Generic,		// Left as uncompressed RGBA
+	Albedo,
+	NormalMap,
+	Roughness,
+	Metalness,
+	PackedORM		// Occlusion, roughness, metalness in red, green, blue
+};
+
+enum class BlockFormat
+{
+	BC1,	// RGB, half a byte per pixel
+	BC4,	// One channel, half a byte per pixel
+	BC5,	// Two channels, a byte per pixel
+	BC7		// RGBA, a byte per pixel
+};
+
+// --------------------------------------------------------
+// Where everything is in a cooked DDS file, largest mip first
+// --------------------------------------------------------
+struct CookedLayout
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	BlockFormat format = BlockFormat::BC7;
+	std::vector<size_t> mipOffsets;		// From the start of the file
+	std::vector<size_t> mipBytes;
+	size_t fileBytes = 0;
+};
+
+// --------------------------------------------------------
+// Block compresses decoded textures into DDS files that can
+// be cached on disk and uploaded as-is.
+//
+// Each 4x4 block's endpoints come from the principal axis of
+// its colors, refined once by least squares; the per-pixel
+// index search is done four pixels at a time with SSE2.  Block
+// rows of every mip are spread across the job system.
+//
+// Portable, like the rest of the import pipeline.
+// --------------------------------------------------------
+class TextureCooker
+{
+public:
+	// BC1 halves albedo memory again, at a visible cost in quality
+	static BlockFormat AlbedoFormat;
+
+	// Bump whenever cooked output changes, so old cache files are ignored
+	static const unsigned int Version = 2;
+
+	// Magic number, header and DX10 header
+	static const unsigned int DDSHeaderSize = 148;
+
+	static BlockFormat FormatForSemantic(TextureSemantic semantic);
+	static const char* GetFormatName(BlockFormat format);
+	static unsigned int GetBlockBytes(BlockFormat format);
+	static unsigned int GetDXGIFormat(BlockFormat format);
+
+	// e.g. "0123456789abcdef_bc7_v2.dds"
+	static std::string GetCacheFileName(uint64_t contentHash, BlockFormat format);
+
+	// D3D11 needs the top level to be a whole number of blocks
+	static bool CanCompress(const MipChain& mips);
+
+	// Compresses every mip and returns a complete DDS file
+	static std::vector<unsigned char> Compress(JobSystem& jobs, const MipChain& mips, BlockFormat format);
+
+	// Reads the layout of a file Compress() made from its first
+	// DDSHeaderSize bytes
+	static bool ReadLayout(const unsigned char* header, size_t size, CookedLayout& layout);
+
+	// One 4x4 block of RGBA pixels (64 bytes, row by row) in, one
+	// compressed block out
+	static void CompressBlockBC1(const unsigned char* pixels, unsigned char* block);
+	static void CompressBlockBC4(const unsigned char* pixels, int channel, unsigned char* block);
+	static void CompressBlockBC5(const unsigned char* pixels, unsigned char* block);
+	static void CompressBlockBC7(const unsigned char* pixels, unsigned char* block);
+};
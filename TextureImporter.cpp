@@ -0,0 +1,192 @@
+#include "TextureImporter.h"
+#include "MipGenerator.h"
+#include "PngDecoder.h"
+
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+TextureImporter::TextureImporter(JobSystem& jobs) : jobs(jobs) { }
+
+TextureImporter::~TextureImporter() { }
+
+void TextureImporter::ReadFiles(const std::vector<ImportedTexture*>& textures)
+{
+	jobs.ParallelFor(textures.size(), [&](size_t i)
+	{
+		ImportedTexture* texture = textures[i];
+		texture->loaded = ReadFile(texture->path, texture->fileData);
+		if (texture->loaded)
+			texture->contentHash = HashContents(texture->fileData.data(), texture->fileData.size());
+		else
+			texture->error = "Couldn't read file";
+	});
+}
+
+void TextureImporter::Decode(const std::vector<ImportedTexture*>& textures, bool generateMips)
+{
+	jobs.ParallelFor(textures.size(), [&](size_t i)
+	{
+		ImportedTexture* texture = textures[i];
+		if (!texture->loaded)
+			return;
+
+		texture->mips.levels.resize(1);
+		texture->decoded = DecodeImage(
+			texture->fileData.data(),
+			texture->fileData.size(),
+			texture->mips.levels[0],
+			&texture->error);
+
+		if (!texture->decoded)
+		{
+			texture->mips.levels.clear();
+			return;
+		}
+
+		// The compressed data isn't needed anymore
+		std::vector<unsigned char>().swap(texture->fileData);
+
+		// Filtered to suit how the texture will be sampled
+		if (generateMips)
+			MipGenerator::Generate(jobs, texture->mips, MipGenerator::SettingsForSemantic(texture->semantic));
+	});
+}
+
+void TextureImporter::Import(const std::vector<ImportedTexture*>& textures, bool generateMips)
+{
+	ReadFiles(textures);
+	Decode(textures, generateMips);
+}
+
+void TextureImporter::LoadCached(const std::vector<ImportedTexture*>& textures)
+{
+	jobs.ParallelFor(textures.size(), [&](size_t i)
+	{
+		ImportedTexture* texture = textures[i];
+		if (texture->semantic == TextureSemantic::Generic || texture->cachePath.empty())
+			return;
+
+		// Anything that isn't exactly the size its header says is a
+		// leftover from an interrupted write, so cook it again
+		CookedLayout layout;
+		if (!ReadFile(texture->cachePath, texture->cooked) ||
+			!TextureCooker::ReadLayout(texture->cooked.data(), texture->cooked.size(), layout) ||
+			layout.fileBytes != texture->cooked.size())
+			texture->cooked.clear();
+	});
+}
+
+void TextureImporter::Cook(const std::vector<ImportedTexture*>& textures)
+{
+	jobs.ParallelFor(textures.size(), [&](size_t i)
+	{
+		ImportedTexture* texture = textures[i];
+		if (texture->semantic == TextureSemantic::Generic || !texture->decoded || !texture->cooked.empty())
+			return;
+
+		// Odd sizes stay uncompressed
+		if (!TextureCooker::CanCompress(texture->mips))
+			return;
+
+		BlockFormat format = TextureCooker::FormatForSemantic(texture->semantic);
+		texture->cooked = TextureCooker::Compress(jobs, texture->mips, format);
+		texture->mips.levels.clear();
+
+		// Without a cache file there's nothing to stream mips from later
+		if (!texture->cachePath.empty())
+		{
+			std::ofstream file(texture->cachePath, std::ios::binary | std::ios::trunc);
+			file.write((const char*)texture->cooked.data(), texture->cooked.size());
+			if (!file)
+				texture->cachePath.clear();
+		}
+	});
+}
+
+bool TextureImporter::ReadFile(const std::string& path, std::vector<unsigned char>& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	data.assign(
+		(std::istreambuf_iterator<char>(file)),
+		std::istreambuf_iterator<char>());
+
+	return true;
+}
+
+bool TextureImporter::ReadFileRange(const std::string& path, size_t offset, size_t size, std::vector<unsigned char>& data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	data.resize(size);
+	file.seekg((std::streamoff)offset);
+	file.read((char*)data.data(), (std::streamsize)size);
+	return (size_t)file.gcount() == size;
+}
+
+// 64-bit FNV-1a
+uint64_t TextureImporter::HashContents(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+bool TextureImporter::DecodeImage(const unsigned char* data, size_t size, Image& image, std::string* error)
+{
+	if (PngDecoder::IsPng(data, size))
+		return PngDecoder::Decode(data, size, image, error);
+
+	if (error) *error = "Unsupported image format";
+	return false;
+}
+
+Image TextureImporter::PackChannels(const Image* sources[4], const unsigned char defaults[4])
+{
+	Image packed;
+	for (int ch = 0; ch < 4; ch++)
+	{
+		if (!sources[ch])
+			continue;
+
+		packed.width = sources[ch]->width > packed.width ? sources[ch]->width : packed.width;
+		packed.height = sources[ch]->height > packed.height ? sources[ch]->height : packed.height;
+	}
+
+	packed.pixels.resize((size_t)packed.width * packed.height * 4);
+
+	for (int ch = 0; ch < 4; ch++)
+	{
+		const Image* source = sources[ch];
+		for (unsigned int y = 0; y < packed.height; y++)
+		{
+			unsigned char* out = &packed.pixels[(size_t)y * packed.width * 4 + ch];
+			if (!source)
+			{
+				for (unsigned int x = 0; x < packed.width; x++)
+					out[x * 4] = defaults[ch];
+				continue;
+			}
+
+			unsigned int sy = (unsigned int)((unsigned long long)y * source->height / packed.height);
+			const unsigned char* row = &source->pixels[(size_t)sy * source->width * 4];
+			for (unsigned int x = 0; x < packed.width; x++)
+			{
+				unsigned int sx = (unsigned int)((unsigned long long)x * source->width / packed.width);
+				out[x * 4] = row[sx * 4];
+			}
+		}
+	}
+
+	return packed;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Image.h"
+#include "JobSystem.h"
+#include "TextureCooker.h"
+
+// --------------------------------------------------------
+// One texture file on its way from disk to GPU-ready mips
+// --------------------------------------------------------
+struct ImportedTexture
+{
+	std::string path;
+
+	// Set by the caller to have the texture block compressed
+	TextureSemantic semantic = TextureSemantic::Generic;
+	std::string cachePath;		// Where its DDS is cached, if anywhere
+
+	// Filled in by ReadFiles()
+	bool loaded = false;
+	std::vector<unsigned char> fileData;	// Released once decoded
+	uint64_t contentHash = 0;
+
+	// Filled in by Decode()
+	bool decoded = false;
+	MipChain mips;
+	std::string error;
+
+	// Filled in by LoadCached() or Cook(): a complete DDS file,
+	// used instead of the mips when present
+	std::vector<unsigned char> cooked;
+};
+
+// --------------------------------------------------------
+// Reads and decodes textures on the job system's threads.
+// Nothing here touches D3D, so the whole CPU side of texture
+// loading runs (and can be measured) on any platform.
+//
+// Work is split in phases so callers can skip decoding files
+// whose contents they've already got (based on the hash), or
+// whose cooked version is already cached.
+// --------------------------------------------------------
+class TextureImporter
+{
+public:
+	TextureImporter(JobSystem& jobs);
+	~TextureImporter();
+
+	// Reads every file and hashes its contents, in parallel
+	void ReadFiles(const std::vector<ImportedTexture*>& textures);
+
+	// Decodes every loaded file and optionally builds its full mip
+	// chain, in parallel.  Files we can't decode keep their data,
+	// so the caller can hand them to another decoder.
+	void Decode(const std::vector<ImportedTexture*>& textures, bool generateMips);
+
+	// Both phases at once
+	void Import(const std::vector<ImportedTexture*>& textures, bool generateMips);
+
+	// Reads any cooked DDS files that already exist, so those
+	// textures don't need decoding at all
+	void LoadCached(const std::vector<ImportedTexture*>& textures);
+
+	// Block compresses every decoded texture that has a semantic,
+	// and writes the result to its cache path
+	void Cook(const std::vector<ImportedTexture*>& textures);
+
+	static bool ReadFile(const std::string& path, std::vector<unsigned char>& data);
+	static bool ReadFileRange(const std::string& path, size_t offset, size_t size, std::vector<unsigned char>& data);
+	static uint64_t HashContents(const unsigned char* data, size_t size);
+
+	// Only PNG for now
+	static bool DecodeImage(const unsigned char* data, size_t size, Image& image, std::string* error);
+
+	// Builds one image from the red channels of up to four others.
+	// Missing sources (null) fill their channel with the default;
+	// sources smaller than the largest one are point sampled.
+	static Image PackChannels(const Image* sources[4], const unsigned char defaults[4]);
+
+private:
+	JobSystem& jobs;
+};
@@ -0,0 +1,887 @@
+#include "TextureManager.h"
+#include "TextureImporter.h"
+#include "MipGenerator.h"
+#include "PathHelpers.h"
+#include "DDSTextureLoader.h"
+#include "WICTextureLoader.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cwctype>
+#include <unordered_set>
+
+// Singleton requirement
+TextureManager* TextureManager::instance;
+
+// --------------- Basic usage -----------------
+//
+// Load textures through the manager instead of calling
+// CreateWICTextureFromFile() directly:
+//
+//   std::shared_ptr<ManagedTexture> tex = TextureManager::GetInstance().Load(path);
+//   if (tex) material->textureSRVs.insert({ "Albedo", tex->srv });
+//
+// When loading several at once, LoadBatch() decodes them all
+// in parallel instead of one after another.  Pass a semantic
+// (Albedo, NormalMap, etc.) to get a block compressed version.
+//
+// Keep the shared_ptr around for as long as the texture is
+// in use - that's what stops the manager from evicting it.
+// ---------------------------------------------
+
+TextureManager::~TextureManager()
+{
+
+}
+
+void TextureManager::Initialize(
+	Microsoft::WRL::ComPtr<ID3D11Device> device,
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+	size_t budgetBytes,
+	const std::wstring& cacheDirectory)
+{
+	this->device = device;
+	this->context = context;
+	this->budget = budgetBytes;
+	this->cacheDirectory = cacheDirectory;
+	this->jobs = std::make_unique<JobSystem>();
+
+	// Fine if it's already there
+	CreateDirectoryW(cacheDirectory.c_str(), 0);
+}
+
+// --------------------------------------------------------
+// Releases every texture, since the singleton itself is
+// never destroyed
+// --------------------------------------------------------
+void TextureManager::Shutdown()
+{
+	// Lets any reads in flight finish before their requests go away
+	jobs.reset();
+	streamRequests.clear();
+
+	textures.clear();
+	paths.clear();
+	bytesResident = 0;
+	context.Reset();
+	device.Reset();
+}
+
+std::shared_ptr<ManagedTexture> TextureManager::Load(const std::wstring& path, TextureSemantic semantic)
+{
+	return LoadBatch({ path }, { semantic })[0];
+}
+
+// --------------------------------------------------------
+// Requests for paths we've seen are answered right away.  The
+// rest are read and hashed in parallel, anything whose contents
+// we already have is shared, and only what's left is loaded from
+// the cooked cache or decoded and cooked (again in parallel)
+// before being uploaded.
+// --------------------------------------------------------
+std::vector<std::shared_ptr<ManagedTexture>> TextureManager::LoadBatch(
+	const std::vector<std::wstring>& files,
+	const std::vector<TextureSemantic>& semantics)
+{
+	std::vector<std::shared_ptr<ManagedTexture>> results(files.size());
+	std::vector<std::wstring> normalized(files.size());
+
+	// Files we have to read, and which of them each request wants
+	std::vector<ImportedTexture> imports;
+	std::vector<int> importForRequest(files.size(), -1);
+	std::unordered_map<std::wstring, size_t> importForPath;
+
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		requests++;
+
+		// Same file, used the same way, as before?
+		TextureSemantic semantic = i < semantics.size() ? semantics[i] : TextureSemantic::Generic;
+		normalized[i] = NormalizePath(files[i]) + L"#" + std::to_wstring((int)semantic);
+		auto knownPath = paths.find(normalized[i]);
+		if (knownPath != paths.end())
+		{
+			auto texture = textures.find(knownPath->second);
+			if (texture != textures.end())
+			{
+				results[i] = Hit(texture->second);
+				continue;
+			}
+		}
+
+		// Same file twice in this batch?
+		auto pending = importForPath.find(normalized[i]);
+		if (pending != importForPath.end())
+		{
+			importForRequest[i] = (int)pending->second;
+			continue;
+		}
+
+		importForPath.insert({ normalized[i], imports.size() });
+		importForRequest[i] = (int)imports.size();
+		imports.push_back(ImportedTexture());
+		imports.back().path = WideToNarrow(files[i]);
+		imports.back().semantic = semantic;
+	}
+
+	if (imports.empty())
+		return results;
+
+	std::vector<ImportedTexture*> toRead;
+	for (ImportedTexture& import : imports)
+		toRead.push_back(&import);
+
+	TextureImporter importer(*jobs);
+	importer.ReadFiles(toRead);
+
+	// Same image under a different name?  Only load contents
+	// we don't have yet, and only once per batch.
+	std::vector<ImportedTexture*> toLoad;
+	std::unordered_set<uint64_t> newKeys;
+	for (ImportedTexture* import : toRead)
+	{
+		uint64_t key = TextureKey(import->contentHash, import->semantic);
+		if (!import->loaded || textures.count(key) || newKeys.count(key))
+			continue;
+
+		if (import->semantic != TextureSemantic::Generic)
+			import->cachePath = GetCachePath(*import);
+
+		newKeys.insert(key);
+		toLoad.push_back(import);
+	}
+
+	// Anything already cooked skips decoding entirely
+	importer.LoadCached(toLoad);
+
+	std::vector<ImportedTexture*> toDecode;
+	for (ImportedTexture* import : toLoad)
+	{
+		if (import->cooked.empty())
+			toDecode.push_back(import);
+	}
+
+	importer.Decode(toDecode, true);
+	importer.Cook(toDecode);
+
+	// Genuinely new, so upload it
+	std::unordered_set<uint64_t> uploaded;
+	for (ImportedTexture* import : toLoad)
+	{
+		if (Upload(*import))
+			uploaded.insert(TextureKey(import->contentHash, import->semantic));
+	}
+
+	// The first request for each new texture is what loaded it;
+	// any other request for the same contents is a hit
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		if (importForRequest[i] < 0)
+			continue;
+
+		const ImportedTexture& import = imports[importForRequest[i]];
+		uint64_t key = TextureKey(import.contentHash, import.semantic);
+		auto texture = import.loaded ? textures.find(key) : textures.end();
+		if (texture == textures.end())
+			continue;
+
+		paths[normalized[i]] = key;
+
+		if (uploaded.erase(key))
+		{
+			texture->second->lastUsed = ++useCounter;
+			results[i] = texture->second;
+		}
+		else
+		{
+			results[i] = Hit(texture->second);
+		}
+	}
+
+	EnforceBudget();
+	return results;
+}
+
+// --------------------------------------------------------
+// Packs each set of maps into one texture.  Sources are read
+// and hashed in parallel, and each packed texture is identified
+// by all of its sources' contents together, so a cooked copy in
+// the cache means none of them need decoding.
+// --------------------------------------------------------
+std::vector<std::shared_ptr<ManagedTexture>> TextureManager::LoadPackedORM(const std::vector<ORMSources>& sources)
+{
+	std::vector<std::shared_ptr<ManagedTexture>> results(sources.size());
+
+	// Every distinct source file, read once
+	std::vector<ImportedTexture> files;
+	std::unordered_map<std::wstring, int> fileForPath;
+	auto addFile = [&](const std::wstring& path) -> int
+	{
+		if (path.empty())
+			return -1;
+
+		std::wstring normalized = NormalizePath(path);
+		auto existing = fileForPath.find(normalized);
+		if (existing != fileForPath.end())
+			return existing->second;
+
+		fileForPath.insert({ normalized, (int)files.size() });
+		files.push_back(ImportedTexture());
+		files.back().path = WideToNarrow(path);
+		return (int)files.size() - 1;
+	};
+
+	// Occlusion, roughness, metalness and normal map file for each request
+	std::vector<std::array<int, 4>> sourceFiles;
+	for (const ORMSources& source : sources)
+	{
+		requests++;
+		sourceFiles.push_back({ addFile(source.occlusion), addFile(source.roughness), addFile(source.metalness), addFile(source.normalMap) });
+	}
+
+	std::vector<ImportedTexture*> toRead;
+	for (ImportedTexture& file : files)
+		toRead.push_back(&file);
+
+	TextureImporter importer(*jobs);
+	importer.ReadFiles(toRead);
+
+	std::vector<ImportedTexture> packed(sources.size());
+	std::vector<ImportedTexture*> toLoad;
+	std::unordered_set<uint64_t> newKeys;
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		std::array<int, 4>& ids = sourceFiles[i];
+
+		// Occlusion and normals are optional, but roughness and metalness aren't
+		for (int source : { 0, 3 })
+		{
+			if (ids[source] >= 0 && !files[ids[source]].loaded)
+				ids[source] = -1;
+		}
+		if (ids[1] < 0 || ids[2] < 0 || !files[ids[1]].loaded || !files[ids[2]].loaded)
+			continue;
+
+		uint64_t hashes[4] = {};
+		for (int source = 0; source < 4; source++)
+			hashes[source] = ids[source] >= 0 ? files[ids[source]].contentHash : 0;
+
+		packed[i].loaded = true;
+		packed[i].semantic = TextureSemantic::PackedORM;
+		packed[i].contentHash = TextureImporter::HashContents((const unsigned char*)hashes, sizeof(hashes));
+
+		uint64_t key = TextureKey(packed[i].contentHash, packed[i].semantic);
+		if (textures.count(key) || newKeys.count(key))
+			continue;
+
+		packed[i].cachePath = GetCachePath(packed[i]);
+		newKeys.insert(key);
+		toLoad.push_back(&packed[i]);
+	}
+
+	// Anything already cooked skips decoding entirely
+	importer.LoadCached(toLoad);
+
+	std::vector<ImportedTexture*> toPack;
+	std::vector<ImportedTexture*> toDecode;
+	std::unordered_set<ImportedTexture*> decoding;
+	for (ImportedTexture* import : toLoad)
+	{
+		if (!import->cooked.empty())
+			continue;
+
+		toPack.push_back(import);
+		for (int id : sourceFiles[import - packed.data()])
+		{
+			if (id >= 0 && decoding.insert(&files[id]).second)
+				toDecode.push_back(&files[id]);
+		}
+	}
+
+	importer.Decode(toDecode, false);
+
+	jobs->ParallelFor(toPack.size(), [&](size_t p)
+	{
+		ImportedTexture* import = toPack[p];
+		const std::array<int, 4>& ids = sourceFiles[import - packed.data()];
+
+		const Image* channels[4] = {};
+		for (int ch = 0; ch < 3; ch++)
+		{
+			if (ids[ch] >= 0 && files[ids[ch]].decoded)
+				channels[ch] = &files[ids[ch]].mips.levels[0];
+		}
+
+		// Nothing to pack without both roughness and metalness
+		if (!channels[1] || !channels[2])
+			return;
+
+		// No occlusion map means nothing is occluded
+		const unsigned char defaults[4] = { 255, 0, 0, 255 };
+		import->mips.levels.push_back(TextureImporter::PackChannels(channels, defaults));
+		import->decoded = true;
+		MipGenerator::Generate(*jobs, import->mips, MipGenerator::SettingsForSemantic(import->semantic));
+
+		if (ids[3] >= 0 && files[ids[3]].decoded)
+			MipGenerator::ApplyToksvig(*jobs, import->mips, 1, files[ids[3]].mips.levels[0]);
+	});
+
+	importer.Cook(toPack);
+
+	std::unordered_set<uint64_t> uploaded;
+	for (ImportedTexture* import : toLoad)
+	{
+		if (Upload(*import))
+			uploaded.insert(TextureKey(import->contentHash, import->semantic));
+	}
+
+	// Same as LoadBatch(): the first request for a new texture
+	// loaded it, and any others are hits
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		if (!packed[i].loaded)
+			continue;
+
+		uint64_t key = TextureKey(packed[i].contentHash, packed[i].semantic);
+		auto texture = textures.find(key);
+		if (texture == textures.end())
+			continue;
+
+		if (uploaded.erase(key))
+		{
+			texture->second->lastUsed = ++useCounter;
+			results[i] = texture->second;
+		}
+		else
+		{
+			results[i] = Hit(texture->second);
+		}
+	}
+
+	EnforceBudget();
+	return results;
+}
+
+// --------------------------------------------------------
+// Creates a texture from whatever the importer produced: a
+// cooked DDS, decoded mips, or failing that the original file
+// through WIC.  Returns false if none of those worked.
+// --------------------------------------------------------
+bool TextureManager::Upload(ImportedTexture& import)
+{
+	std::shared_ptr<ManagedTexture> texture = std::make_shared<ManagedTexture>();
+
+	// Anything with a cache file to come back to starts out small
+	CookedLayout layout;
+	bool streamed =
+		!import.cooked.empty() &&
+		!import.cachePath.empty() &&
+		TextureCooker::ReadLayout(import.cooked.data(), import.cooked.size(), layout) &&
+		layout.fileBytes <= import.cooked.size();
+
+	HRESULT hr;
+	if (streamed)
+	{
+		unsigned int startMip = GetStartMip(layout);
+		hr = CreateStreamedTexture(layout, import.cooked.data() + layout.mipOffsets[startMip], startMip, texture->srv.GetAddressOf());
+
+		texture->streamPath = import.cachePath;
+		texture->layout = layout;
+		texture->residentMip = startMip;
+		texture->requestedMip = startMip;
+	}
+	else if (!import.cooked.empty())
+	{
+		hr = DirectX::CreateDDSTextureFromMemory(
+			device.Get(),
+			import.cooked.data(),
+			import.cooked.size(),
+			nullptr,
+			texture->srv.GetAddressOf());
+	}
+	else if (import.decoded)
+	{
+		hr = CreateTexture(device.Get(), &import.mips, 1, false, texture->srv.GetAddressOf());
+	}
+	else if (!import.fileData.empty())
+	{
+		// Formats we don't decode ourselves (like JPEG) go through WIC
+		hr = DirectX::CreateWICTextureFromMemory(
+			device.Get(),
+			context.Get(),
+			import.fileData.data(),
+			import.fileData.size(),
+			nullptr,
+			texture->srv.GetAddressOf());
+	}
+	else
+	{
+		return false;
+	}
+
+	if (hr != S_OK)
+		return false;
+
+	texture->contentHash = import.contentHash;
+	texture->semantic = import.semantic;
+	texture->bytes = CalculateTextureBytes(texture->srv.Get());
+
+	textures.insert({ TextureKey(texture->contentHash, texture->semantic), texture });
+	bytesResident += texture->bytes;
+	return true;
+}
+
+void TextureManager::RequestDetail(const std::shared_ptr<ManagedTexture>& texture, float uvPerPixel)
+{
+	if (!texture || texture->streamPath.empty())
+		return;
+
+	// Texels per pixel along the texture's longer side, as a mip
+	unsigned int size = max(texture->layout.width, texture->layout.height);
+	float texelsPerPixel = uvPerPixel * size;
+	unsigned int mipCount = (unsigned int)texture->layout.mipOffsets.size();
+	unsigned int mip = texelsPerPixel > 1 ? (unsigned int)std::log2(texelsPerPixel) : 0;
+	mip = min(mip, mipCount - 1);
+
+	if (texture->lastVisibleFrame != frame)
+	{
+		texture->lastVisibleFrame = frame;
+		texture->requestedMip = mip;
+	}
+	else
+	{
+		texture->requestedMip = min(texture->requestedMip, mip);
+	}
+
+	texture->requestedMip = min(texture->requestedMip, GetStartMip(texture->layout));
+}
+
+// --------------------------------------------------------
+// The budget is planned against what will be resident once the
+// requests in flight land, so drops already on their way count
+// as free memory
+// --------------------------------------------------------
+void TextureManager::UpdateStreaming()
+{
+	for (auto it = streamRequests.begin(); it != streamRequests.end();)
+	{
+		if ((*it)->done)
+		{
+			FinishStreaming(**it);
+			it = streamRequests.erase(it);
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	size_t planned = bytesResident;
+	for (auto& request : streamRequests)
+		planned = planned - request->texture->bytes + GetResidentBytes(request->texture->layout, request->targetMip);
+
+	// Visible textures missing detail, and any texture holding more
+	// than it currently needs
+	std::vector<std::shared_ptr<ManagedTexture>> upgrades;
+	std::vector<std::shared_ptr<ManagedTexture>> evictable;
+	for (auto& t : textures)
+	{
+		ManagedTexture* texture = t.second.get();
+		if (texture->streamPath.empty() || texture->streaming)
+			continue;
+
+		bool visible = texture->lastVisibleFrame == frame;
+		unsigned int needed = visible ? texture->requestedMip : GetStartMip(texture->layout);
+		if (needed < texture->residentMip)
+			upgrades.push_back(t.second);
+		else if (needed > texture->residentMip)
+			evictable.push_back(t.second);
+	}
+
+	// Biggest jumps in detail first, and the least recently seen go first
+	std::sort(upgrades.begin(), upgrades.end(), [](const std::shared_ptr<ManagedTexture>& a, const std::shared_ptr<ManagedTexture>& b)
+	{
+		return a->residentMip - a->requestedMip > b->residentMip - b->requestedMip;
+	});
+	std::sort(evictable.begin(), evictable.end(), [](const std::shared_ptr<ManagedTexture>& a, const std::shared_ptr<ManagedTexture>& b)
+	{
+		return a->lastVisibleFrame < b->lastVisibleFrame;
+	});
+
+	size_t nextVictim = 0;
+	for (auto& texture : upgrades)
+	{
+		size_t wantedBytes = GetResidentBytes(texture->layout, texture->requestedMip);
+		while (planned - texture->bytes + wantedBytes > budget &&
+			nextVictim < evictable.size() &&
+			streamRequests.size() + 1 < MaxStreamingRequests)
+		{
+			std::shared_ptr<ManagedTexture>& victim = evictable[nextVictim++];
+			unsigned int keep = victim->lastVisibleFrame == frame ? victim->requestedMip : GetStartMip(victim->layout);
+			planned = planned - victim->bytes + GetResidentBytes(victim->layout, keep);
+			StartStreaming(victim, keep);
+		}
+
+		if (streamRequests.size() >= MaxStreamingRequests)
+			break;
+
+		// Nothing left to drop, so this one waits
+		if (planned - texture->bytes + wantedBytes > budget)
+			continue;
+
+		planned = planned - texture->bytes + wantedBytes;
+		StartStreaming(texture, texture->requestedMip);
+	}
+
+	frame++;
+}
+
+void TextureManager::StartStreaming(const std::shared_ptr<ManagedTexture>& texture, unsigned int targetMip)
+{
+	std::unique_ptr<StreamRequest> request = std::make_unique<StreamRequest>();
+	request->texture = texture;
+	request->targetMip = targetMip;
+	texture->streaming = true;
+
+	// Mips are stored largest first, so everything from the target
+	// down is one read to the end of the file.  The texture's path
+	// and layout don't change while it's streaming.
+	StreamRequest* pending = request.get();
+	streamRequests.push_back(std::move(request));
+	jobs->Submit([pending]()
+	{
+		const CookedLayout& layout = pending->texture->layout;
+		size_t offset = layout.mipOffsets[pending->targetMip];
+		pending->succeeded = TextureImporter::ReadFileRange(pending->texture->streamPath, offset, layout.fileBytes - offset, pending->data);
+		pending->done = true;
+	});
+}
+
+void TextureManager::FinishStreaming(StreamRequest& request)
+{
+	ManagedTexture* texture = request.texture.get();
+	texture->streaming = false;
+
+	// The cache file went away, so keep what we've got from now on
+	if (!request.succeeded)
+	{
+		texture->streamPath.clear();
+		return;
+	}
+
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	if (CreateStreamedTexture(texture->layout, request.data.data(), request.targetMip, srv.GetAddressOf()) != S_OK)
+		return;
+
+	if (request.targetMip < texture->residentMip)
+		mipsStreamedIn += texture->residentMip - request.targetMip;
+	else
+		mipsEvicted += request.targetMip - texture->residentMip;
+
+	size_t bytes = CalculateTextureBytes(srv.Get());
+	bytesResident = bytesResident - texture->bytes + bytes;
+
+	texture->srv = srv;
+	texture->bytes = bytes;
+	texture->residentMip = request.targetMip;
+	texture->version++;
+	residencyVersion++;
+}
+
+// --------------------------------------------------------
+// Creates an immutable texture from the mips of a cooked file,
+// starting at firstMip.  mipData points at that mip, with the
+// smaller ones following it as they do in the file.
+// --------------------------------------------------------
+HRESULT TextureManager::CreateStreamedTexture(const CookedLayout& layout, const unsigned char* mipData, unsigned int firstMip, ID3D11ShaderResourceView** srv)
+{
+	unsigned int mipCount = (unsigned int)layout.mipOffsets.size();
+	if (firstMip >= mipCount)
+		return E_INVALIDARG;
+
+	unsigned int blockBytes = TextureCooker::GetBlockBytes(layout.format);
+	std::vector<D3D11_SUBRESOURCE_DATA> initialData;
+	for (unsigned int mip = firstMip; mip < mipCount; mip++)
+	{
+		D3D11_SUBRESOURCE_DATA data = {};
+		data.pSysMem = mipData + (layout.mipOffsets[mip] - layout.mipOffsets[firstMip]);
+		data.SysMemPitch = max(1u, ((layout.width >> mip) + 3) / 4) * blockBytes;
+		initialData.push_back(data);
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = max(1u, layout.width >> firstMip);
+	desc.Height = max(1u, layout.height >> firstMip);
+	desc.MipLevels = mipCount - firstMip;
+	desc.ArraySize = 1;
+	desc.Format = (DXGI_FORMAT)TextureCooker::GetDXGIFormat(layout.format);
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	HRESULT hr = device->CreateTexture2D(&desc, initialData.data(), texture.GetAddressOf());
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = desc.Format;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = desc.MipLevels;
+	return device->CreateShaderResourceView(texture.Get(), &srvDesc, srv);
+}
+
+// --------------------------------------------------------
+// The first mip no bigger than StreamingStartSize.  Block
+// compressed textures also need their top level to be whole
+// blocks, which stops us short on odd sized textures.
+// --------------------------------------------------------
+unsigned int TextureManager::GetStartMip(const CookedLayout& layout)
+{
+	unsigned int mip = 0;
+	while (mip + 1 < layout.mipOffsets.size() &&
+		max(layout.width >> mip, layout.height >> mip) > StreamingStartSize &&
+		((layout.width >> (mip + 1)) % 4) == 0 &&
+		((layout.height >> (mip + 1)) % 4) == 0)
+	{
+		mip++;
+	}
+
+	return mip;
+}
+
+size_t TextureManager::GetResidentBytes(const CookedLayout& layout, unsigned int firstMip)
+{
+	size_t bytes = 0;
+	for (size_t mip = firstMip; mip < layout.mipBytes.size(); mip++)
+		bytes += layout.mipBytes[mip];
+	return bytes;
+}
+
+size_t TextureManager::GetStreamedTextureCount()
+{
+	size_t count = 0;
+	for (auto& t : textures)
+	{
+		if (!t.second->streamPath.empty())
+			count++;
+	}
+	return count;
+}
+
+size_t TextureManager::GetStreamedBytesIfFullyResident()
+{
+	size_t bytes = 0;
+	for (auto& t : textures)
+	{
+		if (!t.second->streamPath.empty())
+			bytes += GetResidentBytes(t.second->layout, 0);
+	}
+	return bytes;
+}
+
+std::string TextureManager::GetCachePath(const ImportedTexture& import)
+{
+	BlockFormat format = TextureCooker::FormatForSemantic(import.semantic);
+	return WideToNarrow(cacheDirectory) + TextureCooker::GetCacheFileName(import.contentHash, format);
+}
+
+std::shared_ptr<ManagedTexture> TextureManager::Hit(std::shared_ptr<ManagedTexture> texture)
+{
+	hits++;
+	bytesSaved += texture->bytes;
+	texture->lastUsed = ++useCounter;
+	return texture;
+}
+
+void TextureManager::EnforceBudget()
+{
+	while (bytesResident > budget)
+	{
+		// Oldest texture nobody else is holding on to
+		auto victim = textures.end();
+		for (auto it = textures.begin(); it != textures.end(); it++)
+		{
+			if (it->second.use_count() > 1)
+				continue;
+
+			if (victim == textures.end() || it->second->lastUsed < victim->second->lastUsed)
+				victim = it;
+		}
+
+		// Everything left is in use, so we're stuck over budget
+		if (victim == textures.end())
+			return;
+
+		uint64_t hash = victim->first;
+		bytesResident -= victim->second->bytes;
+		textures.erase(victim);
+
+		for (auto it = paths.begin(); it != paths.end();)
+		{
+			if (it->second == hash) it = paths.erase(it);
+			else it++;
+		}
+	}
+}
+
+// --------------------------------------------------------
+// Makes different spellings of the same file compare equal:
+// absolute, with "." and ".." resolved, one kind of slash,
+// and lower case (Windows paths aren't case sensitive)
+// --------------------------------------------------------
+std::wstring TextureManager::NormalizePath(const std::wstring& path)
+{
+	wchar_t fullPath[MAX_PATH] = {};
+	std::wstring result = GetFullPathNameW(path.c_str(), MAX_PATH, fullPath, 0) ? fullPath : path;
+
+	for (wchar_t& c : result)
+	{
+		if (c == L'\\') c = L'/';
+		else c = towlower(c);
+	}
+
+	return result;
+}
+
+uint64_t TextureManager::TextureKey(uint64_t contentHash, TextureSemantic semantic)
+{
+	return contentHash ^ ((uint64_t)semantic * 0x9E3779B97F4A7C15ull);
+}
+
+// --------------------------------------------------------
+// Slices are laid out one after another, each with all of its
+// mips, which is the order D3D11 expects the initial data in
+// --------------------------------------------------------
+HRESULT TextureManager::CreateTexture(
+	ID3D11Device* device,
+	const MipChain* slices,
+	unsigned int sliceCount,
+	bool cube,
+	ID3D11ShaderResourceView** srv)
+{
+	if (sliceCount == 0 || slices[0].levels.empty() || (cube && sliceCount != 6))
+		return E_INVALIDARG;
+
+	const MipChain& first = slices[0];
+	unsigned int mipCount = (unsigned int)first.levels.size();
+
+	std::vector<D3D11_SUBRESOURCE_DATA> initialData;
+	for (unsigned int slice = 0; slice < sliceCount; slice++)
+	{
+		if (slices[slice].levels.size() != mipCount)
+			return E_INVALIDARG;
+
+		for (unsigned int mip = 0; mip < mipCount; mip++)
+		{
+			const Image& image = slices[slice].levels[mip];
+			if (image.width != first.levels[mip].width || image.height != first.levels[mip].height)
+				return E_INVALIDARG;
+
+			D3D11_SUBRESOURCE_DATA data = {};
+			data.pSysMem = image.pixels.data();
+			data.SysMemPitch = image.width * 4;
+			initialData.push_back(data);
+		}
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = first.levels[0].width;
+	desc.Height = first.levels[0].height;
+	desc.MipLevels = mipCount;
+	desc.ArraySize = sliceCount;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM; // Same as WIC gives us for PNGs
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	HRESULT hr = device->CreateTexture2D(&desc, initialData.data(), texture.GetAddressOf());
+	if (FAILED(hr))
+		return hr;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = desc.Format;
+	if (cube)
+	{
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+		srvDesc.TextureCube.MipLevels = mipCount;
+	}
+	else if (sliceCount > 1)
+	{
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MipLevels = mipCount;
+		srvDesc.Texture2DArray.ArraySize = sliceCount;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = mipCount;
+	}
+
+	return device->CreateShaderResourceView(texture.Get(), &srvDesc, srv);
+}
+
+// --------------------------------------------------------
+// Works out how much GPU memory a texture uses, counting
+// every mip level and array slice
+// --------------------------------------------------------
+size_t TextureManager::CalculateTextureBytes(ID3D11ShaderResourceView* srv)
+{
+	Microsoft::WRL::ComPtr<ID3D11Resource> resource;
+	srv->GetResource(resource.GetAddressOf());
+
+	Microsoft::WRL::ComPtr<ID3D11Texture2D> texture;
+	if (resource.As(&texture) != S_OK)
+		return 0;
+
+	D3D11_TEXTURE2D_DESC desc;
+	texture->GetDesc(&desc);
+
+	// Block compressed formats store each 4x4 block in 8 or 16 bytes
+	size_t bytesPerBlock = 0;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC4_UNORM:
+		bytesPerBlock = 8; break;
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC7_UNORM:
+		bytesPerBlock = 16; break;
+	}
+
+	size_t bytesPerPixel;
+	switch (desc.Format)
+	{
+	case DXGI_FORMAT_R8_UNORM:
+		bytesPerPixel = 1; break;
+	case DXGI_FORMAT_R16_UNORM:
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_R8G8_UNORM:
+	case DXGI_FORMAT_B5G6R5_UNORM:
+	case DXGI_FORMAT_B5G5R5A1_UNORM:
+		bytesPerPixel = 2; break;
+	case DXGI_FORMAT_R16G16B16A16_UNORM:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+		bytesPerPixel = 8; break;
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		bytesPerPixel = 16; break;
+	default:
+		bytesPerPixel = 4; break; // The 8-bit RGBA/BGRA formats WIC usually gives us
+	}
+
+	size_t bytes = 0;
+	for (unsigned int mip = 0; mip < desc.MipLevels; mip++)
+	{
+		size_t width = max(desc.Width >> mip, 1u);
+		size_t height = max(desc.Height >> mip, 1u);
+		if (bytesPerBlock > 0)
+			bytes += ((width + 3) / 4) * ((height + 3) / 4) * bytesPerBlock;
+		else
+			bytes += width * height * bytesPerPixel;
+	}
+
+	return bytes * desc.ArraySize;
+}
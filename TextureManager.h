@@ -0,0 +1,226 @@
+#pragma once
+
+#include <d3d11.h>
+#include <wrl/client.h> // Used for ComPtr - a smart pointer for COM objects
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Image.h"
+#include "JobSystem.h"
+#include "TextureCooker.h"
+
+// --------------------------------------------------------
+// A texture owned by the TextureManager.  Whoever holds a
+// shared_ptr to one keeps it resident; once only the manager
+// holds it, it may be evicted to stay under the memory budget.
+// --------------------------------------------------------
+struct ManagedTexture
+{
+	Microsoft::WRL::ComPtr<ID3D11ShaderResourceView> srv;
+	uint64_t contentHash = 0;
+	TextureSemantic semantic = TextureSemantic::Generic;
+	size_t bytes = 0;			// GPU memory, including mips
+	unsigned long long lastUsed = 0;
+
+	// Streaming, for textures cooked to the cache.  Only mips from
+	// residentMip down are on the GPU, and srv is replaced (bumping
+	// version) whenever that changes.
+	std::string streamPath;		// Empty if every mip stays resident
+	CookedLayout layout;
+	unsigned int residentMip = 0;
+	unsigned int requestedMip = 0;			// Most detailed mip asked for on lastVisibleFrame
+	unsigned long long lastVisibleFrame = 0;
+	bool streaming = false;					// A residency change is in flight
+	unsigned int version = 0;
+};
+
+// --------------------------------------------------------
+// Grayscale maps to pack into the channels of one texture:
+// occlusion, roughness and metalness in red, green and blue.
+// Occlusion is optional, and left white without a map.  So is
+// the material's normal map, which only widens roughness in the
+// smaller mips.
+// --------------------------------------------------------
+struct ORMSources
+{
+	std::wstring occlusion;
+	std::wstring roughness;
+	std::wstring metalness;
+	std::wstring normalMap;
+};
+
+struct ImportedTexture;
+
+// --------------------------------------------------------
+// Loads each texture only once.  Requests are matched first by
+// normalized path, then by a hash of the file's contents, so the
+// same image under two names is also shared.
+//
+// Files are read, decoded and mipmapped on the job system's
+// threads; only the final upload happens on the calling thread.
+//
+// Textures loaded with a semantic are block compressed to suit
+// it, and the result is cached as a DDS file keyed by the source
+// file's contents, so later runs skip decoding them entirely.
+//
+// Those cached textures are also streamed: they start with only
+// their smallest mips resident, and larger ones are read from the
+// cache file in the background once something on screen needs
+// them.  When that would go over budget, mips of the textures
+// seen least recently are dropped to make room.
+// --------------------------------------------------------
+class TextureManager
+{
+#pragma region Singleton
+public:
+	// Gets the one and only instance of this class
+	static TextureManager& GetInstance()
+	{
+		if (!instance)
+		{
+			instance = new TextureManager();
+		}
+
+		return *instance;
+	}
+
+	// Remove these functions (C++ 11 version)
+	TextureManager(TextureManager const&) = delete;
+	void operator=(TextureManager const&) = delete;
+
+private:
+	static TextureManager* instance;
+	TextureManager() {};
+#pragma endregion
+
+public:
+	~TextureManager();
+
+	void Initialize(
+		Microsoft::WRL::ComPtr<ID3D11Device> device,
+		Microsoft::WRL::ComPtr<ID3D11DeviceContext> context,
+		size_t budgetBytes,
+		const std::wstring& cacheDirectory);
+	void Shutdown();
+
+	// Returns null if the file is missing or can't be decoded
+	std::shared_ptr<ManagedTexture> Load(const std::wstring& path, TextureSemantic semantic = TextureSemantic::Generic);
+
+	// Same as Load() for each path, but every new file is decoded
+	// in parallel.  Results are in the same order as the paths.
+	// Semantics match up with paths, or are all Generic if empty.
+	std::vector<std::shared_ptr<ManagedTexture>> LoadBatch(
+		const std::vector<std::wstring>& paths,
+		const std::vector<TextureSemantic>& semantics = std::vector<TextureSemantic>());
+
+	// Packs each set of maps into one block compressed texture, so
+	// shaders fetch all three at once.  Results are null where
+	// roughness or metalness is missing.
+	std::vector<std::shared_ptr<ManagedTexture>> LoadPackedORM(const std::vector<ORMSources>& sources);
+
+	// Creates an immutable RGBA texture from decoded images: one per
+	// array slice (six for a cube), all the same size and mip count
+	static HRESULT CreateTexture(
+		ID3D11Device* device,
+		const MipChain* slices,
+		unsigned int sliceCount,
+		bool cube,
+		ID3D11ShaderResourceView** srv);
+
+	JobSystem& GetJobSystem() { return *jobs; }
+
+	// Streamed textures start with their mips of this size and smaller
+	static const unsigned int StreamingStartSize = 64;
+
+	// Residency changes in flight at once, which also bounds how
+	// much gets uploaded in any one frame
+	static const unsigned int MaxStreamingRequests = 4;
+
+	// Asks for enough mips to draw the texture where one screen pixel
+	// covers uvPerPixel of its texture coordinates.  Call for every
+	// visible texture each frame, before UpdateStreaming().
+	void RequestDetail(const std::shared_ptr<ManagedTexture>& texture, float uvPerPixel);
+
+	// Swaps in finished loads, then starts loading whatever this
+	// frame's requests need, within the budget
+	void UpdateStreaming();
+
+	// Changes whenever any texture's srv is replaced
+	unsigned int GetResidencyVersion() { return residencyVersion; }
+
+	// Drops unreferenced textures, least recently used first,
+	// until we're back under the budget
+	void EnforceBudget();
+
+	// Stats
+	unsigned int GetRequestCount() { return requests; }
+	unsigned int GetHitCount() { return hits; }
+	float GetHitRate() { return requests > 0 ? (float)hits / requests : 0.0f; }
+	size_t GetTextureCount() { return textures.size(); }
+	size_t GetBytesResident() { return bytesResident; }
+	size_t GetBytesSaved() { return bytesSaved; }
+	size_t GetBudget() { return budget; }
+	size_t GetStreamedTextureCount();
+	size_t GetStreamedBytesIfFullyResident();
+	size_t GetStreamingRequestCount() { return streamRequests.size(); }
+	unsigned int GetMipsStreamedIn() { return mipsStreamedIn; }
+	unsigned int GetMipsEvicted() { return mipsEvicted; }
+	const std::unordered_map<uint64_t, std::shared_ptr<ManagedTexture>>& GetTextures() { return textures; }
+
+private:
+	Microsoft::WRL::ComPtr<ID3D11Device> device;
+	Microsoft::WRL::ComPtr<ID3D11DeviceContext> context;
+	std::unique_ptr<JobSystem> jobs;
+	std::wstring cacheDirectory;
+
+	// The manager's own reference to each texture, by TextureKey()
+	std::unordered_map<uint64_t, std::shared_ptr<ManagedTexture>> textures;
+	// Every path (and semantic) we've loaded, and the key it turned out to have
+	std::unordered_map<std::wstring, uint64_t> paths;
+
+	size_t budget = 0;
+	size_t bytesResident = 0;
+	size_t bytesSaved = 0;
+	unsigned int requests = 0;
+	unsigned int hits = 0;
+	unsigned long long useCounter = 0;
+
+	// Mips being read from a cache file on the job system
+	struct StreamRequest
+	{
+		std::shared_ptr<ManagedTexture> texture;
+		unsigned int targetMip = 0;
+		std::vector<unsigned char> data;	// Every mip from targetMip down
+		bool succeeded = false;
+		std::atomic<bool> done{ false };
+	};
+
+	std::vector<std::unique_ptr<StreamRequest>> streamRequests;
+	unsigned long long frame = 1;
+	unsigned int residencyVersion = 0;
+	unsigned int mipsStreamedIn = 0;
+	unsigned int mipsEvicted = 0;
+
+	void StartStreaming(const std::shared_ptr<ManagedTexture>& texture, unsigned int targetMip);
+	void FinishStreaming(StreamRequest& request);
+	HRESULT CreateStreamedTexture(const CookedLayout& layout, const unsigned char* mipData, unsigned int firstMip, ID3D11ShaderResourceView** srv);
+
+	// Where streamed textures start out, and the most they can drop to
+	static unsigned int GetStartMip(const CookedLayout& layout);
+	static size_t GetResidentBytes(const CookedLayout& layout, unsigned int firstMip);
+
+	std::shared_ptr<ManagedTexture> Hit(std::shared_ptr<ManagedTexture> texture);
+	bool Upload(ImportedTexture& import);
+	std::string GetCachePath(const ImportedTexture& import);
+
+	static std::wstring NormalizePath(const std::wstring& path);
+
+	// The same contents used two different ways are two textures
+	static uint64_t TextureKey(uint64_t contentHash, TextureSemantic semantic);
+	static size_t CalculateTextureBytes(ID3D11ShaderResourceView* srv);
+};
@@ -0,0 +1,87 @@
+#include <Windows.h>
+#include <d3dcompiler.h>
+#include <wrl/client.h>
+
+#include <cstdio>
+#include <string>
+
+#include "PathHelpers.h"
+#include "ShaderDataGenerator.h"
+
+// --------------------------------------------------------
+// Regenerates ShaderData.h from the compiled shaders.  Run by
+// the game's build after the shaders are compiled and before
+// any C++ is, so the game always builds against structs that
+// match the shaders it ships with:
+//
+//   ShaderDataTool <compiled shader directory> <ShaderData.h>
+//
+// Fails (returns non-zero) if a shader can't be reflected or
+// a shared buffer differs between shaders.  A regenerated
+// header is compiled right away; the static_asserts in it
+// catch any C++ that no longer matches the new buffers.
+// --------------------------------------------------------
+int wmain(int argc, wchar_t* argv[])
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "Usage: ShaderDataTool <compiled shader directory> <ShaderData.h>\n");
+		return 1;
+	}
+
+	std::wstring shaderDirectory = argv[1];
+	std::wstring headerPath = argv[2];
+	if (shaderDirectory.back() != L'\\' && shaderDirectory.back() != L'/')
+		shaderDirectory += L'\\';
+
+	ShaderDataGenerator shaderData;
+	shaderData.AddInclude("Lights.h");
+	shaderData.AddSharedBuffer("LightBuffer");
+	shaderData.AddSharedBuffer("FrameBuffer");
+	bool succeeded = true;
+
+	WIN32_FIND_DATAW findData = {};
+	HANDLE find = FindFirstFileW((shaderDirectory + L"*.cso").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "error: no compiled shaders in %s\n", WideToNarrow(shaderDirectory).c_str());
+		return 1;
+	}
+
+	do
+	{
+		std::wstring fileName = findData.cFileName;
+		std::string shaderName = WideToNarrow(fileName.substr(0, fileName.size() - 4)); // Strip ".cso"
+
+		Microsoft::WRL::ComPtr<ID3DBlob> blob;
+		if (D3DReadFileToBlob((shaderDirectory + fileName).c_str(), blob.GetAddressOf()) != S_OK)
+		{
+			fprintf(stderr, "%s.cso: error: couldn't be read\n", shaderName.c_str());
+			succeeded = false;
+			continue;
+		}
+
+		if (!shaderData.AddShader(shaderName, blob))
+		{
+			fprintf(stderr, "%s.cso: error: couldn't be reflected, or a shared constant buffer doesn't match other shaders\n", shaderName.c_str());
+			succeeded = false;
+		}
+	} while (FindNextFileW(find, &findData));
+
+	FindClose(find);
+
+	if (!succeeded)
+		return 1;
+
+	bool changed = false;
+	if (!shaderData.WriteToFile(headerPath, changed))
+	{
+		fprintf(stderr, "%s: error: couldn't be written\n", WideToNarrow(headerPath).c_str());
+		return 1;
+	}
+
+	if (changed)
+		printf("%s: regenerated because a shader's constant buffers changed\n", WideToNarrow(headerPath).c_str());
+
+	return 0;
+}
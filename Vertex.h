@@ -13,4 +13,15 @@ struct Vertex
 	DirectX::XMFLOAT3 Normal;
 	DirectX::XMFLOAT2 UV;
 	DirectX::XMFLOAT3 Tangent;
+};
+
+// --------------------------------------------------------
+// Everything but the position, which a Mesh keeps in its own
+// tightly packed stream so depth-only passes can skip the rest
+// --------------------------------------------------------
+struct VertexAttributes
+{
+	DirectX::XMFLOAT3 Normal;
+	DirectX::XMFLOAT2 UV;
+	DirectX::XMFLOAT3 Tangent;
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Lighting.hlsli"
+#include "FrameBuffer.hlsli"
 
 // Struct representing a single vertex worth of data
 // - This should match the vertex definition in our C++ code
@@ -22,10 +23,8 @@ cbuffer ConstantBuffer : register(b0)
 {
     matrix world;
     matrix worldInvTranspose;
-    matrix view;
-    matrix projection;
-    matrix lightView;
-    matrix lightProjection;
+    matrix worldViewProjection; // Multiplied together on the CPU, once per draw
+    uint2 lightRange; // Passed through for the pixel shader's per-entity light list
 };
 
 // --------------------------------------------------------
@@ -48,15 +47,12 @@ VertexToPixel main( VertexShaderInput input )
 	// - Each of these components is then automatically divided by the W component, 
 	//   which we're leaving at 1.0 for now (this is more useful when dealing with 
 	//   a perspective projection matrix, which we'll get to in the future).
-    matrix wvp = mul(projection, mul(view, world));
-    output.screenPosition = mul(wvp, float4(input.localPosition, 1.0f));
+    output.screenPosition = mul(worldViewProjection, float4(input.localPosition, 1.0f));
     output.uv = input.uv;
     output.normal = mul((float3x3) worldInvTranspose, input.normal); // Perfect!
     output.worldPosition = mul(world, float4(input.localPosition, 1)).xyz;
     output.tangent = mul((float3x3) world, input.tangent);
-	
-	matrix shadowWVP = mul(lightProjection, mul(lightView, world));
-	output.shadowMapPos = mul(shadowWVP, float4(input.localPosition, 1.0f));
+    output.lightRange = lightRange;
 	
 	// Whatever we return will make its way through the pipeline to the
 	// next programmable stage we're using (the pixel shader for now)